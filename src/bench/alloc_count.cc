@@ -0,0 +1,110 @@
+#include "bench/alloc_count.h"
+#include <cerrno>
+#include <cstdlib>
+
+using namespace Bench;
+
+#if defined(BAE_COUNT_ALLOCS) && defined(__GLIBC__)
+
+// glibc's own allocator, which the replacements below forward to. Defining
+// malloc() and friends in the program replaces them for every library it
+// loads (see "Replacing malloc" in the glibc manual).
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+// Plain thread-locals in the program need no allocation of their own
+static thread_local U64 allocCount_ = 0;
+static thread_local U64 allocBytes_ = 0;
+
+static inline void counted(size_t _size)
+{
+  allocCount_++;
+  allocBytes_ += _size;
+}
+
+extern "C" {
+
+void *malloc(size_t _size) noexcept
+{
+  counted(_size);
+  return __libc_malloc(_size);
+}
+
+void *calloc(size_t _count, size_t _size) noexcept
+{
+  counted(_count * _size);
+  return __libc_calloc(_count, _size);
+}
+
+void *realloc(void *_ptr, size_t _size) noexcept
+{
+  // A resize is counted as an allocation of the new size (it may move)
+  if (_size != 0) {
+    counted(_size);
+  }
+  return __libc_realloc(_ptr, _size);
+}
+
+int posix_memalign(void **_ptr, size_t _alignment, size_t _size) noexcept
+{
+  if ((_alignment % sizeof(void *) != 0) || ((_alignment & (_alignment - 1)) != 0)) {
+    return EINVAL;
+  }
+  counted(_size);
+  void *ptr = __libc_memalign(_alignment, _size);
+  if (ptr == nullptr) {
+    return ENOMEM;
+  }
+  *_ptr = ptr;
+  return 0;
+}
+
+void *aligned_alloc(size_t _alignment, size_t _size) noexcept
+{
+  counted(_size);
+  return __libc_memalign(_alignment, _size);
+}
+
+void free(void *_ptr) noexcept
+{
+  __libc_free(_ptr);
+}
+
+} // extern "C"
+
+bool Bench::allocCounting()
+{
+  return true;
+}
+
+Allocs Bench::allocs()
+{
+  return Allocs{allocCount_, allocBytes_};
+}
+
+#else
+
+bool Bench::allocCounting()
+{
+  return false;
+}
+
+Allocs Bench::allocs()
+{
+  return Allocs{0, 0};
+}
+
+#endif
+
+Allocs Bench::allocsOf(const std::function<void()> &_op)
+{
+  Allocs before = allocs();
+  _op();
+  Allocs after = allocs();
+  return Allocs{after.count - before.count, after.bytes - before.bytes};
+}
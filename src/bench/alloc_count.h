@@ -0,0 +1,33 @@
+#ifndef BENCH_ALLOC_COUNT_H
+#define BENCH_ALLOC_COUNT_H
+
+#include "util/fixed_types.h"
+#include <functional>
+
+namespace Bench {
+
+// Heap allocations made by one thread. Programs linking alloc_count.cc built
+// with BAE_COUNT_ALLOCS on glibc (the Makefile's bae_test and bae_bench, and
+// bae only with ALLOC_COUNT=1; never the libraries) interpose malloc() and
+// its siblings, which operator new, Blob and both backends' libraries all
+// allocate through. Every copy of a Blob's data goes to a new allocation of
+// its size, so 'bytes' also bounds the bytes copied through Blobs.
+struct Allocs
+{
+  U64 count;
+  U64 bytes;
+};
+
+// Whether this build counts allocations; if not, every count is zero
+bool allocCounting();
+
+// The calling thread's allocations since it started
+Allocs allocs();
+
+// The calling thread's allocations during one call of 'op' (allocations on
+// threads that 'op' hands work to are not included)
+Allocs allocsOf(const std::function<void()> &op);
+
+} // namespace Bench
+
+#endif // BENCH_ALLOC_COUNT_H
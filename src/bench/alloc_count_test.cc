@@ -0,0 +1,252 @@
+#include "gtest/gtest.h"
+#include "bench/alloc_count.h"
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "crypto/aes_gcm_pbkd.h"
+#include "crypto/aes_gcm_range.h"
+#include "crypto/backend.h"
+#include "crypto/pbkdf2_sha256.h"
+#include "crypto/random.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace Bench;
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+// Allocation budgets of the hot paths. The paths checked by AllocationFree
+// must not allocate at all. Elsewhere the number of allocations must not grow
+// with the message, and each message byte may be copied (to new allocations)
+// at most the given number of times. Counts include the backend's own, so
+// they are taken on the OpenSSL backend, whose library is the system's rather
+// than a vendored build. Without OpenSSL, or without glibc (where nothing is
+// counted), the tests are skipped; a build meant to count that does not fails.
+static const U32 ENC_COPIES = 2;       // the ciphertext, then the result
+static const U32 DEC_COPIES = 2;       // the plaintext, then the kept result
+static const U32 PBKD_ENC_COPIES = 2;
+static const U32 PBKD_DEC_COPIES = 5;  // splitting the message, then AES_GCM_Dec
+static const U64 PBKDF2_ALLOCS = 3;    // beyond the backend's derivation
+
+static const U64 SMALL = 64;
+static const U64 LARGE = 65536 + SMALL;
+
+#if defined(BAE_COUNT_ALLOCS) && defined(__GLIBC__)
+static const bool COUNTING_BUILD = true;
+#else
+static const bool COUNTING_BUILD = false;
+#endif
+
+// Ends a test with a visible skip (gtest 1.7 has no GTEST_SKIP)
+#if defined(GTEST_SKIP)
+#define SKIP_TEST(why) GTEST_SKIP() << (why)
+#else
+#define SKIP_TEST(why) \
+  do { \
+    std::cout << "[  SKIPPED ] " << (why) << std::endl; \
+    return; \
+  } while (0)
+#endif
+
+// Ends a test that cannot count: a failure if the build meant to, a skip
+// otherwise
+#define REQUIRE_COUNTING() \
+  do { \
+    ASSERT_EQ(allocCounting(), COUNTING_BUILD) << "the counting malloc() is not linked in"; \
+    if (!allocCounting()) { \
+      SKIP_TEST("this build does not count allocations (no glibc)"); \
+    } \
+  } while (0)
+
+// Selects the OpenSSL backend for the life of a test
+class OpenSSLSelected
+{
+ public:
+  OpenSSLSelected() : initial_(backend().type()), active_(backendIs(BACKEND::OPENSSL))
+  {
+    // empty
+  }
+
+  ~OpenSSLSelected()
+  {
+    backendIs(initial_);
+  }
+
+  bool active() const
+  {
+    return active_;
+  }
+
+ private:
+  BACKEND initial_;
+  bool active_;
+};
+
+static AES_GCM_Config gcmConfig()
+{
+  return AES_GCM_Config{AES_GCM_KEYSIZE::K256, AES_GCM_TAGSIZE::T128, AES_GCM_IV_MODE::RANDOM,
+    AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+}
+
+// Allocations of 'op' when repeated: the first call may pay for one-time
+// setup (OpenSSL loads its algorithms on first use, contexts are created on
+// the first message)
+static Allocs repeatedAllocs(const std::function<void()> &_op)
+{
+  _op();
+  return allocsOf(_op);
+}
+
+// The same operation on a small and a large message: as many allocations
+// each time, and at most 'copies' more bytes allocated per added byte. 'op'
+// sets up its own contexts, and runs once beforehand for the process' setup.
+static void expectCopies(const char *_name, U32 _copies, const std::function<Allocs(U64)> &_op)
+{
+  _op(SMALL);
+  Allocs small = _op(SMALL);
+  Allocs large = _op(LARGE);
+  EXPECT_EQ(large.count, small.count) << _name;
+  EXPECT_LE(large.bytes, small.bytes + _copies * (LARGE - SMALL)) << _name;
+}
+
+TEST(AllocCountTest, Counting) {
+  REQUIRE_COUNTING();
+  Allocs none = allocsOf([]() {});
+  EXPECT_EQ(none.count, 0U);
+  EXPECT_EQ(none.bytes, 0U);
+  Allocs vec = allocsOf([]() { std::vector<Byte> v(1000); });
+  EXPECT_EQ(vec.count, 1U);
+  EXPECT_EQ(vec.bytes, 1000U);
+  Allocs blob = allocsOf([]() { unique_ptr<Blob> b = random(1000); });
+  EXPECT_GE(blob.count, 1U);
+  EXPECT_GE(blob.bytes, 1000U);
+}
+
+TEST(AllocCountTest, AllocationFree) {
+  REQUIRE_COUNTING();
+  OpenSSLSelected openssl;
+  if (!openssl.active()) {
+    SKIP_TEST("budgets are checked on the OpenSSL backend, which is not built in");
+  }
+
+  // Keyed contexts on the caller's buffers
+  Blob key = *random(AES_GCM_KEYSIZE_256);
+  Blob ptxt = *random(LARGE);
+  Blob aad = *random(20);
+  Byte iv[12] = {0};
+  Byte tag[16];
+  MutableBlob ctxt(LARGE);
+  AES_GCM_Key k;
+  ASSERT_EQ(k.keyIs(key), AES_GCM_STATUS::VALID);
+  Allocs a = repeatedAllocs([&]() {
+    k.encrypt(ctxt.data(), tag, sizeof(tag), iv, sizeof(iv), aad.data(), aad.size(),
+      ptxt.data(), ptxt.size());
+  });
+  EXPECT_EQ(a.count, 0U) << "AES_GCM_Key::encrypt";
+  MutableBlob out(LARGE);
+  AES_GCM_STATUS status = AES_GCM_STATUS::DEC_ERROR;
+  a = repeatedAllocs([&]() {
+    status = k.decrypt(out.data(), tag, sizeof(tag), iv, sizeof(iv), aad.data(), aad.size(),
+      ctxt.data(), ctxt.size());
+  });
+  EXPECT_EQ(status, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(a.count, 0U) << "AES_GCM_Key::decrypt";
+
+  // Re-reading a decrypted plaintext, and verifying a ranged read's tag
+  AES_GCM_Enc e(gcmConfig());
+  e.keyIs(key);
+  e.plaintextIs(ptxt);
+  Blob msg = e.ciphertext()->first;
+  U64 bodySize = msg.size() - AES_GCM_BLOCKSIZE_BYTES - 16;
+  Blob msgIv(msg, AES_GCM_BLOCKSIZE_BYTES, 0);
+  Blob msgTag(msg, 16, AES_GCM_BLOCKSIZE_BYTES + bodySize);
+  Blob body(msg, bodySize, AES_GCM_BLOCKSIZE_BYTES);
+  AES_GCM_Dec d;
+  d.keyIs(key);
+  d.ivIs(msgIv);
+  d.tagIs(msgTag);
+  d.ciphertextIs(body);
+  ASSERT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(allocsOf([&]() { d.plaintext(); }).count, 0U) << "AES_GCM_Dec::plaintext again";
+  AES_GCM_RangeDec r;
+  ASSERT_EQ(r.keyIs(key), AES_GCM_STATUS::VALID);
+  r.ivIs(msgIv);
+  r.tagIs(msgTag);
+  r.ciphertextIs(body);
+  a = repeatedAllocs([&]() { status = r.verify(); });
+  EXPECT_EQ(status, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(a.count, 0U) << "AES_GCM_RangeDec::verify";
+}
+
+TEST(AllocCountTest, Copies) {
+  REQUIRE_COUNTING();
+  OpenSSLSelected openssl;
+  if (!openssl.active()) {
+    SKIP_TEST("budgets are checked on the OpenSSL backend, which is not built in");
+  }
+  Blob key = *random(AES_GCM_KEYSIZE_256);
+  expectCopies("AES_GCM_Enc::ciphertext", ENC_COPIES, [&](U64 _size) {
+    AES_GCM_Enc e(gcmConfig());
+    e.keyIs(key);
+    e.plaintextIs(*random(_size));
+    return repeatedAllocs([&]() { e.ciphertext(); });
+  });
+  expectCopies("AES_GCM_Dec::plaintext", DEC_COPIES, [&](U64 _size) {
+    AES_GCM_Enc e(gcmConfig());
+    e.keyIs(key);
+    e.plaintextIs(*random(_size));
+    Blob msg = e.ciphertext()->first;
+    AES_GCM_Dec d;
+    d.keyIs(key);
+    d.ivIs(Blob(msg, AES_GCM_BLOCKSIZE_BYTES, 0));
+    d.tagIs(Blob(msg, 16, AES_GCM_BLOCKSIZE_BYTES + _size));
+    d.ciphertextIs(Blob(msg, _size, AES_GCM_BLOCKSIZE_BYTES));
+    return allocsOf([&]() { d.plaintext(); });
+  });
+
+  // Both key derivations; PBKDF2's own allocations are the same each time
+  for (PBKD_KDF kdf : {PBKD_KDF::PBKDF2, PBKD_KDF::HKDF}) {
+    AES_GCM_PBKD_Config cfg;
+    cfg.PBKDIters = 1000;
+    cfg.kdf = kdf;
+    Blob password("password", 8);
+    Blob ctxts[2];
+    expectCopies("AES_GCM_PBKD_Enc::ciphertext", PBKD_ENC_COPIES, [&](U64 _size) {
+      AES_GCM_PBKD_Enc e(cfg);
+      e.passwordIs(key);
+      e.plaintextIs(*random(_size));
+      return repeatedAllocs([&]() { ctxts[_size == LARGE] = e.ciphertext()->first; });
+    });
+    expectCopies("AES_GCM_PBKD_Dec::plaintext", PBKD_DEC_COPIES, [&](U64 _size) {
+      AES_GCM_PBKD_Dec d(cfg);
+      d.passwordIs(key);
+      d.ciphertextIs(ctxts[_size == LARGE]);
+      return allocsOf([&]() { d.plaintext(); });
+    });
+  }
+}
+
+TEST(AllocCountTest, PBKDF2) {
+  // The backend allocates as it likes (OpenSSL 3 does so on every
+  // iteration); the wrapper adds only its result
+  REQUIRE_COUNTING();
+  OpenSSLSelected openssl;
+  if (!openssl.active()) {
+    SKIP_TEST("budgets are checked on the OpenSSL backend, which is not built in");
+  }
+  Blob password("password", 8);
+  Blob salt = *random(16);
+  for (U64 iters : {1000, 4000}) {
+    Byte key[32];
+    Allocs raw = repeatedAllocs([&]() {
+      backend().pbkdf2Sha256(key, sizeof(key), password.data(), password.size(), salt.data(),
+        salt.size(), iters);
+    });
+    Allocs wrapped = repeatedAllocs([&]() {
+      PBKDF2_SHA256(sizeof(key), password, salt, iters);
+    });
+    EXPECT_LE(wrapped.count, raw.count + PBKDF2_ALLOCS) << iters;
+  }
+}
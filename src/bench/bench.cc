@@ -0,0 +1,615 @@
+#include "bench/bench.h"
+#include "crypto/aes_gcm.h"
+#include "crypto/armor.h"
+#include "crypto/aes_gcm_batch.h"
+#include "crypto/aes_gcm_chunked.h"
+#include "crypto/aes_gcm_key.h"
+#include "crypto/aes_gcm_pbkd.h"
+#include "crypto/aes_gcm_pool.h"
+#include "crypto/aes_gcm_range.h"
+#include "crypto/aes_gcm_rotation.h"
+#include "crypto/aes_gcm_sector.h"
+#include "crypto/aes_siv.h"
+#include "crypto/backend.h"
+#include "crypto/base58.h"
+#include "crypto/hkdf_sha256.h"
+#include "crypto/pbkdf2_sha256.h"
+#include "crypto/random.h"
+#include "util/byte_encoders.h"
+#include "util/make_unique.h"
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <vector>
+
+using namespace Bench;
+using Util::Blob;
+using Util::MutableBlob;
+using std::endl;
+using std::ostream;
+using std::string;
+using std::unique_ptr;
+
+typedef std::chrono::steady_clock Clock;
+
+Result Bench::measure(const string &_name, U64 _bytesPerOp,
+  const std::function<void()> &_op, double _minSeconds)
+{
+  // Warm up, then double the batch size until the minimum time is reached
+  _op();
+  U64 ops = 0;
+  U64 batch = 1;
+  double seconds = 0.0;
+  Clock::time_point start = Clock::now();
+  while (seconds < _minSeconds) {
+    for (U64 i = 0; i < batch; i++) {
+      _op();
+    }
+    ops += batch;
+    batch *= 2;
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  return Result{_name, ops, ops * _bytesPerOp, seconds, allocsOf(_op), ""};
+}
+
+void Bench::report(ostream &_out, const Result &_r)
+{
+  double opsPerSec = (double)_r.ops / _r.seconds;
+  _out << "  " << std::left << std::setw(36) << _r.name << std::right << std::fixed
+       << std::setprecision(1) << std::setw(12) << opsPerSec << " op/s";
+  if (_r.bytes != 0) {
+    _out << std::setw(10) << ((double)_r.bytes / _r.seconds / 1e6) << " MB/s";
+  }
+  if (allocCounting()) {
+    _out << "  " << _r.allocs.count << " alloc/op " << _r.allocs.bytes << " B/op";
+  }
+  if (!_r.notes.empty()) {
+    _out << "  " << _r.notes;
+  }
+  _out << endl;
+}
+
+// Log-like records: the kind of payload that compresses well
+static Blob logRecords(U64 _size)
+{
+  std::ostringstream ss;
+  for (U64 i = 0; ss.tellp() < (std::streamoff)_size; i++) {
+    ss << "{\"ts\":" << (1450000000 + i * 7) << ",\"level\":\"" << ((i % 5) ? "info" : "warn")
+       << "\",\"user\":" << (i * 7919 % 1000) << ",\"msg\":\"request served\",\"ms\":"
+       << (i * 31 % 250) << "}\n";
+  }
+  return Blob(ss.str().substr(0, _size));
+}
+
+static void benchAES_GCM(ostream &_out)
+{
+  Crypto::AES_GCM_Config cfg = {Crypto::AES_GCM_KEYSIZE::K256, Crypto::AES_GCM_TAGSIZE::T128,
+    Crypto::AES_GCM_IV_MODE::RANDOM, Crypto::AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  const U64 sizes[] = {64, 4096, 1 << 20};
+  for (U64 size : sizes) {
+    unique_ptr<Blob> ptxt = Crypto::random(size);
+    Crypto::AES_GCM_Enc enc(cfg);
+    enc.keyIs(*key);
+    enc.plaintextIs(*ptxt);
+    report(_out, measure("aes_gcm/encrypt/" + std::to_string(size), size, [&]() {
+      enc.ciphertext();
+    }));
+
+    Blob ctxt = enc.ciphertext()->first;
+    U64 ctxtSize = ctxt.size() - Crypto::AES_GCM_BLOCKSIZE_BYTES - 16;
+    Crypto::AES_GCM_Dec dec;
+    dec.keyIs(*key);
+    dec.ivIs(Blob(ctxt, Crypto::AES_GCM_BLOCKSIZE_BYTES, 0));
+    dec.tagIs(Blob(ctxt, 16, Crypto::AES_GCM_BLOCKSIZE_BYTES + ctxtSize));
+    Blob body(ctxt, ctxtSize, Crypto::AES_GCM_BLOCKSIZE_BYTES);
+    report(_out, measure("aes_gcm/decrypt/" + std::to_string(size), size, [&]() {
+      dec.ciphertextIs(body);
+      dec.keyIs(*key);
+      dec.plaintext();
+    }));
+  }
+}
+
+static void benchPBKDF2(ostream &_out)
+{
+  Blob password("correct horse battery staple");
+  unique_ptr<Blob> salt = Crypto::random(16);
+  report(_out, measure("pbkdf2_sha256/100000", 0, [&]() {
+    Crypto::PBKDF2_SHA256(32, password, *salt, Crypto::PBKD_ITERS_DEFAULT);
+  }));
+
+  // The password-based wrappers, deriving a key for each message: the
+  // decryptor alternates between two messages with different salts
+  Crypto::AES_GCM_PBKD_Config cfg;
+  unique_ptr<Blob> ptxt = Crypto::random(4096);
+  Crypto::AES_GCM_PBKD_Enc enc(cfg);
+  enc.passwordIs(password);
+  enc.plaintextIs(*ptxt);
+  report(_out, measure("aes_gcm_pbkd/encrypt/4096", ptxt->size(), [&]() {
+    enc.ciphertext();
+  }));
+  Blob ctxts[] = {enc.ciphertext()->first, enc.ciphertext()->first};
+  Crypto::AES_GCM_PBKD_Dec dec(cfg);
+  dec.passwordIs(password);
+  U64 next = 0;
+  report(_out, measure("aes_gcm_pbkd/decrypt/4096", ptxt->size(), [&]() {
+    dec.ciphertextIs(ctxts[next++ % 2]);
+    dec.plaintext();
+  }));
+
+  // The calibrated rate of each backend, and the count for a 50 ms target
+  for (Crypto::BACKEND type : {Crypto::BACKEND::CRYPTOPP, Crypto::BACKEND::OPENSSL}) {
+    if (Crypto::backendAvailable(type)) {
+      _out << "  " << std::left << std::setw(36)
+           << (string("pbkdf2_sha256/rate/") + Crypto::backend(type)->name()) << std::right
+           << std::setw(12) << Crypto::PBKDF2_SHA256_Rate(type) << " iter/s" << endl;
+    }
+  }
+  _out << "  " << std::left << std::setw(36) << "pbkdf2_sha256/calibrate/50ms" << std::right
+       << std::setw(12) << Crypto::PBKDF2_SHA256_Calibrate(std::chrono::milliseconds(50))
+       << " iters" << endl;
+}
+
+static void benchHKDF(ostream &_out)
+{
+  // One-shot derivations from a master key, then subkeys from one extract
+  unique_ptr<Blob> master = Crypto::random(32);
+  unique_ptr<Blob> salt = Crypto::random(16);
+  Blob info("tenant-0001");
+  report(_out, measure("hkdf_sha256/derive", 0, [&]() {
+    Crypto::HKDF_SHA256(32, *master, *salt, info);
+  }));
+  Crypto::HKDF_SHA256_Expander expander;
+  expander.secretIs(*master, *salt);
+  MutableBlob subkey(32);
+  report(_out, measure("hkdf_sha256/subkey", 0, [&]() {
+    expander.expand(subkey.data(), subkey.size(), info.data(), info.size());
+  }));
+}
+
+static void benchRotation(ostream &_out)
+{
+  // 1KB messages on one subkey, and rotating every 64 messages
+  Blob ptxt = *Crypto::random(1024);
+  const U64 budgets[] = {Crypto::AES_GCM_ROTATION_MESSAGES_DEFAULT, 64};
+  for (U64 budget : budgets) {
+    Crypto::AES_GCM_Rotation_Config cfg;
+    cfg.messageBudget = budget;
+    std::shared_ptr<Crypto::AES_GCM_RotatingKey> key =
+      std::make_shared<Crypto::AES_GCM_RotatingKey>(cfg);
+    key->masterIs(*Crypto::random(Crypto::AES_GCM_KEYSIZE_256));
+    Crypto::AES_GCM_Rotating_Enc enc(key);
+    enc.plaintextIs(ptxt);
+    std::ostringstream name;
+    name << "rotation/1KB/budget=" << budget;
+    report(_out, measure(name.str(), ptxt.size(), [&]() {
+      enc.ciphertext();
+    }));
+  }
+}
+
+static void benchSIV(ostream &_out)
+{
+  // Deterministic encryption of short identifiers
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_SIV_KEYSIZE_512);
+  const U64 sizes[] = {32, 4096};
+  for (U64 size : sizes) {
+    unique_ptr<Blob> ptxt = Crypto::random(size);
+    Crypto::AES_SIV_Enc enc;
+    enc.keyIs(*key);
+    enc.plaintextIs(*ptxt);
+    report(_out, measure("siv/encrypt/" + std::to_string(size), size, [&]() {
+      enc.ciphertext();
+    }));
+  }
+
+  // Finding one of 1000 encrypted 32-byte values: decrypting every row of an
+  // AES/GCM column against encrypting the search key for an index lookup
+  const U64 rows = 1000;
+  Crypto::AES_GCM_Config cfg = {Crypto::AES_GCM_KEYSIZE::K256, Crypto::AES_GCM_TAGSIZE::T128,
+    Crypto::AES_GCM_IV_MODE::RANDOM, Crypto::AES_GCM_IV_OUTPUT::CTXT_PREPEND};
+  unique_ptr<Blob> gcmKey = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  Crypto::AES_GCM_Enc gcmEnc(cfg);
+  gcmEnc.keyIs(*gcmKey);
+  Crypto::AES_SIV_Enc sivEnc;
+  sivEnc.keyIs(*key);
+  std::vector<Blob> values;
+  std::vector<Blob> column;
+  std::set<string> index;
+  for (U64 i = 0; i < rows; i++) {
+    values.push_back(*Crypto::random(32));
+    gcmEnc.plaintextIs(values.back());
+    column.push_back(gcmEnc.ciphertext()->first);
+    sivEnc.plaintextIs(values.back());
+    Blob ctxt = sivEnc.ciphertext()->first;
+    index.insert(string(reinterpret_cast<const char *>(ctxt.data()), ctxt.size()));
+  }
+  const Blob &wanted = values[rows - 1];
+  U64 tagSize = 16;
+  Crypto::AES_GCM_Dec gcmDec;
+  gcmDec.keyIs(*gcmKey);
+  report(_out, measure("siv/lookup/aes_gcm_scan/1000", 0, [&]() {
+    for (const Blob &row : column) {
+      U64 bodySize = row.size() - Crypto::AES_GCM_BLOCKSIZE_BYTES - tagSize;
+      gcmDec.ivIs(Blob(row, Crypto::AES_GCM_BLOCKSIZE_BYTES, 0));
+      gcmDec.tagIs(Blob(row, tagSize, Crypto::AES_GCM_BLOCKSIZE_BYTES + bodySize));
+      gcmDec.ciphertextIs(Blob(row, bodySize, Crypto::AES_GCM_BLOCKSIZE_BYTES));
+      if (gcmDec.plaintext().first == wanted) {
+        break;
+      }
+    }
+  }));
+  report(_out, measure("siv/lookup/siv_index/1000", 0, [&]() {
+    sivEnc.plaintextIs(wanted);
+    Blob ctxt = sivEnc.ciphertext()->first;
+    index.count(string(reinterpret_cast<const char *>(ctxt.data()), ctxt.size()));
+  }));
+}
+
+static void benchRange(ostream &_out)
+{
+  // A 4KB read from the middle of a 64MB message against decrypting all of
+  // it, and the cost of verifying the tag without decrypting
+  const U64 size = 64ULL << 20;
+  Crypto::AES_GCM_Config cfg = {Crypto::AES_GCM_KEYSIZE::K256, Crypto::AES_GCM_TAGSIZE::T128,
+    Crypto::AES_GCM_IV_MODE::RANDOM, Crypto::AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  Crypto::AES_GCM_Enc enc(cfg);
+  enc.keyIs(*key);
+  enc.plaintextIs(*Crypto::random(size));
+  Blob ctxt = enc.ciphertext()->first;
+  Blob iv(ctxt, Crypto::AES_GCM_BLOCKSIZE_BYTES, 0);
+  Blob tag(ctxt, 16, Crypto::AES_GCM_BLOCKSIZE_BYTES + size);
+  Blob body(ctxt, size, Crypto::AES_GCM_BLOCKSIZE_BYTES);
+
+  Crypto::AES_GCM_Dec dec;
+  dec.keyIs(*key);
+  dec.ivIs(iv);
+  dec.tagIs(tag);
+  report(_out, measure("range/aes_gcm_dec/64MB", size, [&]() {
+    dec.ciphertextIs(body);
+    dec.plaintext();
+  }));
+
+  Crypto::AES_GCM_RangeDec ranged;
+  ranged.keyIs(*key);
+  ranged.ivIs(iv);
+  ranged.tagIs(tag);
+  ranged.ciphertextIs(body);
+  report(_out, measure("range/read/4KB", 4096, [&]() {
+    ranged.range(size / 2 + 5, 4096);
+  }));
+  report(_out, measure("range/verify/64MB", size, [&]() {
+    ranged.ciphertextIs(body);
+    ranged.verify();
+  }));
+}
+
+static void benchCompression(ostream &_out)
+{
+  // Compare AES work and output bytes with and without the deflate stage
+  Crypto::AES_GCM_Config cfg = {Crypto::AES_GCM_KEYSIZE::K256, Crypto::AES_GCM_TAGSIZE::T128,
+    Crypto::AES_GCM_IV_MODE::RANDOM, Crypto::AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  const U64 size = 1 << 20;
+  Blob inputs[] = {logRecords(size), *Crypto::random(size)};
+  const char *names[] = {"logs", "random"};
+  for (int i = 0; i < 2; i++) {
+    for (bool compress : {false, true}) {
+      Crypto::AES_GCM_Enc enc(cfg);
+      enc.keyIs(*key);
+      enc.plaintextIs(inputs[i]);
+      if (compress) {
+        enc.compressionIs(Crypto::AES_GCM_COMPRESSION::DEFLATE);
+      }
+      U64 outBytes = 0;
+      Result r = measure(string("compression/") + names[i] + (compress ? "/deflate" : "/none"),
+        size, [&]() { outBytes = enc.ciphertext()->first.size(); });
+
+      const Crypto::AES_GCM_CompressionStats &stats = enc.compressionStats();
+      std::ostringstream notes;
+      notes << "out=" << outBytes << "B";
+      if (compress) {
+        notes << " ratio=" << std::setprecision(2) << std::fixed
+              << ((double)stats.bytesIn / (double)stats.bytesOut)
+              << " compressed=" << stats.compressed << "/" << stats.messages;
+      }
+      r.notes = notes.str();
+      report(_out, r);
+    }
+  }
+}
+
+static void benchSector(ostream &_out)
+{
+  // Batches of 64 pages, as an O_DIRECT path would submit them
+  const size_t COUNT = 64;
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  for (U32 page : {4096U, 16384U}) {
+    for (U32 lanes : {1U, 4U}) {
+      Crypto::AES_GCM_Sector s(page, lanes);
+      s.keyIs(*key);
+      MutableBlob buf(*Crypto::random(page * COUNT));
+      MutableBlob meta(Crypto::AES_GCM_SECTOR_META_BYTES * COUNT, Blob::ScrubType::ZEROS);
+      std::vector<Crypto::AES_GCM_SectorOp> ops(COUNT);
+      for (size_t i = 0; i < COUNT; i++) {
+        ops[i] = Crypto::AES_GCM_SectorOp{i, buf.data() + i * page, buf.data() + i * page,
+          meta.data() + i * Crypto::AES_GCM_SECTOR_META_BYTES, Crypto::AES_GCM_STATUS::VALID};
+      }
+      string name = "sector/" + std::to_string(page) + "/lanes" + std::to_string(lanes);
+      report(_out, measure(name + "/write", page * COUNT, [&]() {
+        s.write(ops.data(), COUNT);
+      }));
+      report(_out, measure(name + "/read", page * COUNT, [&]() {
+        s.read(ops.data(), COUNT);
+      }));
+    }
+  }
+}
+
+static void benchBatch(ostream &_out)
+{
+  // 16 small messages under 16 different keys, one at a time and as a batch
+  const size_t COUNT = 16;
+  const U32 iv = 12;
+  std::vector<unique_ptr<Crypto::AES_GCM_Key>> keys;
+  std::vector<unique_ptr<Crypto::AES_GCM_BatchKey>> batchKeys;
+  for (size_t i = 0; i < COUNT; i++) {
+    unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+    keys.push_back(Util::make_unique<Crypto::AES_GCM_Key>());
+    keys.back()->keyIs(*key);
+    batchKeys.push_back(Util::make_unique<Crypto::AES_GCM_BatchKey>());
+    batchKeys.back()->keyIs(*key);
+  }
+  unique_ptr<Blob> ivs = Crypto::random(iv * COUNT);
+  for (U64 size : {64ULL, 256ULL, 1024ULL}) {
+    MutableBlob buf(*Crypto::random(size * COUNT));
+    MutableBlob tags(16 * COUNT);
+    std::vector<Crypto::AES_GCM_BatchOp> ops(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+      ops[i] = Crypto::AES_GCM_BatchOp{batchKeys[i].get(), ivs->data() + i * iv, iv, nullptr, 0,
+        buf.data() + i * size, buf.data() + i * size, size, tags.data() + i * 16, 16,
+        Crypto::AES_GCM_STATUS::VALID};
+    }
+    string name = "batch/16x" + std::to_string(size);
+    report(_out, measure(name + "/sequential", size * COUNT, [&]() {
+      for (size_t i = 0; i < COUNT; i++) {
+        keys[i]->encrypt(ops[i].out, ops[i].tag, 16, ops[i].iv, iv, nullptr, 0, ops[i].in,
+          size);
+      }
+    }));
+    Result r = measure(name + "/batch", size * COUNT, [&]() {
+      Crypto::AES_GCM_Batch::encrypt(ops.data(), COUNT);
+    });
+    r.notes = Crypto::AES_GCM_BatchISA();
+    report(_out, r);
+  }
+}
+
+static void benchGHASH(ostream &_out)
+{
+  // Per-context memory against key setup and bulk speed for each table option
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  const Crypto::AES_GCM_TABLES options[] = {Crypto::AES_GCM_TABLES::T2K,
+    Crypto::AES_GCM_TABLES::T64K, Crypto::AES_GCM_TABLES::CLMUL};
+  const char *names[] = {"2k", "64k", "clmul"};
+  Byte iv[Crypto::AES_GCM_BLOCKSIZE_BYTES] = {0};
+  Byte tag[16];
+  for (int i = 0; i < 3; i++) {
+    Crypto::AES_GCM_Key ctx(options[i]);
+    ctx.keyIs(*key);
+    string notes = "context=" + std::to_string(ctx.contextBytes()) + "B";
+    Result r = measure(string("ghash/") + names[i] + "/keyIs", 0, [&]() { ctx.keyIs(*key); });
+    r.notes = notes;
+    report(_out, r);
+    for (U64 size : {64ULL, 16384ULL}) {
+      MutableBlob buf(*Crypto::random(size));
+      r = measure(string("ghash/") + names[i] + "/encrypt/" + std::to_string(size), size, [&]() {
+        ctx.encrypt(buf.data(), tag, sizeof(tag), iv, sizeof(iv), nullptr, 0, buf.data(), size);
+      });
+      r.notes = notes;
+      report(_out, r);
+    }
+  }
+}
+
+static void benchPool(ostream &_out)
+{
+  // Per-request construction against pool checkout/return
+  Crypto::AES_GCM_Config cfg = {Crypto::AES_GCM_KEYSIZE::K256, Crypto::AES_GCM_TAGSIZE::T128,
+    Crypto::AES_GCM_IV_MODE::RANDOM, Crypto::AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  Crypto::AES_GCM_Keyring keyring;
+  keyring.keyIs(1, *Crypto::random(Crypto::AES_GCM_KEYSIZE_256));
+  Blob key = keyring.snapshot().entries.at(1)->key;
+  report(_out, measure("pool/construct", 0, [&]() {
+    Crypto::AES_GCM_Enc enc(cfg);
+    enc.keyIs(key);
+  }));
+
+  Crypto::AES_GCM_ContextPool pool(keyring);
+  Crypto::AES_GCM_STATUS status = Crypto::AES_GCM_STATUS::VALID;
+  report(_out, measure("pool/checkout", 0, [&]() {
+    Crypto::AES_GCM_EncLease lease = pool.enc(cfg, 1, status);
+  }));
+}
+
+static void benchChunked(ostream &_out)
+{
+  // A 64 MB snapshot: whole-message encryption against a chunked run where
+  // 1% of the chunks changed since the previous manifest
+  const U64 SIZE = 64ULL << 20;
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  MutableBlob snapshot(*Crypto::random(SIZE));
+  Crypto::AES_GCM_Key whole;
+  whole.keyIs(*key);
+  Byte iv[Crypto::AES_GCM_BLOCKSIZE_BYTES] = {0};
+  Byte tag[16];
+  MutableBlob out(SIZE);
+  report(_out, measure("chunked/whole", SIZE, [&]() {
+    whole.encrypt(out.data(), tag, sizeof(tag), iv, sizeof(iv), nullptr, 0,
+      snapshot.data(), SIZE);
+  }));
+
+  for (U32 threads : {1U, 4U}) {
+    Crypto::AES_GCM_ChunkConfig cfg = Crypto::AES_GCM_CHUNK_CONFIG_DEFAULT;
+    cfg.threads = threads;
+    Crypto::AES_GCM_Chunked_Enc enc(cfg);
+    enc.keyIs(*key);
+    enc.plaintextIs(snapshot);
+    std::vector<Crypto::AES_GCM_Chunk> chunks;
+    string name = "chunked/threads" + std::to_string(threads);
+    report(_out, measure(name + "/full", SIZE, [&]() { enc.ciphertext(chunks); }));
+
+    std::vector<Crypto::AES_GCM_ChunkRef> previous = enc.manifest();
+    MutableBlob edited(snapshot);
+    for (U64 i = 0; i < 100; i++) {
+      edited.data()[i * (SIZE / 100)] ^= 1;
+    }
+    enc.previousIs(previous);
+    enc.plaintextIs(edited);
+    Result r = measure(name + "/incremental", SIZE, [&]() { enc.ciphertext(chunks); });
+    r.notes = "written=" + std::to_string(chunks.size()) + "/" +
+      std::to_string(enc.manifest().size()) + " chunks";
+    report(_out, r);
+  }
+}
+
+static void benchBackend(ostream &_out)
+{
+  // The same operations on every backend built in
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  Crypto::AES_GCM_Config cfg = {Crypto::AES_GCM_KEYSIZE::K256, Crypto::AES_GCM_TAGSIZE::T128,
+    Crypto::AES_GCM_IV_MODE::RANDOM, Crypto::AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  Byte iv[Crypto::AES_GCM_BLOCKSIZE_BYTES] = {0};
+  Byte tag[16];
+  Crypto::BACKEND initial = Crypto::backend().type();
+  for (Crypto::BACKEND type : {Crypto::BACKEND::CRYPTOPP, Crypto::BACKEND::OPENSSL}) {
+    if (!Crypto::backendIs(type)) {
+      continue;
+    }
+    string name = string("backend/") + Crypto::backend().name();
+    Crypto::AES_GCM_Key ctx;
+    ctx.keyIs(*key);
+    for (U64 size : {64ULL, 16384ULL, 1048576ULL}) {
+      MutableBlob buf(*Crypto::random(size));
+      report(_out, measure(name + "/key/encrypt/" + std::to_string(size), size, [&]() {
+        ctx.encrypt(buf.data(), tag, sizeof(tag), iv, sizeof(iv), nullptr, 0, buf.data(), size);
+      }));
+      report(_out, measure(name + "/key/decrypt/" + std::to_string(size), size, [&]() {
+        ctx.decrypt(buf.data(), tag, sizeof(tag), iv, sizeof(iv), nullptr, 0, buf.data(), size);
+      }));
+    }
+    Crypto::AES_GCM_Enc enc(cfg);
+    enc.keyIs(*key);
+    enc.plaintextIs(*Crypto::random(16384));
+    report(_out, measure(name + "/enc/16384", 16384, [&]() { enc.ciphertext(); }));
+    report(_out, measure(name + "/pbkdf2/10000", 0, [&]() {
+      Crypto::PBKDF2_SHA256(32, Blob("password"), Blob("salt"), 10000);
+    }));
+  }
+  Crypto::backendIs(initial);
+}
+
+struct Group
+{
+  const char *name;
+  void (*fn)(ostream &);
+};
+
+static void benchArmor(ostream &_out)
+{
+  // The string encoders against the codecs writing into a buffer, then
+  // encrypting and armoring in two passes against the fused stage
+  const U64 size = 1 << 20;
+  unique_ptr<Blob> data = Crypto::random(size);
+  string isa = string("[") + Crypto::armorISA() + "]";
+  report(_out, measure("armor/util/hex", size, [&]() { data->data(Util::encode_hex); }));
+  report(_out, measure("armor/util/base64", size, [&]() { data->data(Util::encode_base64); }));
+  const Crypto::AES_GCM_ARMOR armors[] = {Crypto::AES_GCM_ARMOR::HEX,
+    Crypto::AES_GCM_ARMOR::BASE64};
+  const char *names[] = {"hex", "base64"};
+  for (int i = 0; i < 2; i++) {
+    std::vector<char> text(Crypto::armoredSize(armors[i], size));
+    Result r = measure(string("armor/") + names[i] + "/encode", size, [&]() {
+      Crypto::armor(armors[i], text.data(), data->data(), size);
+    });
+    r.notes = isa;
+    report(_out, r);
+    MutableBlob out(size);
+    r = measure(string("armor/") + names[i] + "/decode", size, [&]() {
+      Crypto::unarmor(armors[i], out.data(), text.data(), text.size());
+    });
+    r.notes = isa;
+    report(_out, r);
+  }
+
+  Crypto::AES_GCM_Config cfg = {Crypto::AES_GCM_KEYSIZE::K256, Crypto::AES_GCM_TAGSIZE::T128,
+    Crypto::AES_GCM_IV_MODE::RANDOM, Crypto::AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  unique_ptr<Blob> key = Crypto::random(Crypto::AES_GCM_KEYSIZE_256);
+  for (int i = 0; i < 2; i++) {
+    Crypto::AES_GCM_Enc enc(cfg);
+    enc.keyIs(*key);
+    enc.plaintextIs(*data);
+    report(_out, measure(string("armor/encrypt+") + names[i], size, [&]() {
+      Crypto::armor(armors[i], enc.ciphertext()->first);
+    }));
+    enc.armorIs(armors[i]);
+    report(_out, measure(string("armor/encrypt/fused/") + names[i], size, [&]() {
+      enc.ciphertext();
+    }));
+  }
+}
+
+static void benchBase58(ostream &_out)
+{
+  // Key, IV and token sized items, one at a time and in a batch of 1000
+  const U64 count = 1000;
+  for (U64 size : {16ULL, 32ULL, 64ULL}) {
+    unique_ptr<Blob> items = Crypto::random(size * count);
+    std::vector<char> text(count * Crypto::base58MaxSize(size));
+    std::vector<U64> ends(count);
+    string name = "base58/" + std::to_string(size);
+    report(_out, measure(name + "/encode", size, [&]() {
+      Crypto::encodeBase58(text.data(), items->data(), size);
+    }));
+    report(_out, measure(name + "/encode/batch", size * count, [&]() {
+      Crypto::encodeBase58(text.data(), ends.data(), items->data(), size, count);
+    }));
+    MutableBlob out(size + 1);
+    U64 outSize = 0;
+    report(_out, measure(name + "/decode", size, [&]() {
+      Crypto::decodeBase58(out.data(), outSize, text.data(), ends[0]);
+    }));
+  }
+}
+
+static const Group GROUPS[] = {
+  {"aes_gcm", benchAES_GCM},
+  {"pbkdf2", benchPBKDF2},
+  {"hkdf", benchHKDF},
+  {"rotation", benchRotation},
+  {"siv", benchSIV},
+  {"range", benchRange},
+  {"compression", benchCompression},
+  {"sector", benchSector},
+  {"ghash", benchGHASH},
+  {"batch", benchBatch},
+  {"pool", benchPool},
+  {"chunked", benchChunked},
+  {"backend", benchBackend},
+  {"armor", benchArmor},
+  {"base58", benchBase58},
+};
+
+void Bench::run(ostream &_out, const string &_filter)
+{
+  for (const Group &g : GROUPS) {
+    if ((_filter == "all") || (string(g.name).find(_filter) != string::npos)) {
+      _out << g.name << ":" << endl;
+      g.fn(_out);
+    }
+  }
+}
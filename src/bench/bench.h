@@ -0,0 +1,37 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include "bench/alloc_count.h"
+#include "util/fixed_types.h"
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace Bench {
+
+static const double BENCH_MIN_SECONDS = 0.5;
+
+// One row of benchmark output
+struct Result
+{
+  std::string name;
+  U64         ops;
+  U64         bytes;      // Input bytes processed across all ops
+  double      seconds;
+  Allocs      allocs;     // Heap allocations of one op (see allocCounting())
+  std::string notes;      // Benchmark-specific detail (sizes, ratios, ...)
+};
+
+// Runs 'op' repeatedly for at least 'minSeconds' of wall time, and once more
+// to count its allocations
+Result measure(const std::string &name, U64 bytesPerOp, const std::function<void()> &op,
+  double minSeconds = BENCH_MIN_SECONDS);
+
+void report(std::ostream &out, const Result &result);
+
+// Runs every benchmark group whose name contains 'filter' ("all" runs all)
+void run(std::ostream &out, const std::string &filter);
+
+} // namespace Bench
+
+#endif // BENCH_BENCH_H
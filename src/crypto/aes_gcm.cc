@@ -1,6 +1,11 @@
 #include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_counter.h"
+#include "crypto/aes_gcm_replay.h"
+#include "crypto/byte_order.h"
 #include "crypto/random.h"
 #include "util/make_unique.h"
+#include <algorithm>
+#include <cstring>
 
 using namespace Crypto;
 using Util::Blob;
@@ -8,6 +13,67 @@ using Util::MutableBlob;
 using std::unique_ptr;
 using Util::make_unique;
 
+// Armored messages are encrypted and armored this much at a time. A multiple
+// of 3, so base64 needs no padding between slices.
+static const U64 ARMOR_SLICE_BYTES = 3 * 4096;
+
+namespace {
+
+// Gathers message bytes into a slice and armors each full one
+class ArmorWriter
+{
+ public:
+  ArmorWriter(AES_GCM_ARMOR _armor, char *_text)
+    : armor_(_armor), text_(_text), fill_(0)
+  {
+    // empty
+  }
+
+  // Where the next bytes go, and how many fit
+  Byte *tail()
+  {
+    return slice_ + fill_;
+  }
+
+  U64 room() const
+  {
+    return ARMOR_SLICE_BYTES - fill_;
+  }
+
+  // Accounts for 'size' bytes written at tail()
+  void advance(U64 _size)
+  {
+    fill_ += _size;
+    if (fill_ == ARMOR_SLICE_BYTES) {
+      flush();
+    }
+  }
+
+  void put(const Byte *_data, U64 _size)
+  {
+    for (U64 done = 0; done < _size;) {
+      U64 step = std::min(room(), _size - done);
+      memcpy(tail(), _data + done, step);
+      advance(step);
+      done += step;
+    }
+  }
+
+  void flush()
+  {
+    text_ += armor(armor_, text_, slice_, fill_);
+    fill_ = 0;
+  }
+
+ private:
+  AES_GCM_ARMOR armor_;
+  char *text_;
+  U64 fill_;
+  Byte slice_[ARMOR_SLICE_BYTES];
+};
+
+} // namespace
+
 U32 Crypto::AES_GCM_Keysize(AES_GCM_KEYSIZE _keysize)
 {
   switch (_keysize) {
@@ -36,8 +102,31 @@ U32 Crypto::AES_GCM_Tagsize(AES_GCM_TAGSIZE _tagsize)
   }
 }
 
-AES_GCM_Enc::AES_GCM_Enc(AES_GCM_Config _config)
-  : cfg_(_config), ivc_(AES_GCM_BLOCKSIZE_BYTES), key_(), aad_(), ptxt_(), prng_(), enc_()
+U32 Crypto::AES_GCM_TableBytes(AES_GCM_TABLES _tables)
+{
+  return backend().tableBytes(_tables);
+}
+
+U64 Crypto::AES_GCM_IVCounter(const Blob &_iv)
+{
+  if (_iv.size() < 8) {
+    return 0;
+  }
+  return ((U64)loadBE32(_iv.data() + 4) << 32) | loadBE32(_iv.data());
+}
+
+void Crypto::AES_GCM_IVCounterIs(MutableBlob &_iv, U64 _counter)
+{
+  if (_iv.size() >= 8) {
+    storeBE32(_iv.data(), (U32)_counter);
+    storeBE32(_iv.data() + 4, (U32)(_counter >> 32));
+  }
+}
+
+AES_GCM_Enc::AES_GCM_Enc(AES_GCM_Config _config, AES_GCM_TABLES _tables)
+  : cfg_(_config), compression_(AES_GCM_COMPRESSION_DEFAULT), armor_(AES_GCM_ARMOR_DEFAULT),
+  stats_(), ivc_(AES_GCM_BLOCKSIZE_BYTES), key_(), aad_(), ptxt_(),
+  cipher_(backend().gcm(_tables)), allocator_(), counter_(0), counterEnd_(0)
 {
   updateIV(true);
 }
@@ -49,16 +138,21 @@ const AES_GCM_Config &AES_GCM_Enc::config() const
 
 AES_GCM_STATUS AES_GCM_Enc::keyIs(const Blob &_key)
 {
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
   if (_key.size() == AES_GCM_Keysize(cfg_.keySize)) {
     key_ = _key;
-    return AES_GCM_STATUS::VALID;
   }
   else {
     // Fail to an unknown key
     unique_ptr<Blob> randKey(Crypto::random(AES_GCM_Keysize(cfg_.keySize)));
     key_ = *randKey;
-    return AES_GCM_STATUS::INVALID_SIZE;
+    status = AES_GCM_STATUS::INVALID_SIZE;
+  }
+  if (!cipher_->keyIs(key_.data(), (U32)key_.size())) {
+    key_ = Blob();
+    status = AES_GCM_STATUS::INVALID_KEY;
   }
+  return status;
 }
 
 AES_GCM_STATUS AES_GCM_Enc::ivcIs(const Blob &_ivc)
@@ -83,57 +177,166 @@ void AES_GCM_Enc::plaintextIs(const Blob &_plaintext)
   ptxt_ = _plaintext;
 }
 
+void AES_GCM_Enc::compressionIs(AES_GCM_COMPRESSION _compression)
+{
+  compression_ = _compression;
+}
+
+const AES_GCM_CompressionStats &AES_GCM_Enc::compressionStats() const
+{
+  return stats_;
+}
+
 const Blob &AES_GCM_Enc::ivc() const
 {
   return ivc_;
 }
 
+void AES_GCM_Enc::armorIs(AES_GCM_ARMOR _armor)
+{
+  armor_ = _armor;
+}
+
+void AES_GCM_Enc::reset()
+{
+  aad_ = Blob();
+  ptxt_ = Blob();
+  compression_ = AES_GCM_COMPRESSION_DEFAULT;
+  stats_ = AES_GCM_CompressionStats();
+}
+
+AES_GCM_STATUS AES_GCM_Enc::counterAllocatorIs(
+  const std::shared_ptr<AES_GCM_CounterAllocator> &_allocator)
+{
+  if (cfg_.ivMode != AES_GCM_IV_MODE::COUNTER) {
+    return AES_GCM_STATUS::INVALID_MODE;
+  }
+  allocator_ = _allocator;
+  counter_ = 0;
+  counterEnd_ = 0;
+  if (!allocator_) {
+    updateIV(true);
+    return AES_GCM_STATUS::VALID;
+  }
+  AES_GCM_STATUS status = allocator_->lease(counter_);
+  if (status == AES_GCM_STATUS::VALID) {
+    counterEnd_ = counter_ + allocator_->rangeSize();
+    updateIV(true);
+  }
+  return status;
+}
+
+const std::shared_ptr<AES_GCM_CounterAllocator> &AES_GCM_Enc::counterAllocator() const
+{
+  return allocator_;
+}
+
 unique_ptr<AES_GCM_Result> AES_GCM_Enc::ciphertext()
 {
-  try {
-    enc_.SetKeyWithIV(key_.data(), key_.size(), ivc_.data(), ivc_.size());
-    bool include_ivc = (cfg_.ivOutput != AES_GCM_IV_OUTPUT::NO);
-    bool ivc_aad = (cfg_.ivOutput == AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD);
-
-    // Determine the full output size
-    U64 aadSize = aad_.size();
-    U64 ivcSize = ((include_ivc) ? ivc_.size() : 0U);
-    U32 tagSize = AES_GCM_Tagsize(cfg_.tagSize);
-    U64 ctxtSize = aadSize + ivcSize + ptxt_.size() + tagSize;
-
-    // Allocate space for the ciphertext and create the encryption filter
-    MutableBlob mctxt(ctxtSize);
-    U64 filter_offset = aadSize + ivcSize;
-    Byte *filter_start = mctxt.data() + filter_offset;
-    CryptoPP::AuthenticatedEncryptionFilter encf(enc_,
-      new CryptoPP::ArraySink(filter_start, mctxt.size() - filter_offset),
-      false, (S32)tagSize);
-
-    // Insert the authenticated associated data
-    encf.ChannelPut("AAD", aad_.data(), aadSize);
-    if (ivc_aad) {
-      encf.ChannelPut("AAD", ivc_.data(), ivcSize);
+  // A leased range ran out and the next lease failed: never reuse a counter
+  if (allocator_ && (counter_ == counterEnd_)) {
+    AES_GCM_STATUS status = allocator_->lease(counter_);
+    if (status != AES_GCM_STATUS::VALID) {
+      return make_unique<AES_GCM_Result>(Blob(), status);
     }
-    encf.ChannelMessageEnd("AAD");
+    counterEnd_ = counter_ + allocator_->rangeSize();
+    updateIV(true);
+  }
 
-    // Insert the plaintext as authenticated encrypted data
-    encf.ChannelPut("", ptxt_.data(), ptxt_.size());
-    encf.ChannelMessageEnd("");
+  if ((key_.size() == 0) || (ivc_.size() == 0)) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::ENC_ERROR);
+  }
+  bool include_ivc = (cfg_.ivOutput != AES_GCM_IV_OUTPUT::NO);
+  bool ivc_aad = (cfg_.ivOutput == AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD);
+
+  // Optionally compress the plaintext first
+  const Byte *ptxt = ptxt_.data();
+  U64 ptxtSize = ptxt_.size();
+  unique_ptr<Blob> framed;
+  if (compression_ != AES_GCM_COMPRESSION::NONE) {
+    framed = compress(ptxt, ptxtSize, compression_, stats_);
+    ptxt = framed->data();
+    ptxtSize = framed->size();
+  }
+  if (armor_ != AES_GCM_ARMOR::NONE) {
+    return armoredCiphertext(ptxt, ptxtSize, framed != nullptr);
+  }
 
-    // Prepend the authenticated associated data to the ciphertext
-    memcpy((void *)mctxt.data(), (const void *)aad_.data(), aadSize);
-    if (include_ivc) {
-      memcpy((void *)(mctxt.data() + aadSize), (void *)ivc_.data(), ivcSize);
-    }
+  // Determine the full output size
+  U64 aadSize = aad_.size();
+  U64 ivcSize = ((include_ivc) ? ivc_.size() : 0U);
+  U32 tagSize = AES_GCM_Tagsize(cfg_.tagSize);
+  U64 ctxtSize = aadSize + ivcSize + ptxtSize + tagSize;
+
+  // Prepend the associated data and IV; the authenticated data is then a
+  // prefix of the output
+  MutableBlob mctxt(ctxtSize);
+  memcpy((void *)mctxt.data(), (const void *)aad_.data(), aadSize);
+  if (include_ivc) {
+    memcpy((void *)(mctxt.data() + aadSize), (const void *)ivc_.data(), ivcSize);
+  }
+  U64 authSize = aadSize + ((ivc_aad) ? ivcSize : 0U);
+  const Byte *auth = mctxt.data();
+  MutableBlob framedAuth;
+  if (framed) {
+    framedAuth = framedAAD(auth, authSize);
+    auth = framedAuth.data();
+    authSize = framedAuth.size();
+  }
+  Byte *out = mctxt.data() + aadSize + ivcSize;
+  if (!cipher_->encrypt(out, out + ptxtSize, tagSize, ivc_.data(), (U32)ivc_.size(),
+    auth, authSize, ptxt, ptxtSize)) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::ENC_ERROR);
+  }
+
+  // Create a new IV/Counter if not in manual mode
+  updateIV(false);
+
+  return make_unique<AES_GCM_Result>(mctxt, AES_GCM_STATUS::VALID);
+}
 
-    // Create a new IV/Counter if not in manual mode
-    updateIV(false);
+unique_ptr<AES_GCM_Result> AES_GCM_Enc::armoredCiphertext(const Byte *_ptxt, U64 _ptxtSize,
+  bool _framed)
+{
+  // The same message as ciphertext() builds, in slices: the header, then the
+  // ciphertext encrypted straight into the slice, then the tag
+  bool include_ivc = (cfg_.ivOutput != AES_GCM_IV_OUTPUT::NO);
+  bool ivc_aad = (cfg_.ivOutput == AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD);
+  U64 aadSize = aad_.size();
+  U64 ivcSize = ((include_ivc) ? ivc_.size() : 0U);
+  U32 tagSize = AES_GCM_Tagsize(cfg_.tagSize);
+  MutableBlob header(aadSize + ivcSize);
+  memcpy((void *)header.data(), (const void *)aad_.data(), aadSize);
+  if (include_ivc) {
+    memcpy((void *)(header.data() + aadSize), (const void *)ivc_.data(), ivcSize);
+  }
+  U64 authSize = aadSize + ((ivc_aad) ? ivcSize : 0U);
+  const Byte *auth = header.data();
+  MutableBlob framedAuth;
+  if (_framed) {
+    framedAuth = framedAAD(auth, authSize);
+    auth = framedAuth.data();
+    authSize = framedAuth.size();
+  }
 
-    return make_unique<AES_GCM_Result>(mctxt, AES_GCM_STATUS::VALID);
+  MutableBlob text(armoredSize(armor_, header.size() + _ptxtSize + tagSize));
+  ArmorWriter writer(armor_, reinterpret_cast<char *>(text.data()));
+  writer.put(header.data(), header.size());
+  bool ok = cipher_->encryptBegin(ivc_.data(), (U32)ivc_.size(), auth, authSize);
+  for (U64 done = 0; ok && (done < _ptxtSize);) {
+    U64 step = std::min(writer.room(), _ptxtSize - done);
+    ok = cipher_->encryptUpdate(writer.tail(), _ptxt + done, step);
+    writer.advance(step);
+    done += step;
   }
-  catch (std::exception const &e) {
+  Byte tag[AES_GCM_BLOCKSIZE_BYTES];
+  if (!ok || !cipher_->encryptEnd(tag, tagSize)) {
     return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::ENC_ERROR);
   }
+  writer.put(tag, tagSize);
+  writer.flush();
+  updateIV(false);
+  return make_unique<AES_GCM_Result>(text, AES_GCM_STATUS::VALID);
 }
 
 void AES_GCM_Enc::updateIV(bool _initialize)
@@ -141,7 +344,23 @@ void AES_GCM_Enc::updateIV(bool _initialize)
   Byte *ivcNew = ivc_.data();
 
   if (cfg_.ivMode == AES_GCM_IV_MODE::RANDOM) {
-    prng_.GenerateBlock(ivcNew, ivc_.size());
+    randomize(ivc_);
+  }
+  else if ((cfg_.ivMode == AES_GCM_IV_MODE::COUNTER) && allocator_) {
+    // Next counter of the leased range, or the start of a new range. If that
+    // lease fails, counter_ stays at counterEnd_ and ciphertext() retries.
+    if (!_initialize) {
+      counter_++;
+      U64 first = 0;
+      if ((counter_ == counterEnd_) && (allocator_->lease(first) == AES_GCM_STATUS::VALID)) {
+        counter_ = first;
+        counterEnd_ = first + allocator_->rangeSize();
+      }
+    }
+    if (ivc_.size() != AES_GCM_BLOCKSIZE_BYTES) {
+      ivc_ = MutableBlob(AES_GCM_BLOCKSIZE_BYTES, Blob::ScrubType::ZEROS);
+    }
+    AES_GCM_IVCounterIs(ivc_, counter_);
   }
   else if (cfg_.ivMode == AES_GCM_IV_MODE::COUNTER) {
     // Initialize at zero
@@ -172,43 +391,41 @@ void AES_GCM_Enc::updateIV(bool _initialize)
 
 /*** DECRYPTION ***/
 
-AES_GCM_Dec::AES_GCM_Dec()
-  : ctxt_(), iv_(), tag_(), aad_(), key_(), ptxt_(Blob(), AES_GCM_STATUS::DEC_ERROR),
-  dec_(), needsDecrypt_(false), mutableMux_()
+// Setters only record their input and mark the result stale. Comparing a new
+// input against the previous one would cost a full pass over the data just to
+// skip a decrypt that the caller almost always wants.
+
+AES_GCM_Dec::AES_GCM_Dec(AES_GCM_TABLES _tables)
+  : compression_(AES_GCM_COMPRESSION_DEFAULT), decompressedMax_(COMPRESSION_MAX_BYTES_DEFAULT),
+  ctxt_(), iv_(), tag_(), aad_(), key_(), window_(),
+  ptxt_(Blob(), AES_GCM_STATUS::DEC_ERROR), cipher_(backend().gcm(_tables)),
+  needsDecrypt_(false), mutableMux_()
 {
   // empty
 }
 
 void AES_GCM_Dec::ciphertextIs(const Blob &_ciphertext)
 {
-  if (ctxt_ != _ciphertext) {
-    ctxt_ = _ciphertext;
-    needsDecrypt_ = true;
-  }
+  ctxt_ = _ciphertext;
+  needsDecrypt_ = true;
 }
 
 void AES_GCM_Dec::ivIs(const Blob &_iv)
 {
-  if (iv_ != _iv) {
-    iv_ = _iv;
-    needsDecrypt_ = true;
-  }
+  iv_ = _iv;
+  needsDecrypt_ = true;
 }
 
 void AES_GCM_Dec::tagIs(const Blob &_tag)
 {
-  if (tag_ != _tag) {
-    tag_ = _tag;
-    needsDecrypt_ = true;
-  }
+  tag_ = _tag;
+  needsDecrypt_ = true;
 }
 
 void AES_GCM_Dec::aadIs(const Blob &_aad)
 {
-  if (aad_ != _aad) {
-    aad_ = _aad;
-    needsDecrypt_ = true;
-  }
+  aad_ = _aad;
+  needsDecrypt_ = true;
 }
 
 AES_GCM_STATUS AES_GCM_Dec::keyIs(const Blob &_key)
@@ -220,6 +437,9 @@ AES_GCM_STATUS AES_GCM_Dec::keyIs(const Blob &_key)
     (size != AES_GCM_KEYSIZE_192)) {
     status = AES_GCM_STATUS::INVALID_SIZE;
   }
+  else if (!cipher_->keyIs(_key.data(), (U32)size)) {
+    status = AES_GCM_STATUS::INVALID_KEY;
+  }
   else {
     key_ = _key;
     needsDecrypt_ = true;
@@ -227,6 +447,28 @@ AES_GCM_STATUS AES_GCM_Dec::keyIs(const Blob &_key)
   return status;
 }
 
+void AES_GCM_Dec::replayWindowIs(const std::shared_ptr<AES_GCM_ReplayWindow> &_window)
+{
+  window_ = _window;
+  needsDecrypt_ = true;
+}
+
+void AES_GCM_Dec::compressionIs(AES_GCM_COMPRESSION _compression)
+{
+  if (compression_ != _compression) {
+    compression_ = _compression;
+    needsDecrypt_ = true;
+  }
+}
+
+void AES_GCM_Dec::decompressedMaxIs(U64 _maxSize)
+{
+  if (decompressedMax_ != _maxSize) {
+    decompressedMax_ = _maxSize;
+    needsDecrypt_ = true;
+  }
+}
+
 const std::pair<Blob, AES_GCM_STATUS> &AES_GCM_Dec::plaintext() const
 {
   mutableMux_.lock();
@@ -237,42 +479,67 @@ const std::pair<Blob, AES_GCM_STATUS> &AES_GCM_Dec::plaintext() const
   return ptxt_;
 }
 
+void AES_GCM_Dec::reset()
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  ctxt_ = Blob();
+  iv_ = Blob();
+  tag_ = Blob();
+  aad_ = Blob();
+  compression_ = AES_GCM_COMPRESSION_DEFAULT;
+  decompressedMax_ = COMPRESSION_MAX_BYTES_DEFAULT;
+  ptxt_ = AES_GCM_Result(Blob(), AES_GCM_STATUS::DEC_ERROR);
+  needsDecrypt_ = false;
+}
+
 void AES_GCM_Dec::decrypt() const
 {
   if ((iv_.size() == 0) || (tag_.size() == 0) || (key_.size() == 0)) {
     ptxt_.second = AES_GCM_STATUS::INVALID_SIZE;
   }
+  else if (window_ && !window_->check(AES_GCM_IVCounter(iv_))) {
+    // Cheap rejection before any AES work
+    ptxt_.first.dataIsNull();
+    ptxt_.second = AES_GCM_STATUS::REPLAY;
+  }
   else {
-    try {
-      MutableBlob ptxt(ctxt_.size(), Blob::ScrubType::ZEROS);
-      dec_.SetKeyWithIV(key_.data(), key_.size(), iv_.data(), iv_.size());
-      CryptoPP::AuthenticatedDecryptionFilter decf(
-        dec_,
-        new CryptoPP::ArraySink(ptxt.data(), ptxt.size()),
-        CryptoPP::AuthenticatedDecryptionFilter::MAC_AT_BEGIN |
-        CryptoPP::AuthenticatedDecryptionFilter::THROW_EXCEPTION,
-        tag_.size());
-      decf.ChannelPut("", tag_.data(), tag_.size());
-      decf.ChannelPut("AAD", iv_.data(), iv_.size());
-      decf.ChannelPut("", ctxt_.data(), ctxt_.size());
-      decf.ChannelMessageEnd("AAD");
-      decf.ChannelMessageEnd("");
-
-      // Final verification
-      if (decf.GetLastResult() == false) {
-        ptxt_.first.dataIsNull();// = Blob();
-        ptxt_.second = AES_GCM_STATUS::DEC_ERROR;
-      }
-      else {
-        ptxt_.first = ptxt;
+    // Framed messages carry the compression suffix in their additional data
+    bool framed = (compression_ != AES_GCM_COMPRESSION::NONE);
+    MutableBlob auth = (framed) ? framedAAD(iv_.data(), iv_.size()) : MutableBlob();
+    const Byte *authData = (framed) ? auth.data() : iv_.data();
+    U64 authSize = (framed) ? auth.size() : iv_.size();
+    MutableBlob ptxt(ctxt_.size(), Blob::ScrubType::ZEROS);
+    bool valid = (tag_.size() <= AES_GCM_BLOCKSIZE_BYTES) &&
+      cipher_->decrypt(ptxt.data(), tag_.data(), (U32)tag_.size(), iv_.data(),
+      (U32)iv_.size(), authData, authSize, ctxt_.data(), ctxt_.size());
+    if (!valid) {
+      ptxt_.first.dataIsNull();
+      ptxt_.second = AES_GCM_STATUS::DEC_ERROR;
+    }
+    else if (compression_ != AES_GCM_COMPRESSION::NONE) {
+      // The frame is authenticated; a malformed one fails like a bad tag
+      if (decompress(ptxt.data(), ptxt.size(), ptxt_.first, decompressedMax_)) {
         ptxt_.second = AES_GCM_STATUS::VALID;
         needsDecrypt_ = false;
       }
+      else {
+        ptxt_.first.dataIsNull();
+        ptxt_.second = AES_GCM_STATUS::DEC_ERROR;
+      }
     }
-    catch (std::exception const &e) {
-      //printf("Bad decrypt: %s\n", e.what());
+    else {
+      ptxt_.first = ptxt;
+      ptxt_.second = AES_GCM_STATUS::VALID;
+      needsDecrypt_ = false;
+    }
+
+    // Only authentic messages advance the window; a concurrent decryptor
+    // may have accepted the same counter since the check
+    if ((ptxt_.second == AES_GCM_STATUS::VALID) && window_ &&
+      !window_->commit(AES_GCM_IVCounter(iv_))) {
       ptxt_.first.dataIsNull();
-      ptxt_.second = AES_GCM_STATUS::DEC_ERROR;
+      ptxt_.second = AES_GCM_STATUS::REPLAY;
+      needsDecrypt_ = true;
     }
   }
 }
@@ -1,11 +1,12 @@
 #ifndef CRYPTO_AES_GCM_H
 #define CRYPTO_AES_GCM_H
 
+#include "crypto/armor.h"
+#include "crypto/backend.h"
+#include "crypto/compression.h"
 #include "util/blob.h"
-#include "cryptopp/osrng.h"
-#include "cryptopp/aes.h"
-#include "cryptopp/gcm.h"
 #include "util/fixed_types.h"
+#include <memory>
 #include <mutex>
 #include <utility>
 
@@ -55,6 +56,22 @@ enum class AES_GCM_IV_OUTPUT
 
 static const AES_GCM_IV_OUTPUT AES_GCM_IV_OUTPUT_DEFAULT = AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD;
 
+// GHASH multiplication strategy, which sets the per-context table size with
+// the Crypto++ backend. On CPUs with carry-less multiply (PCLMULQDQ/PMULL)
+// Crypto++ uses it for every option and keeps only 8 precomputed powers of H
+// (128 bytes); elsewhere the 2K and 64K tables trade memory for speed. CLMUL
+// asks for the carry-less path and falls back to 2K tables where the
+// instructions are missing. OpenSSL chooses for itself and ignores this.
+enum class AES_GCM_TABLES
+{
+  T2K, T64K, CLMUL
+};
+static const AES_GCM_TABLES AES_GCM_TABLES_DEFAULT = AES_GCM_TABLES::T2K;
+
+// GHASH table bytes for one direction of a key context of the current
+// backend on this CPU
+U32 AES_GCM_TableBytes(AES_GCM_TABLES tables);
+
 // A collection of configuration options for the encryptor
 struct AES_GCM_Config
 {
@@ -66,15 +83,25 @@ struct AES_GCM_Config
 
 enum class AES_GCM_STATUS
 {
-  VALID, INVALID_SIZE, INVALID_MODE, ENC_ERROR, DEC_ERROR
+  VALID, INVALID_SIZE, INVALID_MODE, INVALID_KEY, ENC_ERROR, DEC_ERROR, IO_ERROR,
+  BUSY, REPLAY, UNVERIFIED
 };
 
+// The message counter carried in a COUNTER mode IV: the low 32 bits are
+// bytes 0-3 (big-endian, as incremented by the encryptor) and the high 32
+// bits are bytes 4-7.
+U64 AES_GCM_IVCounter(const Util::Blob &iv);
+void AES_GCM_IVCounterIs(Util::MutableBlob &iv, U64 counter);
+
+class AES_GCM_ReplayWindow;
+class AES_GCM_CounterAllocator;
+
 typedef std::pair<Util::Blob, AES_GCM_STATUS> AES_GCM_Result;
 
 class AES_GCM_Enc
 {
  public:
-  AES_GCM_Enc(const AES_GCM_Config config);
+  AES_GCM_Enc(const AES_GCM_Config config, AES_GCM_TABLES tables = AES_GCM_TABLES_DEFAULT);
   AES_GCM_Enc(const AES_GCM_Enc &) = delete;
   AES_GCM_Enc &operator=(const AES_GCM_Enc &) = delete;
   AES_GCM_Enc &operator=(AES_GCM_Enc &&) = default;
@@ -83,24 +110,53 @@ class AES_GCM_Enc
   AES_GCM_STATUS ivcIs(const Util::Blob &ivc);
   void aadIs(const Util::Blob &aad);
   void plaintextIs(const Util::Blob &plaintext);
+
+  // Anything but NONE frames the plaintext (see compression.h), and the frame
+  // is what gets encrypted, with COMPRESSION_AAD_SUFFIX added to the
+  // authenticated data. Decryptors must be given the same setting: one that
+  // differs fails with DEC_ERROR.
+  void compressionIs(AES_GCM_COMPRESSION compression);
+  const AES_GCM_CompressionStats &compressionStats() const;
   const Util::Blob &ivc() const;
+
+  // Armors the whole output of ciphertext() (see armor.h). Each slice of the
+  // message is armored as soon as it is encrypted, while still in cache, and
+  // the binary message is never built. Kept across reset().
+  void armorIs(AES_GCM_ARMOR armor);
+
+  // In COUNTER mode, mints IVs from ranges leased from 'allocator' instead of
+  // counting from zero, so encryptors sharing a key never repeat an IV. The
+  // first range is leased here.
+  AES_GCM_STATUS counterAllocatorIs(const std::shared_ptr<AES_GCM_CounterAllocator> &allocator);
+  const std::shared_ptr<AES_GCM_CounterAllocator> &counterAllocator() const;
   std::unique_ptr<AES_GCM_Result> ciphertext();
 
+  // Drops the AAD, plaintext and compression stats and restores default
+  // compression, keeping the key and IV state (for reuse under the same key)
+  void reset();
+
  private:
   void updateIV(bool initialize);
+  std::unique_ptr<AES_GCM_Result> armoredCiphertext(const Byte *ptxt, U64 ptxtSize,
+    bool framed);
   AES_GCM_Config cfg_;
+  AES_GCM_COMPRESSION compression_;
+  AES_GCM_ARMOR armor_;
+  AES_GCM_CompressionStats stats_;
   Util::MutableBlob ivc_;
   Util::Blob key_;
   Util::Blob aad_;
   Util::Blob ptxt_;
-  CryptoPP::AutoSeededRandomPool prng_;
-  CryptoPP::GCM<CryptoPP::AES>::Encryption enc_;
+  std::unique_ptr<AES_GCM_Cipher> cipher_;
+  std::shared_ptr<AES_GCM_CounterAllocator> allocator_;
+  U64 counter_;
+  U64 counterEnd_;
 };
 
 class AES_GCM_Dec
 {
  public:
-  AES_GCM_Dec();
+  AES_GCM_Dec(AES_GCM_TABLES tables = AES_GCM_TABLES_DEFAULT);
   AES_GCM_Dec(const AES_GCM_Dec &) = delete;
   AES_GCM_Dec &operator=(const AES_GCM_Dec &) = delete;
   AES_GCM_Dec &operator=(AES_GCM_Dec &&) = default;
@@ -109,17 +165,37 @@ class AES_GCM_Dec
   void tagIs(const Util::Blob &tag);
   void aadIs(const Util::Blob &aad);
   AES_GCM_STATUS keyIs(const Util::Blob &key);
+
+  // Must match the encryptor's compressionIs(); messages encrypted with the
+  // other setting fail with DEC_ERROR
+  void compressionIs(AES_GCM_COMPRESSION compression);
+
+  // Compressed messages that claim to expand past 'maxSize' bytes fail with
+  // DEC_ERROR before anything is allocated for them (default
+  // COMPRESSION_MAX_BYTES_DEFAULT)
+  void decompressedMaxIs(U64 maxSize);
+
+  // Rejects (with REPLAY) messages whose IV counter was already accepted
+  // through 'window', which may be shared by decryptors on several threads
+  void replayWindowIs(const std::shared_ptr<AES_GCM_ReplayWindow> &window);
   const AES_GCM_Result &plaintext() const;
 
+  // Drops all inputs except the key, and the last plaintext; compression and
+  // the decompressed size limit return to their defaults
+  void reset();
+
  private:
   void decrypt() const;
+  AES_GCM_COMPRESSION compression_;
+  U64 decompressedMax_;
   Util::Blob ctxt_;
   Util::Blob iv_;
   Util::Blob tag_;
   Util::Blob aad_;
   Util::Blob key_;
+  std::shared_ptr<AES_GCM_ReplayWindow> window_;
   mutable AES_GCM_Result ptxt_;
-  mutable CryptoPP::GCM<CryptoPP::AES>::Decryption dec_;
+  std::unique_ptr<AES_GCM_Cipher> cipher_;
   mutable bool needsDecrypt_;
   mutable std::mutex mutableMux_;
 };
@@ -0,0 +1,484 @@
+#include "crypto/aes_gcm_batch.h"
+#include "util/make_unique.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__AES__) && defined(__PCLMUL__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#define CRYPTO_AES_GCM_BATCH_NI 1
+#endif
+
+using namespace Crypto;
+using Util::Blob;
+using Util::make_unique;
+
+// GCM counters are 32 bits and the first counter block makes the tag
+static const U64 BATCH_MAX_BYTES = (((U64)1 << 32) - 2) * AES_GCM_BLOCKSIZE_BYTES;
+
+static bool validOp(const AES_GCM_BatchOp &_op)
+{
+  return (_op.key != nullptr) && (_op.key->keySize() != 0) && (_op.ivSize != 0) &&
+    (_op.tagSize != 0) && (_op.tagSize <= AES_GCM_BLOCKSIZE_BYTES) &&
+    (_op.size <= BATCH_MAX_BYTES);
+}
+
+#if defined(CRYPTO_AES_GCM_BATCH_NI)
+
+namespace {
+
+// GHASH works on byte-reflected blocks (Intel's carry-less multiplication
+// white paper, algorithm 5): products are accumulated unreduced in three
+// parts and reduced once per chunk of blocks
+inline __m128i reflect(__m128i _x)
+{
+  return _mm_shuffle_epi8(_x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15));
+}
+
+inline __m128i loadBlock(const Byte *_data)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(_data));
+}
+
+inline void storeBlock(Byte *_data, __m128i _x)
+{
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(_data), _x);
+}
+
+// Zero-padded
+inline __m128i loadPartial(const Byte *_data, U64 _size)
+{
+  Byte block[AES_GCM_BLOCKSIZE_BYTES] = {0};
+  memcpy(block, _data, _size);
+  return loadBlock(block);
+}
+
+struct Product
+{
+  __m128i lo, mid, hi;
+};
+
+inline void clmulAdd(Product &_p, __m128i _a, __m128i _b)
+{
+  _p.lo = _mm_xor_si128(_p.lo, _mm_clmulepi64_si128(_a, _b, 0x00));
+  _p.hi = _mm_xor_si128(_p.hi, _mm_clmulepi64_si128(_a, _b, 0x11));
+  _p.mid = _mm_xor_si128(_p.mid, _mm_xor_si128(_mm_clmulepi64_si128(_a, _b, 0x10),
+    _mm_clmulepi64_si128(_a, _b, 0x01)));
+}
+
+inline __m128i reduce(const Product &_p)
+{
+  __m128i lo = _mm_xor_si128(_p.lo, _mm_slli_si128(_p.mid, 8));
+  __m128i hi = _mm_xor_si128(_p.hi, _mm_srli_si128(_p.mid, 8));
+
+  // Shift the 256-bit product left by one (the reflection)
+  __m128i loCarry = _mm_srli_epi32(lo, 31);
+  __m128i hiCarry = _mm_srli_epi32(hi, 31);
+  lo = _mm_slli_epi32(lo, 1);
+  hi = _mm_slli_epi32(hi, 1);
+  hi = _mm_or_si128(hi, _mm_srli_si128(loCarry, 12));
+  hi = _mm_or_si128(hi, _mm_slli_si128(hiCarry, 4));
+  lo = _mm_or_si128(lo, _mm_slli_si128(loCarry, 4));
+
+  // Reduce modulo x^128 + x^7 + x^2 + x + 1
+  __m128i a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)),
+    _mm_slli_epi32(lo, 25));
+  __m128i carry = _mm_srli_si128(a, 4);
+  lo = _mm_xor_si128(lo, _mm_slli_si128(a, 12));
+  __m128i b = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)),
+    _mm_srli_epi32(lo, 7));
+  b = _mm_xor_si128(b, carry);
+  return _mm_xor_si128(hi, _mm_xor_si128(lo, b));
+}
+
+inline __m128i gfmul(__m128i _a, __m128i _b)
+{
+  Product p = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+  clmulAdd(p, _a, _b);
+  return reduce(p);
+}
+
+inline __m128i encryptBlock(const __m128i *_rk, U32 _rounds, __m128i _x)
+{
+  _x = _mm_xor_si128(_x, _rk[0]);
+  for (U32 r = 1; r < _rounds; r++) {
+    _x = _mm_aesenc_si128(_x, _rk[r]);
+  }
+  return _mm_aesenclast_si128(_x, _rk[_rounds]);
+}
+
+// Folds 'size' bytes (the last block zero-padded) into the reflected GHASH
+// state 'x', AES_GCM_BATCH_BLOCKS blocks per reduction
+__m128i ghash(const __m128i *_hPowers, __m128i _x, const Byte *_data, U64 _size)
+{
+  const U64 blocks = (_size + AES_GCM_BLOCKSIZE_BYTES - 1) / AES_GCM_BLOCKSIZE_BYTES;
+  for (U64 i = 0; i < blocks; i += AES_GCM_BATCH_BLOCKS) {
+    U64 n = std::min<U64>(AES_GCM_BATCH_BLOCKS, blocks - i);
+    Product p = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+    for (U64 j = 0; j < n; j++) {
+      U64 offset = (i + j) * AES_GCM_BLOCKSIZE_BYTES;
+      U64 size = std::min<U64>(AES_GCM_BLOCKSIZE_BYTES, _size - offset);
+      __m128i block = reflect((size == AES_GCM_BLOCKSIZE_BYTES) ? loadBlock(_data + offset) :
+        loadPartial(_data + offset, size));
+      if (j == 0) {
+        block = _mm_xor_si128(block, _x);
+      }
+      clmulAdd(p, block, _hPowers[n - 1 - j]);
+    }
+    _x = reduce(p);
+  }
+  return _x;
+}
+
+// The reflected GHASH length block: bit lengths of the AAD and the text
+inline __m128i lengthBlock(U64 _aadSize, U64 _size)
+{
+  return _mm_set_epi64x((long long)(_aadSize * 8), (long long)(_size * 8));
+}
+
+// A message being processed. 'counter' is the 32-bit counter of the first
+// block; the block at 'offset' uses counter + offset / 16. The first 'done'
+// bytes are written and the first 'hashed' are in 'x'.
+struct Lane
+{
+  AES_GCM_BatchOp *op;
+  const __m128i *rk;
+  const __m128i *hPowers;
+  U32 rounds;
+  __m128i j0;
+  __m128i x;
+  U32 counter;
+  U64 done;
+  U64 hashed;
+};
+
+} // namespace
+
+// SubWord() of FIPS-197 on each byte; AESKEYGENASSIST's low word is
+// SubWord() of its second word
+static U32 subWord(U32 _w)
+{
+  return (U32)_mm_cvtsi128_si32(_mm_aeskeygenassist_si128(_mm_set1_epi32((int)_w), 0));
+}
+
+static void expandKey(Byte (*_rk)[AES_GCM_BLOCKSIZE_BYTES], const Byte *_key, U32 _keySize,
+  U32 _rounds)
+{
+  static const U32 rcon[] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+  const U32 nk = _keySize / 4;
+  const U32 words = 4 * (_rounds + 1);
+  U32 w[60];
+  memcpy(w, _key, _keySize);
+  for (U32 i = nk; i < words; i++) {
+    U32 t = w[i - 1];
+    if ((i % nk) == 0) {
+      t = subWord((t >> 8) | (t << 24)) ^ rcon[i / nk - 1];
+    }
+    else if ((nk > 6) && ((i % nk) == 4)) {
+      t = subWord(t);
+    }
+    w[i] = w[i - nk] ^ t;
+  }
+  memcpy(_rk, w, words * 4);
+}
+
+// Starts 'op' on 'lane': J0, the AAD's GHASH and the first counter
+static void laneIs(Lane &_lane, AES_GCM_BatchOp &_op, const Byte (*_rk)[AES_GCM_BLOCKSIZE_BYTES],
+  U32 _rounds, const Byte (*_hPowers)[AES_GCM_BLOCKSIZE_BYTES])
+{
+  _lane.op = &_op;
+  _lane.rk = reinterpret_cast<const __m128i *>(_rk);
+  _lane.hPowers = reinterpret_cast<const __m128i *>(_hPowers);
+  _lane.rounds = _rounds;
+  if (_op.ivSize == 12) {
+    Byte j0[AES_GCM_BLOCKSIZE_BYTES] = {0};
+    memcpy(j0, _op.iv, 12);
+    j0[15] = 1;
+    _lane.j0 = loadBlock(j0);
+  }
+  else {
+    __m128i x = ghash(_lane.hPowers, _mm_setzero_si128(), _op.iv, _op.ivSize);
+    x = gfmul(_mm_xor_si128(x, lengthBlock(0, _op.ivSize)), _lane.hPowers[0]);
+    _lane.j0 = reflect(x);
+  }
+  _lane.x = ghash(_lane.hPowers, _mm_setzero_si128(), _op.aad, _op.aadSize);
+  _lane.counter = __builtin_bswap32((U32)_mm_extract_epi32(_lane.j0, 3)) + 1;
+  _lane.done = 0;
+  _lane.hashed = 0;
+}
+
+// Tag, then its check on decryption
+static void laneEnd(Lane &_lane, bool _encrypt)
+{
+  AES_GCM_BatchOp &op = *_lane.op;
+  __m128i x = gfmul(_mm_xor_si128(_lane.x, lengthBlock(op.aadSize, op.size)),
+    _lane.hPowers[0]);
+  Byte tag[AES_GCM_BLOCKSIZE_BYTES];
+  storeBlock(tag, _mm_xor_si128(reflect(x), encryptBlock(_lane.rk, _lane.rounds, _lane.j0)));
+  if (_encrypt) {
+    memcpy(op.tag, tag, op.tagSize);
+    op.status = AES_GCM_STATUS::VALID;
+    return;
+  }
+  Byte diff = 0;
+  for (U32 i = 0; i < op.tagSize; i++) {
+    diff |= (Byte)(tag[i] ^ op.tag[i]);
+  }
+  op.status = (diff == 0) ? AES_GCM_STATUS::VALID : AES_GCM_STATUS::DEC_ERROR;
+  if (diff != 0) {
+    memset(op.out, 0, op.size);
+  }
+}
+
+// One AES round on every slot, each under its own key schedule
+inline void aesRound(__m128i *_x, const __m128i *const *_rk, U32 _r)
+{
+  _x[0] = _mm_aesenc_si128(_x[0], _rk[0][_r]);
+  _x[1] = _mm_aesenc_si128(_x[1], _rk[1][_r]);
+  _x[2] = _mm_aesenc_si128(_x[2], _rk[2][_r]);
+  _x[3] = _mm_aesenc_si128(_x[3], _rk[3][_r]);
+  _x[4] = _mm_aesenc_si128(_x[4], _rk[4][_r]);
+  _x[5] = _mm_aesenc_si128(_x[5], _rk[5][_r]);
+  _x[6] = _mm_aesenc_si128(_x[6], _rk[6][_r]);
+  _x[7] = _mm_aesenc_si128(_x[7], _rk[7][_r]);
+}
+
+// Folds the lane's text up to 'end' into its GHASH, AES_GCM_BATCH_BLOCKS
+// blocks per reduction: the ciphertext it wrote on encryption, the
+// ciphertext it is about to overwrite (if in place) on decryption
+static void laneHash(Lane &_lane, const Byte *_text, U64 _end)
+{
+  const U64 chunk = AES_GCM_BATCH_BLOCKS * AES_GCM_BLOCKSIZE_BYTES;
+  while (_lane.hashed < _end) {
+    U64 size = std::min(chunk, _lane.op->size - _lane.hashed);
+    _lane.x = ghash(_lane.hPowers, _lane.x, _text + _lane.hashed, size);
+    _lane.hashed += size;
+  }
+}
+
+// One step: up to AES_GCM_BATCH_BLOCKS blocks, dealt round-robin across the
+// lanes, go through AES together
+static void laneStep(Lane *_lanes, U32 _active, bool _encrypt)
+{
+  const U64 chunk = AES_GCM_BATCH_BLOCKS * AES_GCM_BLOCKSIZE_BYTES;
+  U32 slotLane[AES_GCM_BATCH_BLOCKS];
+  U64 slotOffset[AES_GCM_BATCH_BLOCKS];
+  U32 laneBlocks[AES_GCM_BATCH_LANES] = {0};
+  U32 slots = 0;
+  for (bool more = true; more && (slots < AES_GCM_BATCH_BLOCKS);) {
+    more = false;
+    for (U32 l = 0; (l < _active) && (slots < AES_GCM_BATCH_BLOCKS); l++) {
+      U64 offset = _lanes[l].done + (U64)laneBlocks[l] * AES_GCM_BLOCKSIZE_BYTES;
+      if (offset < _lanes[l].op->size) {
+        slotLane[slots] = l;
+        slotOffset[slots] = offset;
+        laneBlocks[l]++;
+        slots++;
+        more = true;
+      }
+    }
+  }
+  if (!_encrypt) {
+    for (U32 l = 0; l < _active; l++) {
+      Lane &lane = _lanes[l];
+      U64 end = lane.done + (U64)laneBlocks[l] * AES_GCM_BLOCKSIZE_BYTES;
+      laneHash(lane, lane.op->in, std::min(lane.op->size, (end + chunk - 1) / chunk * chunk));
+    }
+  }
+
+  // AES rounds across all slots whatever their keys (idle slots repeat the
+  // first); the rounds every key has run unrolled, and only mixed key sizes
+  // take the per-slot tail
+  __m128i x[AES_GCM_BATCH_BLOCKS];
+  const __m128i *rk[AES_GCM_BATCH_BLOCKS];
+  U32 rounds[AES_GCM_BATCH_BLOCKS];
+  U32 minRounds = _lanes[slotLane[0]].rounds;
+  U32 maxRounds = minRounds;
+  for (U32 s = 0; s < AES_GCM_BATCH_BLOCKS; s++) {
+    const Lane &lane = _lanes[slotLane[(s < slots) ? s : 0]];
+    U64 offset = slotOffset[(s < slots) ? s : 0];
+    U32 counter = lane.counter + (U32)(offset / AES_GCM_BLOCKSIZE_BYTES);
+    rk[s] = lane.rk;
+    rounds[s] = lane.rounds;
+    x[s] = _mm_xor_si128(_mm_insert_epi32(lane.j0, (int)__builtin_bswap32(counter), 3),
+      lane.rk[0]);
+    minRounds = std::min(minRounds, lane.rounds);
+    maxRounds = std::max(maxRounds, lane.rounds);
+  }
+  for (U32 r = 1; r < minRounds; r++) {
+    aesRound(x, rk, r);
+  }
+  for (U32 r = minRounds; r < maxRounds; r++) {
+    for (U32 s = 0; s < AES_GCM_BATCH_BLOCKS; s++) {
+      if (r < rounds[s]) {
+        x[s] = _mm_aesenc_si128(x[s], rk[s][r]);
+      }
+    }
+  }
+
+  for (U32 s = 0; s < slots; s++) {
+    const AES_GCM_BatchOp &op = *_lanes[slotLane[s]].op;
+    __m128i keystream = _mm_aesenclast_si128(x[s], rk[s][rounds[s]]);
+    U64 size = std::min<U64>(AES_GCM_BLOCKSIZE_BYTES, op.size - slotOffset[s]);
+    if (size == AES_GCM_BLOCKSIZE_BYTES) {
+      storeBlock(op.out + slotOffset[s],
+        _mm_xor_si128(loadBlock(op.in + slotOffset[s]), keystream));
+    }
+    else {
+      Byte block[AES_GCM_BLOCKSIZE_BYTES] = {0};
+      memcpy(block, op.in + slotOffset[s], size);
+      storeBlock(block, _mm_xor_si128(loadBlock(block), keystream));
+      memcpy(op.out + slotOffset[s], block, size);
+    }
+  }
+
+  for (U32 l = 0; l < _active; l++) {
+    Lane &lane = _lanes[l];
+    lane.done = std::min(lane.op->size, lane.done + (U64)laneBlocks[l] * AES_GCM_BLOCKSIZE_BYTES);
+    if (_encrypt) {
+      laneHash(lane, lane.op->out, (lane.done == lane.op->size) ? lane.done :
+        lane.done / chunk * chunk);
+    }
+  }
+}
+
+#endif // CRYPTO_AES_GCM_BATCH_NI
+
+const char *Crypto::AES_GCM_BatchISA()
+{
+#if defined(CRYPTO_AES_GCM_BATCH_NI)
+  return "aesni";
+#else
+  return "backend";
+#endif
+}
+
+// Called through a volatile pointer so the compiler cannot prove the stores
+// dead and drop them
+static void *(*const volatile wipeBytes)(void *, int, size_t) = memset;
+
+AES_GCM_BatchKey::AES_GCM_BatchKey()
+  : keySize_(0), rounds_(0), roundKeys_(), hPowers_(), backend_()
+{
+  // empty
+}
+
+AES_GCM_BatchKey::~AES_GCM_BatchKey()
+{
+  wipe();
+}
+
+void AES_GCM_BatchKey::wipe()
+{
+  wipeBytes(roundKeys_, 0, sizeof(roundKeys_));
+  wipeBytes(hPowers_, 0, sizeof(hPowers_));
+  keySize_ = 0;
+  rounds_ = 0;
+}
+
+AES_GCM_STATUS AES_GCM_BatchKey::keyIs(const Blob &_key)
+{
+  U64 size = _key.size();
+  wipe();
+  if ((size != AES_GCM_KEYSIZE_256) && (size != AES_GCM_KEYSIZE_128) &&
+    (size != AES_GCM_KEYSIZE_192)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+#if defined(CRYPTO_AES_GCM_BATCH_NI)
+  rounds_ = (U32)size / 4 + 6;
+  expandKey(roundKeys_, _key.data(), (U32)size, rounds_);
+  const __m128i *rk = reinterpret_cast<const __m128i *>(roundKeys_);
+  __m128i h = reflect(encryptBlock(rk, rounds_, _mm_setzero_si128()));
+  __m128i power = h;
+  for (U32 i = 0; i < AES_GCM_BATCH_BLOCKS; i++) {
+    storeBlock(hPowers_[i], power);
+    power = gfmul(power, h);
+  }
+#else
+  if (!backend_) {
+    backend_ = make_unique<AES_GCM_Key>();
+  }
+  AES_GCM_STATUS status = backend_->keyIs(_key);
+  if (status != AES_GCM_STATUS::VALID) {
+    return status;
+  }
+#endif
+  keySize_ = (U32)size;
+  return AES_GCM_STATUS::VALID;
+}
+
+U32 AES_GCM_BatchKey::keySize() const
+{
+  return keySize_;
+}
+
+AES_GCM_STATUS AES_GCM_Batch::encrypt(AES_GCM_BatchOp *_ops, size_t _count)
+{
+  return run(_ops, _count, true);
+}
+
+AES_GCM_STATUS AES_GCM_Batch::decrypt(AES_GCM_BatchOp *_ops, size_t _count)
+{
+  return run(_ops, _count, false);
+}
+
+AES_GCM_STATUS AES_GCM_Batch::run(AES_GCM_BatchOp *_ops, size_t _count, bool _encrypt)
+{
+#if defined(CRYPTO_AES_GCM_BATCH_NI)
+  // Keep up to AES_GCM_BATCH_LANES messages in flight, starting the next one
+  // as soon as a lane finishes
+  Lane lanes[AES_GCM_BATCH_LANES];
+  U32 active = 0;
+  size_t next = 0;
+  while ((active > 0) || (next < _count)) {
+    while ((active < AES_GCM_BATCH_LANES) && (next < _count)) {
+      AES_GCM_BatchOp &op = _ops[next++];
+      if (!validOp(op)) {
+        op.status = AES_GCM_STATUS::INVALID_SIZE;
+        continue;
+      }
+      laneIs(lanes[active], op, op.key->roundKeys_, op.key->rounds_, op.key->hPowers_);
+      if (op.size == 0) {
+        laneEnd(lanes[active], _encrypt);
+        continue;
+      }
+      active++;
+    }
+    if (active == 0) {
+      break;
+    }
+    laneStep(lanes, active, _encrypt);
+    for (U32 l = 0; l < active;) {
+      if (lanes[l].done == lanes[l].op->size) {
+        laneEnd(lanes[l], _encrypt);
+        lanes[l] = lanes[--active];
+      }
+      else {
+        l++;
+      }
+    }
+  }
+#else
+  for (size_t i = 0; i < _count; i++) {
+    AES_GCM_BatchOp &op = _ops[i];
+    if (!validOp(op)) {
+      op.status = AES_GCM_STATUS::INVALID_SIZE;
+      continue;
+    }
+    AES_GCM_Key &key = *op.key->backend_;
+    op.status = (_encrypt) ?
+      key.encrypt(op.out, op.tag, op.tagSize, op.iv, op.ivSize, op.aad, op.aadSize, op.in,
+        op.size) :
+      key.decrypt(op.out, op.tag, op.tagSize, op.iv, op.ivSize, op.aad, op.aadSize, op.in,
+        op.size);
+    if (op.status == AES_GCM_STATUS::DEC_ERROR) {
+      memset(op.out, 0, op.size);
+    }
+  }
+#endif
+  for (size_t i = 0; i < _count; i++) {
+    if (_ops[i].status != AES_GCM_STATUS::VALID) {
+      return _ops[i].status;
+    }
+  }
+  return AES_GCM_STATUS::VALID;
+}
@@ -0,0 +1,86 @@
+#ifndef CRYPTO_AES_GCM_BATCH_H
+#define CRYPTO_AES_GCM_BATCH_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <cstddef>
+#include <memory>
+
+namespace Crypto {
+
+// Multi-buffer AES/GCM: one call encrypts or decrypts a batch of messages,
+// each under its own key. With AES-NI and PCLMULQDQ (built in when the build
+// targets them; the Makefile builds with -march=native) the engine keeps
+// AES_GCM_BATCH_BLOCKS counter blocks in flight, drawn from up to
+// AES_GCM_BATCH_LANES messages at once, so a batch of small messages under
+// different keys fills the AES pipeline the way one long message would. Each
+// message's GHASH takes AES_GCM_BATCH_BLOCKS blocks per reduction, using
+// precomputed powers of its H. Otherwise each message goes through
+// AES_GCM_Key on the backend in turn.
+static const U32 AES_GCM_BATCH_BLOCKS = 8;
+static const U32 AES_GCM_BATCH_LANES = 8;
+
+// "aesni" or "backend"
+const char *AES_GCM_BatchISA();
+
+// A key context for batches: the AES key schedule and the first
+// AES_GCM_BATCH_BLOCKS powers of the GHASH key, computed once in keyIs().
+// Read-only afterwards, so any number of ops, batches and threads may share
+// it, except on the backend path, where a context is not thread-safe. The key
+// schedule and GHASH powers are wiped on re-key and on destruction.
+class AES_GCM_BatchKey
+{
+ public:
+  AES_GCM_BatchKey();
+  ~AES_GCM_BatchKey();
+  AES_GCM_BatchKey(const AES_GCM_BatchKey &) = delete;
+  AES_GCM_BatchKey &operator=(const AES_GCM_BatchKey &) = delete;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+  U32 keySize() const;
+
+ private:
+  friend class AES_GCM_Batch;
+  void wipe();
+  static const U32 MAX_ROUNDS = 14;
+  U32 keySize_;
+  U32 rounds_;
+  alignas(16) Byte roundKeys_[MAX_ROUNDS + 1][AES_GCM_BLOCKSIZE_BYTES];
+  alignas(16) Byte hPowers_[AES_GCM_BATCH_BLOCKS][AES_GCM_BLOCKSIZE_BYTES];
+  std::unique_ptr<AES_GCM_Key> backend_;
+};
+
+// One message of a batch. 'in' and 'out' are 'size' bytes and may be the same
+// buffer. Encryption writes tagSize bytes to 'tag'; decryption reads them.
+struct AES_GCM_BatchOp
+{
+  const AES_GCM_BatchKey *key;
+  const Byte             *iv;
+  U32                    ivSize;
+  const Byte             *aad;
+  U64                    aadSize;
+  const Byte             *in;
+  Byte                   *out;
+  U64                    size;
+  Byte                   *tag;
+  U32                    tagSize;
+  AES_GCM_STATUS         status;
+};
+
+// Set each op's status and return VALID if all succeeded, otherwise the first
+// failing status. An op that fails does not stop the others. Decryption
+// zeroes the output of a message that fails authentication.
+class AES_GCM_Batch
+{
+ public:
+  static AES_GCM_STATUS encrypt(AES_GCM_BatchOp *ops, size_t count);
+  static AES_GCM_STATUS decrypt(AES_GCM_BatchOp *ops, size_t count);
+
+ private:
+  static AES_GCM_STATUS run(AES_GCM_BatchOp *ops, size_t count, bool encrypt);
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_BATCH_H
@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_batch.h"
+#include "crypto/random.h"
+#include "util/make_unique.h"
+#include <string>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using Util::make_unique;
+using std::unique_ptr;
+using std::vector;
+
+// A message with its expected output from AES_GCM_Key
+struct Message
+{
+  Blob key, iv, aad, ptxt, ctxt, tag;
+};
+
+static Message message(U32 keySize, U32 ivSize, U64 aadSize, U64 size, U32 tagSize)
+{
+  Message m;
+  m.key = *random(keySize);
+  m.iv = *random(ivSize);
+  m.aad = *random(aadSize);
+  m.ptxt = *random(size);
+  AES_GCM_Key key;
+  key.keyIs(m.key);
+  MutableBlob ctxt(size);
+  MutableBlob tag(tagSize);
+  key.encrypt(ctxt.data(), tag.data(), tagSize, m.iv.data(), ivSize, m.aad.data(), aadSize,
+    m.ptxt.data(), size);
+  m.ctxt = ctxt;
+  m.tag = tag;
+  return m;
+}
+
+TEST(AES_GCM_BatchTest, MatchesKey) {
+  // Mixed key, IV, AAD, message and tag sizes, more messages than lanes
+  const U32 keySizes[] = {AES_GCM_KEYSIZE_128, AES_GCM_KEYSIZE_192, AES_GCM_KEYSIZE_256};
+  const U32 ivSizes[] = {12, 16, 1, 60};
+  vector<Message> messages;
+  for (U64 i = 0; i < 40; i++) {
+    U64 size = (i == 7) ? 5000 : (i * 37) % 300;
+    messages.push_back(message(keySizes[i % 3], ivSizes[i % 4], (i * 13) % 50, size,
+      (i % 5 == 0) ? 12 : 16));
+  }
+  vector<unique_ptr<AES_GCM_BatchKey>> keys;
+  vector<MutableBlob> outs;
+  vector<MutableBlob> tags;
+  vector<AES_GCM_BatchOp> ops;
+  for (const Message &m : messages) {
+    keys.push_back(make_unique<AES_GCM_BatchKey>());
+    ASSERT_EQ(keys.back()->keyIs(m.key), AES_GCM_STATUS::VALID);
+    outs.push_back(MutableBlob(m.ptxt.size()));
+    tags.push_back(MutableBlob(m.tag.size()));
+  }
+  for (size_t i = 0; i < messages.size(); i++) {
+    const Message &m = messages[i];
+    ops.push_back(AES_GCM_BatchOp{keys[i].get(), m.iv.data(), (U32)m.iv.size(), m.aad.data(),
+      m.aad.size(), m.ptxt.data(), outs[i].data(), m.ptxt.size(), tags[i].data(),
+      (U32)m.tag.size(), AES_GCM_STATUS::INVALID_MODE});
+  }
+  ASSERT_EQ(AES_GCM_Batch::encrypt(ops.data(), ops.size()), AES_GCM_STATUS::VALID);
+  for (size_t i = 0; i < messages.size(); i++) {
+    EXPECT_EQ(ops[i].status, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(Blob(outs[i]), messages[i].ctxt) << i;
+    EXPECT_EQ(Blob(tags[i]), messages[i].tag) << i;
+  }
+
+  // Decryption in place
+  for (size_t i = 0; i < messages.size(); i++) {
+    ops[i].in = outs[i].data();
+  }
+  ASSERT_EQ(AES_GCM_Batch::decrypt(ops.data(), ops.size()), AES_GCM_STATUS::VALID);
+  for (size_t i = 0; i < messages.size(); i++) {
+    EXPECT_EQ(Blob(outs[i]), messages[i].ptxt) << i;
+  }
+}
+
+TEST(AES_GCM_BatchTest, Errors) {
+  // Failures are per message: a forged tag and a bad op leave the rest valid
+  Message m = message(AES_GCM_KEYSIZE_256, 12, 20, 100, 16);
+  AES_GCM_BatchKey key;
+  AES_GCM_BatchKey unkeyed;
+  EXPECT_EQ(key.keyIs(Blob(m.key, 20, 0)), AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(key.keyIs(m.key), AES_GCM_STATUS::VALID);
+  MutableBlob tag(m.tag);
+  MutableBlob badTag(m.tag);
+  badTag.data()[0] ^= 1;
+  vector<MutableBlob> outs;
+  for (int i = 0; i < 4; i++) {
+    outs.push_back(MutableBlob(m.ctxt.size()));
+  }
+  AES_GCM_BatchOp ops[4] = {
+    {&key, m.iv.data(), 12, m.aad.data(), 20, m.ctxt.data(), outs[0].data(), 100,
+      badTag.data(), 16, AES_GCM_STATUS::VALID},
+    {&unkeyed, m.iv.data(), 12, m.aad.data(), 20, m.ctxt.data(), outs[1].data(), 100,
+      tag.data(), 16, AES_GCM_STATUS::VALID},
+    {&key, m.iv.data(), 12, m.aad.data(), 20, m.ctxt.data(), outs[2].data(), 100,
+      tag.data(), 17, AES_GCM_STATUS::VALID},
+    {&key, m.iv.data(), 12, m.aad.data(), 20, m.ctxt.data(), outs[3].data(), 100,
+      tag.data(), 16, AES_GCM_STATUS::VALID},
+  };
+  EXPECT_EQ(AES_GCM_Batch::decrypt(ops, 4), AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(ops[0].status, AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(Blob(outs[0]), Blob(std::string(100, '\0')));
+  EXPECT_EQ(ops[1].status, AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(ops[2].status, AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(ops[3].status, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(Blob(outs[3]), m.ptxt);
+  EXPECT_EQ(AES_GCM_Batch::decrypt(ops + 3, 1), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(AES_GCM_Batch::decrypt(nullptr, 0), AES_GCM_STATUS::VALID);
+}
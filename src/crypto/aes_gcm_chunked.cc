@@ -0,0 +1,409 @@
+#include "crypto/aes_gcm_chunked.h"
+#include "crypto/backend.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include "util/make_unique.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using Util::make_unique;
+using std::unique_ptr;
+
+static const U32 CHUNK_MIN_BYTES = 64;
+static const U32 MANIFEST_ENTRY_BYTES = AES_GCM_CHUNK_ID_BYTES + 4;
+
+// Gear table of the rolling hash: fixed pseudo-random values (SplitMix64)
+struct GearTable
+{
+  U64 v[256];
+  GearTable()
+  {
+    U64 x = 0x6261652d63646321ULL;
+    for (U32 i = 0; i < 256; i++) {
+      x += 0x9e3779b97f4a7c15ULL;
+      U64 z = x;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      v[i] = z ^ (z >> 31);
+    }
+  }
+};
+
+static const GearTable &gearTable()
+{
+  static const GearTable table;
+  return table;
+}
+
+// The chunk ID and manifest keys are independent HMACs of the caller's key
+// (empty if the backend fails)
+static Blob subkey(const Blob &_key, const char *_label)
+{
+  MutableBlob out(AES_GCM_KEYSIZE_256);
+  unique_ptr<HMAC_SHA256> mac = backend().hmacSha256();
+  if (!mac->keyIs(_key.data(), _key.size()) ||
+    !mac->update(reinterpret_cast<const Byte *>(_label), strlen(_label)) ||
+    !mac->digest(out.data())) {
+    return Blob();
+  }
+  return out;
+}
+
+// A keyed MAC for chunk IDs, or nullptr if the backend fails
+static unique_ptr<HMAC_SHA256> idMAC(const Blob &_idKey)
+{
+  unique_ptr<HMAC_SHA256> mac = backend().hmacSha256();
+  if (!mac->keyIs(_idKey.data(), _idKey.size())) {
+    return unique_ptr<HMAC_SHA256>();
+  }
+  return mac;
+}
+
+static Blob chunkID(HMAC_SHA256 &_mac, const Byte *_ptxt, U64 _size)
+{
+  MutableBlob id(AES_GCM_CHUNK_ID_BYTES);
+  if (!_mac.update(_ptxt, _size) || !_mac.digest(id.data())) {
+    return Blob();
+  }
+  return id;
+}
+
+static std::string idString(const Blob &_id)
+{
+  return std::string(reinterpret_cast<const char *>(_id.data()), _id.size());
+}
+
+AES_GCM_Chunker::AES_GCM_Chunker(const AES_GCM_ChunkConfig &_config)
+  : cfg_(_config), maskSmall_(0), maskLarge_(0)
+{
+  U32 bits = 0;
+  while ((bits < 31) && ((1U << (bits + 1)) <= std::max(cfg_.avgSize, CHUNK_MIN_BYTES))) {
+    bits++;
+  }
+  cfg_.avgSize = 1U << bits;
+  cfg_.minSize = std::min(std::max(cfg_.minSize, CHUNK_MIN_BYTES), cfg_.avgSize);
+  cfg_.maxSize = std::max(cfg_.maxSize, cfg_.avgSize);
+  cfg_.threads = std::max(cfg_.threads, 1U);
+
+  // One more mask bit than the average before avgSize and one fewer after it
+  // (FastCDC normalization level 1). The top bits of the hash depend on the
+  // most recent 64 bytes.
+  maskSmall_ = ~0ULL << (64 - (bits + 1));
+  maskLarge_ = ~0ULL << (64 - (bits - 1));
+}
+
+const AES_GCM_ChunkConfig &AES_GCM_Chunker::config() const
+{
+  return cfg_;
+}
+
+U64 AES_GCM_Chunker::next(const Byte *_data, U64 _size) const
+{
+  if (_size <= cfg_.minSize) {
+    return _size;
+  }
+  const U64 *gear = gearTable().v;
+  U64 end = std::min(_size, (U64)cfg_.maxSize);
+  U64 normal = std::min(end, (U64)cfg_.avgSize);
+  U64 fp = 0;
+  U64 i = cfg_.minSize;
+  for (; i < normal; i++) {
+    fp = (fp << 1) + gear[_data[i]];
+    if ((fp & maskSmall_) == 0) {
+      return i + 1;
+    }
+  }
+  for (; i < end; i++) {
+    fp = (fp << 1) + gear[_data[i]];
+    if ((fp & maskLarge_) == 0) {
+      return i + 1;
+    }
+  }
+  return end;
+}
+
+namespace {
+
+// A chunk between the boundary finder and the workers
+struct Slot
+{
+  U64            offset;
+  U32            size;
+  Blob           id;
+  Blob           ctxt;
+  bool           reused;
+  AES_GCM_STATUS status;
+};
+
+} // namespace
+
+static void encryptChunk(AES_GCM_Key &_key, HMAC_SHA256 &_mac, const Byte *_ptxt,
+  const std::unordered_set<std::string> &_previous, Slot &_slot)
+{
+  _slot.id = chunkID(_mac, _ptxt + _slot.offset, _slot.size);
+  if (_slot.id.size() == 0) {
+    _slot.status = AES_GCM_STATUS::ENC_ERROR;
+    return;
+  }
+  if (_previous.count(idString(_slot.id)) != 0) {
+    _slot.reused = true;
+    return;
+  }
+  MutableBlob ctxt(_slot.size + AES_GCM_CHUNK_TAG_BYTES);
+  _slot.status = _key.encrypt(ctxt.data(), ctxt.data() + _slot.size,
+    AES_GCM_CHUNK_TAG_BYTES, _slot.id.data(), AES_GCM_BLOCKSIZE_BYTES, _slot.id.data(),
+    AES_GCM_CHUNK_ID_BYTES, _ptxt + _slot.offset, _slot.size);
+  _slot.ctxt = ctxt;
+}
+
+AES_GCM_Chunked_Enc::AES_GCM_Chunked_Enc(const AES_GCM_ChunkConfig &_config)
+  : chunker_(_config), idKey_(), ptxt_(), keys_(), previous_(), manifest_(), reused_(0)
+{
+  for (U32 i = 0; i < chunker_.config().threads; i++) {
+    keys_.push_back(make_unique<AES_GCM_Key>());
+  }
+}
+
+AES_GCM_STATUS AES_GCM_Chunked_Enc::keyIs(const Blob &_key)
+{
+  U64 size = _key.size();
+  if ((size != AES_GCM_KEYSIZE_256) && (size != AES_GCM_KEYSIZE_128) &&
+    (size != AES_GCM_KEYSIZE_192)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  Blob encKey = subkey(_key, "bae chunk key");
+  Blob idKey = subkey(_key, "bae chunk id");
+  if ((encKey.size() == 0) || (idKey.size() == 0)) {
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+  for (std::unique_ptr<AES_GCM_Key> &key : keys_) {
+    AES_GCM_STATUS status = key->keyIs(encKey);
+    if (status != AES_GCM_STATUS::VALID) {
+      return status;
+    }
+  }
+  idKey_ = idKey;
+  return AES_GCM_STATUS::VALID;
+}
+
+void AES_GCM_Chunked_Enc::plaintextIs(const Blob &_plaintext)
+{
+  ptxt_ = _plaintext;
+}
+
+void AES_GCM_Chunked_Enc::previousIs(const std::vector<AES_GCM_ChunkRef> &_previous)
+{
+  previous_.clear();
+  for (const AES_GCM_ChunkRef &ref : _previous) {
+    previous_.insert(idString(ref.id));
+  }
+}
+
+const std::vector<AES_GCM_ChunkRef> &AES_GCM_Chunked_Enc::manifest() const
+{
+  return manifest_;
+}
+
+U64 AES_GCM_Chunked_Enc::chunksReused() const
+{
+  return reused_;
+}
+
+std::unique_ptr<AES_GCM_Result> AES_GCM_Chunked_Enc::ciphertext(
+  std::vector<AES_GCM_Chunk> &_chunks)
+{
+  _chunks.clear();
+  manifest_.clear();
+  reused_ = 0;
+  if (idKey_.size() == 0) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::INVALID_KEY);
+  }
+
+  // The calling thread publishes boundaries; workers (and then the calling
+  // thread) hash and encrypt them. Deque elements stay put as it grows.
+  std::deque<Slot> slots;
+  size_t next = 0;
+  bool done = false;
+  std::mutex mux;
+  std::condition_variable ready;
+  const Byte *ptxt = ptxt_.data();
+  auto work = [&](AES_GCM_Key *_key) {
+    unique_ptr<HMAC_SHA256> mac = idMAC(idKey_);
+    for (;;) {
+      Slot *slot = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(mux);
+        ready.wait(lock, [&]() { return (next < slots.size()) || done; });
+        if (next == slots.size()) {
+          return;
+        }
+        slot = &slots[next++];
+      }
+      if (mac) {
+        encryptChunk(*_key, *mac, ptxt, previous_, *slot);
+      }
+      else {
+        slot->status = AES_GCM_STATUS::ENC_ERROR;
+      }
+    }
+  };
+  std::vector<std::future<void>> workers;
+  for (size_t i = 1; i < keys_.size(); i++) {
+    workers.push_back(std::async(std::launch::async, work, keys_[i].get()));
+  }
+  for (U64 offset = 0; offset < ptxt_.size();) {
+    U64 size = chunker_.next(ptxt + offset, ptxt_.size() - offset);
+    {
+      std::lock_guard<std::mutex> lock(mux);
+      slots.push_back(Slot{offset, (U32)size, Blob(), Blob(), false, AES_GCM_STATUS::VALID});
+    }
+    ready.notify_one();
+    offset += size;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mux);
+    done = true;
+  }
+  ready.notify_all();
+  work(keys_[0].get());
+  for (std::future<void> &worker : workers) {
+    worker.get();
+  }
+
+  // Collect the manifest and the chunks to store, each new ID once
+  std::unordered_set<std::string> emitted;
+  for (Slot &slot : slots) {
+    if (slot.status != AES_GCM_STATUS::VALID) {
+      _chunks.clear();
+      manifest_.clear();
+      return make_unique<AES_GCM_Result>(Blob(), slot.status);
+    }
+    manifest_.push_back(AES_GCM_ChunkRef{slot.id, slot.offset, slot.size});
+    if (slot.reused) {
+      reused_++;
+    }
+    else if (emitted.insert(idString(slot.id)).second) {
+      _chunks.push_back(AES_GCM_Chunk{manifest_.size() - 1, slot.id, slot.ctxt});
+    }
+  }
+
+  U64 ptxtSize = 8 + manifest_.size() * MANIFEST_ENTRY_BYTES;
+  MutableBlob mptxt(ptxtSize);
+  storeBE64(mptxt.data(), manifest_.size());
+  Byte *entry = mptxt.data() + 8;
+  for (const AES_GCM_ChunkRef &ref : manifest_) {
+    memcpy(entry, ref.id.data(), AES_GCM_CHUNK_ID_BYTES);
+    storeBE32(entry + AES_GCM_CHUNK_ID_BYTES, ref.size);
+    entry += MANIFEST_ENTRY_BYTES;
+  }
+  MutableBlob out(AES_GCM_BLOCKSIZE_BYTES + ptxtSize + AES_GCM_CHUNK_TAG_BYTES);
+  MutableBlob iv(AES_GCM_BLOCKSIZE_BYTES);
+  randomize(iv);
+  memcpy(out.data(), iv.data(), AES_GCM_BLOCKSIZE_BYTES);
+  AES_GCM_STATUS status = keys_[0]->encrypt(out.data() + AES_GCM_BLOCKSIZE_BYTES,
+    out.data() + AES_GCM_BLOCKSIZE_BYTES + ptxtSize, AES_GCM_CHUNK_TAG_BYTES, iv.data(),
+    AES_GCM_BLOCKSIZE_BYTES, iv.data(), AES_GCM_BLOCKSIZE_BYTES, mptxt.data(), ptxtSize);
+  if (status != AES_GCM_STATUS::VALID) {
+    _chunks.clear();
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  return make_unique<AES_GCM_Result>(out, AES_GCM_STATUS::VALID);
+}
+
+AES_GCM_Chunked_Dec::AES_GCM_Chunked_Dec()
+  : idKey_(), key_(), manifest_()
+{
+  // empty
+}
+
+AES_GCM_STATUS AES_GCM_Chunked_Dec::keyIs(const Blob &_key)
+{
+  U64 size = _key.size();
+  if ((size != AES_GCM_KEYSIZE_256) && (size != AES_GCM_KEYSIZE_128) &&
+    (size != AES_GCM_KEYSIZE_192)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  Blob encKey = subkey(_key, "bae chunk key");
+  Blob idKey = subkey(_key, "bae chunk id");
+  if ((encKey.size() == 0) || (idKey.size() == 0)) {
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+  AES_GCM_STATUS status = key_.keyIs(encKey);
+  if (status == AES_GCM_STATUS::VALID) {
+    idKey_ = idKey;
+  }
+  return status;
+}
+
+AES_GCM_STATUS AES_GCM_Chunked_Dec::manifestIs(const Blob &_ciphertext)
+{
+  manifest_.clear();
+  if (idKey_.size() == 0) {
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+  U64 overhead = AES_GCM_BLOCKSIZE_BYTES + AES_GCM_CHUNK_TAG_BYTES;
+  if (_ciphertext.size() < overhead + 8) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  U64 ptxtSize = _ciphertext.size() - overhead;
+  const Byte *iv = _ciphertext.data();
+  MutableBlob mptxt(ptxtSize);
+  AES_GCM_STATUS status = key_.decrypt(mptxt.data(),
+    iv + AES_GCM_BLOCKSIZE_BYTES + ptxtSize, AES_GCM_CHUNK_TAG_BYTES, iv,
+    AES_GCM_BLOCKSIZE_BYTES, iv, AES_GCM_BLOCKSIZE_BYTES, iv + AES_GCM_BLOCKSIZE_BYTES,
+    ptxtSize);
+  if (status != AES_GCM_STATUS::VALID) {
+    return status;
+  }
+  U64 count = loadBE64(mptxt.data());
+  if ((count > ptxtSize / MANIFEST_ENTRY_BYTES) ||
+    (ptxtSize != 8 + count * MANIFEST_ENTRY_BYTES)) {
+    return AES_GCM_STATUS::DEC_ERROR;
+  }
+  const Byte *entry = mptxt.data() + 8;
+  U64 offset = 0;
+  for (U64 i = 0; i < count; i++) {
+    U32 size = loadBE32(entry + AES_GCM_CHUNK_ID_BYTES);
+    manifest_.push_back(AES_GCM_ChunkRef{Blob(mptxt, AES_GCM_CHUNK_ID_BYTES,
+      8 + i * MANIFEST_ENTRY_BYTES), offset, size});
+    offset += size;
+    entry += MANIFEST_ENTRY_BYTES;
+  }
+  return AES_GCM_STATUS::VALID;
+}
+
+const std::vector<AES_GCM_ChunkRef> &AES_GCM_Chunked_Dec::manifest() const
+{
+  return manifest_;
+}
+
+std::unique_ptr<AES_GCM_Result> AES_GCM_Chunked_Dec::chunk(U64 _index, const Blob &_ciphertext)
+{
+  if ((_index >= manifest_.size()) ||
+    (_ciphertext.size() != manifest_[_index].size + AES_GCM_CHUNK_TAG_BYTES)) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::INVALID_SIZE);
+  }
+  const AES_GCM_ChunkRef &ref = manifest_[_index];
+  MutableBlob ptxt(ref.size);
+  AES_GCM_STATUS status = key_.decrypt(ptxt.data(), _ciphertext.data() + ref.size,
+    AES_GCM_CHUNK_TAG_BYTES, ref.id.data(), AES_GCM_BLOCKSIZE_BYTES, ref.id.data(),
+    AES_GCM_CHUNK_ID_BYTES, _ciphertext.data(), ref.size);
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+
+  // The tag binds the ciphertext to the ID; this binds the ID to the content
+  unique_ptr<HMAC_SHA256> mac = idMAC(idKey_);
+  Blob id = mac ? chunkID(*mac, ptxt.data(), ref.size) : Blob();
+  if ((id.size() == 0) || id.compare(ref.id, Blob::CompareType::CONST) != Blob::Comparison::EQ) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::DEC_ERROR);
+  }
+  return make_unique<AES_GCM_Result>(ptxt, AES_GCM_STATUS::VALID);
+}
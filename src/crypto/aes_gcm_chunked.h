@@ -0,0 +1,139 @@
+#ifndef CRYPTO_AES_GCM_CHUNKED_H
+#define CRYPTO_AES_GCM_CHUNKED_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace Crypto {
+
+static const U32 AES_GCM_CHUNK_ID_BYTES = 32;
+static const U32 AES_GCM_CHUNK_TAG_BYTES = 16;
+
+// Content-defined chunk sizes. avgSize is rounded down to a power of two and
+// sizes are clamped so that 64 <= minSize <= avgSize <= maxSize. 'threads' is
+// the number of chunks hashed and encrypted concurrently.
+struct AES_GCM_ChunkConfig
+{
+  U32 minSize;
+  U32 avgSize;
+  U32 maxSize;
+  U32 threads;
+};
+
+static const AES_GCM_ChunkConfig AES_GCM_CHUNK_CONFIG_DEFAULT = {2048, 8192, 65536, 4};
+
+// FastCDC-style chunker: a gear rolling hash over each byte, with the first
+// minSize bytes of a chunk skipped and a stricter cut mask before avgSize than
+// after it, so chunk sizes cluster around avgSize. Boundaries depend only on
+// nearby content, so an edit moves at most the chunks around it. The gear
+// table is fixed; changing it would change every boundary (and chunk ID).
+class AES_GCM_Chunker
+{
+ public:
+  AES_GCM_Chunker(const AES_GCM_ChunkConfig &config = AES_GCM_CHUNK_CONFIG_DEFAULT);
+  const AES_GCM_ChunkConfig &config() const;
+
+  // Length of the chunk starting at 'data'
+  U64 next(const Byte *data, U64 size) const;
+
+ private:
+  AES_GCM_ChunkConfig cfg_;
+  U64 maskSmall_;
+  U64 maskLarge_;
+};
+
+// One chunk of a manifest. Offsets follow from the sizes of earlier chunks.
+struct AES_GCM_ChunkRef
+{
+  Util::Blob id;
+  U64        offset;
+  U32        size;
+};
+
+// A chunk that has to be stored: | ciphertext (size) | tag (16) |
+struct AES_GCM_Chunk
+{
+  U64        index;
+  Util::Blob id;
+  Util::Blob ciphertext;
+};
+
+// Incremental encryption of large, slowly changing inputs (e.g. snapshots).
+// The input is split by AES_GCM_Chunker and each chunk is encrypted on its
+// own under a key derived from the one given to keyIs():
+//
+//   id = HMAC-SHA256(id key, chunk), IV = id[0, 16), AAD = id
+//
+// Identical chunks therefore have identical IDs and ciphertexts, and a chunk
+// whose ID appears in the previous manifest is neither re-encrypted nor
+// emitted. Since IVs are a keyed hash of the content they repeat only when
+// the content does; the price is that equal chunks are visible as such.
+//
+// ciphertext() returns the encrypted manifest (see AES_GCM_Chunked_Dec) and
+// fills 'chunks' with the chunks to store, in input order and once per ID.
+// Hashing and encryption run on config().threads key contexts while the
+// calling thread finds boundaries. Not thread-safe.
+class AES_GCM_Chunked_Enc
+{
+ public:
+  AES_GCM_Chunked_Enc(const AES_GCM_ChunkConfig &config = AES_GCM_CHUNK_CONFIG_DEFAULT);
+  AES_GCM_Chunked_Enc(const AES_GCM_Chunked_Enc &) = delete;
+  AES_GCM_Chunked_Enc &operator=(const AES_GCM_Chunked_Enc &) = delete;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+  void plaintextIs(const Util::Blob &plaintext);
+
+  // Chunks already stored, typically AES_GCM_Chunked_Dec::manifest() of the
+  // previous run
+  void previousIs(const std::vector<AES_GCM_ChunkRef> &previous);
+  std::unique_ptr<AES_GCM_Result> ciphertext(std::vector<AES_GCM_Chunk> &chunks);
+
+  // The manifest of the last ciphertext() call
+  const std::vector<AES_GCM_ChunkRef> &manifest() const;
+  U64 chunksReused() const;
+
+ private:
+  AES_GCM_Chunker chunker_;
+  Util::Blob idKey_;
+  Util::Blob ptxt_;
+  std::vector<std::unique_ptr<AES_GCM_Key>> keys_;
+  std::unordered_set<std::string> previous_;
+  std::vector<AES_GCM_ChunkRef> manifest_;
+  U64 reused_;
+};
+
+// Reads chunked ciphertext. The manifest plaintext is
+//
+//   | chunk count (8) | (| id (32) | size (4) |) * count |
+//
+// sealed as | IV (16) | ciphertext | tag (16) | with the IV as AAD.
+class AES_GCM_Chunked_Dec
+{
+ public:
+  AES_GCM_Chunked_Dec();
+  AES_GCM_Chunked_Dec(const AES_GCM_Chunked_Dec &) = delete;
+  AES_GCM_Chunked_Dec &operator=(const AES_GCM_Chunked_Dec &) = delete;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+
+  // Decrypts and parses an encrypted manifest
+  AES_GCM_STATUS manifestIs(const Util::Blob &ciphertext);
+  const std::vector<AES_GCM_ChunkRef> &manifest() const;
+
+  // Decrypts a stored chunk of the manifest and checks that its content
+  // matches its ID
+  std::unique_ptr<AES_GCM_Result> chunk(U64 index, const Util::Blob &ciphertext);
+
+ private:
+  Util::Blob idKey_;
+  AES_GCM_Key key_;
+  std::vector<AES_GCM_ChunkRef> manifest_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_CHUNKED_H
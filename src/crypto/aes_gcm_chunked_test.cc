@@ -0,0 +1,128 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_chunked.h"
+#include "crypto/random.h"
+#include <cstring>
+#include <map>
+#include <string>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+typedef std::map<std::string, Blob> ChunkStore;
+
+static void store(ChunkStore &_store, const std::vector<AES_GCM_Chunk> &_chunks)
+{
+  for (const AES_GCM_Chunk &c : _chunks) {
+    _store[std::string((const char *)c.id.data(), c.id.size())] = c.ciphertext;
+  }
+}
+
+static Blob restore(AES_GCM_Chunked_Dec &_dec, const ChunkStore &_store)
+{
+  std::string out;
+  for (U64 i = 0; i < _dec.manifest().size(); i++) {
+    const Blob &id = _dec.manifest()[i].id;
+    const Blob &ctxt = _store.at(std::string((const char *)id.data(), id.size()));
+    unique_ptr<AES_GCM_Result> r = _dec.chunk(i, ctxt);
+    EXPECT_EQ(r->second, AES_GCM_STATUS::VALID);
+    out.append((const char *)r->first.data(), r->first.size());
+  }
+  return Blob(out);
+}
+
+TEST(AES_GCM_ChunkedTest, Chunker) {
+  AES_GCM_ChunkConfig cfg = {1000, 5000, 20000, 1};
+  AES_GCM_Chunker chunker(cfg);
+  EXPECT_EQ(chunker.config().avgSize, 4096U);
+  EXPECT_EQ(chunker.config().minSize, 1000U);
+
+  unique_ptr<Blob> data = random(1 << 20);
+  U64 count = 0;
+  for (U64 offset = 0; offset < data->size(); count++) {
+    U64 size = chunker.next(data->data() + offset, data->size() - offset);
+    if (offset + size < data->size()) {
+      EXPECT_GE(size, 1000U);
+    }
+    EXPECT_LE(size, 20000U);
+    offset += size;
+  }
+  // Sizes cluster around the average
+  EXPECT_GT(count, (1U << 20) / 8192);
+  EXPECT_LT(count, (1U << 20) / 2048);
+}
+
+TEST(AES_GCM_ChunkedTest, Sanity) {
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_256);
+  AES_GCM_Chunked_Enc enc;
+  std::vector<AES_GCM_Chunk> chunks;
+  EXPECT_EQ(enc.ciphertext(chunks)->second, AES_GCM_STATUS::INVALID_KEY);
+  EXPECT_EQ(enc.keyIs(*key), AES_GCM_STATUS::VALID);
+  unique_ptr<Blob> pt = random(1 << 20);
+  enc.plaintextIs(*pt);
+  unique_ptr<AES_GCM_Result> manifest = enc.ciphertext(chunks);
+  EXPECT_EQ(manifest->second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(chunks.size(), enc.manifest().size());
+  EXPECT_EQ(enc.chunksReused(), 0U);
+
+  AES_GCM_Chunked_Dec dec;
+  EXPECT_EQ(dec.keyIs(*key), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(dec.manifestIs(manifest->first), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(dec.manifest().size(), chunks.size());
+  ChunkStore chunkStore;
+  store(chunkStore, chunks);
+  EXPECT_EQ(restore(dec, chunkStore), *pt);
+
+  // A chunk stored under another chunk's ID fails
+  EXPECT_NE(dec.chunk(0, chunks[1].ciphertext)->second, AES_GCM_STATUS::VALID);
+  MutableBlob bad(chunks[0].ciphertext);
+  bad.data()[3] ^= 1;
+  EXPECT_EQ(dec.chunk(0, bad)->second, AES_GCM_STATUS::DEC_ERROR);
+
+  // Another key
+  AES_GCM_Chunked_Dec other;
+  other.keyIs(*random(AES_GCM_KEYSIZE_256));
+  EXPECT_EQ(other.manifestIs(manifest->first), AES_GCM_STATUS::DEC_ERROR);
+}
+
+TEST(AES_GCM_ChunkedTest, Incremental) {
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_128);
+  unique_ptr<Blob> pt = random(4 << 20);
+  AES_GCM_Chunked_Enc enc;
+  enc.keyIs(*key);
+  enc.plaintextIs(*pt);
+  std::vector<AES_GCM_Chunk> first;
+  EXPECT_EQ(enc.ciphertext(first)->second, AES_GCM_STATUS::VALID);
+  std::vector<AES_GCM_ChunkRef> previous = enc.manifest();
+  ChunkStore chunkStore;
+  store(chunkStore, first);
+
+  // Insert a few bytes in the middle and overwrite some near the end: only
+  // the chunks around each edit change
+  std::string edited((const char *)pt->data(), pt->size());
+  edited.insert(1 << 20, "inserted");
+  memset(&edited[3 << 20], 'x', 100);
+  enc.previousIs(previous);
+  enc.plaintextIs(Blob(edited));
+  std::vector<AES_GCM_Chunk> second;
+  unique_ptr<AES_GCM_Result> manifest = enc.ciphertext(second);
+  EXPECT_EQ(manifest->second, AES_GCM_STATUS::VALID);
+  EXPECT_GE(second.size(), 2U);
+  EXPECT_LE(second.size(), 6U);
+  EXPECT_EQ(enc.chunksReused() + second.size(), enc.manifest().size());
+  store(chunkStore, second);
+
+  AES_GCM_Chunked_Dec dec;
+  dec.keyIs(*key);
+  EXPECT_EQ(dec.manifestIs(manifest->first), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(restore(dec, chunkStore), Blob(edited));
+
+  // Repeated content is stored once
+  std::string twice = edited + edited;
+  enc.previousIs(std::vector<AES_GCM_ChunkRef>());
+  enc.plaintextIs(Blob(twice));
+  std::vector<AES_GCM_Chunk> third;
+  EXPECT_EQ(enc.ciphertext(third)->second, AES_GCM_STATUS::VALID);
+  EXPECT_LT(third.size(), enc.manifest().size() * 2 / 3);
+}
@@ -0,0 +1,107 @@
+#include "crypto/aes_gcm_counter.h"
+#include "crypto/byte_order.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+using namespace Crypto;
+using std::string;
+
+static const U64 HIGH_WATER_BYTES = 8;
+
+AES_GCM_CounterAllocator::AES_GCM_CounterAllocator(U64 _rangeSize, U32 _rangesPerSync)
+  : rangeSize_((_rangeSize == 0) ? 1 : _rangeSize),
+  rangesPerSync_((_rangesPerSync == 0) ? 1 : _rangesPerSync), next_(0), fd_(-1),
+  reservedEnd_(0), mux_()
+{
+  // empty
+}
+
+AES_GCM_CounterAllocator::~AES_GCM_CounterAllocator()
+{
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+U64 AES_GCM_CounterAllocator::rangeSize() const
+{
+  return rangeSize_;
+}
+
+AES_GCM_STATUS AES_GCM_CounterAllocator::fileIs(const string &_path)
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  int fd = open(_path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    return AES_GCM_STATUS::IO_ERROR;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = fd;
+
+  // Nothing handed out so far is covered by the file: start a fresh block
+  reservedEnd_ = 0;
+  next_.store(0);
+  return reserve();
+}
+
+AES_GCM_STATUS AES_GCM_CounterAllocator::lease(U64 &_first)
+{
+  if (fd_ < 0) {
+    // In-process: one CAS, refusing to wrap around into used counters
+    U64 first = next_.load();
+    do {
+      if (first > ~(U64)0 - rangeSize_) {
+        return AES_GCM_STATUS::ENC_ERROR;
+      }
+    } while (!next_.compare_exchange_weak(first, first + rangeSize_));
+    _first = first;
+    return AES_GCM_STATUS::VALID;
+  }
+
+  std::lock_guard<std::mutex> lock(mux_);
+  U64 first = next_.load();
+  if (first + rangeSize_ > reservedEnd_) {
+    AES_GCM_STATUS status = reserve();
+    if (status != AES_GCM_STATUS::VALID) {
+      return status;
+    }
+    first = next_.load();
+  }
+  next_.store(first + rangeSize_);
+  _first = first;
+  return AES_GCM_STATUS::VALID;
+}
+
+AES_GCM_STATUS AES_GCM_CounterAllocator::reserve()
+{
+  // Called with mux_ held and a lease file open
+  if (flock(fd_, LOCK_EX) != 0) {
+    return AES_GCM_STATUS::IO_ERROR;
+  }
+  Byte mark[HIGH_WATER_BYTES] = {0};
+  ssize_t n = pread(fd_, mark, sizeof(mark), 0);
+  U64 highWater = (n == (ssize_t)sizeof(mark)) ? loadBE64(mark) : 0;
+  U64 block = rangeSize_ * rangesPerSync_;
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  if ((n != 0) && (n != (ssize_t)sizeof(mark))) {
+    status = AES_GCM_STATUS::IO_ERROR;
+  }
+  else if (highWater > ~(U64)0 - block) {
+    status = AES_GCM_STATUS::ENC_ERROR;
+  }
+  else {
+    storeBE64(mark, highWater + block);
+    if ((pwrite(fd_, mark, sizeof(mark), 0) != (ssize_t)sizeof(mark)) || (fsync(fd_) != 0)) {
+      status = AES_GCM_STATUS::IO_ERROR;
+    }
+    else {
+      next_.store(highWater);
+      reservedEnd_ = highWater + block;
+    }
+  }
+  flock(fd_, LOCK_UN);
+  return status;
+}
@@ -0,0 +1,54 @@
+#ifndef CRYPTO_AES_GCM_COUNTER_H
+#define CRYPTO_AES_GCM_COUNTER_H
+
+#include "crypto/aes_gcm.h"
+#include "util/fixed_types.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace Crypto {
+
+static const U64 AES_GCM_COUNTER_RANGE_DEFAULT = 1ULL << 20;
+static const U32 AES_GCM_COUNTER_RANGES_PER_SYNC_DEFAULT = 16;
+
+// Hands out disjoint ranges of message counters for one key, so any number
+// of COUNTER mode encryptors can share the key and mint IVs from their own
+// range without coordinating per message (see AES_GCM_Enc::counterAllocatorIs).
+//
+// By default ranges come from an in-process atomic. With fileIs(), the
+// high-water mark is kept in a small lease file: reservations take an
+// exclusive flock(), advance the mark by rangesPerSync ranges and fsync()
+// before any of them is used, so processes sharing the file and restarts
+// never reuse a counter. Ranges reserved but unused at exit are skipped.
+// Thread-safe.
+class AES_GCM_CounterAllocator
+{
+ public:
+  AES_GCM_CounterAllocator(U64 rangeSize = AES_GCM_COUNTER_RANGE_DEFAULT,
+    U32 rangesPerSync = AES_GCM_COUNTER_RANGES_PER_SYNC_DEFAULT);
+  AES_GCM_CounterAllocator(const AES_GCM_CounterAllocator &) = delete;
+  AES_GCM_CounterAllocator &operator=(const AES_GCM_CounterAllocator &) = delete;
+  ~AES_GCM_CounterAllocator();
+  U64 rangeSize() const;
+
+  // Persists the high-water mark in 'path', created if missing. Call before
+  // the allocator is shared.
+  AES_GCM_STATUS fileIs(const std::string &path);
+
+  // Reserves [first, first + rangeSize())
+  AES_GCM_STATUS lease(U64 &first);
+
+ private:
+  AES_GCM_STATUS reserve();
+  const U64 rangeSize_;
+  const U32 rangesPerSync_;
+  std::atomic<U64> next_;
+  int fd_;
+  U64 reservedEnd_;
+  std::mutex mux_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_COUNTER_H
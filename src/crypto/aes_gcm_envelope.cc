@@ -0,0 +1,262 @@
+#include "crypto/aes_gcm_envelope.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include "util/make_unique.h"
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using Util::make_unique;
+
+// Offsets within the envelope header
+static const U32 WRAP_IV_OFFSET = AES_GCM_KEYID_BYTES;
+static const U32 WRAP_DEK_OFFSET = WRAP_IV_OFFSET + AES_GCM_BLOCKSIZE_BYTES;
+static const U32 WRAP_TAG_OFFSET = WRAP_DEK_OFFSET + AES_GCM_ENVELOPE_DEK_BYTES;
+
+// Wraps 'dek' under the primary KEK into the first AES_GCM_ENVELOPE_HEADER_BYTES
+// of 'header'
+static AES_GCM_STATUS wrapDEK(AES_GCM_Keyring_Contexts &_keks, const Byte *_dek,
+  Byte *_header)
+{
+  AES_GCM_KeyId id = 0;
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  AES_GCM_Key *kek = _keks.primary(id, status);
+  if (kek == nullptr) {
+    return status;
+  }
+  storeBE32(_header, id);
+  randomize(_header + WRAP_IV_OFFSET, AES_GCM_BLOCKSIZE_BYTES);
+  return kek->encrypt(_header + WRAP_DEK_OFFSET, _header + WRAP_TAG_OFFSET,
+    AES_GCM_BLOCKSIZE_BYTES, _header + WRAP_IV_OFFSET, AES_GCM_BLOCKSIZE_BYTES, _header,
+    WRAP_DEK_OFFSET, _dek, AES_GCM_ENVELOPE_DEK_BYTES);
+}
+
+// Recovers the DEK from a header
+static AES_GCM_STATUS unwrapDEK(AES_GCM_Keyring_Contexts &_keks, const Byte *_header,
+  MutableBlob &_dek)
+{
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  AES_GCM_Key *kek = _keks.key(loadBE32(_header), status);
+  if (kek == nullptr) {
+    return status;
+  }
+  return kek->decrypt(_dek.data(), _header + WRAP_TAG_OFFSET, AES_GCM_BLOCKSIZE_BYTES,
+    _header + WRAP_IV_OFFSET, AES_GCM_BLOCKSIZE_BYTES, _header, WRAP_DEK_OFFSET,
+    _header + WRAP_DEK_OFFSET, AES_GCM_ENVELOPE_DEK_BYTES);
+}
+
+AES_GCM_STATUS Crypto::AES_GCM_Envelope_PasswordKEK(AES_GCM_Keyring &_keks,
+  AES_GCM_KeyId _id, const Blob &_password, const Blob &_salt, PBKD_Iters _iterations)
+{
+  unique_ptr<Blob> kek = PBKDF2_SHA256(AES_GCM_KEYSIZE_256, _password, _salt, _iterations);
+  if (!kek) {
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+  return _keks.keyIs(_id, *kek);
+}
+
+unique_ptr<AES_GCM_Result> Crypto::AES_GCM_Envelope_Rewrap(AES_GCM_Keyring_Contexts &_keks,
+  const Blob &_envelope)
+{
+  if (_envelope.size() < AES_GCM_ENVELOPE_HEADER_BYTES) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::INVALID_SIZE);
+  }
+  MutableBlob dek(AES_GCM_ENVELOPE_DEK_BYTES, Blob::ScrubType::ZEROS);
+  AES_GCM_STATUS status = unwrapDEK(_keks, _envelope.data(), dek);
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  MutableBlob header(AES_GCM_ENVELOPE_HEADER_BYTES);
+  status = wrapDEK(_keks, dek.data(), header.data());
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  return make_unique<AES_GCM_Result>(header, AES_GCM_STATUS::VALID);
+}
+
+
+/*** ENCRYPTION ***/
+
+AES_GCM_Envelope_Enc::AES_GCM_Envelope_Enc(const AES_GCM_Keyring &_keks,
+  AES_GCM_TAGSIZE _tagSize)
+  : tagSize_(AES_GCM_Tagsize(_tagSize)), aad_(), ptxt_(), keks_(_keks), dek_()
+{
+  // empty
+}
+
+void AES_GCM_Envelope_Enc::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+}
+
+void AES_GCM_Envelope_Enc::plaintextIs(const Blob &_plaintext)
+{
+  ptxt_ = _plaintext;
+}
+
+unique_ptr<AES_GCM_Result> AES_GCM_Envelope_Enc::ciphertext()
+{
+  U64 ptxtSize = ptxt_.size();
+  MutableBlob mctxt(AES_GCM_ENVELOPE_HEADER_BYTES + AES_GCM_BLOCKSIZE_BYTES + ptxtSize +
+    tagSize_);
+  Byte *header = mctxt.data();
+  Byte *iv = header + AES_GCM_ENVELOPE_HEADER_BYTES;
+  Byte *body = iv + AES_GCM_BLOCKSIZE_BYTES;
+
+  // A fresh data key for every object
+  MutableBlob dek(AES_GCM_ENVELOPE_DEK_BYTES, Blob::ScrubType::ZEROS);
+  randomize(dek.data(), dek.size());
+  AES_GCM_STATUS status = wrapDEK(keks_, dek.data(), header);
+  if (status == AES_GCM_STATUS::VALID) {
+    status = dek_.keyIs(dek);
+  }
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+
+  // The payload authenticates its IV and the caller's AAD, but not the
+  // header, so that the header can be rewrapped independently
+  randomize(iv, AES_GCM_BLOCKSIZE_BYTES);
+  MutableBlob aad(AES_GCM_BLOCKSIZE_BYTES + aad_.size());
+  memcpy(aad.data(), iv, AES_GCM_BLOCKSIZE_BYTES);
+  memcpy(aad.data() + AES_GCM_BLOCKSIZE_BYTES, aad_.data(), aad_.size());
+  status = dek_.encrypt(body, body + ptxtSize, tagSize_, iv, AES_GCM_BLOCKSIZE_BYTES,
+    aad.data(), aad.size(), ptxt_.data(), ptxtSize);
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  return make_unique<AES_GCM_Result>(mctxt, AES_GCM_STATUS::VALID);
+}
+
+
+/*** DECRYPTION ***/
+
+AES_GCM_Envelope_Dec::AES_GCM_Envelope_Dec(const AES_GCM_Keyring &_keks,
+  AES_GCM_TAGSIZE _tagSize, U32 _cacheSize)
+  : tagSize_(AES_GCM_Tagsize(_tagSize)), cacheSize_(_cacheSize), aad_(), ctxt_(),
+  ptxt_(Blob(), AES_GCM_STATUS::DEC_ERROR), keks_(_keks), cache_(), cacheIndex_(),
+  hits_(0), misses_(0), needsDecrypt_(false), mutableMux_()
+{
+  // empty
+}
+
+void AES_GCM_Envelope_Dec::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+  needsDecrypt_ = true;
+}
+
+void AES_GCM_Envelope_Dec::ciphertextIs(const Blob &_ciphertext)
+{
+  ctxt_ = _ciphertext;
+  needsDecrypt_ = true;
+}
+
+const AES_GCM_Result &AES_GCM_Envelope_Dec::plaintext() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  if (needsDecrypt_) {
+    decrypt();
+  }
+  return ptxt_;
+}
+
+U64 AES_GCM_Envelope_Dec::cacheHits() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  return hits_;
+}
+
+U64 AES_GCM_Envelope_Dec::cacheMisses() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  return misses_;
+}
+
+AES_GCM_Key *AES_GCM_Envelope_Dec::dek(AES_GCM_STATUS &_status) const
+{
+  const Byte *header = ctxt_.data();
+  AES_GCM_KeyId kekId = loadBE32(header);
+  const AES_GCM_Keyring::Snapshot &snapshot = keks_.keyring().snapshot();
+  auto kek = snapshot.entries.find(kekId);
+  if (kek == snapshot.entries.end()) {
+    _status = AES_GCM_STATUS::INVALID_KEY;
+    return nullptr;
+  }
+
+  // The wrapped form identifies the DEK; a hit is valid while the KEK that
+  // unwrapped it is unchanged
+  string wrapped((const char *)header, AES_GCM_ENVELOPE_HEADER_BYTES);
+  auto hit = cacheIndex_.find(wrapped);
+  if (hit != cacheIndex_.end()) {
+    if (hit->second->kek == kek->second) {
+      cache_.splice(cache_.begin(), cache_, hit->second);
+      hits_++;
+      _status = AES_GCM_STATUS::VALID;
+      return cache_.front().dek.get();
+    }
+    cache_.erase(hit->second);
+    cacheIndex_.erase(hit);
+  }
+  misses_++;
+
+  MutableBlob dekBytes(AES_GCM_ENVELOPE_DEK_BYTES, Blob::ScrubType::ZEROS);
+  _status = unwrapDEK(keks_, header, dekBytes);
+  if (_status != AES_GCM_STATUS::VALID) {
+    return nullptr;
+  }
+  unique_ptr<AES_GCM_Key> dek = make_unique<AES_GCM_Key>();
+  _status = dek->keyIs(dekBytes);
+  if (_status != AES_GCM_STATUS::VALID) {
+    return nullptr;
+  }
+  if (cacheSize_ == 0) {
+    // Caching disabled: keep only the most recent DEK alive
+    cache_.clear();
+    cacheIndex_.clear();
+  }
+  else if (cache_.size() >= cacheSize_) {
+    cacheIndex_.erase(cache_.back().wrapped);
+    cache_.pop_back();
+  }
+  cache_.push_front(CachedDEK{wrapped, kek->second, std::move(dek)});
+  if (cacheSize_ != 0) {
+    cacheIndex_[wrapped] = cache_.begin();
+  }
+  return cache_.front().dek.get();
+}
+
+void AES_GCM_Envelope_Dec::decrypt() const
+{
+  needsDecrypt_ = false;
+  ptxt_.first.dataIsNull();
+  U64 overhead = AES_GCM_ENVELOPE_HEADER_BYTES + AES_GCM_BLOCKSIZE_BYTES + tagSize_;
+  if (ctxt_.size() < overhead) {
+    ptxt_.second = AES_GCM_STATUS::INVALID_SIZE;
+    return;
+  }
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  AES_GCM_Key *dataKey = dek(status);
+  if (dataKey == nullptr) {
+    ptxt_.second = status;
+    return;
+  }
+
+  const Byte *iv = ctxt_.data() + AES_GCM_ENVELOPE_HEADER_BYTES;
+  const Byte *body = iv + AES_GCM_BLOCKSIZE_BYTES;
+  U64 ctxtSize = ctxt_.size() - overhead;
+  MutableBlob aad(AES_GCM_BLOCKSIZE_BYTES + aad_.size());
+  memcpy(aad.data(), iv, AES_GCM_BLOCKSIZE_BYTES);
+  memcpy(aad.data() + AES_GCM_BLOCKSIZE_BYTES, aad_.data(), aad_.size());
+  MutableBlob ptxt(ctxtSize, Blob::ScrubType::ZEROS);
+  status = dataKey->decrypt(ptxt.data(), body + ctxtSize, tagSize_, iv,
+    AES_GCM_BLOCKSIZE_BYTES, aad.data(), aad.size(), body, ctxtSize);
+  if (status == AES_GCM_STATUS::VALID) {
+    ptxt_.first = ptxt;
+  }
+  ptxt_.second = status;
+}
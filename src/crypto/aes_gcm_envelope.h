@@ -0,0 +1,109 @@
+#ifndef CRYPTO_AES_GCM_ENVELOPE_H
+#define CRYPTO_AES_GCM_ENVELOPE_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "crypto/aes_gcm_keyring.h"
+#include "crypto/pbkdf2_sha256.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Crypto {
+
+// Envelope encryption: every object is encrypted under its own random 256-bit
+// data key (DEK), and only the DEK is encrypted ("wrapped") under a
+// key-encryption key (KEK) taken from a keyring. The KEK may be any AES key,
+// including one derived once from a password with PBKDF2_SHA256 (see
+// AES_GCM_Envelope_PasswordKEK). Envelope layout:
+//
+//   | KEK ID (4) | wrap IV (16) | wrapped DEK (32) | wrap tag (16) |   header
+//   | IV (16) | ciphertext | tag |                                     payload
+//
+// The KEK ID and wrap IV are authenticated with the wrapped DEK, and the
+// payload IV and any caller AAD with the payload. The payload does not depend
+// on the header, so rotating the KEK only rewrites the 68-byte header (see
+// AES_GCM_Envelope_Rewrap).
+static const U32 AES_GCM_ENVELOPE_DEK_BYTES = AES_GCM_KEYSIZE_256;
+static const U32 AES_GCM_ENVELOPE_HEADER_BYTES = AES_GCM_KEYID_BYTES +
+  AES_GCM_BLOCKSIZE_BYTES + AES_GCM_ENVELOPE_DEK_BYTES + AES_GCM_BLOCKSIZE_BYTES;
+static const U32 AES_GCM_ENVELOPE_DEK_CACHE_DEFAULT = 1024;
+
+// Derives a KEK from a password once and adds it to the keyring
+AES_GCM_STATUS AES_GCM_Envelope_PasswordKEK(AES_GCM_Keyring &keks, AES_GCM_KeyId id,
+  const Util::Blob &password, const Util::Blob &salt, PBKD_Iters iterations);
+
+// Returns the header of 'envelope' (which may be the header alone) re-wrapped
+// under the keyring's primary KEK. The payload is unaffected and can stay where
+// it is. Reuse the same contexts across calls to rewrap many headers.
+std::unique_ptr<AES_GCM_Result> AES_GCM_Envelope_Rewrap(AES_GCM_Keyring_Contexts &keks,
+  const Util::Blob &envelope);
+
+class AES_GCM_Envelope_Enc
+{
+ public:
+  AES_GCM_Envelope_Enc(const AES_GCM_Keyring &keks,
+    AES_GCM_TAGSIZE tagSize = AES_GCM_TAGSIZE_DEFAULT);
+  AES_GCM_Envelope_Enc(const AES_GCM_Envelope_Enc &) = delete;
+  AES_GCM_Envelope_Enc &operator=(const AES_GCM_Envelope_Enc &) = delete;
+  void aadIs(const Util::Blob &aad);
+  void plaintextIs(const Util::Blob &plaintext);
+  std::unique_ptr<AES_GCM_Result> ciphertext();
+
+ private:
+  U32 tagSize_;
+  Util::Blob aad_;
+  Util::Blob ptxt_;
+  AES_GCM_Keyring_Contexts keks_;
+  AES_GCM_Key dek_;
+};
+
+// Unwrapped DEKs are kept (already expanded) in an LRU cache keyed by the
+// wrapped form, so repeated reads of a hot object skip the unwrap entirely.
+// A cached DEK is only used while its KEK is still in the keyring.
+class AES_GCM_Envelope_Dec
+{
+ public:
+  AES_GCM_Envelope_Dec(const AES_GCM_Keyring &keks,
+    AES_GCM_TAGSIZE tagSize = AES_GCM_TAGSIZE_DEFAULT,
+    U32 cacheSize = AES_GCM_ENVELOPE_DEK_CACHE_DEFAULT);
+  AES_GCM_Envelope_Dec(const AES_GCM_Envelope_Dec &) = delete;
+  AES_GCM_Envelope_Dec &operator=(const AES_GCM_Envelope_Dec &) = delete;
+  void aadIs(const Util::Blob &aad);
+  void ciphertextIs(const Util::Blob &ciphertext);
+  const AES_GCM_Result &plaintext() const;
+  U64 cacheHits() const;
+  U64 cacheMisses() const;
+
+ private:
+  struct CachedDEK
+  {
+    std::string wrapped;
+    std::shared_ptr<const AES_GCM_Keyring::Entry> kek;
+    std::unique_ptr<AES_GCM_Key> dek;
+  };
+  typedef std::list<CachedDEK> CacheList;
+
+  AES_GCM_Key *dek(AES_GCM_STATUS &status) const;
+  void decrypt() const;
+  U32 tagSize_;
+  U32 cacheSize_;
+  Util::Blob aad_;
+  Util::Blob ctxt_;
+  mutable AES_GCM_Result ptxt_;
+  mutable AES_GCM_Keyring_Contexts keks_;
+  mutable CacheList cache_;
+  mutable std::unordered_map<std::string, CacheList::iterator> cacheIndex_;
+  mutable U64 hits_;
+  mutable U64 misses_;
+  mutable bool needsDecrypt_;
+  mutable std::mutex mutableMux_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_ENVELOPE_H
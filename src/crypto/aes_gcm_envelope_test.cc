@@ -0,0 +1,88 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_envelope.h"
+#include "crypto/random.h"
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+static Blob pt("Envelope plaintext", 18);
+
+TEST(AES_GCM_EnvelopeTest, Sanity) {
+  AES_GCM_Keyring keks;
+  keks.keyIs(1, *random(AES_GCM_KEYSIZE_256));
+  keks.primaryIs(1);
+
+  AES_GCM_Envelope_Enc e(keks);
+  e.aadIs(Blob("object-1", 8));
+  e.plaintextIs(pt);
+  unique_ptr<AES_GCM_Result> eres = e.ciphertext();
+  EXPECT_EQ(eres->second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(eres->first.size(),
+    AES_GCM_ENVELOPE_HEADER_BYTES + AES_GCM_BLOCKSIZE_BYTES + pt.size() + 16);
+
+  // Each object has its own data key
+  unique_ptr<AES_GCM_Result> eres2 = e.ciphertext();
+  EXPECT_NE(Blob(eres->first, 68, 0), Blob(eres2->first, 68, 0));
+
+  AES_GCM_Envelope_Dec d(keks);
+  d.ciphertextIs(eres->first);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  d.aadIs(Blob("object-1", 8));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, pt);
+
+  // Corrupting the wrapped key fails
+  MutableBlob bad(eres->first);
+  bad.data()[30] ^= 0x01;
+  d.ciphertextIs(bad);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+}
+
+TEST(AES_GCM_EnvelopeTest, RewrapAndCache) {
+  // A password-derived master key
+  AES_GCM_Keyring keks;
+  EXPECT_EQ(AES_GCM_Envelope_PasswordKEK(keks, 1, Blob("master password", 15),
+    Blob("salt", 4), 1000), AES_GCM_STATUS::VALID);
+  keks.primaryIs(1);
+
+  AES_GCM_Envelope_Enc e(keks);
+  e.plaintextIs(pt);
+  Blob env = e.ciphertext()->first;
+
+  AES_GCM_Envelope_Dec d(keks, AES_GCM_TAGSIZE_DEFAULT, 4);
+  for (int i = 0; i < 3; i++) {
+    d.ciphertextIs(env);
+    EXPECT_EQ(d.plaintext().first, pt);
+  }
+  EXPECT_EQ(d.cacheMisses(), 1U);
+  EXPECT_EQ(d.cacheHits(), 2U);
+
+  // Rotate the master key: only the header changes
+  keks.keyIs(2, *random(AES_GCM_KEYSIZE_256));
+  keks.primaryIs(2);
+  AES_GCM_Keyring_Contexts contexts(keks);
+  unique_ptr<AES_GCM_Result> header = AES_GCM_Envelope_Rewrap(contexts, env);
+  EXPECT_EQ(header->second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(header->first.size(), AES_GCM_ENVELOPE_HEADER_BYTES);
+  MutableBlob rewrapped(env);
+  memcpy(rewrapped.data(), header->first.data(), AES_GCM_ENVELOPE_HEADER_BYTES);
+
+  // Retiring the old KEK invalidates both the old header and its cached DEK
+  keks.keyDel(1);
+  d.ciphertextIs(env);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_KEY);
+  d.ciphertextIs(rewrapped);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, pt);
+
+  // The header alone can be rewrapped, and the cache stays bounded
+  EXPECT_EQ(AES_GCM_Envelope_Rewrap(contexts, header->first)->second, AES_GCM_STATUS::VALID);
+  for (int i = 0; i < 10; i++) {
+    d.ciphertextIs(e.ciphertext()->first);
+    EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  }
+  EXPECT_EQ(d.cacheHits(), 2U);
+}
@@ -0,0 +1,278 @@
+#include "crypto/aes_gcm_jobs.h"
+#include <algorithm>
+
+using namespace Crypto;
+using Util::Blob;
+using std::unique_ptr;
+using std::vector;
+
+// Completes with 'failure' instead of throwing (e.g. std::bad_alloc)
+static AES_GCM_Work guarded(AES_GCM_STATUS _failure, AES_GCM_Work _work)
+{
+  return [_failure, _work]() {
+    try {
+      return _work();
+    }
+    catch (...) {
+      return AES_GCM_Result(Blob(), _failure);
+    }
+  };
+}
+
+AES_GCM_Work Crypto::AES_GCM_EncryptWork(const AES_GCM_Config &_config, const Blob &_key,
+  const Blob &_aad, const Blob &_plaintext)
+{
+  AES_GCM_Config config = _config;
+  Blob key = _key;
+  Blob aad = _aad;
+  Blob plaintext = _plaintext;
+  return guarded(AES_GCM_STATUS::ENC_ERROR, [config, key, aad, plaintext]() {
+    AES_GCM_Enc enc(config);
+    AES_GCM_STATUS status = enc.keyIs(key);
+    if (status != AES_GCM_STATUS::VALID) {
+      return AES_GCM_Result(Blob(), status);
+    }
+    enc.aadIs(aad);
+    enc.plaintextIs(plaintext);
+    return *enc.ciphertext();
+  });
+}
+
+AES_GCM_Work Crypto::AES_GCM_DecryptWork(const Blob &_key, const Blob &_iv,
+  const Blob &_tag, const Blob &_aad, const Blob &_ciphertext)
+{
+  Blob key = _key;
+  Blob iv = _iv;
+  Blob tag = _tag;
+  Blob aad = _aad;
+  Blob ciphertext = _ciphertext;
+  return guarded(AES_GCM_STATUS::DEC_ERROR, [key, iv, tag, aad, ciphertext]() {
+    AES_GCM_Dec dec;
+    AES_GCM_STATUS status = dec.keyIs(key);
+    if (status != AES_GCM_STATUS::VALID) {
+      return AES_GCM_Result(Blob(), status);
+    }
+    dec.ivIs(iv);
+    dec.tagIs(tag);
+    dec.aadIs(aad);
+    dec.ciphertextIs(ciphertext);
+    return dec.plaintext();
+  });
+}
+
+AES_GCM_Work Crypto::AES_GCM_PBKD_EncryptWork(const AES_GCM_PBKD_Config &_config,
+  const Blob &_password, const Blob &_plaintext)
+{
+  AES_GCM_PBKD_Config config = _config;
+  Blob password = _password;
+  Blob plaintext = _plaintext;
+  return guarded(AES_GCM_STATUS::ENC_ERROR, [config, password, plaintext]() {
+    AES_GCM_PBKD_Enc enc(config);
+    enc.passwordIs(password);
+    enc.plaintextIs(plaintext);
+    return *enc.ciphertext();
+  });
+}
+
+AES_GCM_Work Crypto::AES_GCM_PBKD_DecryptWork(const AES_GCM_PBKD_Config &_config,
+  const Blob &_password, const Blob &_ciphertext)
+{
+  AES_GCM_PBKD_Config config = _config;
+  Blob password = _password;
+  Blob ciphertext = _ciphertext;
+  return guarded(AES_GCM_STATUS::DEC_ERROR, [config, password, ciphertext]() {
+    AES_GCM_PBKD_Dec dec(config);
+    dec.passwordIs(password);
+    dec.ciphertextIs(ciphertext);
+    return dec.plaintext();
+  });
+}
+
+AES_GCM_Work Crypto::AES_GCM_DeriveWork(U64 _keySize, const Blob &_password,
+  const Blob &_salt, U64 _iterations)
+{
+  Blob password = _password;
+  Blob salt = _salt;
+  return guarded(AES_GCM_STATUS::INVALID_KEY, [_keySize, password, salt, _iterations]() {
+    unique_ptr<Blob> key = PBKDF2_SHA256(_keySize, password, salt, _iterations);
+    if (!key) {
+      return AES_GCM_Result(Blob(), AES_GCM_STATUS::INVALID_KEY);
+    }
+    return AES_GCM_Result(*key, AES_GCM_STATUS::VALID);
+  });
+}
+
+AES_GCM_JobQueueConfig::AES_GCM_JobQueueConfig()
+  : workers(std::max(1U, std::thread::hardware_concurrency())), maxDepth(1024), batch(16),
+  order(AES_GCM_JOB_ORDER::UNORDERED)
+{
+  // empty
+}
+
+AES_GCM_JobQueue::AES_GCM_JobQueue(const AES_GCM_JobQueueConfig _config)
+  : cfg_(_config), submissions_(_config.maxDepth), depth_(0), nextId_(0), queued_(0),
+  sleepers_(0), stopping_(false), idleMux_(), idle_(), doneMux_(), doneCv_(),
+  completions_(), reorder_(), nextPublish_(0), workers_()
+{
+  cfg_.workers = std::max(1U, cfg_.workers);
+  cfg_.batch = std::max(1U, cfg_.batch);
+  for (U32 i = 0; i < cfg_.workers; i++) {
+    workers_.emplace_back(&AES_GCM_JobQueue::run, this);
+  }
+}
+
+AES_GCM_JobQueue::~AES_GCM_JobQueue()
+{
+  stopping_.store(true);
+  {
+    std::lock_guard<std::mutex> lock(idleMux_);
+    idle_.notify_all();
+  }
+  for (std::thread &t : workers_) {
+    t.join();
+  }
+}
+
+const AES_GCM_JobQueueConfig &AES_GCM_JobQueue::config() const
+{
+  return cfg_;
+}
+
+U32 AES_GCM_JobQueue::depth() const
+{
+  return depth_.load();
+}
+
+AES_GCM_STATUS AES_GCM_JobQueue::submit(AES_GCM_Work _work, U64 &_id)
+{
+  return submit(std::move(_work), _id, nullptr);
+}
+
+AES_GCM_STATUS AES_GCM_JobQueue::submit(AES_GCM_Work _work, U64 &_id,
+  AES_GCM_CompletionFn _done)
+{
+  // Admission: the ring holds at least maxDepth jobs, so an admitted job
+  // always finds a free cell
+  if (depth_.fetch_add(1) >= cfg_.maxDepth) {
+    depth_.fetch_sub(1);
+    return AES_GCM_STATUS::BUSY;
+  }
+  _id = nextId_.fetch_add(1);
+  queued_.fetch_add(1);
+  Job job{_id, std::move(_work), std::move(_done)};
+  while (!submissions_.push(std::move(job))) {
+    std::this_thread::yield();
+  }
+  if (sleepers_.load() > 0) {
+    std::lock_guard<std::mutex> lock(idleMux_);
+    idle_.notify_one();
+  }
+  return AES_GCM_STATUS::VALID;
+}
+
+size_t AES_GCM_JobQueue::reap(vector<AES_GCM_Completion> &_out, size_t _max)
+{
+  std::lock_guard<std::mutex> lock(doneMux_);
+  size_t n = 0;
+  while ((n < _max) && !completions_.empty()) {
+    _out.push_back(std::move(completions_.front()));
+    completions_.pop_front();
+    n++;
+  }
+  depth_.fetch_sub((U32)n);
+  return n;
+}
+
+AES_GCM_Completion AES_GCM_JobQueue::wait()
+{
+  std::unique_lock<std::mutex> lock(doneMux_);
+  doneCv_.wait(lock, [this]() { return !completions_.empty(); });
+  AES_GCM_Completion done = std::move(completions_.front());
+  completions_.pop_front();
+  depth_.fetch_sub(1);
+  return done;
+}
+
+void AES_GCM_JobQueue::run()
+{
+  vector<Job> jobs;
+  vector<AES_GCM_Result> results;
+  results.reserve(cfg_.batch);
+  for (;;) {
+    jobs.clear();
+    results.clear();
+    Job job;
+    while ((jobs.size() < cfg_.batch) && submissions_.pop(job)) {
+      queued_.fetch_sub(1);
+      jobs.push_back(std::move(job));
+    }
+    if (jobs.empty()) {
+      if (stopping_.load() && (queued_.load() == 0)) {
+        return;
+      }
+      // queued_ is raised before the push, so a non-zero count with an empty
+      // ring means a push is in flight and the wait falls straight through
+      std::unique_lock<std::mutex> lock(idleMux_);
+      sleepers_.fetch_add(1);
+      idle_.wait(lock, [this]() { return (queued_.load() > 0) || stopping_.load(); });
+      sleepers_.fetch_sub(1);
+      continue;
+    }
+
+    // Every job gets a result, so depth_ and the reorder map always drain
+    for (Job &j : jobs) {
+      try {
+        results.push_back(j.work());
+      }
+      catch (...) {
+        results.push_back(AES_GCM_Result(Blob(), AES_GCM_STATUS::ENC_ERROR));
+      }
+    }
+    publish(jobs, results);
+  }
+}
+
+void AES_GCM_JobQueue::publish(vector<Job> &_jobs, vector<AES_GCM_Result> &_results)
+{
+  if (cfg_.order == AES_GCM_JOB_ORDER::UNORDERED) {
+    for (size_t i = 0; i < _jobs.size(); i++) {
+      deliver(_jobs[i], std::move(_results[i]));
+    }
+    return;
+  }
+
+  // Hold results until every earlier job has been published
+  std::lock_guard<std::mutex> lock(doneMux_);
+  for (size_t i = 0; i < _jobs.size(); i++) {
+    reorder_.emplace(_jobs[i].id, std::make_pair(std::move(_jobs[i]), std::move(_results[i])));
+  }
+  bool queued = false;
+  while (!reorder_.empty() && (reorder_.begin()->first == nextPublish_)) {
+    std::pair<Job, AES_GCM_Result> next = std::move(reorder_.begin()->second);
+    reorder_.erase(reorder_.begin());
+    nextPublish_++;
+    if (next.first.done) {
+      depth_.fetch_sub(1);
+      next.first.done(AES_GCM_Completion{next.first.id, std::move(next.second)});
+    }
+    else {
+      completions_.push_back(AES_GCM_Completion{next.first.id, std::move(next.second)});
+      queued = true;
+    }
+  }
+  if (queued) {
+    doneCv_.notify_all();
+  }
+}
+
+void AES_GCM_JobQueue::deliver(Job &_job, AES_GCM_Result &&_result)
+{
+  if (_job.done) {
+    depth_.fetch_sub(1);
+    _job.done(AES_GCM_Completion{_job.id, std::move(_result)});
+    return;
+  }
+  std::lock_guard<std::mutex> lock(doneMux_);
+  completions_.push_back(AES_GCM_Completion{_job.id, std::move(_result)});
+  doneCv_.notify_one();
+}
@@ -0,0 +1,187 @@
+#ifndef CRYPTO_AES_GCM_JOBS_H
+#define CRYPTO_AES_GCM_JOBS_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_pbkd.h"
+#include "crypto/mpmc_queue.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__cpp_impl_coroutine) && (__cplusplus >= 202002L)
+#include <coroutine>
+#define CRYPTO_AES_GCM_JOBS_COROUTINES 1
+#endif
+
+namespace Crypto {
+
+// A unit of work for the job queue. The builders below capture their inputs
+// by value, so the caller's Blobs can change once the job is submitted. A
+// builder's work that throws completes with ENC_ERROR, DEC_ERROR (the decrypt
+// builders) or INVALID_KEY (derivation); any other work that throws completes
+// with ENC_ERROR.
+typedef std::function<AES_GCM_Result()> AES_GCM_Work;
+
+// Ciphertext as from AES_GCM_Enc::ciphertext()
+AES_GCM_Work AES_GCM_EncryptWork(const AES_GCM_Config &config, const Util::Blob &key,
+  const Util::Blob &aad, const Util::Blob &plaintext);
+
+// Plaintext as from AES_GCM_Dec::plaintext()
+AES_GCM_Work AES_GCM_DecryptWork(const Util::Blob &key, const Util::Blob &iv,
+  const Util::Blob &tag, const Util::Blob &aad, const Util::Blob &ciphertext);
+
+AES_GCM_Work AES_GCM_PBKD_EncryptWork(const AES_GCM_PBKD_Config &config,
+  const Util::Blob &password, const Util::Blob &plaintext);
+AES_GCM_Work AES_GCM_PBKD_DecryptWork(const AES_GCM_PBKD_Config &config,
+  const Util::Blob &password, const Util::Blob &ciphertext);
+
+// The derived key, as from PBKDF2_SHA256()
+AES_GCM_Work AES_GCM_DeriveWork(U64 keySize, const Util::Blob &password,
+  const Util::Blob &salt, U64 iterations);
+
+// Completion order
+enum class AES_GCM_JOB_ORDER
+{
+  UNORDERED,   // As soon as each job finishes
+  SUBMISSION   // In job ID order (a slow job holds back later ones)
+};
+
+struct AES_GCM_JobQueueConfig
+{
+  AES_GCM_JobQueueConfig();
+
+  U32               workers;   // Worker threads (default: one per core)
+  U32               maxDepth;  // Jobs submitted but not yet reaped
+  U32               batch;     // Jobs a worker takes per wake-up
+  AES_GCM_JOB_ORDER order;
+};
+
+struct AES_GCM_Completion
+{
+  U64            id;
+  AES_GCM_Result result;
+};
+
+// Called on a worker thread instead of queueing the completion. With
+// SUBMISSION order callbacks run one at a time, in order, under the queue's
+// completion lock, so they must not call reap() or wait(). Callbacks must not
+// throw.
+typedef std::function<void(AES_GCM_Completion &&)> AES_GCM_CompletionFn;
+
+// An asynchronous engine for event-loop callers. submit() pushes onto a
+// bounded lock-free submission queue and never blocks; once maxDepth jobs are
+// outstanding it fails fast with BUSY. Workers drain the queue in batches and
+// publish results to a completion queue (reap() / wait()) or to a per-job
+// callback. The destructor finishes queued jobs and drops unreaped results.
+class AES_GCM_JobQueue
+{
+ public:
+  AES_GCM_JobQueue(const AES_GCM_JobQueueConfig config);
+  AES_GCM_JobQueue(const AES_GCM_JobQueue &) = delete;
+  AES_GCM_JobQueue &operator=(const AES_GCM_JobQueue &) = delete;
+  ~AES_GCM_JobQueue();
+  const AES_GCM_JobQueueConfig &config() const;
+
+  // Jobs submitted but not yet reaped (or passed to their callback)
+  U32 depth() const;
+
+  AES_GCM_STATUS submit(AES_GCM_Work work, U64 &id);
+  AES_GCM_STATUS submit(AES_GCM_Work work, U64 &id, AES_GCM_CompletionFn done);
+
+  // Non-blocking; returns the number of completions appended to 'out'
+  size_t reap(std::vector<AES_GCM_Completion> &out, size_t max);
+
+  // Blocks until a completion is available
+  AES_GCM_Completion wait();
+
+ private:
+  struct Job
+  {
+    U64 id;
+    AES_GCM_Work work;
+    AES_GCM_CompletionFn done;
+  };
+
+  void run();
+  void publish(std::vector<Job> &jobs, std::vector<AES_GCM_Result> &results);
+  void deliver(Job &job, AES_GCM_Result &&result);
+  AES_GCM_JobQueueConfig cfg_;
+  MPMCQueue<Job> submissions_;
+  std::atomic<U32> depth_;
+  std::atomic<U64> nextId_;
+  std::atomic<U64> queued_;
+  std::atomic<U32> sleepers_;
+  std::atomic<bool> stopping_;
+  std::mutex idleMux_;
+  std::condition_variable idle_;
+  std::mutex doneMux_;
+  std::condition_variable doneCv_;
+  std::deque<AES_GCM_Completion> completions_;
+  std::map<U64, std::pair<Job, AES_GCM_Result>> reorder_;
+  U64 nextPublish_;
+  std::vector<std::thread> workers_;
+};
+
+#ifdef CRYPTO_AES_GCM_JOBS_COROUTINES
+// co_await AES_GCM_JobAwaitable(queue, work) yields the job's result. The
+// coroutine is resumed through 'resume', which defaults to resuming inline on
+// the worker thread; event loops should pass a function that posts the handle
+// back to the loop. If the queue is full the result is BUSY without suspending.
+class AES_GCM_JobAwaitable
+{
+ public:
+  typedef std::function<void(std::coroutine_handle<>)> ResumeFn;
+
+  AES_GCM_JobAwaitable(AES_GCM_JobQueue &queue, AES_GCM_Work work, ResumeFn resume = nullptr)
+    : queue_(queue), work_(std::move(work)), resume_(std::move(resume)), result_()
+  {
+    // empty
+  }
+
+  bool await_ready() const noexcept
+  {
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> _handle)
+  {
+    U64 id = 0;
+    AES_GCM_STATUS status = queue_.submit(std::move(work_), id,
+      [this, _handle](AES_GCM_Completion &&_done) {
+        result_ = std::move(_done.result);
+        if (resume_) {
+          resume_(_handle);
+        }
+        else {
+          _handle.resume();
+        }
+      });
+    if (status != AES_GCM_STATUS::VALID) {
+      result_ = AES_GCM_Result(Util::Blob(), status);
+      return false;
+    }
+    return true;
+  }
+
+  AES_GCM_Result await_resume()
+  {
+    return std::move(result_);
+  }
+
+ private:
+  AES_GCM_JobQueue &queue_;
+  AES_GCM_Work work_;
+  ResumeFn resume_;
+  AES_GCM_Result result_;
+};
+#endif
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_JOBS_H
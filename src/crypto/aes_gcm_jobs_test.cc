@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_jobs.h"
+#include "crypto/random.h"
+#include <future>
+#include <set>
+#include <stdexcept>
+
+using namespace Crypto;
+using Util::Blob;
+using std::unique_ptr;
+using std::vector;
+
+static AES_GCM_Config cfg = {AES_GCM_KEYSIZE::K256, AES_GCM_TAGSIZE::T128,
+  AES_GCM_IV_MODE::RANDOM, AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+
+TEST(AES_GCM_JobQueueTest, Sanity) {
+  AES_GCM_JobQueueConfig qcfg;
+  qcfg.workers = 4;
+  AES_GCM_JobQueue q(qcfg);
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_256);
+  Blob pt("job queue plaintext", 19);
+
+  std::set<U64> ids;
+  for (int i = 0; i < 50; i++) {
+    U64 id = 0;
+    EXPECT_EQ(q.submit(AES_GCM_EncryptWork(cfg, *key, Blob(), pt), id), AES_GCM_STATUS::VALID);
+    ids.insert(id);
+  }
+  vector<AES_GCM_Completion> done;
+  while (done.size() < 50) {
+    done.push_back(q.wait());
+    q.reap(done, 50 - done.size());
+  }
+  EXPECT_EQ(q.depth(), 0U);
+
+  // Decrypt each result through the queue, reaping with callbacks
+  std::promise<void> all;
+  std::atomic<int> remaining(50);
+  for (const AES_GCM_Completion &c : done) {
+    EXPECT_EQ(ids.erase(c.id), 1U);
+    EXPECT_EQ(c.result.second, AES_GCM_STATUS::VALID);
+    const Blob &ct = c.result.first;
+    U64 ctxtSize = ct.size() - AES_GCM_BLOCKSIZE_BYTES - 16;
+    U64 id = 0;
+    q.submit(AES_GCM_DecryptWork(*key, Blob(ct, 16, 0), Blob(ct, 16, 16 + ctxtSize), Blob(),
+      Blob(ct, ctxtSize, 16)), id, [&](AES_GCM_Completion &&_c) {
+        EXPECT_EQ(_c.result.second, AES_GCM_STATUS::VALID);
+        EXPECT_EQ(_c.result.first, pt);
+        if (--remaining == 0) {
+          all.set_value();
+        }
+      });
+  }
+  all.get_future().wait();
+}
+
+TEST(AES_GCM_JobQueueTest, OrderAndBackpressure) {
+  AES_GCM_JobQueueConfig qcfg;
+  qcfg.workers = 3;
+  qcfg.maxDepth = 8;
+  qcfg.batch = 2;
+  qcfg.order = AES_GCM_JOB_ORDER::SUBMISSION;
+  AES_GCM_JobQueue q(qcfg);
+
+  // Early jobs are slow, so unordered completion would reverse them. One job
+  // throws, which completes it with an error in its place.
+  std::promise<void> gate;
+  std::shared_future<void> open = gate.get_future().share();
+  for (U64 i = 0; i < 8; i++) {
+    U64 id = 0;
+    EXPECT_EQ(q.submit([i, open]() {
+      if (i < 3) {
+        open.wait();
+      }
+      if (i == 4) {
+        throw std::runtime_error("job failed");
+      }
+      return AES_GCM_Result(Blob(std::to_string(i)), AES_GCM_STATUS::VALID);
+    }, id), AES_GCM_STATUS::VALID);
+    EXPECT_EQ(id, i);
+  }
+  U64 id = 0;
+  EXPECT_EQ(q.submit(AES_GCM_DeriveWork(16, Blob("pw"), Blob("salt"), 1), id),
+    AES_GCM_STATUS::BUSY);
+  EXPECT_EQ(q.depth(), 8U);
+  gate.set_value();
+
+  for (U64 i = 0; i < 8; i++) {
+    AES_GCM_Completion c = q.wait();
+    EXPECT_EQ(c.id, i);
+    if (i == 4) {
+      EXPECT_EQ(c.result.second, AES_GCM_STATUS::ENC_ERROR);
+      continue;
+    }
+    EXPECT_EQ(c.result.first, Blob(std::to_string(i)));
+  }
+  EXPECT_EQ(q.depth(), 0U);
+  EXPECT_EQ(q.submit(AES_GCM_DeriveWork(16, Blob("pw"), Blob("salt"), 1), id),
+    AES_GCM_STATUS::VALID);
+  EXPECT_EQ(q.wait().result.first.size(), 16U);
+}
+
+#ifdef CRYPTO_AES_GCM_JOBS_COROUTINES
+struct JobTask
+{
+  struct promise_type
+  {
+    JobTask get_return_object() { return JobTask(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {}
+  };
+};
+
+static JobTask deriveTask(AES_GCM_JobQueue &_q, std::promise<AES_GCM_Result> &_out)
+{
+  AES_GCM_Result r = co_await AES_GCM_JobAwaitable(_q,
+    AES_GCM_DeriveWork(32, Blob("pw"), Blob("salt"), 10));
+  _out.set_value(r);
+}
+
+TEST(AES_GCM_JobQueueTest, Awaitable) {
+  AES_GCM_JobQueue q{AES_GCM_JobQueueConfig()};
+  std::promise<AES_GCM_Result> out;
+  deriveTask(q, out);
+  AES_GCM_Result r = out.get_future().get();
+  EXPECT_EQ(r.second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(r.first, *PBKDF2_SHA256(32, Blob("pw"), Blob("salt"), 10));
+}
+#endif
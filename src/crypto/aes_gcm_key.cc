@@ -0,0 +1,66 @@
+#include "crypto/aes_gcm_key.h"
+
+using namespace Crypto;
+using Util::Blob;
+
+AES_GCM_Key::AES_GCM_Key(AES_GCM_TABLES _tables)
+  : tables_(_tables), keySize_(0), cipher_(backend().gcm(_tables))
+{
+  // empty
+}
+
+AES_GCM_STATUS AES_GCM_Key::keyIs(const Blob &_key)
+{
+  U64 size = _key.size();
+  if ((size != AES_GCM_KEYSIZE_256) && (size != AES_GCM_KEYSIZE_128) &&
+    (size != AES_GCM_KEYSIZE_192)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  if (!cipher_->keyIs(_key.data(), (U32)size)) {
+    keySize_ = 0;
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+  keySize_ = (U32)size;
+  return AES_GCM_STATUS::VALID;
+}
+
+U32 AES_GCM_Key::keySize() const
+{
+  return keySize_;
+}
+
+AES_GCM_TABLES AES_GCM_Key::tables() const
+{
+  return tables_;
+}
+
+U32 AES_GCM_Key::contextBytes() const
+{
+  return (U32)sizeof(*this) + cipher_->contextBytes();
+}
+
+AES_GCM_STATUS AES_GCM_Key::encrypt(Byte *_ctxt, Byte *_tag, U32 _tagSize,
+  const Byte *_iv, U32 _ivSize, const Byte *_aad, U64 _aadSize, const Byte *_ptxt,
+  U64 _ptxtSize)
+{
+  if ((keySize_ == 0) || (_ivSize == 0) || (_tagSize == 0) ||
+    (_tagSize > AES_GCM_BLOCKSIZE_BYTES)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  bool valid = cipher_->encrypt(_ctxt, _tag, _tagSize, _iv, _ivSize, _aad, _aadSize, _ptxt,
+    _ptxtSize);
+  return (valid) ? AES_GCM_STATUS::VALID : AES_GCM_STATUS::ENC_ERROR;
+}
+
+AES_GCM_STATUS AES_GCM_Key::decrypt(Byte *_ptxt, const Byte *_tag, U32 _tagSize,
+  const Byte *_iv, U32 _ivSize, const Byte *_aad, U64 _aadSize, const Byte *_ctxt,
+  U64 _ctxtSize)
+{
+  if ((keySize_ == 0) || (_ivSize == 0) || (_tagSize == 0) ||
+    (_tagSize > AES_GCM_BLOCKSIZE_BYTES)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  bool valid = cipher_->decrypt(_ptxt, _tag, _tagSize, _iv, _ivSize, _aad, _aadSize, _ctxt,
+    _ctxtSize);
+  return (valid) ? AES_GCM_STATUS::VALID : AES_GCM_STATUS::DEC_ERROR;
+}
@@ -0,0 +1,48 @@
+#ifndef CRYPTO_AES_GCM_KEY_H
+#define CRYPTO_AES_GCM_KEY_H
+
+#include "crypto/aes_gcm.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <memory>
+
+namespace Crypto {
+
+// A pre-expanded AES/GCM key context. The AES key schedule and GHASH tables
+// are computed once in keyIs(); each encrypt()/decrypt() afterwards only
+// resynchronizes the IV, so one context can process any number of messages
+// under the same key. Operates on caller-provided buffers and never allocates.
+// A context is not thread-safe: use one per thread. 'tables' selects the
+// GHASH strategy; see AES_GCM_TABLES for the memory each option costs. The
+// context uses the backend() current when it was constructed.
+class AES_GCM_Key
+{
+ public:
+  AES_GCM_Key(AES_GCM_TABLES tables = AES_GCM_TABLES_DEFAULT);
+  AES_GCM_Key(const AES_GCM_Key &) = delete;
+  AES_GCM_Key &operator=(const AES_GCM_Key &) = delete;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+  U32 keySize() const;
+  AES_GCM_TABLES tables() const;
+
+  // Approximate bytes held by this context once keyed
+  U32 contextBytes() const;
+
+  // Writes ptxtSize bytes to 'ctxt' and tagSize bytes to 'tag'
+  AES_GCM_STATUS encrypt(Byte *ctxt, Byte *tag, U32 tagSize, const Byte *iv,
+    U32 ivSize, const Byte *aad, U64 aadSize, const Byte *ptxt, U64 ptxtSize);
+
+  // Writes ctxtSize bytes to 'ptxt'. The contents of 'ptxt' are unspecified
+  // unless the result is VALID.
+  AES_GCM_STATUS decrypt(Byte *ptxt, const Byte *tag, U32 tagSize, const Byte *iv,
+    U32 ivSize, const Byte *aad, U64 aadSize, const Byte *ctxt, U64 ctxtSize);
+
+ private:
+  AES_GCM_TABLES tables_;
+  U32 keySize_;
+  std::unique_ptr<AES_GCM_Cipher> cipher_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_KEY_H
@@ -0,0 +1,80 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_key.h"
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+
+// Test case 16 from McGrew and Viega, "The Galois/Counter Mode of Operation (GCM)"
+static const Blob k("\xfe\xff\xe9\x92\x86\x65\x73\x1c\x6d\x6a\x8f\x94\x67\x30\x83\x08"
+                    "\xfe\xff\xe9\x92\x86\x65\x73\x1c\x6d\x6a\x8f\x94\x67\x30\x83\x08", 32);
+static const Blob iv("\xca\xfe\xba\xbe\xfa\xce\xdb\xad\xde\xca\xf8\x88", 12);
+static const Blob aad("\xfe\xed\xfa\xce\xde\xad\xbe\xef\xfe\xed\xfa\xce\xde\xad\xbe\xef"
+                      "\xab\xad\xda\xd2", 20);
+static const Blob p("\xd9\x31\x32\x25\xf8\x84\x06\xe5\xa5\x59\x09\xc5\xaf\xf5\x26\x9a"
+                    "\x86\xa7\xa9\x53\x15\x34\xf7\xda\x2e\x4c\x30\x3d\x8a\x31\x8a\x72"
+                    "\x1c\x3c\x0c\x95\x95\x68\x09\x53\x2f\xcf\x0e\x24\x49\xa6\xb5\x25"
+                    "\xb1\x6a\xed\xf5\xaa\x0d\xe6\x57\xba\x63\x7b\x39", 60);
+static const Blob c("\x52\x2d\xc1\xf0\x99\x56\x7d\x07\xf4\x7f\x37\xa3\x2a\x84\x42\x7d"
+                    "\x64\x3a\x8c\xdc\xbf\xe5\xc0\xc9\x75\x98\xa2\xbd\x25\x55\xd1\xaa"
+                    "\x8c\xb0\x8e\x48\x59\x0d\xbb\x3d\xa7\xb0\x8b\x10\x56\x82\x88\x38"
+                    "\xc5\xf6\x1e\x63\x93\xba\x7a\x0a\xbc\xc9\xf6\x62", 60);
+static const Blob t("\x76\xfc\x6e\xce\x0f\x4e\x17\x68\xcd\xdf\x88\x53\xbb\x2d\x55\x1b", 16);
+
+TEST(AES_GCM_KeyTest, Vector16) {
+  AES_GCM_Key key;
+  EXPECT_EQ(key.keyIs(k), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(key.keySize(), 32U);
+
+  // The same context handles several messages without re-keying
+  for (int i = 0; i < 3; i++) {
+    MutableBlob ctxt(p.size());
+    MutableBlob tag(16);
+    EXPECT_EQ(key.encrypt(ctxt.data(), tag.data(), 16, iv.data(), 12, aad.data(),
+      aad.size(), p.data(), p.size()), AES_GCM_STATUS::VALID);
+    EXPECT_EQ(Blob(ctxt), c);
+    EXPECT_EQ(Blob(tag), t);
+
+    MutableBlob ptxt(c.size());
+    EXPECT_EQ(key.decrypt(ptxt.data(), t.data(), 16, iv.data(), 12, aad.data(),
+      aad.size(), c.data(), c.size()), AES_GCM_STATUS::VALID);
+    EXPECT_EQ(Blob(ptxt), p);
+  }
+}
+
+TEST(AES_GCM_KeyTest, Errors) {
+  AES_GCM_Key key;
+  MutableBlob buf(p.size());
+
+  // Unkeyed contexts and bad key sizes are rejected
+  EXPECT_EQ(key.decrypt(buf.data(), t.data(), 16, iv.data(), 12, aad.data(), aad.size(),
+    c.data(), c.size()), AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(key.keyIs(Blob(k, 20, 0)), AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(key.keyIs(k), AES_GCM_STATUS::VALID);
+
+  // Any modification fails authentication
+  Blob badTag("\x77\xfc\x6e\xce\x0f\x4e\x17\x68\xcd\xdf\x88\x53\xbb\x2d\x55\x1b", 16);
+  EXPECT_EQ(key.decrypt(buf.data(), badTag.data(), 16, iv.data(), 12, aad.data(),
+    aad.size(), c.data(), c.size()), AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(key.decrypt(buf.data(), t.data(), 16, iv.data(), 12, aad.data(),
+    aad.size() - 1, c.data(), c.size()), AES_GCM_STATUS::DEC_ERROR);
+}
+
+TEST(AES_GCM_KeyTest, Tables) {
+  // Every GHASH strategy computes the same tags
+  const AES_GCM_TABLES options[] = {AES_GCM_TABLES::T2K, AES_GCM_TABLES::T64K,
+    AES_GCM_TABLES::CLMUL};
+  for (AES_GCM_TABLES tables : options) {
+    AES_GCM_Key key(tables);
+    EXPECT_EQ(key.tables(), tables);
+    EXPECT_EQ(key.keyIs(k), AES_GCM_STATUS::VALID);
+    EXPECT_GE(key.contextBytes(), 2 * AES_GCM_TableBytes(tables));
+    MutableBlob ctxt(p.size());
+    MutableBlob tag(16);
+    EXPECT_EQ(key.encrypt(ctxt.data(), tag.data(), 16, iv.data(), 12, aad.data(),
+      aad.size(), p.data(), p.size()), AES_GCM_STATUS::VALID);
+    EXPECT_EQ(Blob(ctxt), c);
+    EXPECT_EQ(Blob(tag), t);
+  }
+  EXPECT_LE(AES_GCM_TableBytes(AES_GCM_TABLES::T2K), AES_GCM_TableBytes(AES_GCM_TABLES::T64K));
+}
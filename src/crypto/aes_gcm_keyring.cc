@@ -0,0 +1,269 @@
+#include "crypto/aes_gcm_keyring.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include "util/make_unique.h"
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::shared_ptr;
+using std::unique_ptr;
+using Util::make_unique;
+
+typedef AES_GCM_Keyring::Entry Entry;
+typedef AES_GCM_Keyring::Snapshot Snapshot;
+
+AES_GCM_Keyring::AES_GCM_Keyring()
+  : snapshot_(nullptr), snapshots_(), writeMux_()
+{
+  snapshotIs(make_unique<const Snapshot>());
+}
+
+AES_GCM_STATUS AES_GCM_Keyring::keyIs(AES_GCM_KeyId _id, const Blob &_key)
+{
+  U64 size = _key.size();
+  if ((size != AES_GCM_KEYSIZE_256) && (size != AES_GCM_KEYSIZE_128) &&
+    (size != AES_GCM_KEYSIZE_192)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+
+  std::lock_guard<std::mutex> lock(writeMux_);
+  unique_ptr<Snapshot> next = make_unique<Snapshot>(snapshot());
+  shared_ptr<const Entry> entry = std::make_shared<const Entry>(Entry{_id, _key});
+  next->entries[_id] = entry;
+  if (next->primary && (next->primary->id == _id)) {
+    next->primary = entry;
+  }
+  snapshotIs(std::move(next));
+  return AES_GCM_STATUS::VALID;
+}
+
+void AES_GCM_Keyring::keyDel(AES_GCM_KeyId _id)
+{
+  std::lock_guard<std::mutex> lock(writeMux_);
+  unique_ptr<Snapshot> next = make_unique<Snapshot>(snapshot());
+  if (next->entries.erase(_id) == 0) {
+    return;
+  }
+  if (next->primary && (next->primary->id == _id)) {
+    next->primary.reset();
+  }
+  snapshotIs(std::move(next));
+}
+
+AES_GCM_STATUS AES_GCM_Keyring::primaryIs(AES_GCM_KeyId _id)
+{
+  std::lock_guard<std::mutex> lock(writeMux_);
+  const Snapshot &current = snapshot();
+  auto it = current.entries.find(_id);
+  if (it == current.entries.end()) {
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+  unique_ptr<Snapshot> next = make_unique<Snapshot>(current);
+  next->primary = it->second;
+  snapshotIs(std::move(next));
+  return AES_GCM_STATUS::VALID;
+}
+
+U64 AES_GCM_Keyring::keys() const
+{
+  return snapshot().entries.size();
+}
+
+const Snapshot &AES_GCM_Keyring::snapshot() const
+{
+  return *snapshot_.load(std::memory_order_acquire);
+}
+
+void AES_GCM_Keyring::snapshotIs(unique_ptr<const Snapshot> _snapshot)
+{
+  // Readers may still hold the current snapshot, so it is retired, not freed
+  snapshot_.store(_snapshot.get(), std::memory_order_release);
+  snapshots_.push_back(std::move(_snapshot));
+}
+
+
+/*** EXPANDED CONTEXTS ***/
+
+AES_GCM_Keyring_Contexts::AES_GCM_Keyring_Contexts(const AES_GCM_Keyring &_keyring,
+  AES_GCM_TABLES _tables)
+  : keyring_(_keyring), tables_(_tables), contexts_()
+{
+  // empty
+}
+
+const AES_GCM_Keyring &AES_GCM_Keyring_Contexts::keyring() const
+{
+  return keyring_;
+}
+
+AES_GCM_Key *AES_GCM_Keyring_Contexts::key(AES_GCM_KeyId _id, AES_GCM_STATUS &_status)
+{
+  const Snapshot &snapshot = keyring_.snapshot();
+  auto entry = snapshot.entries.find(_id);
+  if (entry == snapshot.entries.end()) {
+    // Drop the expanded copy of a retired key
+    contexts_.erase(_id);
+    _status = AES_GCM_STATUS::INVALID_KEY;
+    return nullptr;
+  }
+  return expanded(entry->second, _status);
+}
+
+AES_GCM_Key *AES_GCM_Keyring_Contexts::primary(AES_GCM_KeyId &_id, AES_GCM_STATUS &_status)
+{
+  shared_ptr<const Entry> primary = keyring_.snapshot().primary;
+  if (!primary) {
+    _status = AES_GCM_STATUS::INVALID_KEY;
+    return nullptr;
+  }
+  _id = primary->id;
+  return expanded(primary, _status);
+}
+
+AES_GCM_Key *AES_GCM_Keyring_Contexts::expanded(const shared_ptr<const Entry> &_entry,
+  AES_GCM_STATUS &_status)
+{
+  // Re-expand only when the keyring holds different material for the ID
+  Context &ctx = contexts_[_entry->id];
+  if (ctx.entry != _entry) {
+    if (!ctx.key) {
+      ctx.key = make_unique<AES_GCM_Key>(tables_);
+    }
+    _status = ctx.key->keyIs(_entry->key);
+    if (_status != AES_GCM_STATUS::VALID) {
+      contexts_.erase(_entry->id);
+      return nullptr;
+    }
+    ctx.entry = _entry;
+  }
+  _status = AES_GCM_STATUS::VALID;
+  return ctx.key.get();
+}
+
+
+/*** ENCRYPTION ***/
+
+AES_GCM_Keyring_Enc::AES_GCM_Keyring_Enc(const AES_GCM_Keyring &_keyring,
+  AES_GCM_TAGSIZE _tagSize)
+  : tagSize_(AES_GCM_Tagsize(_tagSize)), aad_(), ptxt_(), contexts_(_keyring)
+{
+  // empty
+}
+
+void AES_GCM_Keyring_Enc::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+}
+
+void AES_GCM_Keyring_Enc::plaintextIs(const Blob &_plaintext)
+{
+  ptxt_ = _plaintext;
+}
+
+unique_ptr<AES_GCM_Result> AES_GCM_Keyring_Enc::ciphertext()
+{
+  AES_GCM_KeyId id = 0;
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  AES_GCM_Key *key = contexts_.primary(id, status);
+  if (key == nullptr) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+
+  // The header (key ID and IV) and the caller's AAD are authenticated together
+  U64 ptxtSize = ptxt_.size();
+  MutableBlob mctxt(AES_GCM_KEYRING_HEADER_BYTES + ptxtSize + tagSize_);
+  Byte *header = mctxt.data();
+  storeBE32(header, id);
+  randomize(header + AES_GCM_KEYID_BYTES, AES_GCM_BLOCKSIZE_BYTES);
+
+  MutableBlob aad(AES_GCM_KEYRING_HEADER_BYTES + aad_.size());
+  memcpy(aad.data(), header, AES_GCM_KEYRING_HEADER_BYTES);
+  memcpy(aad.data() + AES_GCM_KEYRING_HEADER_BYTES, aad_.data(), aad_.size());
+
+  Byte *body = header + AES_GCM_KEYRING_HEADER_BYTES;
+  status = key->encrypt(body, body + ptxtSize, tagSize_,
+    header + AES_GCM_KEYID_BYTES, AES_GCM_BLOCKSIZE_BYTES, aad.data(), aad.size(),
+    ptxt_.data(), ptxtSize);
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  return make_unique<AES_GCM_Result>(mctxt, AES_GCM_STATUS::VALID);
+}
+
+
+/*** DECRYPTION ***/
+
+AES_GCM_Keyring_Dec::AES_GCM_Keyring_Dec(const AES_GCM_Keyring &_keyring,
+  AES_GCM_TAGSIZE _tagSize)
+  : tagSize_(AES_GCM_Tagsize(_tagSize)), aad_(), ctxt_(),
+  ptxt_(Blob(), AES_GCM_STATUS::DEC_ERROR), contexts_(_keyring), needsDecrypt_(false),
+  mutableMux_()
+{
+  // empty
+}
+
+void AES_GCM_Keyring_Dec::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+  needsDecrypt_ = true;
+}
+
+void AES_GCM_Keyring_Dec::ciphertextIs(const Blob &_ciphertext)
+{
+  ctxt_ = _ciphertext;
+  needsDecrypt_ = true;
+}
+
+const AES_GCM_Result &AES_GCM_Keyring_Dec::plaintext() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  if (needsDecrypt_) {
+    decrypt();
+  }
+  return ptxt_;
+}
+
+bool AES_GCM_Keyring_Dec::keyId(const Blob &_ciphertext, AES_GCM_KeyId &_id)
+{
+  if (_ciphertext.size() < AES_GCM_KEYID_BYTES) {
+    return false;
+  }
+  _id = loadBE32(_ciphertext.data());
+  return true;
+}
+
+void AES_GCM_Keyring_Dec::decrypt() const
+{
+  needsDecrypt_ = false;
+  ptxt_.first.dataIsNull();
+  if (ctxt_.size() < AES_GCM_KEYRING_HEADER_BYTES + tagSize_) {
+    ptxt_.second = AES_GCM_STATUS::INVALID_SIZE;
+    return;
+  }
+
+  // One lookup: the key ID selects an already-expanded context
+  const Byte *header = ctxt_.data();
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  AES_GCM_Key *key = contexts_.key(loadBE32(header), status);
+  if (key == nullptr) {
+    ptxt_.second = status;
+    return;
+  }
+
+  MutableBlob aad(AES_GCM_KEYRING_HEADER_BYTES + aad_.size());
+  memcpy(aad.data(), header, AES_GCM_KEYRING_HEADER_BYTES);
+  memcpy(aad.data() + AES_GCM_KEYRING_HEADER_BYTES, aad_.data(), aad_.size());
+
+  U64 ctxtSize = ctxt_.size() - AES_GCM_KEYRING_HEADER_BYTES - tagSize_;
+  const Byte *body = header + AES_GCM_KEYRING_HEADER_BYTES;
+  MutableBlob ptxt(ctxtSize, Blob::ScrubType::ZEROS);
+  status = key->decrypt(ptxt.data(), body + ctxtSize, tagSize_,
+    header + AES_GCM_KEYID_BYTES, AES_GCM_BLOCKSIZE_BYTES, aad.data(), aad.size(), body,
+    ctxtSize);
+  if (status == AES_GCM_STATUS::VALID) {
+    ptxt_.first = ptxt;
+  }
+  ptxt_.second = status;
+}
@@ -0,0 +1,148 @@
+#ifndef CRYPTO_AES_GCM_KEYRING_H
+#define CRYPTO_AES_GCM_KEYRING_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Crypto {
+
+// Keyring messages carry the ID of the key that encrypted them so that a
+// decryptor needs exactly one key lookup and one AES/GCM operation:
+//
+//   | key ID (4, big-endian) | IV (16) | ciphertext | tag |
+//
+// The key ID and IV are authenticated as additional data, followed by any
+// (non-transmitted) AAD given to the encryptor/decryptor.
+typedef U32 AES_GCM_KeyId;
+
+static const U32 AES_GCM_KEYID_BYTES = 4;
+static const U32 AES_GCM_KEYRING_HEADER_BYTES = AES_GCM_KEYID_BYTES + AES_GCM_BLOCKSIZE_BYTES;
+
+// A set of keys indexed by key ID, one of which is the primary (encryption)
+// key. Updates publish a new immutable snapshot; readers take the current one
+// with a single atomic load (no lock and no reference count), so rotation
+// never blocks encryption or decryption in progress. Writers are serialized
+// among themselves. Snapshots are never freed while the keyring lives, which
+// is what makes the lock-free read safe: every update retains one, and keys
+// removed from the keyring stay in memory until it is destroyed. Updates are
+// expected to be rare (rotation), not per message.
+class AES_GCM_Keyring
+{
+ public:
+  struct Entry
+  {
+    AES_GCM_KeyId id;
+    Util::Blob    key;
+  };
+
+  struct Snapshot
+  {
+    std::unordered_map<AES_GCM_KeyId, std::shared_ptr<const Entry>> entries;
+    std::shared_ptr<const Entry> primary;
+  };
+
+  AES_GCM_Keyring();
+  AES_GCM_Keyring(const AES_GCM_Keyring &) = delete;
+  AES_GCM_Keyring &operator=(const AES_GCM_Keyring &) = delete;
+
+  // Adds (or replaces) a key. Replacing the primary key's material makes the
+  // new material primary.
+  AES_GCM_STATUS keyIs(AES_GCM_KeyId id, const Util::Blob &key);
+  // Removes a key. Removing the primary key leaves the keyring without one.
+  void keyDel(AES_GCM_KeyId id);
+  AES_GCM_STATUS primaryIs(AES_GCM_KeyId id);
+  U64 keys() const;
+  // The current snapshot; valid until the keyring is destroyed
+  const Snapshot &snapshot() const;
+
+ private:
+  void snapshotIs(std::unique_ptr<const Snapshot> snapshot);
+  std::atomic<const Snapshot *> snapshot_;
+  std::vector<std::unique_ptr<const Snapshot>> snapshots_;
+  std::mutex writeMux_;
+};
+
+// Expanded contexts for the keys of one keyring, created on first use and
+// reused until the keyring replaces or removes the key. Not thread-safe: each
+// encryptor/decryptor owns one.
+class AES_GCM_Keyring_Contexts
+{
+ public:
+  AES_GCM_Keyring_Contexts(const AES_GCM_Keyring &keyring,
+    AES_GCM_TABLES tables = AES_GCM_TABLES_DEFAULT);
+  AES_GCM_Keyring_Contexts(const AES_GCM_Keyring_Contexts &) = delete;
+  AES_GCM_Keyring_Contexts &operator=(const AES_GCM_Keyring_Contexts &) = delete;
+  const AES_GCM_Keyring &keyring() const;
+
+  // The expanded context for a key, or nullptr (with the reason in 'status')
+  AES_GCM_Key *key(AES_GCM_KeyId id, AES_GCM_STATUS &status);
+  // The expanded context for the primary key and its ID
+  AES_GCM_Key *primary(AES_GCM_KeyId &id, AES_GCM_STATUS &status);
+
+ private:
+  struct Context
+  {
+    std::shared_ptr<const AES_GCM_Keyring::Entry> entry;
+    std::unique_ptr<AES_GCM_Key> key;
+  };
+
+  AES_GCM_Key *expanded(const std::shared_ptr<const AES_GCM_Keyring::Entry> &entry,
+    AES_GCM_STATUS &status);
+  const AES_GCM_Keyring &keyring_;
+  AES_GCM_TABLES tables_;
+  std::unordered_map<AES_GCM_KeyId, Context> contexts_;
+};
+
+class AES_GCM_Keyring_Enc
+{
+ public:
+  AES_GCM_Keyring_Enc(const AES_GCM_Keyring &keyring,
+    AES_GCM_TAGSIZE tagSize = AES_GCM_TAGSIZE_DEFAULT);
+  AES_GCM_Keyring_Enc(const AES_GCM_Keyring_Enc &) = delete;
+  AES_GCM_Keyring_Enc &operator=(const AES_GCM_Keyring_Enc &) = delete;
+  void aadIs(const Util::Blob &aad);
+  void plaintextIs(const Util::Blob &plaintext);
+  std::unique_ptr<AES_GCM_Result> ciphertext();
+
+ private:
+  U32 tagSize_;
+  Util::Blob aad_;
+  Util::Blob ptxt_;
+  AES_GCM_Keyring_Contexts contexts_;
+};
+
+class AES_GCM_Keyring_Dec
+{
+ public:
+  AES_GCM_Keyring_Dec(const AES_GCM_Keyring &keyring,
+    AES_GCM_TAGSIZE tagSize = AES_GCM_TAGSIZE_DEFAULT);
+  AES_GCM_Keyring_Dec(const AES_GCM_Keyring_Dec &) = delete;
+  AES_GCM_Keyring_Dec &operator=(const AES_GCM_Keyring_Dec &) = delete;
+  void aadIs(const Util::Blob &aad);
+  void ciphertextIs(const Util::Blob &ciphertext);
+  const AES_GCM_Result &plaintext() const;
+
+  // The key ID of a keyring message, or false if it is too short
+  static bool keyId(const Util::Blob &ciphertext, AES_GCM_KeyId &id);
+
+ private:
+  void decrypt() const;
+  U32 tagSize_;
+  Util::Blob aad_;
+  Util::Blob ctxt_;
+  mutable AES_GCM_Result ptxt_;
+  mutable AES_GCM_Keyring_Contexts contexts_;
+  mutable bool needsDecrypt_;
+  mutable std::mutex mutableMux_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_KEYRING_H
@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_keyring.h"
+#include "crypto/random.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+static Blob pt("Keyring plaintext", 17);
+
+static Blob encrypt(const AES_GCM_Keyring &ring, const Blob &ptxt)
+{
+  AES_GCM_Keyring_Enc e(ring);
+  e.plaintextIs(ptxt);
+  unique_ptr<AES_GCM_Result> res = e.ciphertext();
+  EXPECT_EQ(res->second, AES_GCM_STATUS::VALID);
+  return res->first;
+}
+
+TEST(AES_GCM_KeyringTest, Rotation) {
+  AES_GCM_Keyring ring;
+  AES_GCM_Keyring_Enc e(ring);
+  e.plaintextIs(pt);
+  EXPECT_EQ(e.ciphertext()->second, AES_GCM_STATUS::INVALID_KEY);
+
+  // Encrypt one message under each of several daily keys
+  std::vector<Blob> ctxts;
+  for (AES_GCM_KeyId id = 1; id <= 5; id++) {
+    EXPECT_EQ(ring.keyIs(id, *random(AES_GCM_KEYSIZE_256)), AES_GCM_STATUS::VALID);
+    EXPECT_EQ(ring.primaryIs(id), AES_GCM_STATUS::VALID);
+    unique_ptr<AES_GCM_Result> res = e.ciphertext();
+    EXPECT_EQ(res->second, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(res->first.size(), AES_GCM_KEYRING_HEADER_BYTES + pt.size() + 16);
+    AES_GCM_KeyId msgId = 0;
+    EXPECT_TRUE(AES_GCM_Keyring_Dec::keyId(res->first, msgId));
+    EXPECT_EQ(msgId, id);
+    ctxts.push_back(res->first);
+  }
+  EXPECT_EQ(ring.keys(), 5U);
+
+  // All of them remain decryptable by one decryptor
+  AES_GCM_Keyring_Dec d(ring);
+  for (const Blob &ctxt : ctxts) {
+    d.ciphertextIs(ctxt);
+    EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(d.plaintext().first, pt);
+  }
+
+  // Retired keys no longer decrypt
+  ring.keyDel(1);
+  d.ciphertextIs(ctxts[0]);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_KEY);
+  d.ciphertextIs(ctxts[1]);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(ring.primaryIs(1), AES_GCM_STATUS::INVALID_KEY);
+
+  // Replacing key material invalidates cached contexts
+  EXPECT_EQ(ring.keyIs(2, *random(AES_GCM_KEYSIZE_256)), AES_GCM_STATUS::VALID);
+  d.ciphertextIs(ctxts[1]);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+}
+
+TEST(AES_GCM_KeyringTest, Authentication) {
+  AES_GCM_Keyring ring;
+  ring.keyIs(7, *random(AES_GCM_KEYSIZE_128));
+  ring.keyIs(8, *random(AES_GCM_KEYSIZE_128));
+  ring.primaryIs(7);
+  EXPECT_EQ(ring.keyIs(9, *random(20)), AES_GCM_STATUS::INVALID_SIZE);
+
+  AES_GCM_Keyring_Enc e(ring);
+  e.aadIs(Blob("context", 7));
+  e.plaintextIs(pt);
+  Blob ctxt = e.ciphertext()->first;
+
+  AES_GCM_Keyring_Dec d(ring);
+  d.ciphertextIs(ctxt);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  d.aadIs(Blob("context", 7));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, pt);
+
+  // Pointing the header at another key fails authentication
+  MutableBlob moved(ctxt);
+  moved.data()[3] = 8;
+  d.ciphertextIs(moved);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+
+  d.ciphertextIs(Blob(ctxt, AES_GCM_KEYRING_HEADER_BYTES, 0));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_SIZE);
+}
+
+TEST(AES_GCM_KeyringTest, ConcurrentRotation) {
+  AES_GCM_Keyring ring;
+  ring.keyIs(0, *random(AES_GCM_KEYSIZE_256));
+  ring.primaryIs(0);
+  Blob first = encrypt(ring, pt);
+
+  // Readers keep decrypting while a writer rotates keys underneath them
+  std::atomic<bool> done(false);
+  std::atomic<U64> failures(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&]() {
+      AES_GCM_Keyring_Dec d(ring);
+      while (!done) {
+        d.ciphertextIs(first);
+        if (d.plaintext().second != AES_GCM_STATUS::VALID) {
+          failures++;
+        }
+      }
+    });
+  }
+  for (AES_GCM_KeyId id = 1; id <= 90; id++) {
+    ring.keyIs(id, *random(AES_GCM_KEYSIZE_256));
+    ring.primaryIs(id);
+    Blob ctxt = encrypt(ring, pt);
+    AES_GCM_Keyring_Dec d(ring);
+    d.ciphertextIs(ctxt);
+    EXPECT_EQ(d.plaintext().first, pt);
+  }
+  done = true;
+  for (std::thread &t : readers) {
+    t.join();
+  }
+  EXPECT_EQ(failures, 0U);
+  EXPECT_EQ(ring.keys(), 91U);
+
+  // Reads are one atomic pointer load, and a snapshot taken earlier is still
+  // intact after later updates
+  EXPECT_EQ(ATOMIC_POINTER_LOCK_FREE, 2);
+  const AES_GCM_Keyring::Snapshot &before = ring.snapshot();
+  ring.keyDel(0);
+  EXPECT_EQ(before.entries.size(), 91U);
+  EXPECT_EQ(ring.snapshot().entries.size(), 90U);
+}
@@ -0,0 +1,478 @@
+#include "crypto/aes_gcm_log.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include "util/make_unique.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::string;
+using std::unique_ptr;
+using Util::make_unique;
+
+static const Byte HEADER_MAGIC[8] = {'B', 'A', 'E', 'L', 'O', 'G', 0x00, 0x01};
+static const Byte FOOTER_MAGIC[8] = {'B', 'A', 'E', 'L', 'O', 'G', 'I', 'X'};
+static const U32 SEGMENT_ID_BYTES = AES_GCM_BLOCKSIZE_BYTES;
+static const U64 INDEX_BLOCK = ~(U64)0;
+
+// Block i's IV: the segment ID with i XORed into its last 8 bytes
+static void blockIV(const Byte *_segmentId, U64 _block, Byte *_iv)
+{
+  memcpy(_iv, _segmentId, SEGMENT_ID_BYTES);
+  U64 mixed = loadBE64(_iv + 8) ^ _block;
+  storeBE64(_iv + 8, mixed);
+}
+
+// Additional data for block i: | segment ID | i | extra |
+static MutableBlob blockAAD(const Byte *_segmentId, U64 _block, const Byte *_extra,
+  U64 _extraSize)
+{
+  MutableBlob aad(SEGMENT_ID_BYTES + 8 + _extraSize);
+  memcpy(aad.data(), _segmentId, SEGMENT_ID_BYTES);
+  storeBE64(aad.data() + SEGMENT_ID_BYTES, _block);
+  memcpy(aad.data() + SEGMENT_ID_BYTES + 8, _extra, _extraSize);
+  return aad;
+}
+
+AES_GCM_LogConfig::AES_GCM_LogConfig()
+  : blockBytes(AES_GCM_LOG_BLOCK_BYTES_DEFAULT), sync(true)
+{
+  // empty
+}
+
+
+/*** WRITER ***/
+
+AES_GCM_LogWriter::AES_GCM_LogWriter(const AES_GCM_LogConfig _config)
+  : cfg_(_config), key_(), fd_(-1), segmentId_(SEGMENT_ID_BYTES), offset_(0), index_(),
+  pendingLengths_(), pendingData_(), sealedRecords_(0), syncedRecords_(0), syncing_(false),
+  error_(AES_GCM_STATUS::VALID), mux_(), synced_()
+{
+  // empty
+}
+
+AES_GCM_LogWriter::~AES_GCM_LogWriter()
+{
+  close();
+}
+
+const AES_GCM_LogConfig &AES_GCM_LogWriter::config() const
+{
+  return cfg_;
+}
+
+AES_GCM_STATUS AES_GCM_LogWriter::keyIs(const Blob &_key)
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  return key_.keyIs(_key);
+}
+
+AES_GCM_STATUS AES_GCM_LogWriter::fileIs(const string &_path)
+{
+  AES_GCM_STATUS status = close();
+  if (status != AES_GCM_STATUS::VALID) {
+    return status;
+  }
+  std::lock_guard<std::mutex> lock(mux_);
+  if (key_.keySize() == 0) {
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+  fd_ = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd_ < 0) {
+    return AES_GCM_STATUS::IO_ERROR;
+  }
+  randomize(segmentId_);
+  offset_ = 0;
+  index_.clear();
+  pendingLengths_.clear();
+  pendingData_.clear();
+  sealedRecords_ = 0;
+  syncedRecords_ = 0;
+  error_ = AES_GCM_STATUS::VALID;
+
+  Byte header[AES_GCM_LOG_HEADER_BYTES];
+  memcpy(header, HEADER_MAGIC, sizeof(HEADER_MAGIC));
+  memcpy(header + sizeof(HEADER_MAGIC), segmentId_.data(), SEGMENT_ID_BYTES);
+  return write(header, sizeof(header));
+}
+
+AES_GCM_STATUS AES_GCM_LogWriter::append(const Blob &_record, U64 &_recordNo)
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  if (fd_ < 0) {
+    return AES_GCM_STATUS::IO_ERROR;
+  }
+  if (error_ != AES_GCM_STATUS::VALID) {
+    return error_;
+  }
+  if (_record.size() > 0xffffffffULL) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  _recordNo = sealedRecords_ + pendingLengths_.size();
+  pendingLengths_.push_back((U32)_record.size());
+  pendingData_.insert(pendingData_.end(), _record.data(), _record.data() + _record.size());
+
+  // Seal full blocks right away (without syncing) to bound the pending data
+  U64 pendingBytes = pendingData_.size() + 4 * pendingLengths_.size();
+  if (pendingBytes >= cfg_.blockBytes) {
+    return seal();
+  }
+  return AES_GCM_STATUS::VALID;
+}
+
+AES_GCM_STATUS AES_GCM_LogWriter::commit()
+{
+  std::unique_lock<std::mutex> lock(mux_);
+  if (fd_ < 0) {
+    return AES_GCM_STATUS::IO_ERROR;
+  }
+  if (!pendingLengths_.empty()) {
+    seal();
+  }
+  if (!cfg_.sync) {
+    return error_;
+  }
+
+  // Group commit: one thread syncs on behalf of everything sealed so far,
+  // others wait for a sync that covers their records
+  U64 target = sealedRecords_;
+  while ((syncedRecords_ < target) && (error_ == AES_GCM_STATUS::VALID)) {
+    if (syncing_) {
+      synced_.wait(lock);
+      continue;
+    }
+    syncing_ = true;
+    U64 upTo = sealedRecords_;
+    int fd = fd_;
+    lock.unlock();
+    int rc = fdatasync(fd);
+    lock.lock();
+    syncing_ = false;
+    if (rc != 0) {
+      error_ = AES_GCM_STATUS::IO_ERROR;
+    }
+    else if (upTo > syncedRecords_) {
+      syncedRecords_ = upTo;
+    }
+    synced_.notify_all();
+  }
+  return error_;
+}
+
+AES_GCM_STATUS AES_GCM_LogWriter::close()
+{
+  AES_GCM_STATUS status = commit();
+  std::unique_lock<std::mutex> lock(mux_);
+  if (fd_ < 0) {
+    return AES_GCM_STATUS::VALID;
+  }
+  while (syncing_) {
+    synced_.wait(lock);
+  }
+
+  // Index and footer, authenticated (not encrypted) as the last block
+  if (status == AES_GCM_STATUS::VALID) {
+    U64 indexBytes = index_.size() * AES_GCM_LOG_INDEX_ENTRY_BYTES;
+    MutableBlob tail(indexBytes + AES_GCM_LOG_FOOTER_BYTES);
+    Byte *entry = tail.data();
+    for (const IndexEntry &e : index_) {
+      storeBE64(entry, e.firstRecord);
+      storeBE64(entry + 8, e.offset);
+      entry += AES_GCM_LOG_INDEX_ENTRY_BYTES;
+    }
+    Byte *footer = tail.data() + indexBytes;
+    storeBE64(footer, offset_);
+    storeBE64(footer + 8, index_.size());
+    storeBE64(footer + 16, sealedRecords_);
+    memcpy(footer + 40, FOOTER_MAGIC, sizeof(FOOTER_MAGIC));
+
+    Byte iv[AES_GCM_BLOCKSIZE_BYTES];
+    blockIV(segmentId_.data(), INDEX_BLOCK, iv);
+    MutableBlob aad = blockAAD(segmentId_.data(), INDEX_BLOCK, tail.data(), indexBytes + 24);
+    status = key_.encrypt(nullptr, footer + 24, AES_GCM_LOG_TAG_BYTES, iv, sizeof(iv),
+      aad.data(), aad.size(), nullptr, 0);
+    if (status == AES_GCM_STATUS::VALID) {
+      status = write(tail.data(), tail.size());
+    }
+    if ((status == AES_GCM_STATUS::VALID) && cfg_.sync && (fdatasync(fd_) != 0)) {
+      status = AES_GCM_STATUS::IO_ERROR;
+    }
+  }
+  if ((::close(fd_) != 0) && (status == AES_GCM_STATUS::VALID)) {
+    status = AES_GCM_STATUS::IO_ERROR;
+  }
+  fd_ = -1;
+  return status;
+}
+
+AES_GCM_STATUS AES_GCM_LogWriter::seal()
+{
+  // Block plaintext: record lengths, then record data
+  U32 count = (U32)pendingLengths_.size();
+  U64 ptxtSize = 4ULL * count + pendingData_.size();
+  if (ptxtSize > 0xffffffffULL) {
+    error_ = AES_GCM_STATUS::INVALID_SIZE;
+    return error_;
+  }
+  MutableBlob ptxt(ptxtSize, Blob::ScrubType::ZEROS);
+  for (U32 i = 0; i < count; i++) {
+    storeBE32(ptxt.data() + 4 * i, pendingLengths_[i]);
+  }
+  memcpy(ptxt.data() + 4ULL * count, pendingData_.data(), pendingData_.size());
+
+  U64 block = index_.size();
+  MutableBlob sealed(AES_GCM_LOG_BLOCK_HEADER_BYTES + ptxtSize + AES_GCM_LOG_TAG_BYTES);
+  Byte *header = sealed.data();
+  storeBE32(header, count);
+  storeBE32(header + 4, (U32)ptxtSize);
+  Byte *body = header + AES_GCM_LOG_BLOCK_HEADER_BYTES;
+  Byte iv[AES_GCM_BLOCKSIZE_BYTES];
+  blockIV(segmentId_.data(), block, iv);
+  MutableBlob aad = blockAAD(segmentId_.data(), block, header, AES_GCM_LOG_BLOCK_HEADER_BYTES);
+  AES_GCM_STATUS status = key_.encrypt(body, body + ptxtSize, AES_GCM_LOG_TAG_BYTES, iv,
+    sizeof(iv), aad.data(), aad.size(), ptxt.data(), ptxtSize);
+  if (status == AES_GCM_STATUS::VALID) {
+    U64 offset = offset_;
+    status = write(sealed.data(), sealed.size());
+    if (status == AES_GCM_STATUS::VALID) {
+      index_.push_back(IndexEntry{sealedRecords_, offset});
+      sealedRecords_ += count;
+    }
+  }
+  pendingLengths_.clear();
+  pendingData_.clear();
+  if (status != AES_GCM_STATUS::VALID) {
+    error_ = status;
+  }
+  return status;
+}
+
+AES_GCM_STATUS AES_GCM_LogWriter::write(const Byte *_data, U64 _size)
+{
+  while (_size > 0) {
+    ssize_t n = ::write(fd_, _data, _size);
+    if (n < 0) {
+      return AES_GCM_STATUS::IO_ERROR;
+    }
+    _data += n;
+    _size -= (U64)n;
+    offset_ += (U64)n;
+  }
+  return AES_GCM_STATUS::VALID;
+}
+
+
+/*** READER ***/
+
+AES_GCM_LogReader::AES_GCM_LogReader()
+  : key_(), map_(nullptr), mapSize_(0), index_(), records_(0), recovered_(false),
+  cachedBlock_(INDEX_BLOCK), cachedCount_(0), cachedPtxt_()
+{
+  // empty
+}
+
+AES_GCM_LogReader::~AES_GCM_LogReader()
+{
+  unmap();
+}
+
+AES_GCM_STATUS AES_GCM_LogReader::keyIs(const Blob &_key)
+{
+  cachedBlock_ = INDEX_BLOCK;
+  return key_.keyIs(_key);
+}
+
+AES_GCM_STATUS AES_GCM_LogReader::fileIs(const string &_path)
+{
+  unmap();
+  int fd = ::open(_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return AES_GCM_STATUS::IO_ERROR;
+  }
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || ((U64)st.st_size < AES_GCM_LOG_HEADER_BYTES)) {
+    ::close(fd);
+    return AES_GCM_STATUS::IO_ERROR;
+  }
+  void *map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return AES_GCM_STATUS::IO_ERROR;
+  }
+  map_ = (const Byte *)map;
+  mapSize_ = (U64)st.st_size;
+  if (memcmp(map_, HEADER_MAGIC, sizeof(HEADER_MAGIC)) != 0) {
+    unmap();
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  return loadIndex();
+}
+
+U64 AES_GCM_LogReader::records() const
+{
+  return records_;
+}
+
+bool AES_GCM_LogReader::recovered() const
+{
+  return recovered_;
+}
+
+unique_ptr<AES_GCM_Result> AES_GCM_LogReader::record(U64 _recordNo)
+{
+  if (_recordNo >= records_) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::INVALID_SIZE);
+  }
+
+  // The last block whose first record is <= recordNo
+  U64 lo = 0;
+  U64 hi = index_.size();
+  while (hi - lo > 1) {
+    U64 mid = lo + (hi - lo) / 2;
+    if (index_[mid].firstRecord <= _recordNo) {
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  AES_GCM_STATUS status = decryptBlock(lo);
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+
+  // Locate the record through the block's length table. The record count is
+  // the one decryptBlock() authenticated: the mapping is shared, so the file
+  // may have changed since.
+  const Byte *ptxt = cachedPtxt_.data();
+  U64 count = cachedCount_;
+  U64 slot = _recordNo - index_[lo].firstRecord;
+  if (slot >= count) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::DEC_ERROR);
+  }
+  U64 start = 4 * count;
+  for (U64 i = 0; i < slot; i++) {
+    start += loadBE32(ptxt + 4 * i);
+  }
+  U64 size = loadBE32(ptxt + 4 * slot);
+  if (start + size > cachedPtxt_.size()) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::DEC_ERROR);
+  }
+  return make_unique<AES_GCM_Result>(Blob(cachedPtxt_, size, start), AES_GCM_STATUS::VALID);
+}
+
+void AES_GCM_LogReader::unmap()
+{
+  if (map_ != nullptr) {
+    munmap(const_cast<Byte *>(map_), mapSize_);
+  }
+  map_ = nullptr;
+  mapSize_ = 0;
+  index_.clear();
+  records_ = 0;
+  recovered_ = false;
+  cachedBlock_ = INDEX_BLOCK;
+  cachedCount_ = 0;
+  cachedPtxt_ = MutableBlob();
+}
+
+AES_GCM_STATUS AES_GCM_LogReader::loadIndex()
+{
+  index_.clear();
+  recovered_ = false;
+  const Byte *segmentId = map_ + sizeof(HEADER_MAGIC);
+  const Byte *footer = map_ + mapSize_ - AES_GCM_LOG_FOOTER_BYTES;
+  if ((mapSize_ < AES_GCM_LOG_HEADER_BYTES + AES_GCM_LOG_FOOTER_BYTES) ||
+    (memcmp(footer + 40, FOOTER_MAGIC, sizeof(FOOTER_MAGIC)) != 0)) {
+    scanIndex();
+    return AES_GCM_STATUS::VALID;
+  }
+
+  // Nothing here is authenticated yet: bound the block count by the space
+  // between header and footer first, so that no sum below can wrap
+  U64 indexOffset = loadBE64(footer);
+  U64 blocks = loadBE64(footer + 8);
+  U64 body = mapSize_ - AES_GCM_LOG_HEADER_BYTES - AES_GCM_LOG_FOOTER_BYTES;
+  if (blocks > body / AES_GCM_LOG_INDEX_ENTRY_BYTES) {
+    return AES_GCM_STATUS::DEC_ERROR;
+  }
+  U64 indexBytes = blocks * AES_GCM_LOG_INDEX_ENTRY_BYTES;
+  if (indexOffset != mapSize_ - AES_GCM_LOG_FOOTER_BYTES - indexBytes) {
+    return AES_GCM_STATUS::DEC_ERROR;
+  }
+
+  // Verify the index before trusting any offset in it
+  Byte iv[AES_GCM_BLOCKSIZE_BYTES];
+  blockIV(segmentId, INDEX_BLOCK, iv);
+  MutableBlob aad = blockAAD(segmentId, INDEX_BLOCK, map_ + indexOffset, indexBytes + 24);
+  AES_GCM_STATUS status = key_.decrypt(nullptr, footer + 24, AES_GCM_LOG_TAG_BYTES, iv,
+    sizeof(iv), aad.data(), aad.size(), nullptr, 0);
+  if (status != AES_GCM_STATUS::VALID) {
+    return status;
+  }
+  const Byte *entry = map_ + indexOffset;
+  for (U64 i = 0; i < blocks; i++) {
+    index_.push_back(IndexEntry{loadBE64(entry), loadBE64(entry + 8)});
+    entry += AES_GCM_LOG_INDEX_ENTRY_BYTES;
+  }
+  records_ = loadBE64(footer + 16);
+  return AES_GCM_STATUS::VALID;
+}
+
+void AES_GCM_LogReader::scanIndex()
+{
+  // Walk complete blocks; each is still authenticated when decrypted
+  recovered_ = true;
+  records_ = 0;
+  U64 offset = AES_GCM_LOG_HEADER_BYTES;
+  while (offset + AES_GCM_LOG_BLOCK_HEADER_BYTES <= mapSize_) {
+    U64 count = loadBE32(map_ + offset);
+    U64 size = loadBE32(map_ + offset + 4);
+    U64 end = offset + AES_GCM_LOG_BLOCK_HEADER_BYTES + size + AES_GCM_LOG_TAG_BYTES;
+    if ((count == 0) || (4 * count > size) || (end > mapSize_)) {
+      break;
+    }
+    index_.push_back(IndexEntry{records_, offset});
+    records_ += count;
+    offset = end;
+  }
+}
+
+AES_GCM_STATUS AES_GCM_LogReader::decryptBlock(U64 _block)
+{
+  if (_block == cachedBlock_) {
+    return AES_GCM_STATUS::VALID;
+  }
+  cachedBlock_ = INDEX_BLOCK;
+  U64 offset = index_[_block].offset;
+  if (offset + AES_GCM_LOG_BLOCK_HEADER_BYTES > mapSize_) {
+    return AES_GCM_STATUS::DEC_ERROR;
+  }
+  const Byte *header = map_ + offset;
+  U64 count = loadBE32(header);
+  U64 size = loadBE32(header + 4);
+  if ((4 * count > size) ||
+    (offset + AES_GCM_LOG_BLOCK_HEADER_BYTES + size + AES_GCM_LOG_TAG_BYTES > mapSize_)) {
+    return AES_GCM_STATUS::DEC_ERROR;
+  }
+
+  const Byte *segmentId = map_ + sizeof(HEADER_MAGIC);
+  const Byte *body = header + AES_GCM_LOG_BLOCK_HEADER_BYTES;
+  Byte iv[AES_GCM_BLOCKSIZE_BYTES];
+  blockIV(segmentId, _block, iv);
+  MutableBlob aad = blockAAD(segmentId, _block, header, AES_GCM_LOG_BLOCK_HEADER_BYTES);
+  MutableBlob ptxt(size, Blob::ScrubType::ZEROS);
+  AES_GCM_STATUS status = key_.decrypt(ptxt.data(), body + size, AES_GCM_LOG_TAG_BYTES, iv,
+    sizeof(iv), aad.data(), aad.size(), body, size);
+  if (status == AES_GCM_STATUS::VALID) {
+    cachedPtxt_ = ptxt;
+    cachedCount_ = count;
+    cachedBlock_ = _block;
+  }
+  return status;
+}
@@ -0,0 +1,136 @@
+#ifndef CRYPTO_AES_GCM_LOG_H
+#define CRYPTO_AES_GCM_LOG_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Crypto {
+
+// Encrypted append-only log segments. Records are batched into blocks and
+// each block is sealed with a single AES/GCM operation; a sparse index (one
+// entry per block) is written at the end of the segment:
+//
+//   | magic (8) | segment ID (16) |                               header
+//   | records (4) | size (4) | ciphertext (size) | tag (16) |     block 0..n-1
+//   | first record (8) | block offset (8) | ...                   index
+//   | index offset (8) | blocks (8) | records (8) | tag (16) | magic (8) |
+//
+// A block's plaintext is the table of its record lengths (4 bytes each)
+// followed by the record data. Block i uses the segment ID with i XORed into
+// its last 8 bytes as IV, and authenticates the segment ID, i and its own
+// header, so blocks cannot be reordered or moved between segments. The index
+// and footer are authenticated as block 2^64-1 (with no ciphertext). The
+// random segment ID keeps IVs distinct between segments under the same key.
+static const U32 AES_GCM_LOG_HEADER_BYTES = 24;
+static const U32 AES_GCM_LOG_BLOCK_HEADER_BYTES = 8;
+static const U32 AES_GCM_LOG_INDEX_ENTRY_BYTES = 16;
+static const U32 AES_GCM_LOG_FOOTER_BYTES = 48;
+static const U32 AES_GCM_LOG_TAG_BYTES = 16;
+static const U32 AES_GCM_LOG_BLOCK_BYTES_DEFAULT = 65536;
+
+struct AES_GCM_LogConfig
+{
+  AES_GCM_LogConfig();
+
+  U32  blockBytes;  // Seal a block once its pending records reach this size
+  bool sync;        // fdatasync() on commit
+};
+
+// Appends are thread-safe. commit() seals the pending records and makes every
+// sealed block durable; concurrent committers share a single fdatasync()
+// (group commit).
+class AES_GCM_LogWriter
+{
+ public:
+  AES_GCM_LogWriter(const AES_GCM_LogConfig config);
+  AES_GCM_LogWriter(const AES_GCM_LogWriter &) = delete;
+  AES_GCM_LogWriter &operator=(const AES_GCM_LogWriter &) = delete;
+  ~AES_GCM_LogWriter();
+  const AES_GCM_LogConfig &config() const;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+
+  // Starts a new segment at 'path' (truncating any existing file)
+  AES_GCM_STATUS fileIs(const std::string &path);
+
+  // Queues a record and returns its record number in 'recordNo'
+  AES_GCM_STATUS append(const Util::Blob &record, U64 &recordNo);
+  AES_GCM_STATUS commit();
+
+  // Commits, then writes the index and footer and closes the segment
+  AES_GCM_STATUS close();
+
+ private:
+  struct IndexEntry
+  {
+    U64 firstRecord;
+    U64 offset;
+  };
+
+  AES_GCM_STATUS seal();
+  AES_GCM_STATUS write(const Byte *data, U64 size);
+  AES_GCM_LogConfig cfg_;
+  AES_GCM_Key key_;
+  int fd_;
+  Util::MutableBlob segmentId_;
+  U64 offset_;
+  std::vector<IndexEntry> index_;
+  std::vector<U32> pendingLengths_;
+  std::vector<Byte> pendingData_;
+  U64 sealedRecords_;
+  U64 syncedRecords_;
+  bool syncing_;
+  AES_GCM_STATUS error_;
+  std::mutex mux_;
+  std::condition_variable synced_;
+};
+
+// Reads a segment through a read-only memory map. record(n) finds the block
+// holding record n through the index and decrypts only that block; the most
+// recent block is kept, so sequential reads decrypt each block once. A segment
+// without a valid footer (e.g. after a crash) is indexed by walking the block
+// headers.
+class AES_GCM_LogReader
+{
+ public:
+  AES_GCM_LogReader();
+  AES_GCM_LogReader(const AES_GCM_LogReader &) = delete;
+  AES_GCM_LogReader &operator=(const AES_GCM_LogReader &) = delete;
+  ~AES_GCM_LogReader();
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+  AES_GCM_STATUS fileIs(const std::string &path);
+  U64 records() const;
+  bool recovered() const;
+  std::unique_ptr<AES_GCM_Result> record(U64 recordNo);
+
+ private:
+  struct IndexEntry
+  {
+    U64 firstRecord;
+    U64 offset;
+  };
+
+  void unmap();
+  AES_GCM_STATUS loadIndex();
+  void scanIndex();
+  AES_GCM_STATUS decryptBlock(U64 block);
+  AES_GCM_Key key_;
+  const Byte *map_;
+  U64 mapSize_;
+  std::vector<IndexEntry> index_;
+  U64 records_;
+  bool recovered_;
+  U64 cachedBlock_;
+  U64 cachedCount_;
+  Util::MutableBlob cachedPtxt_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_LOG_H
@@ -0,0 +1,169 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_log.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::string;
+using std::unique_ptr;
+
+static string logPath(const char *_name)
+{
+  return string("/tmp/aes_gcm_log_test_") + std::to_string(getpid()) + "_" + _name;
+}
+
+static Blob recordFor(U64 _n)
+{
+  string s = "record " + std::to_string(_n) + string(_n % 97, 'x');
+  return Blob(s);
+}
+
+TEST(AES_GCM_LogTest, Sanity) {
+  string path = logPath("sanity");
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_256);
+  AES_GCM_LogConfig cfg;
+  cfg.blockBytes = 4096;
+
+  AES_GCM_LogWriter w(cfg);
+  EXPECT_EQ(w.fileIs(path), AES_GCM_STATUS::INVALID_KEY);
+  EXPECT_EQ(w.keyIs(*key), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(w.fileIs(path), AES_GCM_STATUS::VALID);
+  for (U64 i = 0; i < 2000; i++) {
+    U64 n = 0;
+    EXPECT_EQ(w.append(recordFor(i), n), AES_GCM_STATUS::VALID);
+    EXPECT_EQ(n, i);
+    if (i % 500 == 0) {
+      EXPECT_EQ(w.commit(), AES_GCM_STATUS::VALID);
+    }
+  }
+  EXPECT_EQ(w.close(), AES_GCM_STATUS::VALID);
+
+  AES_GCM_LogReader r;
+  r.keyIs(*key);
+  EXPECT_EQ(r.fileIs(path), AES_GCM_STATUS::VALID);
+  EXPECT_FALSE(r.recovered());
+  EXPECT_EQ(r.records(), 2000U);
+  for (U64 i : {0, 1, 1999, 777, 778, 3}) {
+    unique_ptr<AES_GCM_Result> res = r.record(i);
+    EXPECT_EQ(res->second, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(res->first, recordFor(i));
+  }
+  EXPECT_EQ(r.record(2000)->second, AES_GCM_STATUS::INVALID_SIZE);
+
+  // Wrong key
+  AES_GCM_LogReader r2;
+  r2.keyIs(*random(AES_GCM_KEYSIZE_256));
+  EXPECT_EQ(r2.fileIs(path), AES_GCM_STATUS::DEC_ERROR);
+  remove(path.c_str());
+}
+
+TEST(AES_GCM_LogTest, ConcurrentAppend) {
+  string path = logPath("concurrent");
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_128);
+  AES_GCM_LogConfig cfg;
+  cfg.blockBytes = 1024;
+  AES_GCM_LogWriter w(cfg);
+  w.keyIs(*key);
+  w.fileIs(path);
+
+  // Each thread commits after every append; records keep their numbers
+  const int THREADS = 4;
+  const int PER_THREAD = 200;
+  std::vector<std::vector<std::pair<U64, Blob>>> written(THREADS);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < PER_THREAD; i++) {
+        Blob rec = recordFor(t * PER_THREAD + i);
+        U64 n = 0;
+        EXPECT_EQ(w.append(rec, n), AES_GCM_STATUS::VALID);
+        EXPECT_EQ(w.commit(), AES_GCM_STATUS::VALID);
+        written[t].push_back(std::make_pair(n, rec));
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(w.close(), AES_GCM_STATUS::VALID);
+
+  AES_GCM_LogReader r;
+  r.keyIs(*key);
+  EXPECT_EQ(r.fileIs(path), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(r.records(), (U64)(THREADS * PER_THREAD));
+  for (const std::vector<std::pair<U64, Blob>> &recs : written) {
+    for (const std::pair<U64, Blob> &rec : recs) {
+      EXPECT_EQ(r.record(rec.first)->first, rec.second);
+    }
+  }
+  remove(path.c_str());
+}
+
+TEST(AES_GCM_LogTest, TamperAndRecovery) {
+  string path = logPath("tamper");
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_256);
+  AES_GCM_LogConfig cfg;
+  cfg.blockBytes = 512;
+  cfg.sync = false;
+
+  // A segment that is never closed has no index or footer
+  AES_GCM_LogWriter *w = new AES_GCM_LogWriter(cfg);
+  w->keyIs(*key);
+  w->fileIs(path);
+  for (U64 i = 0; i < 100; i++) {
+    U64 n = 0;
+    w->append(recordFor(i), n);
+  }
+  w->commit();
+
+  AES_GCM_LogReader r;
+  r.keyIs(*key);
+  EXPECT_EQ(r.fileIs(path), AES_GCM_STATUS::VALID);
+  EXPECT_TRUE(r.recovered());
+  EXPECT_EQ(r.records(), 100U);
+  EXPECT_EQ(r.record(42)->first, recordFor(42));
+  delete w;
+
+  // Flip a ciphertext byte in the first block
+  FILE *f = fopen(path.c_str(), "r+b");
+  fseek(f, AES_GCM_LOG_HEADER_BYTES + AES_GCM_LOG_BLOCK_HEADER_BYTES + 10, SEEK_SET);
+  int c = fgetc(f);
+  fseek(f, -1, SEEK_CUR);
+  fputc(c ^ 0x01, f);
+  fclose(f);
+
+  AES_GCM_LogReader r2;
+  r2.keyIs(*key);
+  EXPECT_EQ(r2.fileIs(path), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(r2.record(0)->second, AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(r2.record(99)->first, recordFor(99));
+  remove(path.c_str());
+
+  // A forged footer whose index offset wraps around is rejected before
+  // anything is read through it
+  MutableBlob forged(1024, Blob::ScrubType::ZEROS);
+  memcpy(forged.data(), "BAELOG\x00\x01", 8);
+  Byte *footer = forged.data() + forged.size() - AES_GCM_LOG_FOOTER_BYTES;
+  storeBE64(footer, ~0ULL - AES_GCM_LOG_FOOTER_BYTES + 1);
+  storeBE64(footer + 8, forged.size() / AES_GCM_LOG_INDEX_ENTRY_BYTES);
+  memcpy(footer + 40, "BAELOGIX", 8);
+  f = fopen(path.c_str(), "wb");
+  fwrite(forged.data(), 1, forged.size(), f);
+  fclose(f);
+  AES_GCM_LogReader r3;
+  r3.keyIs(*key);
+  EXPECT_EQ(r3.fileIs(path), AES_GCM_STATUS::DEC_ERROR);
+  storeBE64(footer + 8, 1);
+  f = fopen(path.c_str(), "wb");
+  fwrite(forged.data(), 1, forged.size(), f);
+  fclose(f);
+  EXPECT_EQ(r3.fileIs(path), AES_GCM_STATUS::DEC_ERROR);
+  remove(path.c_str());
+}
@@ -0,0 +1,332 @@
+#include "crypto/aes_gcm_multi.h"
+#include "crypto/aes_gcm_key.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include "util/make_unique.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::future;
+using std::unique_ptr;
+using std::vector;
+using Util::make_unique;
+
+// Offsets within a slot
+static const U32 SLOT_IV_OFFSET = AES_GCM_KEYID_BYTES;
+static const U32 SLOT_CEK_OFFSET = SLOT_IV_OFFSET + AES_GCM_BLOCKSIZE_BYTES;
+static const U32 SLOT_TAG_OFFSET = SLOT_CEK_OFFSET + AES_GCM_MULTI_CEK_BYTES;
+static const U32 COUNT_BYTES = 4;
+
+// Wraps or unwraps the CEK of one slot. The recipient ID and slot IV are
+// authenticated with the wrapped key.
+static AES_GCM_STATUS wrapCEK(const Blob &_kek, const Byte *_cek, Byte *_slot)
+{
+  AES_GCM_Key kek;
+  AES_GCM_STATUS status = kek.keyIs(_kek);
+  if (status != AES_GCM_STATUS::VALID) {
+    return status;
+  }
+  return kek.encrypt(_slot + SLOT_CEK_OFFSET, _slot + SLOT_TAG_OFFSET,
+    AES_GCM_BLOCKSIZE_BYTES, _slot + SLOT_IV_OFFSET, AES_GCM_BLOCKSIZE_BYTES, _slot,
+    SLOT_CEK_OFFSET, _cek, AES_GCM_MULTI_CEK_BYTES);
+}
+
+static AES_GCM_STATUS unwrapCEK(const Blob &_kek, const Byte *_slot, Byte *_cek)
+{
+  AES_GCM_Key kek;
+  AES_GCM_STATUS status = kek.keyIs(_kek);
+  if (status != AES_GCM_STATUS::VALID) {
+    return status;
+  }
+  return kek.decrypt(_cek, _slot + SLOT_TAG_OFFSET, AES_GCM_BLOCKSIZE_BYTES,
+    _slot + SLOT_IV_OFFSET, AES_GCM_BLOCKSIZE_BYTES, _slot, SLOT_CEK_OFFSET,
+    _slot + SLOT_CEK_OFFSET, AES_GCM_MULTI_CEK_BYTES);
+}
+
+// A password slot derives its KEK from the password and the slot IV
+static unique_ptr<Blob> slotKEK(const Blob &_password, const Byte *_slot, PBKD_Iters _iters)
+{
+  MutableBlob salt(AES_GCM_BLOCKSIZE_BYTES);
+  memcpy(salt.data(), _slot + SLOT_IV_OFFSET, AES_GCM_BLOCKSIZE_BYTES);
+  return PBKDF2_SHA256(AES_GCM_MULTI_CEK_BYTES, _password, salt, _iters);
+}
+
+AES_GCM_Multi_Config::AES_GCM_Multi_Config()
+  : tagSize(AES_GCM_TAGSIZE_DEFAULT), PBKDIters(PBKD_ITERS_DEFAULT),
+  threads(std::max(1U, std::thread::hardware_concurrency()))
+{
+  // empty
+}
+
+
+/*** ENCRYPTION ***/
+
+AES_GCM_Multi_Enc::AES_GCM_Multi_Enc(const AES_GCM_Multi_Config _config)
+  : cfg_(_config), recipients_(), ptxt_()
+{
+  // empty
+}
+
+const AES_GCM_Multi_Config &AES_GCM_Multi_Enc::config() const
+{
+  return cfg_;
+}
+
+AES_GCM_STATUS AES_GCM_Multi_Enc::recipientKeyIs(AES_GCM_KeyId _id, const Blob &_key)
+{
+  U64 size = _key.size();
+  if ((size != AES_GCM_KEYSIZE_256) && (size != AES_GCM_KEYSIZE_128) &&
+    (size != AES_GCM_KEYSIZE_192)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  recipients_[_id] = Recipient{_key, false};
+  return AES_GCM_STATUS::VALID;
+}
+
+void AES_GCM_Multi_Enc::recipientPasswordIs(AES_GCM_KeyId _id, const Blob &_password)
+{
+  recipients_[_id] = Recipient{_password, true};
+}
+
+void AES_GCM_Multi_Enc::recipientDel(AES_GCM_KeyId _id)
+{
+  recipients_.erase(_id);
+}
+
+U64 AES_GCM_Multi_Enc::recipients() const
+{
+  return recipients_.size();
+}
+
+void AES_GCM_Multi_Enc::plaintextIs(const Blob &_plaintext)
+{
+  ptxt_ = _plaintext;
+}
+
+unique_ptr<AES_GCM_Result> AES_GCM_Multi_Enc::ciphertext()
+{
+  if (recipients_.empty()) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::INVALID_KEY);
+  }
+  U32 tagSize = AES_GCM_Tagsize(cfg_.tagSize);
+  U64 headerSize = COUNT_BYTES + recipients_.size() * AES_GCM_MULTI_SLOT_BYTES;
+  U64 ptxtSize = ptxt_.size();
+  MutableBlob mctxt(headerSize + AES_GCM_BLOCKSIZE_BYTES + ptxtSize + tagSize);
+  Byte *header = mctxt.data();
+  Byte *iv = header + headerSize;
+  Byte *body = iv + AES_GCM_BLOCKSIZE_BYTES;
+
+  // Lay out the slot table; slot IVs are needed before any derivation starts
+  storeBE32(header, (U32)recipients_.size());
+  Byte *slot = header + COUNT_BYTES;
+  for (auto &r : recipients_) {
+    storeBE32(slot, r.first);
+    randomize(slot + SLOT_IV_OFFSET, AES_GCM_BLOCKSIZE_BYTES);
+    slot += AES_GCM_MULTI_SLOT_BYTES;
+  }
+
+  // Start the (expensive) password derivations on a bounded number of
+  // threads, which take slots in turn; the calling thread joins them after
+  // the payload, and derives them all if no thread could be started
+  vector<std::pair<const Blob *, const Byte *>> derivations;
+  slot = header + COUNT_BYTES;
+  for (auto &r : recipients_) {
+    if (r.second.password) {
+      derivations.push_back(std::make_pair(&r.second.secret, (const Byte *)slot));
+    }
+    slot += AES_GCM_MULTI_SLOT_BYTES;
+  }
+  vector<unique_ptr<Blob>> keks(derivations.size());
+  std::atomic<size_t> nextDerivation(0);
+  auto derive = [&]() {
+    for (size_t i = nextDerivation++; i < derivations.size(); i = nextDerivation++) {
+      keks[i] = slotKEK(*derivations[i].first, derivations[i].second, cfg_.PBKDIters);
+    }
+  };
+  vector<future<void>> workers;
+  size_t threads = std::min(derivations.size(), (size_t)std::max(1U, cfg_.threads));
+  try {
+    while (workers.size() < threads) {
+      workers.push_back(std::async(std::launch::async, derive));
+    }
+  }
+  catch (const std::system_error &) {
+    // Out of threads; carry on with those started
+  }
+
+  // Meanwhile encrypt the payload once
+  MutableBlob cek(AES_GCM_MULTI_CEK_BYTES, Blob::ScrubType::ZEROS);
+  randomize(cek.data(), cek.size());
+  randomize(iv, AES_GCM_BLOCKSIZE_BYTES);
+  AES_GCM_Key contentKey;
+  AES_GCM_STATUS status = contentKey.keyIs(cek);
+  if (status == AES_GCM_STATUS::VALID) {
+    MutableBlob maad(Blob(mctxt, headerSize + AES_GCM_BLOCKSIZE_BYTES, 0));
+    Byte *aslot = maad.data() + COUNT_BYTES;
+    for (U64 i = 0; i < recipients_.size(); i++) {
+      memset(aslot + SLOT_CEK_OFFSET, 0, AES_GCM_MULTI_CEK_BYTES + AES_GCM_BLOCKSIZE_BYTES);
+      aslot += AES_GCM_MULTI_SLOT_BYTES;
+    }
+    status = contentKey.encrypt(body, body + ptxtSize, tagSize, iv, AES_GCM_BLOCKSIZE_BYTES,
+      maad.data(), maad.size(), ptxt_.data(), ptxtSize);
+  }
+
+  // Wrap the CEK for each recipient (all derivations must finish regardless)
+  derive();
+  for (future<void> &worker : workers) {
+    worker.get();
+  }
+  slot = header + COUNT_BYTES;
+  U64 next = 0;
+  for (auto &r : recipients_) {
+    AES_GCM_STATUS wrapStatus = AES_GCM_STATUS::VALID;
+    if (r.second.password) {
+      const unique_ptr<Blob> &kek = keks[next++];
+      wrapStatus = kek ? wrapCEK(*kek, cek.data(), slot) : AES_GCM_STATUS::INVALID_KEY;
+    }
+    else {
+      wrapStatus = wrapCEK(r.second.secret, cek.data(), slot);
+    }
+    if (status == AES_GCM_STATUS::VALID) {
+      status = wrapStatus;
+    }
+    slot += AES_GCM_MULTI_SLOT_BYTES;
+  }
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  return make_unique<AES_GCM_Result>(mctxt, AES_GCM_STATUS::VALID);
+}
+
+
+/*** DECRYPTION ***/
+
+AES_GCM_Multi_Dec::AES_GCM_Multi_Dec(const AES_GCM_Multi_Config _config)
+  : cfg_(_config), id_(0), secret_(), password_(false), ctxt_(),
+  ptxt_(Blob(), AES_GCM_STATUS::DEC_ERROR), needsDecrypt_(false), mutableMux_()
+{
+  // empty
+}
+
+AES_GCM_STATUS AES_GCM_Multi_Dec::keyIs(AES_GCM_KeyId _id, const Blob &_key)
+{
+  U64 size = _key.size();
+  if ((size != AES_GCM_KEYSIZE_256) && (size != AES_GCM_KEYSIZE_128) &&
+    (size != AES_GCM_KEYSIZE_192)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  id_ = _id;
+  secret_ = _key;
+  password_ = false;
+  needsDecrypt_ = true;
+  return AES_GCM_STATUS::VALID;
+}
+
+void AES_GCM_Multi_Dec::passwordIs(AES_GCM_KeyId _id, const Blob &_password)
+{
+  id_ = _id;
+  secret_ = _password;
+  password_ = true;
+  needsDecrypt_ = true;
+}
+
+void AES_GCM_Multi_Dec::ciphertextIs(const Blob &_ciphertext)
+{
+  ctxt_ = _ciphertext;
+  needsDecrypt_ = true;
+}
+
+const AES_GCM_Result &AES_GCM_Multi_Dec::plaintext() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  if (needsDecrypt_) {
+    decrypt();
+  }
+  return ptxt_;
+}
+
+void AES_GCM_Multi_Dec::decrypt() const
+{
+  needsDecrypt_ = false;
+  ptxt_.first.dataIsNull();
+  ptxt_.second = AES_GCM_STATUS::INVALID_SIZE;
+  U32 tagSize = AES_GCM_Tagsize(cfg_.tagSize);
+  if (ctxt_.size() < COUNT_BYTES) {
+    return;
+  }
+  const Byte *header = ctxt_.data();
+  U64 count = loadBE32(header);
+  U64 headerSize = COUNT_BYTES + count * AES_GCM_MULTI_SLOT_BYTES;
+  if ((count == 0) || (ctxt_.size() < headerSize + AES_GCM_BLOCKSIZE_BYTES + tagSize)) {
+    return;
+  }
+
+  // Binary search the sorted slot table for our recipient ID
+  const Byte *slots = header + COUNT_BYTES;
+  const Byte *slot = nullptr;
+  U64 lo = 0;
+  U64 hi = count;
+  while (lo < hi) {
+    U64 mid = lo + (hi - lo) / 2;
+    AES_GCM_KeyId midId = loadBE32(slots + mid * AES_GCM_MULTI_SLOT_BYTES);
+    if (midId == id_) {
+      slot = slots + mid * AES_GCM_MULTI_SLOT_BYTES;
+      break;
+    }
+    else if (midId < id_) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  if (slot == nullptr) {
+    ptxt_.second = AES_GCM_STATUS::INVALID_KEY;
+    return;
+  }
+
+  // Recover the CEK
+  MutableBlob cek(AES_GCM_MULTI_CEK_BYTES, Blob::ScrubType::ZEROS);
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  if (password_) {
+    unique_ptr<Blob> kek = slotKEK(secret_, slot, cfg_.PBKDIters);
+    status = kek ? unwrapCEK(*kek, slot, cek.data()) : AES_GCM_STATUS::INVALID_KEY;
+  }
+  else {
+    status = unwrapCEK(secret_, slot, cek.data());
+  }
+  AES_GCM_Key contentKey;
+  if (status == AES_GCM_STATUS::VALID) {
+    status = contentKey.keyIs(cek);
+  }
+  if (status != AES_GCM_STATUS::VALID) {
+    ptxt_.second = status;
+    return;
+  }
+
+  // Decrypt the payload
+  const Byte *iv = header + headerSize;
+  const Byte *body = iv + AES_GCM_BLOCKSIZE_BYTES;
+  U64 ctxtSize = ctxt_.size() - headerSize - AES_GCM_BLOCKSIZE_BYTES - tagSize;
+  MutableBlob aad(Blob(ctxt_, headerSize + AES_GCM_BLOCKSIZE_BYTES, 0));
+  Byte *aslot = aad.data() + COUNT_BYTES;
+  for (U64 i = 0; i < count; i++) {
+    memset(aslot + SLOT_CEK_OFFSET, 0, AES_GCM_MULTI_CEK_BYTES + AES_GCM_BLOCKSIZE_BYTES);
+    aslot += AES_GCM_MULTI_SLOT_BYTES;
+  }
+  MutableBlob ptxt(ctxtSize, Blob::ScrubType::ZEROS);
+  status = contentKey.decrypt(ptxt.data(), body + ctxtSize, tagSize, iv,
+    AES_GCM_BLOCKSIZE_BYTES, aad.data(), aad.size(), body, ctxtSize);
+  if (status == AES_GCM_STATUS::VALID) {
+    ptxt_.first = ptxt;
+  }
+  ptxt_.second = status;
+}
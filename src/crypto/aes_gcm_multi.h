@@ -0,0 +1,95 @@
+#ifndef CRYPTO_AES_GCM_MULTI_H
+#define CRYPTO_AES_GCM_MULTI_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_keyring.h"
+#include "crypto/pbkdf2_sha256.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace Crypto {
+
+// Multi-recipient messages encrypt the payload once under a random content
+// key (CEK) and wrap the CEK once per recipient:
+//
+//   | recipients (4) | slot 0 | ... | slot n-1 | IV (16) | ciphertext | tag |
+//   slot: | recipient ID (4) | IV (16) | wrapped CEK (32) | tag (16) |
+//
+// Recipients hold either an AES key or a password. For a password the slot IV
+// is also the PBKDF2 salt. Slots are sorted by recipient ID, which serves as
+// the hint that lets a decryptor go straight to its own slot. The payload
+// authenticates the recipient count, recipient IDs and slot IVs (with the
+// wrapped keys zeroed, so it can be encrypted while the slots are derived);
+// each wrapped key is authenticated under its own recipient key.
+static const U32 AES_GCM_MULTI_CEK_BYTES = AES_GCM_KEYSIZE_256;
+static const U32 AES_GCM_MULTI_SLOT_BYTES = AES_GCM_KEYID_BYTES + AES_GCM_BLOCKSIZE_BYTES +
+  AES_GCM_MULTI_CEK_BYTES + AES_GCM_BLOCKSIZE_BYTES;
+
+struct AES_GCM_Multi_Config
+{
+  AES_GCM_Multi_Config();
+
+  AES_GCM_TAGSIZE tagSize;      // Payload tag: 64, 96, 128
+  PBKD_Iters      PBKDIters;    // For password recipients
+  U32             threads;      // Most derivation threads (default: one per core)
+};
+
+class AES_GCM_Multi_Enc
+{
+ public:
+  AES_GCM_Multi_Enc(const AES_GCM_Multi_Config config);
+  AES_GCM_Multi_Enc(const AES_GCM_Multi_Enc &) = delete;
+  AES_GCM_Multi_Enc &operator=(const AES_GCM_Multi_Enc &) = delete;
+  const AES_GCM_Multi_Config &config() const;
+  AES_GCM_STATUS recipientKeyIs(AES_GCM_KeyId id, const Util::Blob &key);
+  void recipientPasswordIs(AES_GCM_KeyId id, const Util::Blob &password);
+  void recipientDel(AES_GCM_KeyId id);
+  U64 recipients() const;
+  void plaintextIs(const Util::Blob &plaintext);
+
+  // Password slots are derived in parallel with each other and with the
+  // payload encryption, on up to config().threads threads besides the
+  // caller's (fewer if the system cannot start them)
+  std::unique_ptr<AES_GCM_Result> ciphertext();
+
+ private:
+  struct Recipient
+  {
+    Util::Blob secret;
+    bool       password;
+  };
+
+  AES_GCM_Multi_Config cfg_;
+  std::map<AES_GCM_KeyId, Recipient> recipients_;
+  Util::Blob ptxt_;
+};
+
+class AES_GCM_Multi_Dec
+{
+ public:
+  AES_GCM_Multi_Dec(const AES_GCM_Multi_Config config);
+  AES_GCM_Multi_Dec(const AES_GCM_Multi_Dec &) = delete;
+  AES_GCM_Multi_Dec &operator=(const AES_GCM_Multi_Dec &) = delete;
+  AES_GCM_STATUS keyIs(AES_GCM_KeyId id, const Util::Blob &key);
+  void passwordIs(AES_GCM_KeyId id, const Util::Blob &password);
+  void ciphertextIs(const Util::Blob &ciphertext);
+  const AES_GCM_Result &plaintext() const;
+
+ private:
+  void decrypt() const;
+  AES_GCM_Multi_Config cfg_;
+  AES_GCM_KeyId id_;
+  Util::Blob secret_;
+  bool password_;
+  Util::Blob ctxt_;
+  mutable AES_GCM_Result ptxt_;
+  mutable bool needsDecrypt_;
+  mutable std::mutex mutableMux_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_MULTI_H
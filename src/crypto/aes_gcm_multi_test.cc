@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_multi.h"
+#include "crypto/random.h"
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+static Blob pt("Artifact shared by many tenants", 31);
+
+TEST(AES_GCM_MultiTest, Recipients) {
+  AES_GCM_Multi_Config cfg;
+  cfg.PBKDIters = 1000;
+  unique_ptr<Blob> k10 = random(AES_GCM_KEYSIZE_256);
+  unique_ptr<Blob> k30 = random(AES_GCM_KEYSIZE_128);
+
+  AES_GCM_Multi_Enc e(cfg);
+  e.plaintextIs(pt);
+  EXPECT_EQ(e.ciphertext()->second, AES_GCM_STATUS::INVALID_KEY);
+  EXPECT_EQ(e.recipientKeyIs(30, *k30), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(e.recipientKeyIs(10, *k10), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(e.recipientKeyIs(11, Blob("short", 5)), AES_GCM_STATUS::INVALID_SIZE);
+  e.recipientPasswordIs(20, Blob("tenant-20", 9));
+  e.recipientPasswordIs(40, Blob("tenant-40", 9));
+  e.recipientPasswordIs(50, Blob("tenant-50", 9));
+  e.recipientDel(50);
+  EXPECT_EQ(e.recipients(), 4U);
+
+  unique_ptr<AES_GCM_Result> eres = e.ciphertext();
+  EXPECT_EQ(eres->second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(eres->first.size(),
+    4 + 4 * AES_GCM_MULTI_SLOT_BYTES + AES_GCM_BLOCKSIZE_BYTES + pt.size() + 16);
+
+  // Every recipient decrypts with its own secret
+  AES_GCM_Multi_Dec d(cfg);
+  d.ciphertextIs(eres->first);
+  d.keyIs(10, *k10);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, pt);
+  d.keyIs(30, *k30);
+  EXPECT_EQ(d.plaintext().first, pt);
+  d.passwordIs(20, Blob("tenant-20", 9));
+  EXPECT_EQ(d.plaintext().first, pt);
+  d.passwordIs(40, Blob("tenant-40", 9));
+  EXPECT_EQ(d.plaintext().first, pt);
+
+  // Unknown recipients, removed recipients and wrong secrets fail
+  d.passwordIs(50, Blob("tenant-50", 9));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_KEY);
+  d.passwordIs(40, Blob("tenant-20", 9));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  d.keyIs(10, *k30);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+}
+
+TEST(AES_GCM_MultiTest, Tampering) {
+  AES_GCM_Multi_Config cfg;
+  unique_ptr<Blob> k1 = random(AES_GCM_KEYSIZE_256);
+  unique_ptr<Blob> k2 = random(AES_GCM_KEYSIZE_256);
+  AES_GCM_Multi_Enc e(cfg);
+  e.recipientKeyIs(1, *k1);
+  e.recipientKeyIs(2, *k2);
+  e.plaintextIs(pt);
+  Blob ctxt = e.ciphertext()->first;
+
+  AES_GCM_Multi_Dec d(cfg);
+  d.keyIs(2, *k2);
+
+  // Dropping a recipient from the table is detected
+  MutableBlob fewer(Blob(ctxt, ctxt.size() - AES_GCM_MULTI_SLOT_BYTES,
+    AES_GCM_MULTI_SLOT_BYTES));
+  fewer.data()[0] = 0;
+  fewer.data()[1] = 0;
+  fewer.data()[2] = 0;
+  fewer.data()[3] = 1;
+  d.ciphertextIs(fewer);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+
+  MutableBlob flipped(ctxt);
+  flipped.data()[flipped.size() - 20] ^= 0x80;
+  d.ciphertextIs(flipped);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+
+  d.ciphertextIs(Blob(ctxt, 20, 0));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_SIZE);
+  d.ciphertextIs(ctxt);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+}
+
+TEST(AES_GCM_MultiTest, ManyPasswords) {
+  // More password recipients than derivation threads
+  AES_GCM_Multi_Config cfg;
+  cfg.PBKDIters = 1000;
+  cfg.threads = 2;
+  AES_GCM_Multi_Enc e(cfg);
+  e.plaintextIs(pt);
+  for (AES_GCM_KeyId id = 1; id <= 9; id++) {
+    e.recipientPasswordIs(id, Blob(std::to_string(id)));
+  }
+  unique_ptr<AES_GCM_Result> eres = e.ciphertext();
+  ASSERT_EQ(eres->second, AES_GCM_STATUS::VALID);
+  AES_GCM_Multi_Dec d(cfg);
+  d.ciphertextIs(eres->first);
+  for (AES_GCM_KeyId id = 1; id <= 9; id++) {
+    d.passwordIs(id, Blob(std::to_string(id)));
+    EXPECT_EQ(d.plaintext().first, pt) << id;
+  }
+}
@@ -1,21 +1,56 @@
 #include "aes_gcm_pbkd.h"
+#include "crypto/byte_order.h"
+#include <cstring>
 using namespace Crypto;
 using Util::Blob;
 using Util::MutableBlob;
 using std::unique_ptr;
 
+// Binds HKDF keys to this use of the secret
+static const Blob HKDF_INFO("bae aes-gcm-pbkd", 16);
+
+// Derives directly, or through the scheduler if there is one. HKDF is cheap
+// enough that scheduling it would cost more than it saves.
+static unique_ptr<Blob> deriveKey(PBKD_KDF _kdf,
+  const std::shared_ptr<PBKD_Scheduler> &_scheduler, PBKD_Tenant _tenant,
+  std::chrono::milliseconds _timeout, U64 _keySize, const Blob &_password,
+  const Blob &_salt, U64 _iterations, AES_GCM_STATUS &_status)
+{
+  _status = AES_GCM_STATUS::VALID;
+  if (_kdf == PBKD_KDF::HKDF) {
+    unique_ptr<Blob> key = HKDF_SHA256(_keySize, _password, _salt, HKDF_INFO);
+    if (!key) {
+      _status = AES_GCM_STATUS::INVALID_KEY;
+    }
+    return key;
+  }
+  if (!_scheduler) {
+    unique_ptr<Blob> key = PBKDF2_SHA256(_keySize, _password, _salt, _iterations);
+    if (!key) {
+      _status = AES_GCM_STATUS::INVALID_KEY;
+    }
+    return key;
+  }
+  PBKD_Deadline deadline = (_timeout.count() == 0) ? PBKD_DEADLINE_NONE :
+    std::chrono::steady_clock::now() + _timeout;
+  return _scheduler->derive(_tenant, _keySize, _password, _salt, _iterations, deadline,
+    _status);
+}
+
 AES_GCM_PBKD_Config::AES_GCM_PBKD_Config()
   : keySize(AES_GCM_KEYSIZE_DEFAULT), tagSize(AES_GCM_TAGSIZE_DEFAULT),
-  ivOutput(AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD), PBKDIters(PBKD_ITERS_DEFAULT)
+  ivOutput(AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD), PBKDIters(PBKD_ITERS_DEFAULT),
+  PBKDItersHeader(false), PBKDItersMax(PBKD_ITERS_MAX), kdf(PBKD_KDF::PBKDF2),
+  compression(AES_GCM_COMPRESSION_DEFAULT), decompressedMax(COMPRESSION_MAX_BYTES_DEFAULT)
 {
   // empty
 }
 
 AES_GCM_PBKD_Enc::AES_GCM_PBKD_Enc(const AES_GCM_PBKD_Config _cfg)
-  : cfg_(_cfg), password_(), enc_(
+  : cfg_(_cfg), password_(), scheduler_(), tenant_(0), timeout_(0), enc_(
   AES_GCM_Config{_cfg.keySize, _cfg.tagSize, AES_GCM_IV_MODE::RANDOM, _cfg.ivOutput})
 {
-  // empty
+  enc_.compressionIs(cfg_.compression);
 }
 
 const AES_GCM_PBKD_Config &AES_GCM_PBKD_Enc::config() const
@@ -33,6 +68,14 @@ void AES_GCM_PBKD_Enc::plaintextIs(const Blob &_plaintext)
   enc_.plaintextIs(_plaintext);
 }
 
+void AES_GCM_PBKD_Enc::schedulerIs(const std::shared_ptr<PBKD_Scheduler> &_scheduler,
+  PBKD_Tenant _tenant, std::chrono::milliseconds _timeout)
+{
+  scheduler_ = _scheduler;
+  tenant_ = _tenant;
+  timeout_ = _timeout;
+}
+
 
 unique_ptr<AES_GCM_Result> AES_GCM_PBKD_Enc::ciphertext()
 {
@@ -45,70 +88,120 @@ unique_ptr<AES_GCM_Result> AES_GCM_PBKD_Enc::ciphertext()
   // encryption and decryption sides and passed (if needed) with the message.
 
 
-  unique_ptr<Blob> key = PBKDF2_SHA256(AES_GCM_Keysize(cfg_.keySize), password_,
-    enc_.ivc(), cfg_.PBKDIters);
-
   unique_ptr<AES_GCM_Result> result(new AES_GCM_Result());
+  unique_ptr<Blob> key = deriveKey(cfg_.kdf, scheduler_, tenant_, timeout_,
+    AES_GCM_Keysize(cfg_.keySize), password_, enc_.ivc(), cfg_.PBKDIters, result->second);
+  if (result->second != AES_GCM_STATUS::VALID) {
+    return result;
+  }
   result->second = enc_.keyIs(*key);
   if (result->second != AES_GCM_STATUS::VALID) {
     return result;
   }
-  return enc_.ciphertext();
+  result = enc_.ciphertext();
+  if (cfg_.PBKDItersHeader && (result->second == AES_GCM_STATUS::VALID)) {
+    MutableBlob out(PBKD_ITERS_HEADER_BYTES + result->first.size());
+    storeBE32(out.data(), cfg_.PBKDIters);
+    memcpy(out.data() + PBKD_ITERS_HEADER_BYTES, result->first.data(), result->first.size());
+    result->first = out;
+  }
+  return result;
 }
 
 
 // Decryption
 
 AES_GCM_PBKD_Dec::AES_GCM_PBKD_Dec(const AES_GCM_PBKD_Config _config)
-  : cfg_(_config), password_(), key_(), ciphertext_(), plaintext_(), dec_(),
-  havePassword_(false), haveCiphertext_(false)
+  : cfg_(_config), password_(), ciphertext_(), havePassword_(false), haveCiphertext_(false),
+  scheduler_(), tenant_(0), timeout_(0), key_(), keySalt_(), keyIters_(0),
+  keyDerivations_(0), plaintext_(Blob(), AES_GCM_STATUS::DEC_ERROR), dec_(),
+  needsDecrypt_(false), mutableMux_()
 {
-  // empty
+  dec_.compressionIs(cfg_.compression);
+  dec_.decompressedMaxIs(cfg_.decompressedMax);
 }
 
 void AES_GCM_PBKD_Dec::passwordIs(const Blob &_password)
 {
-  if (password_.compare(_password, Blob::CompareType::CONST) ==
-      Blob::Comparison::NE) {
-    password_ = _password;
-    havePassword_ = true;
-    if (haveCiphertext_) {
-      decrypt();
-    }
-  }
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  password_ = _password;
+  havePassword_ = true;
+  key_.reset();
+  needsDecrypt_ = true;
 }
 
 void AES_GCM_PBKD_Dec::ciphertextIs(const Blob &_ciphertext)
 {
-  if (ciphertext_ != _ciphertext) {
-    ciphertext_ = _ciphertext;
-    haveCiphertext_ = true;
-    if (havePassword_) {
-      decrypt();
-    }
-  }
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  ciphertext_ = _ciphertext;
+  haveCiphertext_ = true;
+  needsDecrypt_ = true;
+}
+
+void AES_GCM_PBKD_Dec::schedulerIs(const std::shared_ptr<PBKD_Scheduler> &_scheduler,
+  PBKD_Tenant _tenant, std::chrono::milliseconds _timeout)
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  scheduler_ = _scheduler;
+  tenant_ = _tenant;
+  timeout_ = _timeout;
 }
 
 const AES_GCM_Result &AES_GCM_PBKD_Dec::plaintext() const
 {
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  if (needsDecrypt_ && havePassword_ && haveCiphertext_) {
+    decrypt();
+    needsDecrypt_ = (plaintext_.second == AES_GCM_STATUS::BUSY);
+  }
   return plaintext_;
 }
 
+U64 AES_GCM_PBKD_Dec::keyDerivations() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  return keyDerivations_;
+}
+
 
-void AES_GCM_PBKD_Dec::decrypt()
+void AES_GCM_PBKD_Dec::decrypt() const
 {
-  // Sizes of components (under/overflow okay)
+  // Sizes of components; reject what cannot be a message before paying for
+  // a derivation
+  U32 headerSize = (cfg_.PBKDItersHeader) ? PBKD_ITERS_HEADER_BYTES : 0;
   U32 ivSize = AES_GCM_BLOCKSIZE_BYTES;
   U32 tagSize = AES_GCM_Tagsize(cfg_.tagSize);
-  U64 ctxtSize = ciphertext_.size() - ivSize - tagSize;
-
-  // Actual components (auto-truncated)
-  Blob iv(ciphertext_, ivSize, 0);
-  Blob ctxt(ciphertext_, ctxtSize, ivSize);
-  Blob tag(ciphertext_, tagSize, ivSize + ctxtSize);
+  if (ciphertext_.size() < headerSize + ivSize + tagSize) {
+    plaintext_ = AES_GCM_Result(Blob(), AES_GCM_STATUS::INVALID_SIZE);
+    return;
+  }
+  U64 ctxtSize = ciphertext_.size() - headerSize - ivSize - tagSize;
+
+  // Actual components
+  PBKD_Iters iters = (cfg_.PBKDItersHeader) ? loadBE32(ciphertext_.data()) : cfg_.PBKDIters;
+  Blob iv(ciphertext_, ivSize, headerSize);
+  Blob ctxt(ciphertext_, ctxtSize, headerSize + ivSize);
+  Blob tag(ciphertext_, tagSize, headerSize + ivSize + ctxtSize);
+  if (cfg_.PBKDItersHeader && (cfg_.kdf == PBKD_KDF::PBKDF2) &&
+    ((iters == 0) || (iters > cfg_.PBKDItersMax))) {
+    plaintext_ = AES_GCM_Result(Blob(), AES_GCM_STATUS::DEC_ERROR);
+    return;
+  }
 
-  // Recover the key
-  key_ = PBKDF2_SHA256(AES_GCM_Keysize(cfg_.keySize), password_, iv, cfg_.PBKDIters);
+  // Recover the key, unless the password, salt and count are those of the
+  // last key
+  if (!key_ || (keySalt_ != iv) || (keyIters_ != iters)) {
+    AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+    key_ = deriveKey(cfg_.kdf, scheduler_, tenant_, timeout_,
+      AES_GCM_Keysize(cfg_.keySize), password_, iv, iters, status);
+    if (status != AES_GCM_STATUS::VALID) {
+      plaintext_ = AES_GCM_Result(Blob(), status);
+      return;
+    }
+    keySalt_ = iv;
+    keyIters_ = iters;
+    keyDerivations_++;
+  }
 
   // Decrypt
   dec_.ciphertextIs(ctxt);
@@ -118,4 +211,3 @@ void AES_GCM_PBKD_Dec::decrypt()
   dec_.keyIs(*key_);
   plaintext_ = dec_.plaintext();
 }
-
@@ -1,23 +1,48 @@
 #ifndef CRYPTO_AES_GCM_PBKD_H
 #define CRYPTO_AES_GCM_PBKD_H
 
+#include "crypto/hkdf_sha256.h"
 #include "crypto/pbkdf2_sha256.h"
+#include "crypto/pbkdf2_scheduler.h"
 #include "crypto/aes_gcm.h"
 #include "util/blob.h"
 #include "util/fixed_types.h"
+#include <chrono>
 #include <mutex>
 #include <memory>
 
 namespace Crypto {
 
+// How the wrappers turn the secret into a key. PBKDF2 is for passwords and is
+// deliberately slow; HKDF (HKDF_SHA256, salted with the IV) takes well under
+// a microsecond but is only safe when the secret is already a random key of
+// at least the AES key size. HKDF ignores PBKDIters and the scheduler.
+enum class PBKD_KDF
+{
+  PBKDF2, HKDF
+};
+
+// With PBKDItersHeader, each ciphertext starts with its PBKDF2 iteration
+// count (PBKD_ITERS_HEADER_BYTES, big-endian) and decryptors use that count
+// instead of their own PBKDIters, so a count calibrated on one host (see
+// PBKDF2_SHA256_Calibrate()) decrypts on any other. The count is bound to the
+// key, so changing it fails authentication. Counts above PBKDItersMax fail
+// with DEC_ERROR before any derivation.
+static const U32 PBKD_ITERS_HEADER_BYTES = 4;
+
 struct AES_GCM_PBKD_Config
 {
   AES_GCM_PBKD_Config();
 
-  AES_GCM_KEYSIZE   keySize;      // 128, 192, 256
-  AES_GCM_TAGSIZE   tagSize;      // 64, 96, 128
-  AES_GCM_IV_OUTPUT ivOutput;     // no, prepend, prepend+aad
-  PBKD_Iters        PBKDIters;
+  AES_GCM_KEYSIZE     keySize;      // 128, 192, 256
+  AES_GCM_TAGSIZE     tagSize;      // 64, 96, 128
+  AES_GCM_IV_OUTPUT   ivOutput;     // no, prepend, prepend+aad
+  PBKD_Iters          PBKDIters;
+  bool                PBKDItersHeader;  // prepend PBKDIters (opt-in)
+  PBKD_Iters          PBKDItersMax;     // the most a header may ask for
+  PBKD_KDF            kdf;          // PBKDF2, HKDF (high-entropy secrets)
+  AES_GCM_COMPRESSION compression;  // none, deflate (opt-in); must match the encryptor's
+  U64                 decompressedMax;  // largest plaintext a compressed message may claim
 };
 
 class AES_GCM_PBKD_Enc
@@ -30,14 +55,27 @@ class AES_GCM_PBKD_Enc
   const AES_GCM_PBKD_Config &config() const;
   void passwordIs(const Util::Blob &password);
   void plaintextIs(const Util::Blob &plaintext);
+  // Derives keys through 'scheduler' on behalf of 'tenant'. A derivation not
+  // admitted within 'timeout' (zero: no limit) fails with BUSY.
+  void schedulerIs(const std::shared_ptr<PBKD_Scheduler> &scheduler, PBKD_Tenant tenant,
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
   std::unique_ptr<AES_GCM_Result> ciphertext();
 
  private:
   AES_GCM_PBKD_Config cfg_;
   Util::Blob password_;
+  std::shared_ptr<PBKD_Scheduler> scheduler_;
+  PBKD_Tenant tenant_;
+  std::chrono::milliseconds timeout_;
   AES_GCM_Enc enc_;
 };
 
+// Decryption is lazy, like AES_GCM_Dec: the setters only record their input
+// and plaintext() derives the key and decrypts once. The derived key is kept
+// and reused while the password and salt (the ciphertext's IV) are unchanged,
+// so re-reading or re-setting the same message does not run PBKDF2 again.
+// Ciphertexts too short to hold an IV and tag fail with INVALID_SIZE before
+// any derivation.
 class AES_GCM_PBKD_Dec
 {
  public:
@@ -47,18 +85,35 @@ class AES_GCM_PBKD_Dec
   AES_GCM_PBKD_Dec &operator=(AES_GCM_PBKD_Dec &&) = default;
   void passwordIs(const Util::Blob &password);
   void ciphertextIs(const Util::Blob &ciphertext);
+  // Derives keys through 'scheduler' on behalf of 'tenant'. A derivation not
+  // admitted within 'timeout' (zero: no limit) fails with BUSY.
+  void schedulerIs(const std::shared_ptr<PBKD_Scheduler> &scheduler, PBKD_Tenant tenant,
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+  // BUSY if the scheduler turned the derivation away; the next call retries
   const AES_GCM_Result &plaintext() const;
 
+  // Number of key derivations so far
+  U64 keyDerivations() const;
+
  private:
-  void decrypt();
+  void decrypt() const;
   AES_GCM_PBKD_Config cfg_;
   Util::Blob password_;
-  std::unique_ptr<Util::Blob> key_;
   Util::Blob ciphertext_;
-  AES_GCM_Result plaintext_;
-  AES_GCM_Dec dec_;
   bool havePassword_;
   bool haveCiphertext_;
+  std::shared_ptr<PBKD_Scheduler> scheduler_;
+  PBKD_Tenant tenant_;
+  std::chrono::milliseconds timeout_;
+  mutable std::unique_ptr<Util::Blob> key_;
+  mutable Util::Blob keySalt_;
+  mutable PBKD_Iters keyIters_;
+  mutable U64 keyDerivations_;
+  mutable AES_GCM_Result plaintext_;
+  mutable AES_GCM_Dec dec_;
+  mutable bool needsDecrypt_;
+  mutable std::mutex mutableMux_;
 };
 
 } // namespace Crypto
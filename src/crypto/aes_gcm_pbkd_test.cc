@@ -36,3 +36,82 @@ TEST(AES_GCM_PBKD_Test, Sanity) {
   EXPECT_NE(eres2->first, eres->first);
 }
 
+
+TEST(AES_GCM_PBKD_Test, LazyDecrypt) {
+  AES_GCM_PBKD_Config lcfg;
+  lcfg.PBKDIters = 1000;
+  AES_GCM_PBKD_Enc e(lcfg);
+  e.passwordIs(pw);
+  e.plaintextIs(pt);
+  Blob ct1 = e.ciphertext()->first;
+  Blob ct2 = e.ciphertext()->first;
+
+  // Nothing is derived until the plaintext is read
+  AES_GCM_PBKD_Dec d(lcfg);
+  d.passwordIs(Blob("stale", 5));
+  d.ciphertextIs(ct2);
+  d.passwordIs(pw);
+  d.ciphertextIs(ct1);
+  EXPECT_EQ(d.keyDerivations(), 0U);
+  EXPECT_EQ(d.plaintext().first, pt);
+  EXPECT_EQ(d.keyDerivations(), 1U);
+
+  // Same password and salt: the key is reused
+  d.ciphertextIs(ct1);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.keyDerivations(), 1U);
+
+  // A new salt, then a new password, derive again
+  d.ciphertextIs(ct2);
+  EXPECT_EQ(d.plaintext().first, pt);
+  EXPECT_EQ(d.keyDerivations(), 2U);
+  d.passwordIs(Blob("wrong", 5));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(d.keyDerivations(), 3U);
+}
+
+
+TEST(AES_GCM_PBKD_Test, ItersHeader) {
+  // Decryptors take the count from the header, whatever their own
+  AES_GCM_PBKD_Config ecfg;
+  ecfg.PBKDIters = 2000;
+  ecfg.PBKDItersHeader = true;
+  AES_GCM_PBKD_Enc e(ecfg);
+  e.passwordIs(pw);
+  e.plaintextIs(pt);
+  unique_ptr<AES_GCM_Result> eres = e.ciphertext();
+  ASSERT_EQ(eres->second, AES_GCM_STATUS::VALID);
+  ASSERT_EQ(eres->first.size(), PBKD_ITERS_HEADER_BYTES + AES_GCM_BLOCKSIZE_BYTES + 9 + 16);
+  EXPECT_EQ(Blob(eres->first, 4, 0), Blob("\x00\x00\x07\xd0", 4));
+
+  AES_GCM_PBKD_Config dcfg;
+  dcfg.PBKDIters = 1000;
+  dcfg.PBKDItersHeader = true;
+  AES_GCM_PBKD_Dec d(dcfg);
+  d.passwordIs(pw);
+  d.ciphertextIs(eres->first);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, pt);
+
+  // A changed count derives another key, which fails authentication
+  Util::MutableBlob bad(eres->first);
+  bad.data()[3] ^= 1;
+  d.ciphertextIs(bad);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(d.keyDerivations(), 2U);
+
+  // Counts past the limit, and zero, are refused without deriving
+  for (U32 iters : {dcfg.PBKDItersMax + 1, 0U}) {
+    bad.data()[0] = (Byte)(iters >> 24);
+    bad.data()[1] = (Byte)(iters >> 16);
+    bad.data()[2] = (Byte)(iters >> 8);
+    bad.data()[3] = (Byte)iters;
+    d.ciphertextIs(bad);
+    EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+    EXPECT_EQ(d.keyDerivations(), 2U);
+  }
+
+  // Too short for a header, IV and tag
+  d.ciphertextIs(Blob(eres->first, PBKD_ITERS_HEADER_BYTES + AES_GCM_BLOCKSIZE_BYTES + 15, 0));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_SIZE);
+}
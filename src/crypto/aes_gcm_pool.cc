@@ -0,0 +1,288 @@
+#include "crypto/aes_gcm_pool.h"
+#include "util/make_unique.h"
+#include <algorithm>
+
+using namespace Crypto;
+using std::shared_ptr;
+using std::vector;
+using Util::make_unique;
+
+// Distinguishes pools in the per-thread caches, which outlive any one pool
+static std::atomic<U64> nextPoolId(1);
+
+// One thread's idle contexts, of any pool. Other threads only reach in to
+// destroy the contexts of a pool being destroyed.
+struct AES_GCM_ContextPool::Shelf
+{
+  std::mutex mux;
+  std::vector<U64> pools;   // Pools that know of this shelf
+  std::vector<Idle<AES_GCM_Enc>> enc;
+  std::vector<Idle<AES_GCM_Dec>> dec;
+};
+
+template <>
+vector<AES_GCM_ContextPool::Idle<AES_GCM_Enc>> &AES_GCM_ContextPool::shelved(Shelf &_shelf)
+{
+  return _shelf.enc;
+}
+
+template <>
+vector<AES_GCM_ContextPool::Idle<AES_GCM_Dec>> &AES_GCM_ContextPool::shelved(Shelf &_shelf)
+{
+  return _shelf.dec;
+}
+
+// Drops the contexts of pool 'id' from 'idle'
+template <typename T>
+static void unshelve(vector<T> &_idle, U64 _id)
+{
+  _idle.erase(std::remove_if(_idle.begin(), _idle.end(),
+    [_id](const T &_t) { return _t.pool == _id; }), _idle.end());
+}
+
+// Encryptors are interchangeable only under the same key and configuration
+static U64 encSlot(const AES_GCM_Config &_config, AES_GCM_KeyId _id)
+{
+  U64 packed = ((U64)_config.keySize << 6) | ((U64)_config.tagSize << 4) |
+    ((U64)_config.ivMode << 2) | (U64)_config.ivOutput;
+  return ((U64)_id << 32) | packed;
+}
+
+static AES_GCM_KeyId slotKeyId(U64 _slot)
+{
+  return (AES_GCM_KeyId)(_slot >> 32);
+}
+
+AES_GCM_ContextPool::AES_GCM_ContextPool(const AES_GCM_Keyring &_keyring, U32 _perThread,
+  U32 _maxIdle, AES_GCM_TABLES _tables)
+  : keyring_(_keyring), id_(nextPoolId.fetch_add(1)), perThread_(_perThread),
+  maxIdle_(_maxIdle), tables_(_tables), created_(0), reused_(0), mux_(), idleEnc_(),
+  idleDec_(), shelves_(), counters_()
+{
+  // empty
+}
+
+AES_GCM_ContextPool::~AES_GCM_ContextPool()
+{
+  // Shelves are locked one at a time and never with mux_ held, as put()
+  // registers a shelf after releasing its lock
+  vector<std::weak_ptr<Shelf>> shelves;
+  {
+    std::lock_guard<std::mutex> lock(mux_);
+    shelves.swap(shelves_);
+  }
+  for (const std::weak_ptr<Shelf> &weak : shelves) {
+    shared_ptr<Shelf> shelf = weak.lock();
+    if (shelf) {
+      std::lock_guard<std::mutex> lock(shelf->mux);
+      unshelve(shelf->enc, id_);
+      unshelve(shelf->dec, id_);
+      shelf->pools.erase(std::remove(shelf->pools.begin(), shelf->pools.end(), id_),
+        shelf->pools.end());
+    }
+  }
+}
+
+const AES_GCM_Keyring &AES_GCM_ContextPool::keyring() const
+{
+  return keyring_;
+}
+
+AES_GCM_EncLease AES_GCM_ContextPool::enc(const AES_GCM_Config &_config, AES_GCM_KeyId _id,
+  AES_GCM_STATUS &_status)
+{
+  AES_GCM_EncLease lease;
+  if (_config.ivMode == AES_GCM_IV_MODE::MANUAL) {
+    _status = AES_GCM_STATUS::INVALID_MODE;
+    return lease;
+  }
+  const AES_GCM_Keyring::Snapshot &snapshot = keyring_.snapshot();
+  auto entry = snapshot.entries.find(_id);
+  if (entry == snapshot.entries.end()) {
+    _status = AES_GCM_STATUS::INVALID_KEY;
+    return lease;
+  }
+  U64 slot = encSlot(_config, _id);
+  _status = AES_GCM_STATUS::VALID;
+  if (!take<AES_GCM_Enc>(slot, idleEnc_, lease)) {
+    lease.ctx_ = make_unique<AES_GCM_Enc>(_config, tables_);
+    _status = lease.ctx_->keyIs(entry->second->key);
+    if ((_status == AES_GCM_STATUS::VALID) && (_config.ivMode == AES_GCM_IV_MODE::COUNTER)) {
+      _status = lease.ctx_->counterAllocatorIs(counterAllocator(_id));
+    }
+    created_.fetch_add(1, std::memory_order_relaxed);
+  }
+  else if (lease.entry_ != entry->second) {
+    _status = lease.ctx_->keyIs(entry->second->key);
+  }
+  if (_status != AES_GCM_STATUS::VALID) {
+    lease.ctx_.reset();
+    return lease;
+  }
+  lease.pool_ = this;
+  lease.slot_ = slot;
+  lease.entry_ = entry->second;
+  return lease;
+}
+
+AES_GCM_DecLease AES_GCM_ContextPool::dec(AES_GCM_KeyId _id, AES_GCM_STATUS &_status)
+{
+  AES_GCM_DecLease lease;
+  const AES_GCM_Keyring::Snapshot &snapshot = keyring_.snapshot();
+  auto entry = snapshot.entries.find(_id);
+  if (entry == snapshot.entries.end()) {
+    _status = AES_GCM_STATUS::INVALID_KEY;
+    return lease;
+  }
+  U64 slot = _id;
+  _status = AES_GCM_STATUS::VALID;
+  if (!take<AES_GCM_Dec>(slot, idleDec_, lease)) {
+    lease.ctx_ = make_unique<AES_GCM_Dec>(tables_);
+    _status = lease.ctx_->keyIs(entry->second->key);
+    created_.fetch_add(1, std::memory_order_relaxed);
+  }
+  else if (lease.entry_ != entry->second) {
+    _status = lease.ctx_->keyIs(entry->second->key);
+  }
+  if (_status != AES_GCM_STATUS::VALID) {
+    lease.ctx_.reset();
+    return lease;
+  }
+  lease.pool_ = this;
+  lease.slot_ = slot;
+  lease.entry_ = entry->second;
+  return lease;
+}
+
+U64 AES_GCM_ContextPool::created() const
+{
+  return created_.load();
+}
+
+U64 AES_GCM_ContextPool::reused() const
+{
+  return reused_.load();
+}
+
+const shared_ptr<AES_GCM_ContextPool::Shelf> &AES_GCM_ContextPool::shelf()
+{
+  static thread_local shared_ptr<Shelf> mine = std::make_shared<Shelf>();
+  return mine;
+}
+
+template <typename T>
+bool AES_GCM_ContextPool::take(U64 _slot, vector<Idle<T>> &_shared,
+  AES_GCM_PoolLease<T> &_lease)
+{
+  // Most recently returned first: this thread's cache, then the shared list
+  {
+    Shelf &shelf = *AES_GCM_ContextPool::shelf();
+    std::lock_guard<std::mutex> lock(shelf.mux);
+    vector<Idle<T>> &mine = shelved<T>(shelf);
+    for (size_t i = mine.size(); i-- > 0;) {
+      if ((mine[i].pool == id_) && (mine[i].slot == _slot)) {
+        _lease.entry_ = std::move(mine[i].entry);
+        _lease.ctx_ = std::move(mine[i].ctx);
+        mine.erase(mine.begin() + (std::ptrdiff_t)i);
+        reused_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+  std::lock_guard<std::mutex> lock(mux_);
+  for (size_t i = _shared.size(); i-- > 0;) {
+    if (_shared[i].slot == _slot) {
+      _lease.entry_ = std::move(_shared[i].entry);
+      _lease.ctx_ = std::move(_shared[i].ctx);
+      _shared[i] = std::move(_shared.back());
+      _shared.pop_back();
+      reused_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T>
+void AES_GCM_ContextPool::put(AES_GCM_PoolLease<T> &_lease, vector<Idle<T>> &_shared)
+{
+  _lease.ctx_->reset();
+
+  // Contexts for keys that left the keyring are dropped rather than kept idle
+  const AES_GCM_Keyring::Snapshot &snapshot = keyring_.snapshot();
+  auto entry = snapshot.entries.find(_lease.entry_->id);
+  if ((entry == snapshot.entries.end()) || (entry->second != _lease.entry_)) {
+    return;
+  }
+
+  Idle<T> idle{id_, _lease.slot_, std::move(_lease.entry_), std::move(_lease.ctx_)};
+  const shared_ptr<Shelf> &shelf = AES_GCM_ContextPool::shelf();
+  bool kept = false;
+  bool known = true;
+  {
+    std::lock_guard<std::mutex> lock(shelf->mux);
+    vector<Idle<T>> &mine = shelved<T>(*shelf);
+    if (mine.size() >= perThread_) {
+      // Make room by evicting the oldest context of another pool
+      auto other = std::find_if(mine.begin(), mine.end(),
+        [this](const Idle<T> &_i) { return _i.pool != id_; });
+      if (other != mine.end()) {
+        mine.erase(other);
+      }
+    }
+    if (mine.size() < perThread_) {
+      mine.push_back(std::move(idle));
+      kept = true;
+      if (std::find(shelf->pools.begin(), shelf->pools.end(), id_) == shelf->pools.end()) {
+        shelf->pools.push_back(id_);
+        known = false;
+      }
+    }
+  }
+  if (kept && known) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mux_);
+  if (kept) {
+    // This pool's first context on this thread's shelf: the destructor must
+    // find it there
+    shelves_.erase(std::remove_if(shelves_.begin(), shelves_.end(),
+      [](const std::weak_ptr<Shelf> &_s) { return _s.expired(); }), shelves_.end());
+    shelves_.push_back(shelf);
+    return;
+  }
+  if (_shared.size() < maxIdle_) {
+    _shared.push_back(std::move(idle));
+  }
+}
+
+void AES_GCM_ContextPool::put(AES_GCM_PoolLease<AES_GCM_Enc> &_lease)
+{
+  // A COUNTER mode context given another allocator is not the pool's to hand out
+  const AES_GCM_Enc &enc = *_lease.ctx_;
+  if ((enc.config().ivMode == AES_GCM_IV_MODE::COUNTER) &&
+    (enc.counterAllocator() != counterAllocator(slotKeyId(_lease.slot_)))) {
+    return;
+  }
+  _lease.ctx_->armorIs(AES_GCM_ARMOR_DEFAULT);
+  put(_lease, idleEnc_);
+}
+
+void AES_GCM_ContextPool::put(AES_GCM_PoolLease<AES_GCM_Dec> &_lease)
+{
+  _lease.ctx_->replayWindowIs(nullptr);
+  put(_lease, idleDec_);
+}
+
+shared_ptr<AES_GCM_CounterAllocator> AES_GCM_ContextPool::counterAllocator(AES_GCM_KeyId _id)
+{
+  // One per key ID, whatever the configuration (the IV does not depend on the
+  // tag size or output), for the life of the pool: a key replaced under the
+  // same ID keeps counting rather than starting over
+  std::lock_guard<std::mutex> lock(mux_);
+  shared_ptr<AES_GCM_CounterAllocator> &allocator = counters_[_id];
+  if (!allocator) {
+    allocator = std::make_shared<AES_GCM_CounterAllocator>();
+  }
+  return allocator;
+}
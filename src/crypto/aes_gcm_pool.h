@@ -0,0 +1,185 @@
+#ifndef CRYPTO_AES_GCM_POOL_H
+#define CRYPTO_AES_GCM_POOL_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_counter.h"
+#include "crypto/aes_gcm_keyring.h"
+#include "util/fixed_types.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Crypto {
+
+class AES_GCM_ContextPool;
+
+// A checked-out context. Returns the context to its pool when destroyed (or
+// on release()); move-only.
+template <typename T>
+class AES_GCM_PoolLease
+{
+ public:
+  AES_GCM_PoolLease();
+  AES_GCM_PoolLease(AES_GCM_PoolLease &&other);
+  AES_GCM_PoolLease &operator=(AES_GCM_PoolLease &&other);
+  AES_GCM_PoolLease(const AES_GCM_PoolLease &) = delete;
+  AES_GCM_PoolLease &operator=(const AES_GCM_PoolLease &) = delete;
+  ~AES_GCM_PoolLease();
+  explicit operator bool() const;
+  T *operator->() const;
+  T &operator*() const;
+  void release();
+
+ private:
+  friend class AES_GCM_ContextPool;
+  AES_GCM_ContextPool *pool_;
+  U64 slot_;
+  std::shared_ptr<const AES_GCM_Keyring::Entry> entry_;
+  std::unique_ptr<T> ctx_;
+};
+
+typedef AES_GCM_PoolLease<AES_GCM_Enc> AES_GCM_EncLease;
+typedef AES_GCM_PoolLease<AES_GCM_Dec> AES_GCM_DecLease;
+
+// Hands out keyed AES_GCM_Enc/AES_GCM_Dec contexts by (config, key ID) so
+// request-scoped code does not pay for RNG seeding, GCM setup and the initial
+// IV on every request. Returned contexts are reset(), which drops (and lets
+// the Blob scrub) their inputs and last plaintext, and lose whatever else the
+// lessee set: armor, replay window, compression. Each thread keeps a few idle
+// contexts of its own behind a lock that only the destruction of a pool
+// contends, so checkout and return normally wait for nobody; overflow goes to
+// a shared, bounded free list. A context whose key was replaced in the
+// keyring is re-keyed on checkout, and one whose key was removed is
+// discarded. Destroying the pool destroys its idle contexts, on every
+// thread. Thread-safe; the pool must outlive its leases.
+//
+// COUNTER mode encryptors of one key ID share a counter allocator owned by
+// the pool, whatever their tag size or IV output, so no two of its leases
+// ever mint the same IV under a key.
+// Other encryptors of the same key (outside this pool, or in another pool)
+// must not use COUNTER mode. MANUAL mode is refused with INVALID_MODE: a
+// context would carry its last IV over to the next lessee.
+class AES_GCM_ContextPool
+{
+ public:
+  AES_GCM_ContextPool(const AES_GCM_Keyring &keyring, U32 perThread = 4, U32 maxIdle = 1024,
+    AES_GCM_TABLES tables = AES_GCM_TABLES_DEFAULT);
+  AES_GCM_ContextPool(const AES_GCM_ContextPool &) = delete;
+  AES_GCM_ContextPool &operator=(const AES_GCM_ContextPool &) = delete;
+  ~AES_GCM_ContextPool();
+  const AES_GCM_Keyring &keyring() const;
+
+  // An encryptor for 'config' keyed with key 'id', or an empty lease with the
+  // reason in 'status'
+  AES_GCM_EncLease enc(const AES_GCM_Config &config, AES_GCM_KeyId id,
+    AES_GCM_STATUS &status);
+  AES_GCM_DecLease dec(AES_GCM_KeyId id, AES_GCM_STATUS &status);
+
+  // Contexts constructed, and checkouts served by an idle context
+  U64 created() const;
+  U64 reused() const;
+
+ private:
+  template <typename T> friend class AES_GCM_PoolLease;
+  template <typename T> struct Idle
+  {
+    U64 pool;
+    U64 slot;
+    std::shared_ptr<const AES_GCM_Keyring::Entry> entry;
+    std::unique_ptr<T> ctx;
+  };
+
+  struct Shelf;
+
+  static const std::shared_ptr<Shelf> &shelf();
+  template <typename T> static std::vector<Idle<T>> &shelved(Shelf &shelf);
+  template <typename T> bool take(U64 slot, std::vector<Idle<T>> &shared,
+    AES_GCM_PoolLease<T> &lease);
+  template <typename T> void put(AES_GCM_PoolLease<T> &lease,
+    std::vector<Idle<T>> &shared);
+  void put(AES_GCM_PoolLease<AES_GCM_Enc> &lease);
+  void put(AES_GCM_PoolLease<AES_GCM_Dec> &lease);
+  std::shared_ptr<AES_GCM_CounterAllocator> counterAllocator(AES_GCM_KeyId id);
+  const AES_GCM_Keyring &keyring_;
+  const U64 id_;
+  const U32 perThread_;
+  const U32 maxIdle_;
+  const AES_GCM_TABLES tables_;
+  std::atomic<U64> created_;
+  std::atomic<U64> reused_;
+  std::mutex mux_;
+  std::vector<Idle<AES_GCM_Enc>> idleEnc_;
+  std::vector<Idle<AES_GCM_Dec>> idleDec_;
+  std::vector<std::weak_ptr<Shelf>> shelves_;
+  std::unordered_map<AES_GCM_KeyId, std::shared_ptr<AES_GCM_CounterAllocator>> counters_;
+};
+
+template <typename T>
+AES_GCM_PoolLease<T>::AES_GCM_PoolLease()
+  : pool_(nullptr), slot_(0), entry_(), ctx_()
+{
+  // empty
+}
+
+template <typename T>
+AES_GCM_PoolLease<T>::AES_GCM_PoolLease(AES_GCM_PoolLease &&_other)
+  : pool_(_other.pool_), slot_(_other.slot_), entry_(std::move(_other.entry_)),
+  ctx_(std::move(_other.ctx_))
+{
+  _other.pool_ = nullptr;
+}
+
+template <typename T>
+AES_GCM_PoolLease<T> &AES_GCM_PoolLease<T>::operator=(AES_GCM_PoolLease &&_other)
+{
+  if (this != &_other) {
+    release();
+    pool_ = _other.pool_;
+    slot_ = _other.slot_;
+    entry_ = std::move(_other.entry_);
+    ctx_ = std::move(_other.ctx_);
+    _other.pool_ = nullptr;
+  }
+  return *this;
+}
+
+template <typename T>
+AES_GCM_PoolLease<T>::~AES_GCM_PoolLease()
+{
+  release();
+}
+
+template <typename T>
+AES_GCM_PoolLease<T>::operator bool() const
+{
+  return (bool)ctx_;
+}
+
+template <typename T>
+T *AES_GCM_PoolLease<T>::operator->() const
+{
+  return ctx_.get();
+}
+
+template <typename T>
+T &AES_GCM_PoolLease<T>::operator*() const
+{
+  return *ctx_;
+}
+
+template <typename T>
+void AES_GCM_PoolLease<T>::release()
+{
+  if ((pool_ != nullptr) && ctx_) {
+    pool_->put(*this);
+  }
+  pool_ = nullptr;
+  entry_.reset();
+  ctx_.reset();
+}
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_POOL_H
@@ -0,0 +1,211 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_pool.h"
+#include "crypto/aes_gcm_replay.h"
+#include "crypto/random.h"
+#include <future>
+#include <thread>
+
+using namespace Crypto;
+using Util::Blob;
+using std::unique_ptr;
+
+static AES_GCM_Config cfg = {AES_GCM_KEYSIZE::K256, AES_GCM_TAGSIZE::T128,
+  AES_GCM_IV_MODE::RANDOM, AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+
+static Blob decrypt(AES_GCM_Dec &_dec, const Blob &_ct)
+{
+  U64 ctxtSize = _ct.size() - AES_GCM_BLOCKSIZE_BYTES - 16;
+  _dec.ivIs(Blob(_ct, AES_GCM_BLOCKSIZE_BYTES, 0));
+  _dec.tagIs(Blob(_ct, 16, AES_GCM_BLOCKSIZE_BYTES + ctxtSize));
+  _dec.ciphertextIs(Blob(_ct, ctxtSize, AES_GCM_BLOCKSIZE_BYTES));
+  return _dec.plaintext().first;
+}
+
+TEST(AES_GCM_PoolTest, Sanity) {
+  AES_GCM_Keyring keyring;
+  keyring.keyIs(1, *random(AES_GCM_KEYSIZE_256));
+  AES_GCM_ContextPool pool(keyring);
+  Blob pt("pooled", 6);
+
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  EXPECT_FALSE(pool.enc(cfg, 2, status));
+  EXPECT_EQ(status, AES_GCM_STATUS::INVALID_KEY);
+
+  Blob ct;
+  {
+    AES_GCM_EncLease e = pool.enc(cfg, 1, status);
+    EXPECT_EQ(status, AES_GCM_STATUS::VALID);
+    e->plaintextIs(pt);
+    ct = e->ciphertext()->first;
+  }
+  {
+    // The returned context is reused, with its plaintext dropped
+    AES_GCM_EncLease e = pool.enc(cfg, 1, status);
+    EXPECT_EQ(pool.created(), 1U);
+    EXPECT_EQ(pool.reused(), 1U);
+    EXPECT_EQ(e->ciphertext()->first.size(), AES_GCM_BLOCKSIZE_BYTES + 16);
+  }
+  {
+    AES_GCM_DecLease d = pool.dec(1, status);
+    EXPECT_EQ(decrypt(*d, ct), pt);
+  }
+  {
+    AES_GCM_DecLease d = pool.dec(1, status);
+    EXPECT_EQ(d->plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  }
+
+  // Replaced key material re-keys idle contexts; decrypting old data fails
+  keyring.keyIs(1, *random(AES_GCM_KEYSIZE_256));
+  {
+    AES_GCM_DecLease d = pool.dec(1, status);
+    EXPECT_EQ(status, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(decrypt(*d, ct).size(), 0U);
+    EXPECT_EQ(d->plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  }
+  keyring.keyDel(1);
+  EXPECT_FALSE(pool.dec(1, status));
+}
+
+TEST(AES_GCM_PoolTest, Threads) {
+  AES_GCM_Keyring keyring;
+  keyring.keyIs(7, *random(AES_GCM_KEYSIZE_256));
+  AES_GCM_ContextPool pool(keyring, 2, 8);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&pool]() {
+      Blob pt("threaded", 8);
+      for (int i = 0; i < 200; i++) {
+        AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+        Blob ct;
+        {
+          AES_GCM_EncLease e = pool.enc(cfg, 7, status);
+          e->plaintextIs(pt);
+          ct = e->ciphertext()->first;
+        }
+        AES_GCM_DecLease d = pool.dec(7, status);
+        EXPECT_EQ(decrypt(*d, ct), pt);
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  // Each thread builds its own pair once, then reuses it
+  EXPECT_LE(pool.created(), 8U);
+  EXPECT_EQ(pool.created() + pool.reused(), 1600U);
+}
+
+TEST(AES_GCM_PoolTest, CounterIVs) {
+  // Concurrent COUNTER mode leases of one key never share an IV, nor does a
+  // returned context reused later
+  AES_GCM_Keyring keyring;
+  keyring.keyIs(1, *random(AES_GCM_KEYSIZE_256));
+  AES_GCM_ContextPool pool(keyring);
+  AES_GCM_Config ccfg = {AES_GCM_KEYSIZE::K256, AES_GCM_TAGSIZE::T128,
+    AES_GCM_IV_MODE::COUNTER, AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  AES_GCM_STATUS status = AES_GCM_STATUS::DEC_ERROR;
+  std::vector<Blob> ivs;
+  {
+    AES_GCM_EncLease a = pool.enc(ccfg, 1, status);
+    ASSERT_EQ(status, AES_GCM_STATUS::VALID);
+    AES_GCM_EncLease b = pool.enc(ccfg, 1, status);
+    ASSERT_EQ(status, AES_GCM_STATUS::VALID);
+    a->plaintextIs(Blob("first", 5));
+    b->plaintextIs(Blob("other", 5));
+    ivs.push_back(Blob(a->ciphertext()->first, AES_GCM_BLOCKSIZE_BYTES, 0));
+    ivs.push_back(Blob(b->ciphertext()->first, AES_GCM_BLOCKSIZE_BYTES, 0));
+    EXPECT_NE(ivs[0], ivs[1]);
+  }
+  AES_GCM_EncLease c = pool.enc(ccfg, 1, status);
+  ASSERT_EQ(status, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(pool.reused(), 1U);
+  Blob iv(c->ciphertext()->first, AES_GCM_BLOCKSIZE_BYTES, 0);
+  EXPECT_NE(iv, ivs[0]);
+  EXPECT_NE(iv, ivs[1]);
+  ivs.push_back(iv);
+
+  // Nor do leases of the same key under other tag sizes or IV outputs
+  AES_GCM_Config tcfg = ccfg;
+  tcfg.tagSize = AES_GCM_TAGSIZE::T96;
+  AES_GCM_Config ocfg = ccfg;
+  ocfg.ivOutput = AES_GCM_IV_OUTPUT::CTXT_PREPEND;
+  for (const AES_GCM_Config &cfg : {tcfg, ocfg}) {
+    AES_GCM_EncLease other = pool.enc(cfg, 1, status);
+    ASSERT_EQ(status, AES_GCM_STATUS::VALID);
+    Blob otherIv(other->ciphertext()->first, AES_GCM_BLOCKSIZE_BYTES, 0);
+    for (const Blob &seen : ivs) {
+      EXPECT_NE(otherIv, seen);
+    }
+    ivs.push_back(otherIv);
+  }
+
+  // The caller sets MANUAL IVs, which a pooled context would carry over
+  AES_GCM_Config mcfg = ccfg;
+  mcfg.ivMode = AES_GCM_IV_MODE::MANUAL;
+  EXPECT_FALSE(pool.enc(mcfg, 1, status));
+  EXPECT_EQ(status, AES_GCM_STATUS::INVALID_MODE);
+}
+
+TEST(AES_GCM_PoolTest, Scrubbed) {
+  // A reused context keeps nothing its last lessee set
+  AES_GCM_Keyring keyring;
+  keyring.keyIs(1, *random(AES_GCM_KEYSIZE_256));
+  AES_GCM_ContextPool pool(keyring);
+  AES_GCM_Config ccfg = {AES_GCM_KEYSIZE::K256, AES_GCM_TAGSIZE::T128,
+    AES_GCM_IV_MODE::COUNTER, AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  Blob pt("pooled", 6);
+  {
+    AES_GCM_EncLease e = pool.enc(ccfg, 1, status);
+    e->armorIs(AES_GCM_ARMOR::HEX);
+  }
+  Blob ct;
+  {
+    AES_GCM_EncLease e = pool.enc(ccfg, 1, status);
+    EXPECT_EQ(pool.reused(), 1U);
+    e->plaintextIs(pt);
+    ct = e->ciphertext()->first;
+    EXPECT_EQ(ct.size(), AES_GCM_BLOCKSIZE_BYTES + pt.size() + 16);
+  }
+  {
+    AES_GCM_DecLease d = pool.dec(1, status);
+    d->replayWindowIs(std::make_shared<AES_GCM_ReplayWindow>());
+    EXPECT_EQ(decrypt(*d, ct), pt);
+  }
+  {
+    AES_GCM_DecLease d = pool.dec(1, status);
+    EXPECT_EQ(pool.reused(), 2U);
+    EXPECT_EQ(decrypt(*d, ct), pt);
+    EXPECT_EQ(d->plaintext().second, AES_GCM_STATUS::VALID);
+  }
+}
+
+TEST(AES_GCM_PoolTest, Destroyed) {
+  // A destroyed pool's idle contexts go with it, from every thread's cache,
+  // releasing their hold on the key
+  AES_GCM_Keyring keyring;
+  keyring.keyIs(1, *random(AES_GCM_KEYSIZE_256));
+  std::shared_ptr<const AES_GCM_Keyring::Entry> entry = keyring.snapshot().entries.at(1);
+  long held = entry.use_count();
+  std::promise<void> returned;
+  std::promise<void> destroyed;
+  std::thread other;
+  {
+    AES_GCM_ContextPool pool(keyring);
+    AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+    pool.enc(cfg, 1, status);
+    pool.dec(1, status);
+    std::shared_future<void> done = destroyed.get_future().share();
+    other = std::thread([&pool, &returned, done]() {
+      AES_GCM_STATUS s = AES_GCM_STATUS::VALID;
+      pool.enc(cfg, 1, s);
+      returned.set_value();
+      done.wait();
+    });
+    returned.get_future().wait();
+    EXPECT_EQ(entry.use_count(), held + 3);
+  }
+  EXPECT_EQ(entry.use_count(), held);
+  destroyed.set_value();
+  other.join();
+}
@@ -0,0 +1,247 @@
+#include "crypto/aes_gcm_range.h"
+#include "crypto/byte_order.h"
+#include "util/make_unique.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+using Util::make_unique;
+
+// GCM's standard IV size, for which the pre-counter block is the IV itself
+static const U32 GCM_IV96_BYTES = 12;
+
+// Multiplication in GCM's field, bit by bit (SP 800-38D, algorithm 1). It
+// only serves the few products per message that the backends' GHASH does not
+// expose.
+static void gfMul(Byte *_x, const Byte *_y)
+{
+  Byte z[AES_GCM_BLOCKSIZE_BYTES] = {0};
+  Byte v[AES_GCM_BLOCKSIZE_BYTES];
+  memcpy(v, _y, sizeof(v));
+  for (U32 i = 0; i < 8 * AES_GCM_BLOCKSIZE_BYTES; i++) {
+    if ((_x[i / 8] >> (7 - i % 8)) & 1) {
+      for (U32 j = 0; j < AES_GCM_BLOCKSIZE_BYTES; j++) {
+        z[j] ^= v[j];
+      }
+    }
+    Byte lsb = v[AES_GCM_BLOCKSIZE_BYTES - 1] & 1;
+    for (U32 j = AES_GCM_BLOCKSIZE_BYTES - 1; j > 0; j--) {
+      v[j] = (Byte)((v[j] >> 1) | (v[j - 1] << 7));
+    }
+    v[0] = (Byte)((v[0] >> 1) ^ (lsb * 0xe1));
+  }
+  memcpy(_x, z, sizeof(z));
+}
+
+static void xorBlock(Byte *_block, const Byte *_other, U64 _size)
+{
+  for (U64 i = 0; i < _size; i++) {
+    _block[i] ^= _other[i];
+  }
+}
+
+AES_GCM_RangeDec::AES_GCM_RangeDec(AES_GCM_TABLES _tables)
+  : ctxt_(), iv_(), tag_(), aad_(), keyed_(false), h_(), j0_(),
+  cipher_(backend().gcm(_tables)), ctr_(backend().aesCtr()),
+  verified_(AES_GCM_STATUS::UNVERIFIED), ctrMux_(), verifyMux_()
+{
+  // empty
+}
+
+AES_GCM_STATUS AES_GCM_RangeDec::keyIs(const Blob &_key)
+{
+  U64 size = _key.size();
+  if ((size != AES_GCM_KEYSIZE_256) && (size != AES_GCM_KEYSIZE_128) &&
+    (size != AES_GCM_KEYSIZE_192)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+
+  // The GHASH key H is the encrypted zero block: CTR from a zero counter
+  static const Byte zeros[AES_GCM_BLOCKSIZE_BYTES] = {0};
+  verified_ = AES_GCM_STATUS::UNVERIFIED;
+  keyed_ = cipher_->keyIs(_key.data(), (U32)size) && ctr_->keyIs(_key.data(), (U32)size) &&
+    ctr_->crypt(h_, zeros, sizeof(zeros), zeros);
+  if (!keyed_) {
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+  counterIs();
+  return AES_GCM_STATUS::VALID;
+}
+
+void AES_GCM_RangeDec::ivIs(const Blob &_iv)
+{
+  iv_ = _iv;
+  verified_ = AES_GCM_STATUS::UNVERIFIED;
+  counterIs();
+}
+
+void AES_GCM_RangeDec::tagIs(const Blob &_tag)
+{
+  tag_ = _tag;
+  verified_ = AES_GCM_STATUS::UNVERIFIED;
+}
+
+void AES_GCM_RangeDec::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+  verified_ = AES_GCM_STATUS::UNVERIFIED;
+}
+
+void AES_GCM_RangeDec::ciphertextIs(const Blob &_ciphertext)
+{
+  ctxt_ = _ciphertext;
+  verified_ = AES_GCM_STATUS::UNVERIFIED;
+}
+
+unique_ptr<AES_GCM_Result> AES_GCM_RangeDec::range(U64 _offset, U64 _length) const
+{
+  U64 size = ctxt_.size();
+  if (!keyed_ || (iv_.size() == 0) || (_offset > size) || (_length > size - _offset)) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::INVALID_SIZE);
+  }
+
+  // Read before decrypting: a verify() finishing meanwhile leaves these
+  // bytes UNVERIFIED, never the reverse
+  AES_GCM_STATUS status = verified_;
+  if (status == AES_GCM_STATUS::DEC_ERROR) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  MutableBlob ptxt(_length, Blob::ScrubType::ZEROS);
+  if (!ctr(ptxt.data(), _offset, _length)) {
+    return make_unique<AES_GCM_Result>(Blob(), AES_GCM_STATUS::DEC_ERROR);
+  }
+  return make_unique<AES_GCM_Result>(ptxt, status);
+}
+
+AES_GCM_STATUS AES_GCM_RangeDec::verify() const
+{
+  std::lock_guard<std::mutex> lock(verifyMux_);
+  AES_GCM_STATUS status = verified_;
+  if (status == AES_GCM_STATUS::UNVERIFIED) {
+    status = authenticate();
+    if ((status == AES_GCM_STATUS::VALID) || (status == AES_GCM_STATUS::DEC_ERROR)) {
+      verified_ = status;
+    }
+  }
+  return status;
+}
+
+std::shared_future<AES_GCM_STATUS> AES_GCM_RangeDec::verifyAsync() const
+{
+  return std::async(std::launch::async, [this]() { return verify(); }).share();
+}
+
+AES_GCM_STATUS AES_GCM_RangeDec::verified() const
+{
+  return verified_;
+}
+
+void AES_GCM_RangeDec::counterIs()
+{
+  // The pre-counter block J0 (SP 800-38D, 7.1): the IV and a counter of one,
+  // or GHASH of the IV and its length for other IV sizes
+  U64 ivSize = iv_.size();
+  if (!keyed_ || (ivSize == 0)) {
+    return;
+  }
+  if (ivSize == GCM_IV96_BYTES) {
+    memcpy(j0_, iv_.data(), GCM_IV96_BYTES);
+    storeBE32(j0_ + GCM_IV96_BYTES, 1);
+    return;
+  }
+  memset(j0_, 0, sizeof(j0_));
+  for (U64 done = 0; done < ivSize; done += AES_GCM_BLOCKSIZE_BYTES) {
+    xorBlock(j0_, iv_.data() + done, std::min<U64>(AES_GCM_BLOCKSIZE_BYTES, ivSize - done));
+    gfMul(j0_, h_);
+  }
+  Byte lengths[AES_GCM_BLOCKSIZE_BYTES] = {0};
+  storeBE64(lengths + 8, 8 * ivSize);
+  xorBlock(j0_, lengths, sizeof(lengths));
+  gfMul(j0_, h_);
+}
+
+bool AES_GCM_RangeDec::ctr(Byte *_out, U64 _offset, U64 _length) const
+{
+  std::lock_guard<std::mutex> lock(ctrMux_);
+  const Byte *ctxt = ctxt_.data();
+  U64 size = ctxt_.size();
+  U32 first = loadBE32(j0_ + 12);
+  Byte counter[AES_GCM_BLOCKSIZE_BYTES];
+  memcpy(counter, j0_, sizeof(counter));
+  U64 end = _offset + _length;
+  for (U64 pos = _offset; pos < end;) {
+    // Block b is under counter J0 + 1 + b, incremented in the low 32 bits
+    // only. The backends carry into the upper 96 bits, so each run stops
+    // where the low word wraps.
+    U64 block = pos / AES_GCM_BLOCKSIZE_BYTES;
+    U32 low = (U32)((U64)first + 1 + block);
+    storeBE32(counter + 12, low);
+    U64 wrap = (block + ((1ULL << 32) - low)) * AES_GCM_BLOCKSIZE_BYTES;
+    U64 runEnd = std::min(end, wrap);
+    U64 skip = pos % AES_GCM_BLOCKSIZE_BYTES;
+    if (skip != 0) {
+      // A range starting mid-block: decrypt the block aside
+      Byte tmp[AES_GCM_BLOCKSIZE_BYTES];
+      U64 start = pos - skip;
+      U64 avail = std::min<U64>(AES_GCM_BLOCKSIZE_BYTES, size - start);
+      if (!ctr_->crypt(tmp, ctxt + start, avail, counter)) {
+        return false;
+      }
+      U64 step = std::min(avail - skip, end - pos);
+      memcpy(_out + (pos - _offset), tmp + skip, step);
+      pos += step;
+    }
+    else {
+      if (!ctr_->crypt(_out + (pos - _offset), ctxt + pos, runEnd - pos, counter)) {
+        return false;
+      }
+      pos = runEnd;
+    }
+  }
+  return true;
+}
+
+AES_GCM_STATUS AES_GCM_RangeDec::authenticate() const
+{
+  U64 tagSize = tag_.size();
+  if (!keyed_ || (iv_.size() == 0) || (tagSize == 0) || (tagSize > AES_GCM_BLOCKSIZE_BYTES)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+
+  // The backend's GHASH runs over the ciphertext as if it were more AAD,
+  // after the authenticated data padded to a block, with no plaintext. Every
+  // GHASH block is then the same as for the message except the last, which
+  // holds the lengths; GHASH being linear, the tags differ by the XOR of the
+  // two length blocks times H.
+  static const Byte zeros[AES_GCM_BLOCKSIZE_BYTES] = {0};
+  U64 authSize = aad_.size() + iv_.size();
+  U64 pad = (AES_GCM_BLOCKSIZE_BYTES - authSize % AES_GCM_BLOCKSIZE_BYTES) %
+    AES_GCM_BLOCKSIZE_BYTES;
+  U64 ctxtSize = ctxt_.size();
+  Byte tag[AES_GCM_BLOCKSIZE_BYTES];
+  bool ok = cipher_->encryptBegin(iv_.data(), (U32)iv_.size(), aad_.data(), aad_.size()) &&
+    cipher_->encryptAad(iv_.data(), iv_.size()) && cipher_->encryptAad(zeros, pad) &&
+    cipher_->encryptAad(ctxt_.data(), ctxtSize) && cipher_->encryptEnd(tag, sizeof(tag));
+  if (!ok) {
+    return AES_GCM_STATUS::DEC_ERROR;
+  }
+  Byte lengths[AES_GCM_BLOCKSIZE_BYTES];
+  Byte asAad[AES_GCM_BLOCKSIZE_BYTES];
+  storeBE64(lengths, 8 * authSize);
+  storeBE64(lengths + 8, 8 * ctxtSize);
+  storeBE64(asAad, 8 * (authSize + pad + ctxtSize));
+  storeBE64(asAad + 8, 0);
+  xorBlock(lengths, asAad, sizeof(lengths));
+  gfMul(lengths, h_);
+  xorBlock(tag, lengths, sizeof(tag));
+
+  // Compare all of the tag, whatever the first difference
+  Byte diff = 0;
+  for (U64 i = 0; i < tagSize; i++) {
+    diff |= (Byte)(tag[i] ^ tag_.data()[i]);
+  }
+  return (diff == 0) ? AES_GCM_STATUS::VALID : AES_GCM_STATUS::DEC_ERROR;
+}
@@ -0,0 +1,70 @@
+#ifndef CRYPTO_AES_GCM_RANGE_H
+#define CRYPTO_AES_GCM_RANGE_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/backend.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+
+namespace Crypto {
+
+// Ranged reads from one large (uncompressed) AES/GCM message, as an
+// alternative to AES_GCM_Dec::plaintext() decrypting all of it. GCM encrypts
+// in counter mode, so range() seeks the counter and decrypts only the bytes
+// asked for. Those bytes are UNVERIFIED: the tag covers the whole message,
+// and until verify() has checked it they may be forged. verify() runs GHASH
+// over the ciphertext without decrypting it, on demand or on another thread
+// (verifyAsync()) while range() keeps serving reads; afterwards range()
+// returns VALID, or DEC_ERROR and no data for a forgery.
+//
+// The inputs are those of AES_GCM_Dec: the authenticated data is the AAD (if
+// any) followed by the IV, as AES_GCM_Enc writes them with CTXT_PREPEND_AAD.
+// Setters must not run concurrently with reads.
+class AES_GCM_RangeDec
+{
+ public:
+  AES_GCM_RangeDec(AES_GCM_TABLES tables = AES_GCM_TABLES_DEFAULT);
+  AES_GCM_RangeDec(const AES_GCM_RangeDec &) = delete;
+  AES_GCM_RangeDec &operator=(const AES_GCM_RangeDec &) = delete;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+  void ivIs(const Util::Blob &iv);
+  void tagIs(const Util::Blob &tag);
+  void aadIs(const Util::Blob &aad);
+  void ciphertextIs(const Util::Blob &ciphertext);
+
+  // Plaintext bytes [offset, offset + length), which must lie within the
+  // message, with UNVERIFIED, VALID or DEC_ERROR as above
+  std::unique_ptr<AES_GCM_Result> range(U64 offset, U64 length) const;
+
+  // Checks the tag (once; the result is kept until an input changes)
+  AES_GCM_STATUS verify() const;
+  std::shared_future<AES_GCM_STATUS> verifyAsync() const;
+
+  // UNVERIFIED until verify() has finished
+  AES_GCM_STATUS verified() const;
+
+ private:
+  void counterIs();
+  bool ctr(Byte *out, U64 offset, U64 length) const;
+  AES_GCM_STATUS authenticate() const;
+  Util::Blob ctxt_;
+  Util::Blob iv_;
+  Util::Blob tag_;
+  Util::Blob aad_;
+  bool keyed_;
+  Byte h_[AES_GCM_BLOCKSIZE_BYTES];
+  Byte j0_[AES_GCM_BLOCKSIZE_BYTES];
+  std::unique_ptr<AES_GCM_Cipher> cipher_;
+  std::unique_ptr<AES_CTR> ctr_;
+  mutable std::atomic<AES_GCM_STATUS> verified_;
+  mutable std::mutex ctrMux_;
+  mutable std::mutex verifyMux_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_RANGE_H
@@ -0,0 +1,150 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_range.h"
+#include "crypto/aes_gcm_key.h"
+#include "crypto/random.h"
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+// A message from AES_GCM_Enc: | AAD | IV | ciphertext | tag |
+struct Message
+{
+  Blob key, aad, iv, body, tag, ptxt;
+};
+
+static Message encrypt(U64 size, U64 aadSize)
+{
+  AES_GCM_Config cfg = {AES_GCM_KEYSIZE::K256, AES_GCM_TAGSIZE::T128, AES_GCM_IV_MODE::RANDOM,
+    AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  Message m;
+  m.key = *random(AES_GCM_KEYSIZE_256);
+  m.aad = *random(aadSize);
+  m.ptxt = *random(size);
+  AES_GCM_Enc e(cfg);
+  e.keyIs(m.key);
+  e.aadIs(m.aad);
+  e.plaintextIs(m.ptxt);
+  Blob ctxt = e.ciphertext()->first;
+  m.iv = Blob(ctxt, AES_GCM_BLOCKSIZE_BYTES, aadSize);
+  m.body = Blob(ctxt, size, aadSize + AES_GCM_BLOCKSIZE_BYTES);
+  m.tag = Blob(ctxt, 16, aadSize + AES_GCM_BLOCKSIZE_BYTES + size);
+  return m;
+}
+
+static void load(AES_GCM_RangeDec &d, const Message &m)
+{
+  ASSERT_EQ(d.keyIs(m.key), AES_GCM_STATUS::VALID);
+  d.aadIs(m.aad);
+  d.ivIs(m.iv);
+  d.tagIs(m.tag);
+  d.ciphertextIs(m.body);
+}
+
+TEST(AES_GCM_RangeTest, Ranges) {
+  Message m = encrypt(100003, 7);
+  AES_GCM_RangeDec d;
+  load(d, m);
+  const U64 ranges[][2] = {{0, 0}, {0, 1}, {0, 16}, {1, 15}, {15, 2}, {17, 33}, {5000, 60000},
+    {99990, 13}, {100002, 1}, {100003, 0}, {0, 100003}};
+  for (const U64 *r : ranges) {
+    unique_ptr<AES_GCM_Result> res = d.range(r[0], r[1]);
+    EXPECT_EQ(res->second, AES_GCM_STATUS::UNVERIFIED) << r[0];
+    EXPECT_EQ(res->first, Blob(m.ptxt, r[1], r[0])) << r[0] << "+" << r[1];
+  }
+  EXPECT_EQ(d.verified(), AES_GCM_STATUS::UNVERIFIED);
+  EXPECT_EQ(d.verify(), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.verified(), AES_GCM_STATUS::VALID);
+  unique_ptr<AES_GCM_Result> res = d.range(50, 50);
+  EXPECT_EQ(res->second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(res->first, Blob(m.ptxt, 50, 50));
+
+  EXPECT_EQ(d.range(100000, 4)->second, AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(d.range(100004, 0)->second, AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(d.range(1, ~0ULL)->second, AES_GCM_STATUS::INVALID_SIZE);
+  AES_GCM_RangeDec unkeyed;
+  unkeyed.ivIs(m.iv);
+  unkeyed.tagIs(m.tag);
+  unkeyed.ciphertextIs(m.body);
+  EXPECT_EQ(unkeyed.range(0, 1)->second, AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(unkeyed.verify(), AES_GCM_STATUS::INVALID_SIZE);
+}
+
+TEST(AES_GCM_RangeTest, IVSizes) {
+  // 96-bit IVs use the IV as the counter; others go through GHASH. The
+  // authenticated data (AAD then IV) need not fill a block.
+  for (U32 ivSize : {12, 1, 16, 60}) {
+    for (U64 size : {0, 5, 16, 1000}) {
+      Blob key = *random(AES_GCM_KEYSIZE_128);
+      Blob aad = *random(3);
+      Blob iv = *random(ivSize);
+      Blob ptxt = *random(size);
+      MutableBlob auth(aad.size() + ivSize);
+      memcpy(auth.data(), aad.data(), aad.size());
+      memcpy(auth.data() + aad.size(), iv.data(), ivSize);
+      MutableBlob ctxt(size);
+      MutableBlob tag(12);
+      AES_GCM_Key k;
+      k.keyIs(key);
+      ASSERT_EQ(k.encrypt(ctxt.data(), tag.data(), 12, iv.data(), ivSize, auth.data(),
+        auth.size(), ptxt.data(), size), AES_GCM_STATUS::VALID);
+
+      AES_GCM_RangeDec d;
+      ASSERT_EQ(d.keyIs(key), AES_GCM_STATUS::VALID);
+      d.aadIs(aad);
+      d.ivIs(iv);
+      d.tagIs(tag);
+      d.ciphertextIs(ctxt);
+      EXPECT_EQ(d.range(size / 3, size / 2)->first, Blob(ptxt, size / 2, size / 3)) << ivSize;
+      EXPECT_EQ(d.verify(), AES_GCM_STATUS::VALID) << ivSize << " " << size;
+    }
+  }
+}
+
+TEST(AES_GCM_RangeTest, Forgery) {
+  // A forged message still decrypts until verified, then yields nothing
+  Message m = encrypt(4096, 0);
+  MutableBlob forged(m.body);
+  forged.data()[4000] ^= 1;
+  AES_GCM_RangeDec d;
+  load(d, m);
+  d.ciphertextIs(forged);
+  unique_ptr<AES_GCM_Result> res = d.range(0, 100);
+  EXPECT_EQ(res->second, AES_GCM_STATUS::UNVERIFIED);
+  EXPECT_EQ(res->first, Blob(m.ptxt, 100, 0));
+  EXPECT_EQ(d.verify(), AES_GCM_STATUS::DEC_ERROR);
+  res = d.range(0, 100);
+  EXPECT_EQ(res->second, AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(res->first.size(), 0U);
+
+  // New inputs start over
+  d.ciphertextIs(m.body);
+  EXPECT_EQ(d.verified(), AES_GCM_STATUS::UNVERIFIED);
+  EXPECT_EQ(d.verify(), AES_GCM_STATUS::VALID);
+  d.aadIs(Blob("x", 1));
+  EXPECT_EQ(d.verify(), AES_GCM_STATUS::DEC_ERROR);
+  d.aadIs(Blob());
+  MutableBlob tag(m.tag);
+  tag.data()[15] ^= 0x80;
+  d.tagIs(tag);
+  EXPECT_EQ(d.verify(), AES_GCM_STATUS::DEC_ERROR);
+  d.tagIs(Blob(m.tag, 8, 0));
+  EXPECT_EQ(d.verify(), AES_GCM_STATUS::VALID);
+}
+
+TEST(AES_GCM_RangeTest, VerifyAsync) {
+  // Reads carry on while the tag is checked on another thread
+  Message m = encrypt(1 << 22, 0);
+  AES_GCM_RangeDec d;
+  load(d, m);
+  std::shared_future<AES_GCM_STATUS> verified = d.verifyAsync();
+  for (U64 offset = 0; offset < m.ptxt.size(); offset += 100000) {
+    unique_ptr<AES_GCM_Result> res = d.range(offset, 4096);
+    EXPECT_NE(res->second, AES_GCM_STATUS::DEC_ERROR);
+    EXPECT_EQ(res->first, Blob(m.ptxt, 4096, offset));
+  }
+  EXPECT_EQ(verified.get(), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.range(0, 1)->second, AES_GCM_STATUS::VALID);
+}
@@ -0,0 +1,98 @@
+#include "crypto/aes_gcm_replay.h"
+
+using namespace Crypto;
+
+static const U32 BITS_PER_WORD = 32;
+
+// Word layout: | block index (32) | counter bits (32) |
+static U32 blockOf(U64 _word)
+{
+  return (U32)(_word >> 32);
+}
+
+// Ring size: enough whole blocks to cover the window plus the block in
+// progress, rounded up to a power of 2
+static U64 ringWords(U32 _width)
+{
+  U64 need = (_width + BITS_PER_WORD - 1) / BITS_PER_WORD + 1;
+  U64 words = 1;
+  while (words < need) {
+    words <<= 1;
+  }
+  return words;
+}
+
+AES_GCM_ReplayWindow::AES_GCM_ReplayWindow(U32 _width)
+  : width_((_width == 0) ? 1 : _width), mask_(ringWords(width_) - 1),
+  words_(new std::atomic<U64>[mask_ + 1]), top_(0)
+{
+  // Word i starts out holding the block one ring before block i, so the
+  // first counter to use it claims it
+  for (U64 i = 0; i <= mask_; i++) {
+    words_[i].store((U64)(U32)(i - (mask_ + 1)) << 32, std::memory_order_relaxed);
+  }
+}
+
+U32 AES_GCM_ReplayWindow::width() const
+{
+  return width_;
+}
+
+U64 AES_GCM_ReplayWindow::top() const
+{
+  return top_.load(std::memory_order_acquire);
+}
+
+bool AES_GCM_ReplayWindow::check(U64 _counter) const
+{
+  U64 top = top_.load(std::memory_order_acquire);
+  if (_counter + width_ < top) {
+    return false;
+  }
+  U64 word = words_[(_counter / BITS_PER_WORD) & mask_].load(std::memory_order_acquire);
+  U32 block = (U32)(_counter / BITS_PER_WORD);
+  if (blockOf(word) != block) {
+    // Still holding an older block (not yet used) or already a newer one
+    return (S32)(blockOf(word) - block) < 0;
+  }
+  return (word & (1ULL << (_counter % BITS_PER_WORD))) == 0;
+}
+
+bool AES_GCM_ReplayWindow::commit(U64 _counter)
+{
+  std::atomic<U64> &slot = words_[(_counter / BITS_PER_WORD) & mask_];
+  U32 block = (U32)(_counter / BITS_PER_WORD);
+  U64 bit = 1ULL << (_counter % BITS_PER_WORD);
+  U64 word = slot.load(std::memory_order_acquire);
+  for (;;) {
+    if (_counter + width_ < top_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    U64 next = 0;
+    if (blockOf(word) == block) {
+      if ((word & bit) != 0) {
+        return false;
+      }
+      next = word | bit;
+    }
+    else if ((S32)(blockOf(word) - block) < 0) {
+      // Reclaim the word from a block that has left the window
+      next = ((U64)block << 32) | bit;
+    }
+    else {
+      return false;
+    }
+    if (slot.compare_exchange_weak(word, next, std::memory_order_acq_rel,
+      std::memory_order_acquire)) {
+      break;
+    }
+  }
+
+  // Advance the top (a lock-free max)
+  U64 top = top_.load(std::memory_order_acquire);
+  while ((top <= _counter) && !top_.compare_exchange_weak(top, _counter + 1,
+    std::memory_order_acq_rel, std::memory_order_acquire)) {
+    // retry with the refreshed top
+  }
+  return true;
+}
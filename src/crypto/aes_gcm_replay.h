@@ -0,0 +1,48 @@
+#ifndef CRYPTO_AES_GCM_REPLAY_H
+#define CRYPTO_AES_GCM_REPLAY_H
+
+#include "util/fixed_types.h"
+#include <atomic>
+#include <memory>
+
+namespace Crypto {
+
+static const U32 AES_GCM_REPLAY_WIDTH_DEFAULT = 1024;
+
+// A sliding anti-replay window over message counters (see
+// AES_GCM_IVCounter()). Counters more than 'width' below the highest accepted
+// counter are rejected as too old; newer ones are accepted once each.
+//
+// The bitmap is a ring of 64-bit words, each holding 32 counter bits and the
+// (truncated) index of the 32-counter block they belong to, so a word can be
+// claimed for a new block and have a bit set in a single CAS. No locks are
+// taken, and any number of threads may check and commit concurrently.
+class AES_GCM_ReplayWindow
+{
+ public:
+  AES_GCM_ReplayWindow(U32 width = AES_GCM_REPLAY_WIDTH_DEFAULT);
+  AES_GCM_ReplayWindow(const AES_GCM_ReplayWindow &) = delete;
+  AES_GCM_ReplayWindow &operator=(const AES_GCM_ReplayWindow &) = delete;
+  U32 width() const;
+
+  // One past the highest committed counter
+  U64 top() const;
+
+  // False if 'counter' is too old or already committed. Call before the tag
+  // is verified, to skip work on obvious replays.
+  bool check(U64 counter) const;
+
+  // Marks 'counter' as seen. Call only after the tag verified; false if
+  // another thread committed it first or it has fallen out of the window.
+  bool commit(U64 counter);
+
+ private:
+  const U32 width_;
+  const U64 mask_;
+  std::unique_ptr<std::atomic<U64>[]> words_;
+  std::atomic<U64> top_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_REPLAY_H
@@ -0,0 +1,89 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_replay.h"
+#include "crypto/random.h"
+#include <atomic>
+#include <thread>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+TEST(AES_GCM_ReplayTest, Window) {
+  AES_GCM_ReplayWindow w(64);
+  EXPECT_TRUE(w.check(0));
+  EXPECT_TRUE(w.commit(0));
+  EXPECT_FALSE(w.check(0));
+  EXPECT_FALSE(w.commit(0));
+
+  // Out of order within the window is fine, once
+  EXPECT_TRUE(w.commit(10));
+  EXPECT_TRUE(w.commit(5));
+  EXPECT_FALSE(w.commit(5));
+  EXPECT_EQ(w.top(), 11U);
+
+  // Jumping ahead slides the window
+  EXPECT_TRUE(w.commit(1000));
+  EXPECT_FALSE(w.check(900));
+  EXPECT_TRUE(w.check(950));
+  EXPECT_TRUE(w.commit(950));
+  EXPECT_FALSE(w.check(950));
+  EXPECT_FALSE(w.check(10));
+
+  // Counters carried in the IV
+  MutableBlob iv(AES_GCM_BLOCKSIZE_BYTES);
+  AES_GCM_IVCounterIs(iv, 0x0000000100000002ULL);
+  EXPECT_EQ(iv.data()[3], 2);
+  EXPECT_EQ(iv.data()[7], 1);
+  EXPECT_EQ(AES_GCM_IVCounter(iv), 0x0000000100000002ULL);
+}
+
+TEST(AES_GCM_ReplayTest, Concurrent) {
+  // Every counter is delivered twice across threads; each is accepted once
+  AES_GCM_ReplayWindow w(4096);
+  std::atomic<U64> accepted(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&w, &accepted]() {
+      for (U64 c = 0; c < 2000; c++) {
+        if (w.check(c) && w.commit(c)) {
+          accepted++;
+        }
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(accepted.load(), 2000U);
+}
+
+TEST(AES_GCM_ReplayTest, Decryptor) {
+  AES_GCM_Config cfg = {AES_GCM_KEYSIZE::K128, AES_GCM_TAGSIZE::T128,
+    AES_GCM_IV_MODE::COUNTER, AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_128);
+  AES_GCM_Enc e(cfg);
+  e.keyIs(*key);
+  e.plaintextIs(Blob("counter", 7));
+  Blob ct0 = e.ciphertext()->first;
+  Blob ct1 = e.ciphertext()->first;
+
+  std::shared_ptr<AES_GCM_ReplayWindow> window = std::make_shared<AES_GCM_ReplayWindow>();
+  AES_GCM_Dec d;
+  d.keyIs(*key);
+  d.replayWindowIs(window);
+  auto open = [&d](const Blob &_ct, const Blob &_tag) {
+    d.ivIs(Blob(_ct, 16, 0));
+    d.tagIs(_tag);
+    d.ciphertextIs(Blob(_ct, 7, 16));
+    return d.plaintext().second;
+  };
+
+  // A forged tag does not consume the counter
+  EXPECT_EQ(open(ct1, Blob(std::string(16, 0))), AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(open(ct1, Blob(ct1, 16, 23)), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(open(ct0, Blob(ct0, 16, 23)), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(open(ct1, Blob(ct1, 16, 23)), AES_GCM_STATUS::REPLAY);
+  EXPECT_EQ(window->top(), 2U);
+}
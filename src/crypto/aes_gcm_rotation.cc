@@ -0,0 +1,266 @@
+#include "crypto/aes_gcm_rotation.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include "util/make_unique.h"
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::shared_ptr;
+using std::unique_ptr;
+using Util::make_unique;
+
+// HKDF info for subkey i: this label followed by i (8, big-endian)
+static const char SUBKEY_LABEL[] = "bae aes-gcm rotating subkey";
+static const U32 SUBKEY_LABEL_BYTES = sizeof(SUBKEY_LABEL) - 1;
+
+AES_GCM_Rotation_Config::AES_GCM_Rotation_Config()
+  : keySize(AES_GCM_KEYSIZE_DEFAULT), messageBudget(AES_GCM_ROTATION_MESSAGES_DEFAULT),
+  byteBudget(0)
+{
+  // empty
+}
+
+AES_GCM_RotatingKey::AES_GCM_RotatingKey(const AES_GCM_Rotation_Config &_config)
+  : cfg_(_config), expander_(), keyed_(false), index_(0), messages_(0), bytes_(0),
+  rotations_(0), generation_(0), mux_()
+{
+  // empty
+}
+
+const AES_GCM_Rotation_Config &AES_GCM_RotatingKey::config() const
+{
+  return cfg_;
+}
+
+AES_GCM_STATUS AES_GCM_RotatingKey::masterIs(const Blob &_master)
+{
+  if (_master.size() < AES_GCM_ROTATION_MASTER_MIN_BYTES) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+
+  // A random start keeps restarts and other instances off used subkeys
+  Byte start[AES_GCM_SUBKEY_INDEX_BYTES];
+  randomize(start, sizeof(start));
+
+  std::lock_guard<std::mutex> lock(mux_);
+  expander_.secretIs(_master, Blob());
+  keyed_ = true;
+  index_ = loadBE64(start);
+  messages_ = 0;
+  bytes_ = 0;
+  rotations_ = 0;
+  generation_++;
+  return AES_GCM_STATUS::VALID;
+}
+
+U64 AES_GCM_RotatingKey::generation() const
+{
+  return generation_;
+}
+
+AES_GCM_STATUS AES_GCM_RotatingKey::charge(U64 _size, U64 &_index, U64 &_generation)
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  if (!keyed_) {
+    return AES_GCM_STATUS::INVALID_KEY;
+  }
+
+  // Budgets are checked before use, so no subkey ever goes over one (bar a
+  // single message larger than the byte budget, alone on its subkey)
+  bool overMessages = (messages_ >= cfg_.messageBudget);
+  bool overBytes = (cfg_.byteBudget != 0) &&
+    ((bytes_ > cfg_.byteBudget) || (_size > cfg_.byteBudget - bytes_));
+  if ((messages_ != 0) && (overMessages || overBytes)) {
+    index_++;
+    messages_ = 0;
+    bytes_ = 0;
+    rotations_++;
+  }
+  messages_++;
+  bytes_ += _size;
+  _index = index_;
+  _generation = generation_;
+  return AES_GCM_STATUS::VALID;
+}
+
+U64 AES_GCM_RotatingKey::index() const
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  return index_;
+}
+
+U64 AES_GCM_RotatingKey::rotations() const
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  return rotations_;
+}
+
+unique_ptr<Blob> AES_GCM_RotatingKey::subkey(U64 _index, U64 &_generation) const
+{
+  MutableBlob info(SUBKEY_LABEL_BYTES + AES_GCM_SUBKEY_INDEX_BYTES);
+  memcpy(info.data(), SUBKEY_LABEL, SUBKEY_LABEL_BYTES);
+  storeBE64(info.data() + SUBKEY_LABEL_BYTES, _index);
+
+  std::lock_guard<std::mutex> lock(mux_);
+  if (!keyed_) {
+    return nullptr;
+  }
+  _generation = generation_;
+  return expander_.subkey(AES_GCM_Keysize(cfg_.keySize), info);
+}
+
+
+/*** ENCRYPTION ***/
+
+AES_GCM_Rotating_Enc::AES_GCM_Rotating_Enc(const shared_ptr<AES_GCM_RotatingKey> &_key,
+  AES_GCM_TAGSIZE _tagSize)
+  : key_(_key), tagSize_(AES_GCM_Tagsize(_tagSize)), aad_(), ptxt_(), subkey_(),
+  subkeyIndex_(0), subkeyGeneration_(0), haveSubkey_(false)
+{
+  // empty
+}
+
+void AES_GCM_Rotating_Enc::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+}
+
+void AES_GCM_Rotating_Enc::plaintextIs(const Blob &_plaintext)
+{
+  ptxt_ = _plaintext;
+}
+
+unique_ptr<AES_GCM_Result> AES_GCM_Rotating_Enc::ciphertext()
+{
+  U64 ptxtSize = ptxt_.size();
+  U64 index = 0;
+  U64 generation = 0;
+  AES_GCM_STATUS status = key_->charge(ptxtSize, index, generation);
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  if (!haveSubkey_ || (index != subkeyIndex_) || (generation != subkeyGeneration_)) {
+    haveSubkey_ = false;
+    unique_ptr<Blob> subkey = key_->subkey(index, generation);
+    status = (subkey) ? subkey_.keyIs(*subkey) : AES_GCM_STATUS::INVALID_KEY;
+    if (status != AES_GCM_STATUS::VALID) {
+      return make_unique<AES_GCM_Result>(Blob(), status);
+    }
+    subkeyIndex_ = index;
+    subkeyGeneration_ = generation;
+    haveSubkey_ = true;
+  }
+
+  // The header (subkey index and IV) and the caller's AAD are authenticated
+  // together
+  MutableBlob mctxt(AES_GCM_ROTATION_HEADER_BYTES + ptxtSize + tagSize_);
+  Byte *header = mctxt.data();
+  storeBE64(header, index);
+  randomize(header + AES_GCM_SUBKEY_INDEX_BYTES, AES_GCM_BLOCKSIZE_BYTES);
+
+  MutableBlob aad(AES_GCM_ROTATION_HEADER_BYTES + aad_.size());
+  memcpy(aad.data(), header, AES_GCM_ROTATION_HEADER_BYTES);
+  memcpy(aad.data() + AES_GCM_ROTATION_HEADER_BYTES, aad_.data(), aad_.size());
+
+  Byte *body = header + AES_GCM_ROTATION_HEADER_BYTES;
+  status = subkey_.encrypt(body, body + ptxtSize, tagSize_,
+    header + AES_GCM_SUBKEY_INDEX_BYTES, AES_GCM_BLOCKSIZE_BYTES, aad.data(), aad.size(),
+    ptxt_.data(), ptxtSize);
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  return make_unique<AES_GCM_Result>(mctxt, AES_GCM_STATUS::VALID);
+}
+
+
+/*** DECRYPTION ***/
+
+AES_GCM_Rotating_Dec::AES_GCM_Rotating_Dec(const shared_ptr<const AES_GCM_RotatingKey> &_key,
+  AES_GCM_TAGSIZE _tagSize)
+  : key_(_key), tagSize_(AES_GCM_Tagsize(_tagSize)), aad_(), ctxt_(),
+  ptxt_(Blob(), AES_GCM_STATUS::DEC_ERROR), subkey_(), subkeyIndex_(0),
+  subkeyGeneration_(0), haveSubkey_(false), subkeyDerivations_(0), needsDecrypt_(false),
+  mutableMux_()
+{
+  // empty
+}
+
+void AES_GCM_Rotating_Dec::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+  needsDecrypt_ = true;
+}
+
+void AES_GCM_Rotating_Dec::ciphertextIs(const Blob &_ciphertext)
+{
+  ctxt_ = _ciphertext;
+  needsDecrypt_ = true;
+}
+
+const AES_GCM_Result &AES_GCM_Rotating_Dec::plaintext() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  if (needsDecrypt_) {
+    decrypt();
+  }
+  return ptxt_;
+}
+
+U64 AES_GCM_Rotating_Dec::subkeyDerivations() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  return subkeyDerivations_;
+}
+
+bool AES_GCM_Rotating_Dec::subkeyIndex(const Blob &_ciphertext, U64 &_index)
+{
+  if (_ciphertext.size() < AES_GCM_SUBKEY_INDEX_BYTES) {
+    return false;
+  }
+  _index = loadBE64(_ciphertext.data());
+  return true;
+}
+
+void AES_GCM_Rotating_Dec::decrypt() const
+{
+  needsDecrypt_ = false;
+  ptxt_.first.dataIsNull();
+  if (ctxt_.size() < AES_GCM_ROTATION_HEADER_BYTES + tagSize_) {
+    ptxt_.second = AES_GCM_STATUS::INVALID_SIZE;
+    return;
+  }
+
+  const Byte *header = ctxt_.data();
+  U64 index = loadBE64(header);
+  U64 generation = key_->generation();
+  if (!haveSubkey_ || (index != subkeyIndex_) || (generation != subkeyGeneration_)) {
+    haveSubkey_ = false;
+    unique_ptr<Blob> subkey = key_->subkey(index, generation);
+    AES_GCM_STATUS status = (subkey) ? subkey_.keyIs(*subkey) : AES_GCM_STATUS::INVALID_KEY;
+    if (status != AES_GCM_STATUS::VALID) {
+      ptxt_.second = status;
+      return;
+    }
+    subkeyIndex_ = index;
+    subkeyGeneration_ = generation;
+    haveSubkey_ = true;
+    subkeyDerivations_++;
+  }
+
+  MutableBlob aad(AES_GCM_ROTATION_HEADER_BYTES + aad_.size());
+  memcpy(aad.data(), header, AES_GCM_ROTATION_HEADER_BYTES);
+  memcpy(aad.data() + AES_GCM_ROTATION_HEADER_BYTES, aad_.data(), aad_.size());
+
+  U64 ctxtSize = ctxt_.size() - AES_GCM_ROTATION_HEADER_BYTES - tagSize_;
+  const Byte *body = header + AES_GCM_ROTATION_HEADER_BYTES;
+  MutableBlob ptxt(ctxtSize, Blob::ScrubType::ZEROS);
+  AES_GCM_STATUS status = subkey_.decrypt(ptxt.data(), body + ctxtSize, tagSize_,
+    header + AES_GCM_SUBKEY_INDEX_BYTES, AES_GCM_BLOCKSIZE_BYTES, aad.data(), aad.size(), body,
+    ctxtSize);
+  if (status == AES_GCM_STATUS::VALID) {
+    ptxt_.first = ptxt;
+  }
+  ptxt_.second = status;
+}
@@ -0,0 +1,149 @@
+#ifndef CRYPTO_AES_GCM_ROTATION_H
+#define CRYPTO_AES_GCM_ROTATION_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "crypto/hkdf_sha256.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace Crypto {
+
+// Random IVs are safe for about 2^32 messages per key (NIST SP 800-38D,
+// 8.3). A rotating key encrypts each message under one of a sequence of
+// subkeys derived from a master key with HKDF_SHA256, and moves to the next
+// subkey once the current one has used its budget, so one master key can
+// encrypt without limit and without external rotation. Messages name their
+// subkey:
+//
+//   | subkey index (8, big-endian) | IV (16) | ciphertext | tag |
+//
+// The header is authenticated as additional data, followed by any
+// (non-transmitted) AAD given to the encryptor/decryptor. Each rotating key
+// starts at a random index, so instances sharing a master key (other
+// processes, restarts) use disjoint subkeys without keeping any state.
+static const U32 AES_GCM_SUBKEY_INDEX_BYTES = 8;
+static const U32 AES_GCM_ROTATION_HEADER_BYTES = AES_GCM_SUBKEY_INDEX_BYTES +
+  AES_GCM_BLOCKSIZE_BYTES;
+static const U64 AES_GCM_ROTATION_MESSAGES_DEFAULT = 1ULL << 32;
+
+// Master keys must be random, and at least this long
+static const U32 AES_GCM_ROTATION_MASTER_MIN_BYTES = AES_GCM_KEYSIZE_128;
+
+struct AES_GCM_Rotation_Config
+{
+  AES_GCM_Rotation_Config();
+
+  AES_GCM_KEYSIZE keySize;         // of the subkeys: 128, 192, 256
+  U64             messageBudget;   // messages per subkey
+  U64             byteBudget;      // plaintext bytes per subkey (0: no limit)
+};
+
+// A master key and the usage of its current subkey, shared by the encryptors
+// (and decryptors) of one service. Thread-safe.
+class AES_GCM_RotatingKey
+{
+ public:
+  AES_GCM_RotatingKey(const AES_GCM_Rotation_Config &config = AES_GCM_Rotation_Config());
+  AES_GCM_RotatingKey(const AES_GCM_RotatingKey &) = delete;
+  AES_GCM_RotatingKey &operator=(const AES_GCM_RotatingKey &) = delete;
+  const AES_GCM_Rotation_Config &config() const;
+
+  // Starts a new sequence of subkeys, at a random index
+  AES_GCM_STATUS masterIs(const Util::Blob &master);
+
+  // Counts masterIs() calls: a subkey derived for one generation is stale in
+  // the next, whatever its index
+  U64 generation() const;
+
+  // Charges one message of 'size' bytes to the current subkey and returns
+  // its index, first moving to the next subkey if the message would exceed
+  // a budget. A message larger than the byte budget gets a subkey to itself.
+  AES_GCM_STATUS charge(U64 size, U64 &index, U64 &generation);
+
+  // The current subkey and the number of rotations so far
+  U64 index() const;
+  U64 rotations() const;
+
+  // The subkey with the given index and the generation it belongs to, or
+  // nullptr without a master key
+  std::unique_ptr<Util::Blob> subkey(U64 index, U64 &generation) const;
+
+ private:
+  AES_GCM_Rotation_Config cfg_;
+  mutable HKDF_SHA256_Expander expander_;
+  bool keyed_;
+  U64 index_;
+  U64 messages_;
+  U64 bytes_;
+  U64 rotations_;
+  std::atomic<U64> generation_;
+  mutable std::mutex mux_;
+};
+
+// Not thread-safe: each thread owns one, and they share the rotating key
+class AES_GCM_Rotating_Enc
+{
+ public:
+  AES_GCM_Rotating_Enc(const std::shared_ptr<AES_GCM_RotatingKey> &key,
+    AES_GCM_TAGSIZE tagSize = AES_GCM_TAGSIZE_DEFAULT);
+  AES_GCM_Rotating_Enc(const AES_GCM_Rotating_Enc &) = delete;
+  AES_GCM_Rotating_Enc &operator=(const AES_GCM_Rotating_Enc &) = delete;
+  void aadIs(const Util::Blob &aad);
+  void plaintextIs(const Util::Blob &plaintext);
+
+  // Expands a subkey only when the rotating key has moved on
+  std::unique_ptr<AES_GCM_Result> ciphertext();
+
+ private:
+  std::shared_ptr<AES_GCM_RotatingKey> key_;
+  U32 tagSize_;
+  Util::Blob aad_;
+  Util::Blob ptxt_;
+  AES_GCM_Key subkey_;
+  U64 subkeyIndex_;
+  U64 subkeyGeneration_;
+  bool haveSubkey_;
+};
+
+// Keeps the last subkey it expanded, which serves runs of messages from the
+// same subkey without deriving again
+class AES_GCM_Rotating_Dec
+{
+ public:
+  AES_GCM_Rotating_Dec(const std::shared_ptr<const AES_GCM_RotatingKey> &key,
+    AES_GCM_TAGSIZE tagSize = AES_GCM_TAGSIZE_DEFAULT);
+  AES_GCM_Rotating_Dec(const AES_GCM_Rotating_Dec &) = delete;
+  AES_GCM_Rotating_Dec &operator=(const AES_GCM_Rotating_Dec &) = delete;
+  void aadIs(const Util::Blob &aad);
+  void ciphertextIs(const Util::Blob &ciphertext);
+  const AES_GCM_Result &plaintext() const;
+
+  // Number of subkeys derived so far
+  U64 subkeyDerivations() const;
+
+  // The subkey index of a rotating-key message, or false if it is too short
+  static bool subkeyIndex(const Util::Blob &ciphertext, U64 &index);
+
+ private:
+  void decrypt() const;
+  std::shared_ptr<const AES_GCM_RotatingKey> key_;
+  U32 tagSize_;
+  Util::Blob aad_;
+  Util::Blob ctxt_;
+  mutable AES_GCM_Result ptxt_;
+  mutable AES_GCM_Key subkey_;
+  mutable U64 subkeyIndex_;
+  mutable U64 subkeyGeneration_;
+  mutable bool haveSubkey_;
+  mutable U64 subkeyDerivations_;
+  mutable bool needsDecrypt_;
+  mutable std::mutex mutableMux_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_ROTATION_H
@@ -0,0 +1,169 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_rotation.h"
+#include "crypto/random.h"
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::shared_ptr;
+using std::unique_ptr;
+
+static Blob pt("Rotating plaintext", 18);
+
+static shared_ptr<AES_GCM_RotatingKey> rotatingKey(U64 messageBudget, U64 byteBudget)
+{
+  AES_GCM_Rotation_Config cfg;
+  cfg.messageBudget = messageBudget;
+  cfg.byteBudget = byteBudget;
+  shared_ptr<AES_GCM_RotatingKey> key = std::make_shared<AES_GCM_RotatingKey>(cfg);
+  EXPECT_EQ(key->masterIs(*random(AES_GCM_KEYSIZE_256)), AES_GCM_STATUS::VALID);
+  return key;
+}
+
+static U64 indexOf(const Blob &ctxt)
+{
+  U64 index = 0;
+  EXPECT_TRUE(AES_GCM_Rotating_Dec::subkeyIndex(ctxt, index));
+  return index;
+}
+
+TEST(AES_GCM_RotationTest, MessageBudget) {
+  shared_ptr<AES_GCM_RotatingKey> key = std::make_shared<AES_GCM_RotatingKey>();
+  AES_GCM_Rotating_Enc e(key);
+  e.plaintextIs(pt);
+  EXPECT_EQ(e.ciphertext()->second, AES_GCM_STATUS::INVALID_KEY);
+  EXPECT_EQ(key->masterIs(*random(8)), AES_GCM_STATUS::INVALID_SIZE);
+
+  // Three messages per subkey: ten messages use four consecutive subkeys
+  key = rotatingKey(3, 0);
+  AES_GCM_Rotating_Enc e3(key);
+  e3.plaintextIs(pt);
+  U64 first = key->index();
+  std::vector<Blob> ctxts;
+  for (U64 i = 0; i < 10; i++) {
+    unique_ptr<AES_GCM_Result> res = e3.ciphertext();
+    ASSERT_EQ(res->second, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(res->first.size(), AES_GCM_ROTATION_HEADER_BYTES + pt.size() + 16);
+    EXPECT_EQ(indexOf(res->first), first + i / 3);
+    ctxts.push_back(res->first);
+  }
+  EXPECT_EQ(key->rotations(), 3U);
+
+  // One decryptor handles every subkey, deriving each once for a run
+  AES_GCM_Rotating_Dec d(key);
+  for (const Blob &ctxt : ctxts) {
+    d.ciphertextIs(ctxt);
+    EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(d.plaintext().first, pt);
+  }
+  EXPECT_EQ(d.subkeyDerivations(), 4U);
+
+  // Subkeys are distinct and depend only on the master key and index
+  U64 generation = 0;
+  EXPECT_NE(*key->subkey(first, generation), *key->subkey(first + 1, generation));
+  EXPECT_EQ(key->subkey(first, generation)->size(), AES_GCM_KEYSIZE_256);
+  EXPECT_EQ(generation, key->generation());
+}
+
+TEST(AES_GCM_RotationTest, ByteBudget) {
+  shared_ptr<AES_GCM_RotatingKey> key = rotatingKey(AES_GCM_ROTATION_MESSAGES_DEFAULT, 100);
+  AES_GCM_Rotating_Enc e(key);
+  AES_GCM_Rotating_Dec d(key);
+  U64 first = key->index();
+
+  // 40 + 40 fit, a further 40 does not; a message over the whole budget gets
+  // a subkey to itself
+  const U64 sizes[] = {40, 40, 40, 300, 10, 100, 0};
+  const U64 offsets[] = {0, 0, 1, 2, 3, 4, 4};
+  for (U32 i = 0; i < 7; i++) {
+    Blob ptxt = *random(sizes[i]);
+    e.plaintextIs(ptxt);
+    unique_ptr<AES_GCM_Result> res = e.ciphertext();
+    ASSERT_EQ(res->second, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(indexOf(res->first), first + offsets[i]) << i;
+    d.ciphertextIs(res->first);
+    EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(d.plaintext().first, ptxt);
+  }
+}
+
+TEST(AES_GCM_RotationTest, Authentication) {
+  shared_ptr<AES_GCM_RotatingKey> key = rotatingKey(1, 0);
+  AES_GCM_Rotating_Enc e(key, AES_GCM_TAGSIZE::T128);
+  e.aadIs(Blob("context", 7));
+  e.plaintextIs(pt);
+  Blob ctxt = e.ciphertext()->first;
+
+  AES_GCM_Rotating_Dec d(key);
+  d.ciphertextIs(ctxt);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  d.aadIs(Blob("context", 7));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+
+  // Pointing a message at another subkey fails authentication
+  MutableBlob moved(ctxt);
+  moved.data()[AES_GCM_SUBKEY_INDEX_BYTES - 1] ^= 1;
+  d.ciphertextIs(moved);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(d.plaintext().first.size(), 0U);
+
+  d.ciphertextIs(Blob(ctxt, AES_GCM_ROTATION_HEADER_BYTES, 0));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_SIZE);
+
+  // Another instance with the same master key starts elsewhere, but decrypts
+  // the same messages; a different master key does not
+  Blob master = *random(AES_GCM_KEYSIZE_256);
+  shared_ptr<AES_GCM_RotatingKey> a = std::make_shared<AES_GCM_RotatingKey>();
+  shared_ptr<AES_GCM_RotatingKey> b = std::make_shared<AES_GCM_RotatingKey>();
+  a->masterIs(master);
+  b->masterIs(master);
+  EXPECT_NE(a->index(), b->index());
+  AES_GCM_Rotating_Enc ea(a);
+  ea.plaintextIs(pt);
+  AES_GCM_Rotating_Dec db(b);
+  db.ciphertextIs(ea.ciphertext()->first);
+  EXPECT_EQ(db.plaintext().second, AES_GCM_STATUS::VALID);
+  b->masterIs(*random(AES_GCM_KEYSIZE_256));
+  db.ciphertextIs(ea.ciphertext()->first);
+  EXPECT_EQ(db.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+}
+
+TEST(AES_GCM_RotationTest, Threads) {
+  // Encryptors on several threads share one key and its budgets: every
+  // subkey carries at most its budget of messages
+  const U64 budget = 16;
+  const int threads = 4;
+  const int messages = 100;
+  shared_ptr<AES_GCM_RotatingKey> key = rotatingKey(budget, 0);
+  std::vector<std::vector<Blob>> ctxts(threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&key, &ctxts, t]() {
+      AES_GCM_Rotating_Enc e(key);
+      e.plaintextIs(pt);
+      for (int i = 0; i < messages; i++) {
+        ctxts[t].push_back(e.ciphertext()->first);
+      }
+    });
+  }
+  for (std::thread &w : workers) {
+    w.join();
+  }
+
+  std::multiset<U64> indexes;
+  AES_GCM_Rotating_Dec d(key);
+  for (const std::vector<Blob> &thread : ctxts) {
+    for (const Blob &ctxt : thread) {
+      indexes.insert(indexOf(ctxt));
+      d.ciphertextIs(ctxt);
+      EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+    }
+  }
+  for (U64 index : indexes) {
+    EXPECT_LE(indexes.count(index), budget);
+  }
+  EXPECT_EQ(key->rotations(), (threads * messages + budget - 1) / budget - 1);
+}
@@ -0,0 +1,219 @@
+#include "crypto/aes_gcm_sector.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include "util/make_unique.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::make_unique;
+
+// Batches smaller than this per lane are not worth a thread hand-off
+static const size_t LANE_MIN_PAGES = 4;
+
+// Thread i runs lane i + 1. Each batch bumps 'round'; threads whose lane is
+// in the batch run it and count down 'running'.
+struct AES_GCM_Sector::Workers
+{
+  Workers()
+    : mux(), posted(), finished(), threads(), round(0), lanes(0), running(0), stop(false),
+    ops(nullptr), count(0), perLane(0), write(false)
+  {
+    // empty
+  }
+
+  std::mutex mux;
+  std::condition_variable posted;
+  std::condition_variable finished;
+  std::vector<std::thread> threads;
+  U64 round;
+  size_t lanes;
+  size_t running;
+  bool stop;
+  AES_GCM_SectorOp *ops;
+  size_t count;
+  size_t perLane;
+  bool write;
+};
+
+AES_GCM_Sector::AES_GCM_Sector(U32 _pageSize, U32 _lanes)
+  : pageSize_(_pageSize), generation_(0), keys_(), workers_(make_unique<Workers>())
+{
+  for (U32 i = 0; i < ((_lanes == 0) ? 1 : _lanes); i++) {
+    keys_.push_back(make_unique<AES_GCM_Key>());
+  }
+  try {
+    for (size_t lane = 1; lane < keys_.size(); lane++) {
+      workers_->threads.push_back(std::thread(&AES_GCM_Sector::work, this, lane));
+    }
+  }
+  catch (const std::system_error &) {
+    // Out of threads; batches use the lanes that have one
+  }
+}
+
+AES_GCM_Sector::~AES_GCM_Sector()
+{
+  {
+    std::lock_guard<std::mutex> lock(workers_->mux);
+    workers_->stop = true;
+  }
+  workers_->posted.notify_all();
+  for (std::thread &thread : workers_->threads) {
+    thread.join();
+  }
+}
+
+U32 AES_GCM_Sector::pageSize() const
+{
+  return pageSize_;
+}
+
+U32 AES_GCM_Sector::lanes() const
+{
+  return (U32)keys_.size();
+}
+
+AES_GCM_STATUS AES_GCM_Sector::keyIs(const Blob &_key)
+{
+  for (std::unique_ptr<AES_GCM_Key> &key : keys_) {
+    AES_GCM_STATUS status = key->keyIs(_key);
+    if (status != AES_GCM_STATUS::VALID) {
+      return status;
+    }
+  }
+
+  // A fresh, random start for this key's generations
+  Byte start[AES_GCM_SECTOR_GEN_BYTES];
+  randomize(start, sizeof(start));
+  generation_ = loadBE64(start);
+  return AES_GCM_STATUS::VALID;
+}
+
+AES_GCM_STATUS AES_GCM_Sector::writePage(U64 _page, const Byte *_ptxt, Byte *_ctxt,
+  Byte *_meta)
+{
+  return writePage(*keys_[0], _page, _ptxt, _ctxt, _meta);
+}
+
+AES_GCM_STATUS AES_GCM_Sector::readPage(U64 _page, const Byte *_ctxt, Byte *_ptxt,
+  const Byte *_meta)
+{
+  return readPage(*keys_[0], _page, _ctxt, _ptxt, _meta);
+}
+
+AES_GCM_STATUS AES_GCM_Sector::write(AES_GCM_SectorOp *_ops, size_t _count)
+{
+  return batch(_ops, _count, true);
+}
+
+AES_GCM_STATUS AES_GCM_Sector::read(AES_GCM_SectorOp *_ops, size_t _count)
+{
+  return batch(_ops, _count, false);
+}
+
+AES_GCM_STATUS AES_GCM_Sector::writePage(AES_GCM_Key &_key, U64 _page, const Byte *_ptxt,
+  Byte *_ctxt, Byte *_meta)
+{
+  U64 gen = generation_.fetch_add(1, std::memory_order_relaxed);
+  Byte iv[AES_GCM_BLOCKSIZE_BYTES];
+  Byte aad[8];
+  storeBE64(iv, _page);
+  storeBE64(iv + 8, gen);
+  storeBE64(aad, _page);
+  Byte tag[AES_GCM_SECTOR_TAG_BYTES];
+  AES_GCM_STATUS status = _key.encrypt(_ctxt, tag, sizeof(tag), iv, sizeof(iv), aad,
+    sizeof(aad), _ptxt, pageSize_);
+  if (status == AES_GCM_STATUS::VALID) {
+    storeBE64(_meta, gen);
+    memcpy(_meta + AES_GCM_SECTOR_GEN_BYTES, tag, sizeof(tag));
+  }
+  return status;
+}
+
+AES_GCM_STATUS AES_GCM_Sector::readPage(AES_GCM_Key &_key, U64 _page, const Byte *_ctxt,
+  Byte *_ptxt, const Byte *_meta)
+{
+  Byte iv[AES_GCM_BLOCKSIZE_BYTES];
+  Byte aad[8];
+  storeBE64(iv, _page);
+  memcpy(iv + 8, _meta, AES_GCM_SECTOR_GEN_BYTES);
+  storeBE64(aad, _page);
+  return _key.decrypt(_ptxt, _meta + AES_GCM_SECTOR_GEN_BYTES, AES_GCM_SECTOR_TAG_BYTES, iv,
+    sizeof(iv), aad, sizeof(aad), _ctxt, pageSize_);
+}
+
+void AES_GCM_Sector::runLane(size_t _lane, AES_GCM_SectorOp *_ops, size_t _count,
+  size_t _perLane, bool _write)
+{
+  AES_GCM_Key &key = *keys_[_lane];
+  size_t end = std::min(_count, (_lane + 1) * _perLane);
+  for (size_t i = _lane * _perLane; i < end; i++) {
+    AES_GCM_SectorOp &op = _ops[i];
+    op.status = (_write) ? writePage(key, op.page, op.in, op.out, op.meta) :
+      readPage(key, op.page, op.in, op.out, op.meta);
+  }
+}
+
+void AES_GCM_Sector::work(size_t _lane)
+{
+  Workers &w = *workers_;
+  U64 seen = 0;
+  std::unique_lock<std::mutex> lock(w.mux);
+  for (;;) {
+    w.posted.wait(lock, [&]() { return w.stop || (w.round != seen); });
+    if (w.stop) {
+      return;
+    }
+    seen = w.round;
+    if (_lane >= w.lanes) {
+      continue;
+    }
+    lock.unlock();
+    runLane(_lane, w.ops, w.count, w.perLane, w.write);
+    lock.lock();
+    if (--w.running == 0) {
+      w.finished.notify_one();
+    }
+  }
+}
+
+AES_GCM_STATUS AES_GCM_Sector::batch(AES_GCM_SectorOp *_ops, size_t _count, bool _write)
+{
+  // Lane i takes a contiguous slice of the batch; lane 0 runs here and the
+  // others on the sector's threads
+  Workers &w = *workers_;
+  size_t lanes = std::min(w.threads.size() + 1,
+    std::max<size_t>(1, _count / LANE_MIN_PAGES));
+  size_t perLane = (_count + lanes - 1) / lanes;
+  if (lanes > 1) {
+    {
+      std::lock_guard<std::mutex> lock(w.mux);
+      w.round++;
+      w.lanes = lanes;
+      w.running = lanes - 1;
+      w.ops = _ops;
+      w.count = _count;
+      w.perLane = perLane;
+      w.write = _write;
+    }
+    w.posted.notify_all();
+  }
+  runLane(0, _ops, _count, perLane, _write);
+  if (lanes > 1) {
+    std::unique_lock<std::mutex> lock(w.mux);
+    w.finished.wait(lock, [&]() { return w.running == 0; });
+  }
+
+  for (size_t i = 0; i < _count; i++) {
+    if (_ops[i].status != AES_GCM_STATUS::VALID) {
+      return _ops[i].status;
+    }
+  }
+  return AES_GCM_STATUS::VALID;
+}
@@ -0,0 +1,98 @@
+#ifndef CRYPTO_AES_GCM_SECTOR_H
+#define CRYPTO_AES_GCM_SECTOR_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace Crypto {
+
+// Random-access encryption of fixed-size pages (sector mode). Ciphertext is
+// the same size as the page, so pages keep their on-disk alignment; each page
+// has a side metadata record:
+//
+//   | generation (8) | tag (16) |
+//
+// The IV is | page (8) | generation (8) | and the page number is
+// authenticated as additional data so pages cannot be swapped. Generations
+// do not come from the stored metadata, which may be lost or rolled back:
+// each keyIs() starts a sequence at a random 64-bit point and every write
+// takes the next value. Within one keyed instance no generation repeats
+// whatever the metadata says; across instances (restarts) under the same key
+// an IV repeats only if two sequences overlap, with probability about
+// (writes in both) / 2^64. Generations therefore increase per page only
+// within an instance.
+// Metadata is not protected against rollback: restoring an old page together
+// with its old metadata decrypts successfully. Callers that need freshness
+// must keep generations (or the metadata) somewhere trusted.
+static const U32 AES_GCM_SECTOR_GEN_BYTES = 8;
+static const U32 AES_GCM_SECTOR_TAG_BYTES = 16;
+static const U32 AES_GCM_SECTOR_META_BYTES = AES_GCM_SECTOR_GEN_BYTES +
+  AES_GCM_SECTOR_TAG_BYTES;
+
+// One page of a batch. 'in' and 'out' are pageSize() bytes and may be the
+// same buffer; 'meta' is AES_GCM_SECTOR_META_BYTES. No buffers are copied, so
+// they can be the aligned buffers of an O_DIRECT read or write.
+struct AES_GCM_SectorOp
+{
+  U64            page;
+  const Byte     *in;
+  Byte           *out;
+  Byte           *meta;
+  AES_GCM_STATUS status;
+};
+
+// Pages of a batch are split across 'lanes' key contexts that run
+// concurrently; a single page is always processed on the calling thread.
+// Lanes after the first run on threads the sector starts once and keeps
+// until it is destroyed (if the system cannot start them all, batches use
+// fewer lanes). Not thread-safe: use one instance per thread (each with its
+// own lanes).
+class AES_GCM_Sector
+{
+ public:
+  AES_GCM_Sector(U32 pageSize, U32 lanes = 1);
+  ~AES_GCM_Sector();
+  AES_GCM_Sector(const AES_GCM_Sector &) = delete;
+  AES_GCM_Sector &operator=(const AES_GCM_Sector &) = delete;
+  U32 pageSize() const;
+  U32 lanes() const;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+
+  // Encrypts 'ptxt' into 'ctxt' and overwrites 'meta' with a new generation
+  // and the new tag
+  AES_GCM_STATUS writePage(U64 page, const Byte *ptxt, Byte *ctxt, Byte *meta);
+
+  // Decrypts 'ctxt' into 'ptxt' using the generation and tag in 'meta'
+  AES_GCM_STATUS readPage(U64 page, const Byte *ctxt, Byte *ptxt, const Byte *meta);
+
+  // Batched forms: set each op's status and return VALID if all succeeded,
+  // otherwise the first failing status
+  AES_GCM_STATUS write(AES_GCM_SectorOp *ops, size_t count);
+  AES_GCM_STATUS read(AES_GCM_SectorOp *ops, size_t count);
+
+ private:
+  AES_GCM_STATUS writePage(AES_GCM_Key &key, U64 page, const Byte *ptxt, Byte *ctxt,
+    Byte *meta);
+  AES_GCM_STATUS readPage(AES_GCM_Key &key, U64 page, const Byte *ctxt, Byte *ptxt,
+    const Byte *meta);
+  AES_GCM_STATUS batch(AES_GCM_SectorOp *ops, size_t count, bool write);
+  void runLane(size_t lane, AES_GCM_SectorOp *ops, size_t count, size_t perLane, bool write);
+  void work(size_t lane);
+
+  // The lane threads and the batch they are working on
+  struct Workers;
+
+  U32 pageSize_;
+  std::atomic<U64> generation_;
+  std::vector<std::unique_ptr<AES_GCM_Key>> keys_;
+  std::unique_ptr<Workers> workers_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_GCM_SECTOR_H
@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_sector.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+TEST(AES_GCM_SectorTest, Sanity) {
+  const U32 PAGE = 4096;
+  AES_GCM_Sector s(PAGE);
+  EXPECT_EQ(s.keyIs(*random(AES_GCM_KEYSIZE_256)), AES_GCM_STATUS::VALID);
+
+  unique_ptr<Blob> pt = random(PAGE);
+  MutableBlob ct(PAGE);
+  Byte meta[AES_GCM_SECTOR_META_BYTES] = {0};
+  EXPECT_EQ(s.writePage(7, pt->data(), ct.data(), meta), AES_GCM_STATUS::VALID);
+  U64 gen = loadBE64(meta);
+
+  MutableBlob out(PAGE);
+  EXPECT_EQ(s.readPage(7, ct.data(), out.data(), meta), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(Blob(out), *pt);
+
+  // The page number is authenticated
+  EXPECT_EQ(s.readPage(8, ct.data(), out.data(), meta), AES_GCM_STATUS::DEC_ERROR);
+
+  // Rewriting the same data uses a new generation and ciphertext; the old
+  // ciphertext no longer matches the new metadata
+  MutableBlob ct2(PAGE);
+  Byte meta2[AES_GCM_SECTOR_META_BYTES];
+  memcpy(meta2, meta, sizeof(meta));
+  EXPECT_EQ(s.writePage(7, pt->data(), ct2.data(), meta2), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(loadBE64(meta2), gen + 1);
+  EXPECT_NE(Blob(ct), Blob(ct2));
+  EXPECT_EQ(s.readPage(7, ct.data(), out.data(), meta2), AES_GCM_STATUS::DEC_ERROR);
+  EXPECT_EQ(s.readPage(7, ct2.data(), out.data(), meta2), AES_GCM_STATUS::VALID);
+
+  // In place
+  MutableBlob buf(*pt);
+  EXPECT_EQ(s.writePage(9, buf.data(), buf.data(), meta), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(s.readPage(9, buf.data(), buf.data(), meta), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(Blob(buf), *pt);
+
+  // Rolling the metadata back does not roll the generation back, so the IV
+  // is not reused
+  memcpy(meta2, meta, sizeof(meta));
+  EXPECT_EQ(s.writePage(9, pt->data(), ct2.data(), meta2), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(loadBE64(meta2), gen + 3);
+
+  // Re-keying (a restart) starts a new random sequence
+  EXPECT_EQ(s.keyIs(*random(AES_GCM_KEYSIZE_256)), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(s.writePage(7, pt->data(), ct2.data(), meta2), AES_GCM_STATUS::VALID);
+  EXPECT_NE(loadBE64(meta2), gen + 4);
+}
+
+TEST(AES_GCM_SectorTest, Batch) {
+  const U32 PAGE = 16384;
+  const size_t COUNT = 32;
+  AES_GCM_Sector s(PAGE, 4);
+  EXPECT_EQ(s.lanes(), 4U);
+  s.keyIs(*random(AES_GCM_KEYSIZE_128));
+
+  unique_ptr<Blob> pt = random(PAGE * COUNT);
+  MutableBlob disk(PAGE * COUNT);
+  MutableBlob meta(AES_GCM_SECTOR_META_BYTES * COUNT, Blob::ScrubType::ZEROS);
+  std::vector<AES_GCM_SectorOp> ops(COUNT);
+  for (size_t i = 0; i < COUNT; i++) {
+    ops[i] = AES_GCM_SectorOp{100 + i, pt->data() + i * PAGE, disk.data() + i * PAGE,
+      meta.data() + i * AES_GCM_SECTOR_META_BYTES, AES_GCM_STATUS::INVALID_SIZE};
+  }
+  EXPECT_EQ(s.write(ops.data(), COUNT), AES_GCM_STATUS::VALID);
+
+  // Read back in place, with one page corrupted
+  disk.data()[5 * PAGE + 17] ^= 0x01;
+  for (size_t i = 0; i < COUNT; i++) {
+    ops[i].in = disk.data() + i * PAGE;
+  }
+  EXPECT_EQ(s.read(ops.data(), COUNT), AES_GCM_STATUS::DEC_ERROR);
+  for (size_t i = 0; i < COUNT; i++) {
+    if (i == 5) {
+      EXPECT_EQ(ops[i].status, AES_GCM_STATUS::DEC_ERROR);
+      continue;
+    }
+    EXPECT_EQ(ops[i].status, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(memcmp(disk.data() + i * PAGE, pt->data() + i * PAGE, PAGE), 0);
+  }
+}
+
+TEST(AES_GCM_SectorTest, RepeatedBatches) {
+  // The lane threads are reused by batches of every size
+  const U32 PAGE = 64;
+  const size_t COUNT = 20;
+  AES_GCM_Sector s(PAGE, 4);
+  s.keyIs(*random(AES_GCM_KEYSIZE_256));
+  unique_ptr<Blob> pt = random(PAGE * COUNT);
+  MutableBlob disk(PAGE * COUNT);
+  MutableBlob out(PAGE * COUNT);
+  std::vector<AES_GCM_SectorOp> ops(COUNT);
+  for (U32 round = 0; round < 200; round++) {
+    size_t count = 1 + round % COUNT;
+    MutableBlob meta(AES_GCM_SECTOR_META_BYTES * count, Blob::ScrubType::ZEROS);
+    for (size_t i = 0; i < count; i++) {
+      ops[i] = AES_GCM_SectorOp{i, pt->data() + i * PAGE, disk.data() + i * PAGE,
+        meta.data() + i * AES_GCM_SECTOR_META_BYTES, AES_GCM_STATUS::INVALID_SIZE};
+    }
+    ASSERT_EQ(s.write(ops.data(), count), AES_GCM_STATUS::VALID) << round;
+    for (size_t i = 0; i < count; i++) {
+      ops[i].in = disk.data() + i * PAGE;
+      ops[i].out = out.data() + i * PAGE;
+    }
+    ASSERT_EQ(s.read(ops.data(), count), AES_GCM_STATUS::VALID) << round;
+    EXPECT_EQ(memcmp(out.data(), pt->data(), count * PAGE), 0) << round;
+  }
+}
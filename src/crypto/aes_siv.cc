@@ -0,0 +1,241 @@
+#include "crypto/aes_siv.h"
+#include "util/make_unique.h"
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+using Util::make_unique;
+
+// Doubling in GF(2^128), as CMAC's subkeys do
+static void dbl(Byte *_block)
+{
+  Byte carry = (Byte)(_block[0] >> 7);
+  for (U32 i = 0; i < AES_CMAC_BYTES - 1; i++) {
+    _block[i] = (Byte)((_block[i] << 1) | (_block[i + 1] >> 7));
+  }
+  _block[AES_CMAC_BYTES - 1] = (Byte)((_block[AES_CMAC_BYTES - 1] << 1) ^ (carry * 0x87));
+}
+
+static void xorBlock(Byte *_block, const Byte *_other)
+{
+  for (U32 i = 0; i < AES_CMAC_BYTES; i++) {
+    _block[i] ^= _other[i];
+  }
+}
+
+// Compares all of both IVs, whatever the first difference
+static bool ivsEqual(const Byte *_a, const Byte *_b)
+{
+  Byte diff = 0;
+  for (U32 i = 0; i < AES_SIV_IV_BYTES; i++) {
+    diff |= (Byte)(_a[i] ^ _b[i]);
+  }
+  return diff == 0;
+}
+
+AES_SIV_Key::AES_SIV_Key()
+  : keySize_(0), mac_(backend().aesCmac()), ctr_(backend().aesCtr()), zeroMac_()
+{
+  // empty
+}
+
+AES_GCM_STATUS AES_SIV_Key::keyIs(const Blob &_key)
+{
+  U64 size = _key.size();
+  if ((size != AES_SIV_KEYSIZE_512) && (size != AES_SIV_KEYSIZE_256) &&
+    (size != AES_SIV_KEYSIZE_384)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+
+  // S2V's first step depends only on the key: D = CMAC(zero block)
+  static const Byte zeros[AES_CMAC_BYTES] = {0};
+  U32 half = (U32)size / 2;
+  keySize_ = 0;
+  if (!mac_->keyIs(_key.data(), half) || !ctr_->keyIs(_key.data() + half, half) ||
+    !mac_->update(zeros, sizeof(zeros)) || !mac_->digest(zeroMac_)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  keySize_ = (U32)size;
+  return AES_GCM_STATUS::VALID;
+}
+
+U32 AES_SIV_Key::keySize() const
+{
+  return keySize_;
+}
+
+AES_GCM_STATUS AES_SIV_Key::encrypt(Byte *_ctxt, const Blob *_headers, size_t _headerCount,
+  const Byte *_ptxt, U64 _ptxtSize)
+{
+  if ((keySize_ == 0) || (_headerCount > AES_SIV_HEADERS_MAX)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+  Byte iv[AES_SIV_IV_BYTES];
+  if (!s2v(iv, _headers, _headerCount, _ptxt, _ptxtSize) ||
+    !ctr(_ctxt + AES_SIV_IV_BYTES, _ptxt, _ptxtSize, iv)) {
+    return AES_GCM_STATUS::ENC_ERROR;
+  }
+  memcpy(_ctxt, iv, AES_SIV_IV_BYTES);
+  return AES_GCM_STATUS::VALID;
+}
+
+AES_GCM_STATUS AES_SIV_Key::decrypt(Byte *_ptxt, const Blob *_headers, size_t _headerCount,
+  const Byte *_ctxt, U64 _ptxtSize)
+{
+  if ((keySize_ == 0) || (_headerCount > AES_SIV_HEADERS_MAX)) {
+    return AES_GCM_STATUS::INVALID_SIZE;
+  }
+
+  // The IV authenticates the plaintext, so decrypt first, then recompute it
+  Byte iv[AES_SIV_IV_BYTES];
+  Byte expected[AES_SIV_IV_BYTES];
+  memcpy(iv, _ctxt, AES_SIV_IV_BYTES);
+  bool valid = ctr(_ptxt, _ctxt + AES_SIV_IV_BYTES, _ptxtSize, iv) &&
+    s2v(expected, _headers, _headerCount, _ptxt, _ptxtSize) && ivsEqual(iv, expected);
+  if (!valid) {
+    if (_ptxtSize != 0) {
+      memset(_ptxt, 0, _ptxtSize);
+    }
+    return AES_GCM_STATUS::DEC_ERROR;
+  }
+  return AES_GCM_STATUS::VALID;
+}
+
+bool AES_SIV_Key::s2v(Byte *_iv, const Blob *_headers, size_t _headerCount,
+  const Byte *_ptxt, U64 _ptxtSize)
+{
+  Byte d[AES_CMAC_BYTES];
+  Byte mac[AES_CMAC_BYTES];
+  memcpy(d, zeroMac_, sizeof(d));
+  for (size_t i = 0; i < _headerCount; i++) {
+    if (!mac_->update(_headers[i].data(), _headers[i].size()) || !mac_->digest(mac)) {
+      return false;
+    }
+    dbl(d);
+    xorBlock(d, mac);
+  }
+
+  // The plaintext's last block absorbs D: xored into its end, or doubled
+  // and xored into the padded block of a short plaintext
+  Byte last[AES_CMAC_BYTES];
+  if (_ptxtSize >= AES_CMAC_BYTES) {
+    U64 head = _ptxtSize - AES_CMAC_BYTES;
+    memcpy(last, _ptxt + head, AES_CMAC_BYTES);
+    xorBlock(last, d);
+    if (!mac_->update(_ptxt, head)) {
+      return false;
+    }
+  }
+  else {
+    dbl(d);
+    memset(last, 0, sizeof(last));
+    if (_ptxtSize != 0) {
+      memcpy(last, _ptxt, _ptxtSize);
+    }
+    last[_ptxtSize] = 0x80;
+    xorBlock(last, d);
+  }
+  return mac_->update(last, sizeof(last)) && mac_->digest(_iv);
+}
+
+bool AES_SIV_Key::ctr(Byte *_out, const Byte *_in, U64 _size, const Byte *_iv)
+{
+  // The counter is the IV with bits 63 and 31 cleared (RFC 5297, 2.5), so
+  // 32-bit counter implementations work too
+  Byte counter[AES_SIV_IV_BYTES];
+  memcpy(counter, _iv, sizeof(counter));
+  counter[8] &= 0x7f;
+  counter[12] &= 0x7f;
+  return (_size == 0) || ctr_->crypt(_out, _in, _size, counter);
+}
+
+
+/*** ENCRYPTION ***/
+
+AES_SIV_Enc::AES_SIV_Enc()
+  : key_(), aad_(), ptxt_()
+{
+  // empty
+}
+
+AES_GCM_STATUS AES_SIV_Enc::keyIs(const Blob &_key)
+{
+  return key_.keyIs(_key);
+}
+
+void AES_SIV_Enc::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+}
+
+void AES_SIV_Enc::plaintextIs(const Blob &_plaintext)
+{
+  ptxt_ = _plaintext;
+}
+
+unique_ptr<AES_GCM_Result> AES_SIV_Enc::ciphertext()
+{
+  MutableBlob mctxt(AES_SIV_IV_BYTES + ptxt_.size());
+  AES_GCM_STATUS status = key_.encrypt(mctxt.data(), &aad_, 1, ptxt_.data(), ptxt_.size());
+  if (status != AES_GCM_STATUS::VALID) {
+    return make_unique<AES_GCM_Result>(Blob(), status);
+  }
+  return make_unique<AES_GCM_Result>(mctxt, AES_GCM_STATUS::VALID);
+}
+
+
+/*** DECRYPTION ***/
+
+AES_SIV_Dec::AES_SIV_Dec()
+  : key_(), aad_(), ctxt_(), ptxt_(Blob(), AES_GCM_STATUS::DEC_ERROR), needsDecrypt_(false),
+  mutableMux_()
+{
+  // empty
+}
+
+AES_GCM_STATUS AES_SIV_Dec::keyIs(const Blob &_key)
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  needsDecrypt_ = true;
+  return key_.keyIs(_key);
+}
+
+void AES_SIV_Dec::aadIs(const Blob &_aad)
+{
+  aad_ = _aad;
+  needsDecrypt_ = true;
+}
+
+void AES_SIV_Dec::ciphertextIs(const Blob &_ciphertext)
+{
+  ctxt_ = _ciphertext;
+  needsDecrypt_ = true;
+}
+
+const AES_GCM_Result &AES_SIV_Dec::plaintext() const
+{
+  std::lock_guard<std::mutex> lock(mutableMux_);
+  if (needsDecrypt_) {
+    decrypt();
+  }
+  return ptxt_;
+}
+
+void AES_SIV_Dec::decrypt() const
+{
+  needsDecrypt_ = false;
+  ptxt_.first.dataIsNull();
+  if (ctxt_.size() < AES_SIV_IV_BYTES) {
+    ptxt_.second = AES_GCM_STATUS::INVALID_SIZE;
+    return;
+  }
+  U64 ptxtSize = ctxt_.size() - AES_SIV_IV_BYTES;
+  MutableBlob ptxt(ptxtSize, Blob::ScrubType::ZEROS);
+  AES_GCM_STATUS status = key_.decrypt(ptxt.data(), &aad_, 1, ctxt_.data(), ptxtSize);
+  if (status == AES_GCM_STATUS::VALID) {
+    ptxt_.first = ptxt;
+  }
+  ptxt_.second = status;
+}
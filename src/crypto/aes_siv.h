@@ -0,0 +1,109 @@
+#ifndef CRYPTO_AES_SIV_H
+#define CRYPTO_AES_SIV_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/backend.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+namespace Crypto {
+
+// AES-SIV (RFC 5297): deterministic authenticated encryption. The IV is a
+// MAC (S2V, built on AES-CMAC) of the headers and plaintext, and then the
+// AES-CTR counter, so encrypting the same plaintext with the same key and
+// headers always gives the same ciphertext:
+//
+//   | synthetic IV (16) | ciphertext |
+//
+// That is what lets an encrypted column be indexed and searched for an
+// encrypted value, and also what an observer learns: which messages are
+// equal. Use it for lookup keys, not for general data; adding a random
+// nonce as the last header makes it an ordinary (misuse-resistant) AEAD.
+// Each message is read twice, once for S2V and once for CTR.
+static const U32 AES_SIV_IV_BYTES = AES_CMAC_BYTES;
+
+// Keys are two AES keys of the same size, for S2V then CTR
+static const U32 AES_SIV_KEYSIZE_256 = 2 * AES_GCM_KEYSIZE_128;
+static const U32 AES_SIV_KEYSIZE_384 = 2 * AES_GCM_KEYSIZE_192;
+static const U32 AES_SIV_KEYSIZE_512 = 2 * AES_GCM_KEYSIZE_256;
+
+// S2V takes at most this many headers
+static const U32 AES_SIV_HEADERS_MAX = 126;
+
+// One AES-SIV key context: keyed CMAC and CTR contexts from the backend. Not
+// thread-safe.
+class AES_SIV_Key
+{
+ public:
+  AES_SIV_Key();
+  AES_SIV_Key(const AES_SIV_Key &) = delete;
+  AES_SIV_Key &operator=(const AES_SIV_Key &) = delete;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+  U32 keySize() const;
+
+  // Writes AES_SIV_IV_BYTES + ptxtSize bytes to 'ctxt'
+  AES_GCM_STATUS encrypt(Byte *ctxt, const Util::Blob *headers, size_t headerCount,
+    const Byte *ptxt, U64 ptxtSize);
+
+  // Reads AES_SIV_IV_BYTES + ptxtSize bytes from 'ctxt' and writes ptxtSize
+  // bytes to 'ptxt', which may be the ciphertext after the IV. 'ptxt' is
+  // zeroed unless the result is VALID.
+  AES_GCM_STATUS decrypt(Byte *ptxt, const Util::Blob *headers, size_t headerCount,
+    const Byte *ctxt, U64 ptxtSize);
+
+ private:
+  bool s2v(Byte *iv, const Util::Blob *headers, size_t headerCount, const Byte *ptxt,
+    U64 ptxtSize);
+  bool ctr(Byte *out, const Byte *in, U64 size, const Byte *iv);
+  U32 keySize_;
+  std::unique_ptr<AES_CMAC> mac_;
+  std::unique_ptr<AES_CTR> ctr_;
+  Byte zeroMac_[AES_CMAC_BYTES];
+};
+
+// One message with the AAD (possibly empty) as its only header, so the same
+// plaintext, key and AAD always give the same ciphertext
+class AES_SIV_Enc
+{
+ public:
+  AES_SIV_Enc();
+  AES_SIV_Enc(const AES_SIV_Enc &) = delete;
+  AES_SIV_Enc &operator=(const AES_SIV_Enc &) = delete;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+  void aadIs(const Util::Blob &aad);
+  void plaintextIs(const Util::Blob &plaintext);
+  std::unique_ptr<AES_GCM_Result> ciphertext();
+
+ private:
+  AES_SIV_Key key_;
+  Util::Blob aad_;
+  Util::Blob ptxt_;
+};
+
+class AES_SIV_Dec
+{
+ public:
+  AES_SIV_Dec();
+  AES_SIV_Dec(const AES_SIV_Dec &) = delete;
+  AES_SIV_Dec &operator=(const AES_SIV_Dec &) = delete;
+  AES_GCM_STATUS keyIs(const Util::Blob &key);
+  void aadIs(const Util::Blob &aad);
+  void ciphertextIs(const Util::Blob &ciphertext);
+  const AES_GCM_Result &plaintext() const;
+
+ private:
+  void decrypt() const;
+  mutable AES_SIV_Key key_;
+  Util::Blob aad_;
+  Util::Blob ctxt_;
+  mutable AES_GCM_Result ptxt_;
+  mutable bool needsDecrypt_;
+  mutable std::mutex mutableMux_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_AES_SIV_H
@@ -0,0 +1,134 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_siv.h"
+#include "crypto/random.h"
+#include <string>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::string;
+using std::unique_ptr;
+
+static Blob fromHex(const string &hex)
+{
+  MutableBlob out(hex.size() / 2);
+  for (U64 i = 0; i < out.size(); i++) {
+    out.data()[i] = (Byte)std::stoi(hex.substr(2 * i, 2), nullptr, 16);
+  }
+  return out;
+}
+
+TEST(AES_SIV_Test, Vectors) {
+  // RFC 5297 appendix A.1: deterministic, one header
+  Blob key = fromHex("fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+  Blob aad = fromHex("101112131415161718191a1b1c1d1e1f2021222324252627");
+  Blob ptxt = fromHex("112233445566778899aabbccddee");
+  Blob ctxt = fromHex("85632d07c6e8f37f950acd320a2ecc9340c02b9690c4dc04daef7f6afe5c");
+  AES_SIV_Enc e;
+  ASSERT_EQ(e.keyIs(key), AES_GCM_STATUS::VALID);
+  e.aadIs(aad);
+  e.plaintextIs(ptxt);
+  unique_ptr<AES_GCM_Result> res = e.ciphertext();
+  EXPECT_EQ(res->second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(res->first, ctxt);
+
+  AES_SIV_Dec d;
+  ASSERT_EQ(d.keyIs(key), AES_GCM_STATUS::VALID);
+  d.aadIs(aad);
+  d.ciphertextIs(ctxt);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, ptxt);
+
+  // A.2: two headers and a nonce
+  key = fromHex("7f7e7d7c7b7a79787776757473727170404142434445464748494a4b4c4d4e4f");
+  Blob headers[] = {
+    fromHex("00112233445566778899aabbccddeeffdeaddadadeaddadaffeeddccbbaa99887766554433221100"),
+    fromHex("102030405060708090a0"),
+    fromHex("09f911029d74e35bd84156c5635688c0"),
+  };
+  ptxt = fromHex("7468697320697320736f6d6520706c61696e7465787420746f20656e6372797074"
+    "207573696e67205349562d414553");
+  ctxt = fromHex("7bdb6e3b432667eb06f4d14bff2fbd0fcb900f2fddbe404326601965c889bf17"
+    "dba77ceb094fa663b7a3f748ba8af829ea64ad544a272e9c485b62a3fd5c0d");
+  AES_SIV_Key siv;
+  ASSERT_EQ(siv.keyIs(key), AES_GCM_STATUS::VALID);
+  MutableBlob out(ctxt.size());
+  EXPECT_EQ(siv.encrypt(out.data(), headers, 3, ptxt.data(), ptxt.size()),
+    AES_GCM_STATUS::VALID);
+  EXPECT_EQ(Blob(out), ctxt);
+
+  // In place
+  EXPECT_EQ(siv.decrypt(out.data() + AES_SIV_IV_BYTES, headers, 3, out.data(), ptxt.size()),
+    AES_GCM_STATUS::VALID);
+  EXPECT_EQ(Blob(out, ptxt.size(), AES_SIV_IV_BYTES), ptxt);
+}
+
+TEST(AES_SIV_Test, Deterministic) {
+  // Equal plaintexts give equal ciphertexts, whatever their size, so they
+  // can be looked up; other plaintexts, AADs and keys do not
+  Blob key = *random(AES_SIV_KEYSIZE_512);
+  AES_SIV_Enc e;
+  ASSERT_EQ(e.keyIs(key), AES_GCM_STATUS::VALID);
+  AES_SIV_Dec d;
+  ASSERT_EQ(d.keyIs(key), AES_GCM_STATUS::VALID);
+  for (U64 size : {0, 1, 15, 16, 17, 32, 1000}) {
+    Blob ptxt = *random(size);
+    e.aadIs(Blob("users.email", 11));
+    e.plaintextIs(ptxt);
+    Blob ctxt = e.ciphertext()->first;
+    EXPECT_EQ(ctxt.size(), AES_SIV_IV_BYTES + size);
+    EXPECT_EQ(e.ciphertext()->first, ctxt) << size;
+    e.aadIs(Blob("users.name", 10));
+    EXPECT_NE(e.ciphertext()->first, ctxt) << size;
+
+    d.aadIs(Blob("users.email", 11));
+    d.ciphertextIs(ctxt);
+    EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+    EXPECT_EQ(d.plaintext().first, ptxt);
+  }
+
+  AES_SIV_Enc other;
+  ASSERT_EQ(other.keyIs(*random(AES_SIV_KEYSIZE_512)), AES_GCM_STATUS::VALID);
+  Blob ptxt("alice@example.com", 17);
+  e.plaintextIs(ptxt);
+  other.plaintextIs(ptxt);
+  EXPECT_NE(e.ciphertext()->first, other.ciphertext()->first);
+}
+
+TEST(AES_SIV_Test, Errors) {
+  AES_SIV_Enc e;
+  e.plaintextIs(Blob("secret", 6));
+  EXPECT_EQ(e.ciphertext()->second, AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(e.keyIs(*random(AES_GCM_KEYSIZE_128)), AES_GCM_STATUS::INVALID_SIZE);
+  Blob key = *random(AES_SIV_KEYSIZE_384);
+  ASSERT_EQ(e.keyIs(key), AES_GCM_STATUS::VALID);
+  e.aadIs(Blob("context", 7));
+  Blob ctxt = e.ciphertext()->first;
+
+  // Any change to the IV, ciphertext or AAD fails, leaving no plaintext
+  AES_SIV_Dec d;
+  ASSERT_EQ(d.keyIs(key), AES_GCM_STATUS::VALID);
+  d.ciphertextIs(ctxt);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  d.aadIs(Blob("context", 7));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  for (U64 i : {(U64)0, (U64)AES_SIV_IV_BYTES - 1, ctxt.size() - 1}) {
+    MutableBlob bad(ctxt);
+    bad.data()[i] ^= 1;
+    d.ciphertextIs(bad);
+    EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::DEC_ERROR) << i;
+    EXPECT_EQ(d.plaintext().first.size(), 0U);
+  }
+  d.ciphertextIs(Blob(ctxt, AES_SIV_IV_BYTES - 1, 0));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_SIZE);
+
+  std::vector<Blob> headers(AES_SIV_HEADERS_MAX + 1);
+  AES_SIV_Key siv;
+  ASSERT_EQ(siv.keyIs(key), AES_GCM_STATUS::VALID);
+  MutableBlob out(AES_SIV_IV_BYTES);
+  EXPECT_EQ(siv.encrypt(out.data(), headers.data(), headers.size(), nullptr, 0),
+    AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(siv.encrypt(out.data(), headers.data(), AES_SIV_HEADERS_MAX, nullptr, 0),
+    AES_GCM_STATUS::VALID);
+}
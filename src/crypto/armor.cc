@@ -0,0 +1,523 @@
+#include "crypto/armor.h"
+#include "util/make_unique.h"
+#include <cctype>
+#include <cstring>
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+using Util::make_unique;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+static const char BASE64_DIGITS[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char BASE64_PAD = '=';
+static const Byte INVALID = 0xff;
+
+namespace {
+
+// Value of each character, or INVALID
+struct DecodeTable
+{
+  DecodeTable()
+  {
+    memset(hex, INVALID, sizeof(hex));
+    memset(base64, INVALID, sizeof(base64));
+    for (Byte i = 0; i < 16; i++) {
+      hex[(Byte)HEX_DIGITS[i]] = i;
+      hex[(Byte)toupper(HEX_DIGITS[i])] = i;
+    }
+    for (Byte i = 0; i < 64; i++) {
+      base64[(Byte)BASE64_DIGITS[i]] = i;
+    }
+  }
+
+  Byte hex[256];
+  Byte base64[256];
+};
+
+} // namespace
+
+static const DecodeTable &decodeTable()
+{
+  static const DecodeTable table;
+  return table;
+}
+
+/*** VECTOR CODECS ***/
+
+// Each codec runs over the longest prefix it can and returns the input it
+// consumed; the scalar code finishes the rest.
+
+#if defined(__SSSE3__)
+
+static U64 encodeHexVector(char *_text, const Byte *_data, U64 _size)
+{
+  U64 i = 0;
+#if defined(__AVX2__)
+  const __m256i digits32 = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+    'a', 'b', 'c', 'd', 'e', 'f', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b',
+    'c', 'd', 'e', 'f');
+  const __m256i low32 = _mm256_set1_epi8(0x0f);
+  for (; i + 32 <= _size; i += 32) {
+    __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_data + i));
+    __m256i hi = _mm256_shuffle_epi8(digits32, _mm256_and_si256(_mm256_srli_epi16(in, 4), low32));
+    __m256i lo = _mm256_shuffle_epi8(digits32, _mm256_and_si256(in, low32));
+
+    // The unpacks work within 128-bit lanes
+    __m256i first = _mm256_unpacklo_epi8(hi, lo);
+    __m256i second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(_text + 2 * i),
+      _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(_text + 2 * i + 32),
+      _mm256_permute2x128_si256(first, second, 0x31));
+  }
+#endif
+  const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a',
+    'b', 'c', 'd', 'e', 'f');
+  const __m128i low = _mm_set1_epi8(0x0f);
+  for (; i + 16 <= _size; i += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_data + i));
+    __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), low));
+    __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, low));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(_text + 2 * i), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(_text + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+  return i;
+}
+
+// Nibble values of 16 hex characters; false if any is not a hex digit
+static bool hexValues(__m128i _text, __m128i &_values)
+{
+  __m128i digit = _mm_sub_epi8(_text, _mm_set1_epi8('0'));
+  __m128i alpha = _mm_sub_epi8(_mm_or_si128(_text, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  __m128i isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+  _values = _mm_or_si128(_mm_and_si128(isDigit, digit),
+    _mm_and_si128(isAlpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+  return _mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) == 0xffff;
+}
+
+#if defined(__AVX2__)
+static bool hexValues(__m256i _text, __m256i &_values)
+{
+  __m256i digit = _mm256_sub_epi8(_text, _mm256_set1_epi8('0'));
+  __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(_text, _mm256_set1_epi8(0x20)),
+    _mm256_set1_epi8('a'));
+  __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+  __m256i isAlpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+  _values = _mm256_or_si256(_mm256_and_si256(isDigit, digit),
+    _mm256_and_si256(isAlpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+  return _mm256_movemask_epi8(_mm256_or_si256(isDigit, isAlpha)) == -1;
+}
+#endif
+
+// Returns the characters consumed; 'ok' is false if one was not a hex digit
+static U64 decodeHexVector(Byte *_data, const char *_text, U64 _size, bool &_ok)
+{
+  U64 i = 0;
+  _ok = true;
+#if defined(__AVX2__)
+  // Adjacent nibbles (high first) combine as hi * 16 + lo
+  const __m256i weights32 = _mm256_set1_epi16(0x0110);
+  for (; i + 64 <= _size; i += 64) {
+    __m256i first;
+    __m256i second;
+    if (!hexValues(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(_text + i)), first) ||
+      !hexValues(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(_text + i + 32)),
+      second)) {
+      _ok = false;
+      return i;
+    }
+    __m256i out = _mm256_packus_epi16(_mm256_maddubs_epi16(first, weights32),
+      _mm256_maddubs_epi16(second, weights32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(_data + i / 2),
+      _mm256_permute4x64_epi64(out, 0xd8));
+  }
+#endif
+  const __m128i weights = _mm_set1_epi16(0x0110);
+  for (; i + 32 <= _size; i += 32) {
+    __m128i first;
+    __m128i second;
+    if (!hexValues(_mm_loadu_si128(reinterpret_cast<const __m128i *>(_text + i)), first) ||
+      !hexValues(_mm_loadu_si128(reinterpret_cast<const __m128i *>(_text + i + 16)), second)) {
+      _ok = false;
+      return i;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(_data + i / 2),
+      _mm_packus_epi16(_mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights)));
+  }
+  return i;
+}
+
+// Base64 after W. Mula and D. Lemire, "Faster Base64 Encoding and Decoding
+// Using AVX2 Instructions" (2018). The encoder spreads each 3 input bytes
+// over a 32-bit word and extracts the four 6-bit indices with two multiplies;
+// the decoder validates characters with two nibble-indexed lookups.
+
+static __m128i base64Encode(__m128i _in)
+{
+  // Bytes a b c to the word b a c b, then move each 6-bit field into a byte
+  __m128i in = _mm_shuffle_epi8(_in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1,
+    2, 0, 1));
+  __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+    _mm_set1_epi32(0x04000040));
+  __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+    _mm_set1_epi32(0x01000010));
+  __m128i indices = _mm_or_si128(t0, t1);
+
+  // 0-25 to 'A', 26-51 to 'a', 52-61 to '0', then '+' and '/', by range
+  __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices),
+    _mm_set1_epi8(13)));
+  const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+
+#if defined(__AVX2__)
+static __m256i base64Encode(__m256i _in)
+{
+  __m256i in = _mm256_shuffle_epi8(_in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3,
+    4, 1, 2, 0, 1, 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+    _mm256_set1_epi32(0x04000040));
+  __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+    _mm256_set1_epi32(0x01000010));
+  __m256i indices = _mm256_or_si256(t0, t1);
+  __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26),
+    indices), _mm256_set1_epi8(13)));
+  const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices);
+}
+#endif
+
+static U64 encodeBase64Vector(char *_text, const Byte *_data, U64 _size)
+{
+  U64 i = 0;
+  char *out = _text;
+#if defined(__AVX2__)
+  // 24 bytes in, as 12 per 128-bit lane; each lane loads 16
+  for (; i + 32 <= _size; i += 24) {
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(_data + i))),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(_data + i + 12)), 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), base64Encode(in));
+    out += 32;
+  }
+#endif
+  for (; i + 16 <= _size; i += 12) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_data + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), base64Encode(in));
+    out += 16;
+  }
+  return i;
+}
+
+// Bit per valid high nibble (2-7), and per low nibble the high nibbles it is
+// invalid with; bit 7 rejects every other high nibble
+static const char BASE64_HI_CLASS[16] = {(char)0x80, (char)0x80, 0x01, 0x02, 0x04, 0x08,
+  0x10, 0x20, (char)0x80, (char)0x80, (char)0x80, (char)0x80, (char)0x80, (char)0x80,
+  (char)0x80, (char)0x80};
+static const char BASE64_LO_INVALID[16] = {(char)0x95, (char)0x81, (char)0x81, (char)0x81,
+  (char)0x81, (char)0x81, (char)0x81, (char)0x81, (char)0x81, (char)0x81, (char)0x83,
+  (char)0xaa, (char)0xab, (char)0xab, (char)0xab, (char)0xaa};
+
+// Added to a character by high nibble: '+' 19, '0' 4, 'A' -65, 'a' -71 ('/'
+// is 3 less than '+')
+static const char BASE64_SHIFT[16] = {0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0,
+  0};
+
+static bool base64Values(__m128i _text, __m128i &_values)
+{
+  const __m128i hiClass = _mm_loadu_si128(reinterpret_cast<const __m128i *>(BASE64_HI_CLASS));
+  const __m128i loInvalid =
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(BASE64_LO_INVALID));
+  const __m128i shifts = _mm_loadu_si128(reinterpret_cast<const __m128i *>(BASE64_SHIFT));
+  __m128i hi = _mm_and_si128(_mm_srli_epi32(_text, 4), _mm_set1_epi8(0x0f));
+  __m128i lo = _mm_and_si128(_text, _mm_set1_epi8(0x0f));
+  __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(hiClass, hi), _mm_shuffle_epi8(loInvalid, lo));
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) != 0xffff) {
+    return false;
+  }
+  __m128i slash = _mm_and_si128(_mm_cmpeq_epi8(_text, _mm_set1_epi8('/')), _mm_set1_epi8(-3));
+  _values = _mm_add_epi8(_text, _mm_add_epi8(_mm_shuffle_epi8(shifts, hi), slash));
+  return true;
+}
+
+// Four 6-bit values to three bytes in each 32-bit word, packed into the low 12
+// bytes of the lane
+static __m128i base64Pack(__m128i _values)
+{
+  __m128i pairs = _mm_maddubs_epi16(_values, _mm_set1_epi32(0x01400140));
+  __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+    -1, -1));
+}
+
+#if defined(__AVX2__)
+static bool base64Values(__m256i _text, __m256i &_values)
+{
+  const __m256i hiClass = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(BASE64_HI_CLASS)));
+  const __m256i loInvalid = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(BASE64_LO_INVALID)));
+  const __m256i shifts = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(BASE64_SHIFT)));
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi32(_text, 4), _mm256_set1_epi8(0x0f));
+  __m256i lo = _mm256_and_si256(_text, _mm256_set1_epi8(0x0f));
+  __m256i invalid = _mm256_and_si256(_mm256_shuffle_epi8(hiClass, hi),
+    _mm256_shuffle_epi8(loInvalid, lo));
+  if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(invalid, _mm256_setzero_si256())) != -1) {
+    return false;
+  }
+  __m256i slash = _mm256_and_si256(_mm256_cmpeq_epi8(_text, _mm256_set1_epi8('/')),
+    _mm256_set1_epi8(-3));
+  _values = _mm256_add_epi8(_text, _mm256_add_epi8(_mm256_shuffle_epi8(shifts, hi), slash));
+  return true;
+}
+
+static __m256i base64Pack(__m256i _values)
+{
+  __m256i pairs = _mm256_maddubs_epi16(_values, _mm256_set1_epi32(0x01400140));
+  __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+  __m256i lanes = _mm256_shuffle_epi8(words, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+    13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  return _mm256_permutevar8x32_epi32(lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+#endif
+
+// Leaves the last quad (which may be padded) to the scalar code. The stores
+// run past the bytes produced, so each block needs a quad or two after it.
+static U64 decodeBase64Vector(Byte *_data, const char *_text, U64 _size, bool &_ok)
+{
+  U64 i = 0;
+  Byte *out = _data;
+  _ok = true;
+#if defined(__AVX2__)
+  for (; i + 48 <= _size; i += 32) {
+    __m256i values;
+    if (!base64Values(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(_text + i)),
+      values)) {
+      _ok = false;
+      return i;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), base64Pack(values));
+    out += 24;
+  }
+#endif
+  for (; i + 24 <= _size; i += 16) {
+    __m128i values;
+    if (!base64Values(_mm_loadu_si128(reinterpret_cast<const __m128i *>(_text + i)), values)) {
+      _ok = false;
+      return i;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), base64Pack(values));
+    out += 12;
+  }
+  return i;
+}
+
+#else
+
+static U64 encodeHexVector(char *, const Byte *, U64)
+{
+  return 0;
+}
+
+static U64 decodeHexVector(Byte *, const char *, U64, bool &_ok)
+{
+  _ok = true;
+  return 0;
+}
+
+static U64 encodeBase64Vector(char *, const Byte *, U64)
+{
+  return 0;
+}
+
+static U64 decodeBase64Vector(Byte *, const char *, U64, bool &_ok)
+{
+  _ok = true;
+  return 0;
+}
+
+#endif // __SSSE3__
+
+/*** CODECS ***/
+
+static void encodeHex(char *_text, const Byte *_data, U64 _size)
+{
+  for (U64 i = encodeHexVector(_text, _data, _size); i < _size; i++) {
+    _text[2 * i] = HEX_DIGITS[_data[i] >> 4];
+    _text[2 * i + 1] = HEX_DIGITS[_data[i] & 0x0f];
+  }
+}
+
+static bool decodeHex(Byte *_data, const char *_text, U64 _size)
+{
+  if ((_size % 2) != 0) {
+    return false;
+  }
+  bool ok = true;
+  U64 i = decodeHexVector(_data, _text, _size, ok);
+  const Byte *table = decodeTable().hex;
+  for (; ok && (i < _size); i += 2) {
+    Byte hi = table[(Byte)_text[i]];
+    Byte lo = table[(Byte)_text[i + 1]];
+    ok = (hi != INVALID) && (lo != INVALID);
+    _data[i / 2] = (Byte)((hi << 4) | lo);
+  }
+  return ok;
+}
+
+static void encodeBase64(char *_text, const Byte *_data, U64 _size)
+{
+  U64 i = encodeBase64Vector(_text, _data, _size);
+  char *out = _text + i / 3 * 4;
+  for (; i + 3 <= _size; i += 3) {
+    U32 word = ((U32)_data[i] << 16) | ((U32)_data[i + 1] << 8) | _data[i + 2];
+    out[0] = BASE64_DIGITS[word >> 18];
+    out[1] = BASE64_DIGITS[(word >> 12) & 0x3f];
+    out[2] = BASE64_DIGITS[(word >> 6) & 0x3f];
+    out[3] = BASE64_DIGITS[word & 0x3f];
+    out += 4;
+  }
+  if (i < _size) {
+    U32 word = (U32)_data[i] << 16;
+    if (i + 1 < _size) {
+      word |= (U32)_data[i + 1] << 8;
+    }
+    out[0] = BASE64_DIGITS[word >> 18];
+    out[1] = BASE64_DIGITS[(word >> 12) & 0x3f];
+    out[2] = (i + 1 < _size) ? BASE64_DIGITS[(word >> 6) & 0x3f] : BASE64_PAD;
+    out[3] = BASE64_PAD;
+  }
+}
+
+static bool decodeBase64(Byte *_data, const char *_text, U64 _size)
+{
+  if ((_size % 4) != 0) {
+    return false;
+  }
+  bool ok = true;
+  U64 i = decodeBase64Vector(_data, _text, _size, ok);
+  Byte *out = _data + i / 4 * 3;
+  const Byte *table = decodeTable().base64;
+  for (; ok && (i < _size); i += 4) {
+    // Only the last quad may be padded, as "xx==" or "xxx="
+    bool last = (i + 4 == _size);
+    U32 pad = (last && (_text[i + 3] == BASE64_PAD)) ?
+      ((_text[i + 2] == BASE64_PAD) ? 2 : 1) : 0;
+    U32 word = 0;
+    for (U32 j = 0; j < 4; j++) {
+      Byte value = (j < 4 - pad) ? table[(Byte)_text[i + j]] : 0;
+      ok = ok && (value != INVALID);
+      word = (word << 6) | (value & 0x3f);
+    }
+    out[0] = (Byte)(word >> 16);
+    if (pad < 2) {
+      out[1] = (Byte)(word >> 8);
+    }
+    if (pad < 1) {
+      out[2] = (Byte)word;
+    }
+    out += 3;
+  }
+  return ok;
+}
+
+const char *Crypto::armorISA()
+{
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSSE3__)
+  return "ssse3";
+#else
+  return "scalar";
+#endif
+}
+
+U64 Crypto::armoredSize(AES_GCM_ARMOR _armor, U64 _size)
+{
+  switch (_armor) {
+    case AES_GCM_ARMOR::HEX:
+      return 2 * _size;
+    case AES_GCM_ARMOR::BASE64:
+      return (_size + 2) / 3 * 4;
+    default:
+      return _size;
+  }
+}
+
+U64 Crypto::unarmoredSize(AES_GCM_ARMOR _armor, const char *_text, U64 _size)
+{
+  switch (_armor) {
+    case AES_GCM_ARMOR::HEX:
+      return _size / 2;
+    case AES_GCM_ARMOR::BASE64: {
+      U64 size = _size / 4 * 3;
+      if ((_size >= 4) && ((_size % 4) == 0)) {
+        size -= (_text[_size - 1] == BASE64_PAD) ? 1 : 0;
+        size -= (_text[_size - 2] == BASE64_PAD) ? 1 : 0;
+      }
+      return size;
+    }
+    default:
+      return _size;
+  }
+}
+
+U64 Crypto::armor(AES_GCM_ARMOR _armor, char *_text, const Byte *_data, U64 _size)
+{
+  switch (_armor) {
+    case AES_GCM_ARMOR::HEX:
+      encodeHex(_text, _data, _size);
+      break;
+    case AES_GCM_ARMOR::BASE64:
+      encodeBase64(_text, _data, _size);
+      break;
+    default:
+      memcpy(_text, _data, _size);
+      break;
+  }
+  return armoredSize(_armor, _size);
+}
+
+bool Crypto::unarmor(AES_GCM_ARMOR _armor, Byte *_data, const char *_text, U64 _size)
+{
+  switch (_armor) {
+    case AES_GCM_ARMOR::HEX:
+      return decodeHex(_data, _text, _size);
+    case AES_GCM_ARMOR::BASE64:
+      return decodeBase64(_data, _text, _size);
+    default:
+      memcpy(_data, _text, _size);
+      return true;
+  }
+}
+
+unique_ptr<Blob> Crypto::armor(AES_GCM_ARMOR _armor, const Blob &_data)
+{
+  MutableBlob text(armoredSize(_armor, _data.size()));
+  armor(_armor, reinterpret_cast<char *>(text.data()), _data.data(), _data.size());
+  return make_unique<Blob>(text);
+}
+
+unique_ptr<Blob> Crypto::unarmor(AES_GCM_ARMOR _armor, const Blob &_text)
+{
+  const char *text = reinterpret_cast<const char *>(_text.data());
+  MutableBlob data(unarmoredSize(_armor, text, _text.size()));
+  if (!unarmor(_armor, data.data(), text, _text.size())) {
+    return unique_ptr<Blob>();
+  }
+  return make_unique<Blob>(data);
+}
@@ -0,0 +1,47 @@
+#ifndef CRYPTO_ARMOR_H
+#define CRYPTO_ARMOR_H
+
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <memory>
+
+namespace Crypto {
+
+// Optional text encoding ("armor") of a whole encrypted message, for carrying
+// ciphertexts in JSON or HTTP headers: lowercase hex, or base64 with the
+// standard alphabet and '=' padding (RFC 4648). Decoding also accepts
+// uppercase hex and rejects anything else, including whitespace.
+enum class AES_GCM_ARMOR
+{
+  NONE, HEX, BASE64
+};
+
+static const AES_GCM_ARMOR AES_GCM_ARMOR_DEFAULT = AES_GCM_ARMOR::NONE;
+
+// The codecs run 16 or 32 bytes at a time with SSSE3 or AVX2 when the build
+// targets them (the Makefile builds with -march=native) and byte by byte
+// otherwise. Which one was built in: "avx2", "ssse3" or "scalar".
+const char *armorISA();
+
+// Characters that 'size' bytes armor to
+U64 armoredSize(AES_GCM_ARMOR armor, U64 size);
+
+// Bytes that 'size' characters of well-formed 'text' unarmor to
+U64 unarmoredSize(AES_GCM_ARMOR armor, const char *text, U64 size);
+
+// Writes armoredSize() characters for 'size' bytes of 'data' to 'text'
+// (no terminator) and returns that count. Base64 input whose size is a
+// multiple of 3 needs no padding, so a message may be armored in such pieces.
+U64 armor(AES_GCM_ARMOR armor, char *text, const Byte *data, U64 size);
+
+// Writes unarmoredSize() bytes to 'data'. Returns false, with 'data'
+// partially written, if 'text' is malformed.
+bool unarmor(AES_GCM_ARMOR armor, Byte *data, const char *text, U64 size);
+
+// The same into new blobs; unarmor() returns nullptr if 'text' is malformed
+std::unique_ptr<Util::Blob> armor(AES_GCM_ARMOR armor, const Util::Blob &data);
+std::unique_ptr<Util::Blob> unarmor(AES_GCM_ARMOR armor, const Util::Blob &text);
+
+} // namespace Crypto
+
+#endif // CRYPTO_ARMOR_H
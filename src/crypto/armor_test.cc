@@ -0,0 +1,164 @@
+#include "gtest/gtest.h"
+#include "crypto/armor.h"
+#include "crypto/aes_gcm.h"
+#include "crypto/random.h"
+#include <string>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::string;
+using std::unique_ptr;
+
+static string armored(AES_GCM_ARMOR armor, const Blob &data)
+{
+  unique_ptr<Blob> text = Crypto::armor(armor, data);
+  return string(reinterpret_cast<const char *>(text->data()), text->size());
+}
+
+// Byte-at-a-time reference encoders
+static string referenceHex(const Blob &data)
+{
+  static const char *digits = "0123456789abcdef";
+  string s;
+  for (U64 i = 0; i < data.size(); i++) {
+    s += digits[data.data()[i] >> 4];
+    s += digits[data.data()[i] & 0x0f];
+  }
+  return s;
+}
+
+static string referenceBase64(const Blob &data)
+{
+  static const char *digits =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  string s;
+  U32 bits = 0;
+  U32 count = 0;
+  for (U64 i = 0; i < data.size(); i++) {
+    bits = (bits << 8) | data.data()[i];
+    count += 8;
+    while (count >= 6) {
+      count -= 6;
+      s += digits[(bits >> count) & 0x3f];
+    }
+  }
+  if (count > 0) {
+    s += digits[(bits << (6 - count)) & 0x3f];
+  }
+  while ((s.size() % 4) != 0) {
+    s += '=';
+  }
+  return s;
+}
+
+TEST(ArmorTest, Vectors) {
+  // RFC 4648, section 10
+  const char *base64[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+  const char *hex[] = {"", "66", "666f", "666f6f", "666f6f62", "666f6f6261", "666f6f626172"};
+  string foobar = "foobar";
+  for (U64 i = 0; i <= foobar.size(); i++) {
+    Blob data(foobar.substr(0, i));
+    EXPECT_EQ(armored(AES_GCM_ARMOR::BASE64, data), base64[i]);
+    EXPECT_EQ(armored(AES_GCM_ARMOR::HEX, data), hex[i]);
+    EXPECT_EQ(*unarmor(AES_GCM_ARMOR::BASE64, Blob(base64[i])), data);
+    EXPECT_EQ(*unarmor(AES_GCM_ARMOR::HEX, Blob(hex[i])), data);
+  }
+  EXPECT_EQ(*unarmor(AES_GCM_ARMOR::HEX, Blob("666F6F")), Blob("foo"));
+  EXPECT_EQ(armored(AES_GCM_ARMOR::NONE, Blob("foo")), "foo");
+  EXPECT_NE(string(armorISA()), "");
+}
+
+TEST(ArmorTest, RoundTrip) {
+  // Every length through the vector blocks and the scalar tails
+  unique_ptr<Blob> noise = random(300);
+  for (U64 size = 0; size <= noise->size(); size++) {
+    Blob data(*noise, size, 0);
+    string hex = armored(AES_GCM_ARMOR::HEX, data);
+    string base64 = armored(AES_GCM_ARMOR::BASE64, data);
+    ASSERT_EQ(hex, referenceHex(data));
+    ASSERT_EQ(base64, referenceBase64(data));
+    EXPECT_EQ(hex.size(), armoredSize(AES_GCM_ARMOR::HEX, size));
+    EXPECT_EQ(base64.size(), armoredSize(AES_GCM_ARMOR::BASE64, size));
+    EXPECT_EQ(unarmoredSize(AES_GCM_ARMOR::BASE64, base64.data(), base64.size()), size);
+    unique_ptr<Blob> back = unarmor(AES_GCM_ARMOR::HEX, Blob(hex));
+    ASSERT_TRUE(back);
+    EXPECT_EQ(*back, data);
+    back = unarmor(AES_GCM_ARMOR::BASE64, Blob(base64));
+    ASSERT_TRUE(back);
+    EXPECT_EQ(*back, data);
+  }
+}
+
+TEST(ArmorTest, Malformed) {
+  unique_ptr<Blob> noise = random(150);
+  string hex = armored(AES_GCM_ARMOR::HEX, *noise);
+  string base64 = armored(AES_GCM_ARMOR::BASE64, *noise);
+
+  // A bad character anywhere, in a vector block or the tail
+  const char badHex[] = {'g', 'G', '/', ':', '@', '`', ' ', '\0', (char)0xc1};
+  for (U64 i = 0; i < hex.size(); i++) {
+    for (char c : badHex) {
+      string text = hex;
+      text[i] = c;
+      ASSERT_FALSE(unarmor(AES_GCM_ARMOR::HEX, Blob(text))) << i;
+    }
+  }
+  const char badBase64[] = {'=', '*', '-', '_', '.', ':', '@', '[', '`', '{', '\n',
+    (char)0x80, (char)0xff};
+  for (U64 i = 0; i < base64.size(); i++) {
+    for (char c : badBase64) {
+      if ((c == '=') && (i == base64.size() - 1)) {
+        continue;  // Padding, which is fine there
+      }
+      string text = base64;
+      text[i] = c;
+      ASSERT_FALSE(unarmor(AES_GCM_ARMOR::BASE64, Blob(text))) << i;
+    }
+  }
+
+  // Bad lengths and padding
+  EXPECT_FALSE(unarmor(AES_GCM_ARMOR::HEX, Blob("abc")));
+  EXPECT_FALSE(unarmor(AES_GCM_ARMOR::BASE64, Blob("Zm9")));
+  EXPECT_FALSE(unarmor(AES_GCM_ARMOR::BASE64, Blob("Zg==Zm9v")));
+  EXPECT_FALSE(unarmor(AES_GCM_ARMOR::BASE64, Blob("Z===")));
+  EXPECT_FALSE(unarmor(AES_GCM_ARMOR::BASE64, Blob("Zm=v")));
+}
+
+TEST(ArmorTest, Encryption) {
+  // The fused output is the armored binary message
+  AES_GCM_Config cfg = {AES_GCM_KEYSIZE::K128, AES_GCM_TAGSIZE::T96,
+    AES_GCM_IV_MODE::MANUAL, AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_128);
+  unique_ptr<Blob> iv = random(12);
+  unique_ptr<Blob> noise = random(100000);
+  const U64 sizes[] = {0, 1, 12287, 12288, 12289, 100000};
+  for (AES_GCM_ARMOR armor : {AES_GCM_ARMOR::HEX, AES_GCM_ARMOR::BASE64}) {
+    for (U64 size : sizes) {
+      AES_GCM_Enc binary(cfg);
+      AES_GCM_Enc text(cfg);
+      text.armorIs(armor);
+      for (AES_GCM_Enc *e : {&binary, &text}) {
+        e->keyIs(*key);
+        e->ivcIs(*iv);
+        e->plaintextIs(Blob(*noise, size, 0));
+      }
+      unique_ptr<AES_GCM_Result> expected = binary.ciphertext();
+      unique_ptr<AES_GCM_Result> actual = text.ciphertext();
+      EXPECT_EQ(actual->second, AES_GCM_STATUS::VALID);
+      EXPECT_EQ(actual->first, *Crypto::armor(armor, expected->first));
+
+      // And decrypts once unarmored
+      unique_ptr<Blob> message = unarmor(armor, actual->first);
+      ASSERT_TRUE(message);
+      U64 ctxtOffset = iv->size();
+      AES_GCM_Dec dec;
+      dec.keyIs(*key);
+      dec.ivIs(*iv);
+      dec.ciphertextIs(Blob(*message, size, ctxtOffset));
+      dec.tagIs(Blob(*message, 12, ctxtOffset + size));
+      EXPECT_EQ(dec.plaintext().second, AES_GCM_STATUS::VALID);
+      EXPECT_EQ(dec.plaintext().first, Blob(*noise, size, 0));
+    }
+  }
+}
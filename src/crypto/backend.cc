@@ -0,0 +1,61 @@
+#include "crypto/backend.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Crypto;
+
+static const Backend *initialBackend()
+{
+  const char *env = getenv("BAE_BACKEND");
+  if ((env != nullptr) && (strcmp(env, "openssl") == 0) && (OpenSSLBackend() != nullptr)) {
+    return OpenSSLBackend();
+  }
+  if ((env != nullptr) && (strcmp(env, "cryptopp") == 0)) {
+    return CryptoPPBackend();
+  }
+#if defined(BAE_DEFAULT_BACKEND_OPENSSL)
+  if (OpenSSLBackend() != nullptr) {
+    return OpenSSLBackend();
+  }
+#endif
+  return CryptoPPBackend();
+}
+
+static std::atomic<const Backend *> &current()
+{
+  static std::atomic<const Backend *> current(initialBackend());
+  return current;
+}
+
+bool Crypto::backendAvailable(BACKEND _type)
+{
+  return backend(_type) != nullptr;
+}
+
+const Backend *Crypto::backend(BACKEND _type)
+{
+  switch (_type) {
+    case BACKEND::CRYPTOPP:
+      return CryptoPPBackend();
+    case BACKEND::OPENSSL:
+      return OpenSSLBackend();
+    default:
+      return nullptr;
+  }
+}
+
+const Backend &Crypto::backend()
+{
+  return *current().load();
+}
+
+bool Crypto::backendIs(BACKEND _type)
+{
+  const Backend *b = backend(_type);
+  if (b == nullptr) {
+    return false;
+  }
+  current().store(b);
+  return true;
+}
@@ -0,0 +1,136 @@
+#ifndef CRYPTO_BACKEND_H
+#define CRYPTO_BACKEND_H
+
+#include "util/fixed_types.h"
+#include <cstddef>
+#include <memory>
+
+namespace Crypto {
+
+// Libraries that can provide the primitives. Crypto++ is always built; the
+// OpenSSL (libcrypto) backend is built with BAE_WITH_OPENSSL (see the
+// Makefile's OPENSSL option).
+enum class BACKEND
+{
+  CRYPTOPP, OPENSSL
+};
+
+// Defined in aes_gcm.h
+enum class AES_GCM_TABLES;
+
+// One AES/GCM key context of a backend, usable in both directions. Buffers
+// are the caller's; 'ptxt' and 'ctxt' may be the same. Key and tag sizes are
+// validated by the callers. Not thread-safe.
+class AES_GCM_Cipher
+{
+ public:
+  virtual ~AES_GCM_Cipher() {}
+  virtual bool keyIs(const Byte *key, U32 keySize) = 0;
+
+  // Writes ptxtSize bytes to 'ctxt' and tagSize bytes to 'tag'
+  virtual bool encrypt(Byte *ctxt, Byte *tag, U32 tagSize, const Byte *iv, U32 ivSize,
+    const Byte *aad, U64 aadSize, const Byte *ptxt, U64 ptxtSize) = 0;
+
+  // The same, one piece at a time: encryptBegin(), encryptUpdate() on
+  // consecutive pieces of the plaintext (any sizes), then encryptEnd()
+  virtual bool encryptBegin(const Byte *iv, U32 ivSize, const Byte *aad, U64 aadSize) = 0;
+  // More AAD, after encryptBegin() and before the first encryptUpdate()
+  virtual bool encryptAad(const Byte *aad, U64 aadSize) = 0;
+  virtual bool encryptUpdate(Byte *ctxt, const Byte *ptxt, U64 size) = 0;
+  virtual bool encryptEnd(Byte *tag, U32 tagSize) = 0;
+
+  // False on any error, including an authentication failure
+  virtual bool decrypt(Byte *ptxt, const Byte *tag, U32 tagSize, const Byte *iv,
+    U32 ivSize, const Byte *aad, U64 aadSize, const Byte *ctxt, U64 ctxtSize) = 0;
+
+  // Approximate bytes held once keyed
+  virtual U32 contextBytes() const = 0;
+};
+
+static const U32 HMAC_SHA256_BYTES = 32;
+
+// One HMAC-SHA256 key context of a backend. Each MAC is update() any number
+// of times, then digest(), which leaves the context ready for the next one
+// under the same key. Not thread-safe.
+class HMAC_SHA256
+{
+ public:
+  virtual ~HMAC_SHA256() {}
+  virtual bool keyIs(const Byte *key, U64 keySize) = 0;
+  virtual bool update(const Byte *data, U64 size) = 0;
+
+  // Writes HMAC_SHA256_BYTES bytes
+  virtual bool digest(Byte *mac) = 0;
+};
+
+static const U32 AES_CMAC_BYTES = 16;
+
+// One AES-CMAC key context of a backend, used like HMAC_SHA256. Not
+// thread-safe.
+class AES_CMAC
+{
+ public:
+  virtual ~AES_CMAC() {}
+  virtual bool keyIs(const Byte *key, U32 keySize) = 0;
+  virtual bool update(const Byte *data, U64 size) = 0;
+
+  // Writes AES_CMAC_BYTES bytes
+  virtual bool digest(Byte *mac) = 0;
+};
+
+// One AES-CTR key context of a backend. The counter is the whole 16-byte
+// block, incremented as a big-endian number; 'in' and 'out' may be the same.
+// Not thread-safe.
+class AES_CTR
+{
+ public:
+  virtual ~AES_CTR() {}
+  virtual bool keyIs(const Byte *key, U32 keySize) = 0;
+  virtual bool crypt(Byte *out, const Byte *in, U64 size, const Byte *counter) = 0;
+};
+
+// The primitives a library provides. Backends are stateless singletons and
+// thread-safe.
+class Backend
+{
+ public:
+  virtual ~Backend() {}
+  virtual BACKEND type() const = 0;
+  virtual const char *name() const = 0;
+  virtual std::unique_ptr<AES_GCM_Cipher> gcm(AES_GCM_TABLES tables) const = 0;
+  virtual std::unique_ptr<HMAC_SHA256> hmacSha256() const = 0;
+  virtual std::unique_ptr<AES_CMAC> aesCmac() const = 0;
+  virtual std::unique_ptr<AES_CTR> aesCtr() const = 0;
+
+  // GHASH table bytes for one direction of a context on this CPU
+  virtual U32 tableBytes(AES_GCM_TABLES tables) const = 0;
+  virtual bool pbkdf2Sha256(Byte *key, U64 keySize, const Byte *password,
+    U64 passwordSize, const Byte *salt, U64 saltSize, U64 iterations) const = 0;
+
+  // Throws if the generator fails (e.g. it cannot be seeded)
+  virtual void random(Byte *data, U64 size) const = 0;
+};
+
+// The built-in backends; OpenSSLBackend() is nullptr unless built with
+// BAE_WITH_OPENSSL
+const Backend *CryptoPPBackend();
+const Backend *OpenSSLBackend();
+
+// Whether 'type' was built in
+bool backendAvailable(BACKEND type);
+
+// The given backend, or nullptr if it was not built in
+const Backend *backend(BACKEND type);
+
+// The backend new contexts use. It starts as the Makefile's DEFAULT_BACKEND
+// (BAE_DEFAULT_BACKEND_OPENSSL), unless the BAE_BACKEND environment variable
+// names another one ("cryptopp" or "openssl"). Contexts keep the backend
+// they were created with.
+const Backend &backend();
+
+// Returns false (and changes nothing) if 'type' was not built in
+bool backendIs(BACKEND type);
+
+} // namespace Crypto
+
+#endif // CRYPTO_BACKEND_H
@@ -0,0 +1,336 @@
+#include "crypto/backend.h"
+#include "crypto/aes_gcm.h"
+#include "util/make_unique.h"
+#include "cryptopp/aes.h"
+#include "cryptopp/cmac.h"
+#include "cryptopp/cpu.h"
+#include "cryptopp/gcm.h"
+#include "cryptopp/hmac.h"
+#include "cryptopp/modes.h"
+#include "cryptopp/osrng.h"
+#include "cryptopp/pwdbased.h"
+#include "cryptopp/sha.h"
+#include <climits>
+
+using namespace Crypto;
+using std::unique_ptr;
+using Util::make_unique;
+
+// Table bytes Crypto++ allocates per direction (see GCM_Base::SetKeyWithoutResync)
+static const U32 GCM_CLMUL_TABLE_BYTES = 8 * AES_GCM_BLOCKSIZE_BYTES;
+static const U32 GCM_2K_TABLE_BYTES = 2 * 1024;
+static const U32 GCM_64K_TABLE_BYTES = 64 * 1024;
+
+static unique_ptr<CryptoPP::GCM_Base> gcmDirection(AES_GCM_TABLES _tables, bool _encrypt)
+{
+  typedef CryptoPP::GCM<CryptoPP::AES, CryptoPP::GCM_2K_Tables> GCM_2K;
+  typedef CryptoPP::GCM<CryptoPP::AES, CryptoPP::GCM_64K_Tables> GCM_64K;
+  if (_tables == AES_GCM_TABLES::T64K) {
+    if (_encrypt) {
+      return make_unique<GCM_64K::Encryption>();
+    }
+    return make_unique<GCM_64K::Decryption>();
+  }
+  if (_encrypt) {
+    return make_unique<GCM_2K::Encryption>();
+  }
+  return make_unique<GCM_2K::Decryption>();
+}
+
+namespace {
+
+// Crypto++ splits the directions into two objects, each with its own key
+// schedule and GHASH tables
+class CryptoPP_Cipher : public AES_GCM_Cipher
+{
+ public:
+  CryptoPP_Cipher(AES_GCM_TABLES _tables, U32 _tableBytes)
+    : tableBytes_(_tableBytes), enc_(gcmDirection(_tables, true)),
+    dec_(gcmDirection(_tables, false))
+  {
+    // empty
+  }
+
+  bool keyIs(const Byte *_key, U32 _keySize) override
+  {
+    try {
+      enc_->SetKey(_key, _keySize);
+      dec_->SetKey(_key, _keySize);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  bool encrypt(Byte *_ctxt, Byte *_tag, U32 _tagSize, const Byte *_iv, U32 _ivSize,
+    const Byte *_aad, U64 _aadSize, const Byte *_ptxt, U64 _ptxtSize) override
+  {
+    try {
+      enc_->EncryptAndAuthenticate(_ctxt, _tag, _tagSize, _iv, (int)_ivSize, _aad,
+        _aadSize, _ptxt, _ptxtSize);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  bool encryptBegin(const Byte *_iv, U32 _ivSize, const Byte *_aad, U64 _aadSize) override
+  {
+    try {
+      enc_->Resynchronize(_iv, (int)_ivSize);
+      enc_->Update(_aad, _aadSize);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  bool encryptAad(const Byte *_aad, U64 _aadSize) override
+  {
+    try {
+      enc_->Update(_aad, _aadSize);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  bool encryptUpdate(Byte *_ctxt, const Byte *_ptxt, U64 _size) override
+  {
+    try {
+      enc_->ProcessData(_ctxt, _ptxt, _size);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  bool encryptEnd(Byte *_tag, U32 _tagSize) override
+  {
+    try {
+      enc_->TruncatedFinal(_tag, _tagSize);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  bool decrypt(Byte *_ptxt, const Byte *_tag, U32 _tagSize, const Byte *_iv, U32 _ivSize,
+    const Byte *_aad, U64 _aadSize, const Byte *_ctxt, U64 _ctxtSize) override
+  {
+    try {
+      return dec_->DecryptAndVerify(_ptxt, _tag, _tagSize, _iv, (int)_ivSize, _aad,
+        _aadSize, _ctxt, _ctxtSize);
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  U32 contextBytes() const override
+  {
+    // Each direction keeps its own cipher object, AES key schedule (inside the
+    // object) and heap buffer: GHASH tables plus two blocks of working state
+    U32 perDirection = (U32)sizeof(CryptoPP::GCM<CryptoPP::AES>::Encryption) +
+      tableBytes_ + 2 * AES_GCM_BLOCKSIZE_BYTES;
+    return (U32)sizeof(*this) + 2 * perDirection;
+  }
+
+ private:
+  U32 tableBytes_;
+  unique_ptr<CryptoPP::GCM_Base> enc_;
+  unique_ptr<CryptoPP::GCM_Base> dec_;
+};
+
+class CryptoPP_HMAC : public HMAC_SHA256
+{
+ public:
+  CryptoPP_HMAC()
+    : mac_()
+  {
+    // empty
+  }
+
+  bool keyIs(const Byte *_key, U64 _keySize) override
+  {
+    try {
+      mac_.SetKey(_key, _keySize);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  bool update(const Byte *_data, U64 _size) override
+  {
+    mac_.Update(_data, _size);
+    return true;
+  }
+
+  bool digest(Byte *_mac) override
+  {
+    mac_.Final(_mac);
+    return true;
+  }
+
+ private:
+  CryptoPP::HMAC<CryptoPP::SHA256> mac_;
+};
+
+class CryptoPP_CMAC : public AES_CMAC
+{
+ public:
+  CryptoPP_CMAC()
+    : mac_()
+  {
+    // empty
+  }
+
+  bool keyIs(const Byte *_key, U32 _keySize) override
+  {
+    try {
+      mac_.SetKey(_key, _keySize);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  bool update(const Byte *_data, U64 _size) override
+  {
+    mac_.Update(_data, _size);
+    return true;
+  }
+
+  bool digest(Byte *_mac) override
+  {
+    mac_.Final(_mac);
+    return true;
+  }
+
+ private:
+  CryptoPP::CMAC<CryptoPP::AES> mac_;
+};
+
+// Keyed once; each call only resynchronizes the counter
+class CryptoPP_CTR : public AES_CTR
+{
+ public:
+  CryptoPP_CTR()
+    : ctr_(), keyed_(false)
+  {
+    // empty
+  }
+
+  bool keyIs(const Byte *_key, U32 _keySize) override
+  {
+    static const Byte zeros[AES_GCM_BLOCKSIZE_BYTES] = {0};
+    keyed_ = false;
+    try {
+      ctr_.SetKeyWithIV(_key, _keySize, zeros, sizeof(zeros));
+      keyed_ = true;
+    }
+    catch (std::exception const &e) {
+      // keyed_ stays false
+    }
+    return keyed_;
+  }
+
+  bool crypt(Byte *_out, const Byte *_in, U64 _size, const Byte *_counter) override
+  {
+    if (!keyed_) {
+      return false;
+    }
+    ctr_.Resynchronize(_counter, AES_GCM_BLOCKSIZE_BYTES);
+    ctr_.ProcessData(_out, _in, _size);
+    return true;
+  }
+
+ private:
+  CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption ctr_;
+  bool keyed_;
+};
+
+class CryptoPP_Backend : public Backend
+{
+ public:
+  BACKEND type() const override
+  {
+    return BACKEND::CRYPTOPP;
+  }
+
+  const char *name() const override
+  {
+    return "cryptopp";
+  }
+
+  unique_ptr<AES_GCM_Cipher> gcm(AES_GCM_TABLES _tables) const override
+  {
+    return make_unique<CryptoPP_Cipher>(_tables, tableBytes(_tables));
+  }
+
+  unique_ptr<HMAC_SHA256> hmacSha256() const override
+  {
+    return make_unique<CryptoPP_HMAC>();
+  }
+
+  unique_ptr<AES_CMAC> aesCmac() const override
+  {
+    return make_unique<CryptoPP_CMAC>();
+  }
+
+  unique_ptr<AES_CTR> aesCtr() const override
+  {
+    return make_unique<CryptoPP_CTR>();
+  }
+
+  U32 tableBytes(AES_GCM_TABLES _tables) const override
+  {
+#if defined(CRYPTOPP_CLMUL_AVAILABLE)
+    if (CryptoPP::HasCLMUL()) {
+      return GCM_CLMUL_TABLE_BYTES;
+    }
+#endif
+    return (_tables == AES_GCM_TABLES::T64K) ? GCM_64K_TABLE_BYTES : GCM_2K_TABLE_BYTES;
+  }
+
+  bool pbkdf2Sha256(Byte *_key, U64 _keySize, const Byte *_password, U64 _passwordSize,
+    const Byte *_salt, U64 _saltSize, U64 _iterations) const override
+  {
+    if (_iterations > UINT_MAX) {
+      return false;
+    }
+    try {
+      CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> pbkdf;
+      pbkdf.DeriveKey(_key, _keySize, 0, _password, _passwordSize, _salt, _saltSize,
+        (unsigned int)_iterations);
+      return true;
+    }
+    catch (std::exception const &e) {
+      return false;
+    }
+  }
+
+  void random(Byte *_data, U64 _size) const override
+  {
+    // Seeding a pool reads the OS generator, so keep one per thread
+    static thread_local CryptoPP::AutoSeededRandomPool prng;
+    prng.GenerateBlock(_data, _size);
+  }
+};
+
+} // namespace
+
+const Backend *Crypto::CryptoPPBackend()
+{
+  static const CryptoPP_Backend backend;
+  return &backend;
+}
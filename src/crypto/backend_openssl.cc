@@ -0,0 +1,515 @@
+#include "crypto/backend.h"
+
+#if defined(BAE_WITH_OPENSSL)
+
+#include "crypto/aes_gcm.h"
+#include "util/make_unique.h"
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+using namespace Crypto;
+using std::unique_ptr;
+using Util::make_unique;
+
+// EVP lengths are ints, so long inputs go through in pieces
+static const U64 EVP_STEP_BYTES = 1ULL << 30;
+
+// GHASH keeps 16 precomputed multiples of H (Htable) whatever the CPU
+static const U32 GCM_HTABLE_BYTES = 16 * AES_GCM_BLOCKSIZE_BYTES;
+
+// Approximate size of an EVP_CIPHER_CTX with its AES-GCM state (key
+// schedule, GCM128 context and Htable); the structures are opaque
+static const U32 EVP_GCM_CTX_BYTES = 1024;
+
+static const EVP_CIPHER *cbcCipher(U32 _keySize)
+{
+  switch (_keySize) {
+    case AES_GCM_KEYSIZE_128:
+      return EVP_aes_128_cbc();
+    case AES_GCM_KEYSIZE_192:
+      return EVP_aes_192_cbc();
+    case AES_GCM_KEYSIZE_256:
+      return EVP_aes_256_cbc();
+    default:
+      return nullptr;
+  }
+}
+
+static const EVP_CIPHER *ctrCipher(U32 _keySize)
+{
+  switch (_keySize) {
+    case AES_GCM_KEYSIZE_128:
+      return EVP_aes_128_ctr();
+    case AES_GCM_KEYSIZE_192:
+      return EVP_aes_192_ctr();
+    case AES_GCM_KEYSIZE_256:
+      return EVP_aes_256_ctr();
+    default:
+      return nullptr;
+  }
+}
+
+static const EVP_CIPHER *gcmCipher(U32 _keySize)
+{
+  switch (_keySize) {
+    case AES_GCM_KEYSIZE_128:
+      return EVP_aes_128_gcm();
+    case AES_GCM_KEYSIZE_192:
+      return EVP_aes_192_gcm();
+    case AES_GCM_KEYSIZE_256:
+      return EVP_aes_256_gcm();
+    default:
+      return nullptr;
+  }
+}
+
+namespace {
+
+// One EVP context per direction, keyed once; each message only resets the IV
+class OpenSSL_Cipher : public AES_GCM_Cipher
+{
+ public:
+  OpenSSL_Cipher()
+    : enc_(EVP_CIPHER_CTX_new()), dec_(EVP_CIPHER_CTX_new()), encIVSize_(0), decIVSize_(0)
+  {
+    // empty
+  }
+
+  OpenSSL_Cipher(const OpenSSL_Cipher &) = delete;
+  OpenSSL_Cipher &operator=(const OpenSSL_Cipher &) = delete;
+
+  ~OpenSSL_Cipher()
+  {
+    EVP_CIPHER_CTX_free(enc_);
+    EVP_CIPHER_CTX_free(dec_);
+  }
+
+  bool keyIs(const Byte *_key, U32 _keySize) override
+  {
+    const EVP_CIPHER *cipher = gcmCipher(_keySize);
+    encIVSize_ = 0;
+    decIVSize_ = 0;
+    return (cipher != nullptr) && (enc_ != nullptr) && (dec_ != nullptr) &&
+      (EVP_EncryptInit_ex(enc_, cipher, nullptr, _key, nullptr) == 1) &&
+      (EVP_DecryptInit_ex(dec_, cipher, nullptr, _key, nullptr) == 1);
+  }
+
+  bool encrypt(Byte *_ctxt, Byte *_tag, U32 _tagSize, const Byte *_iv, U32 _ivSize,
+    const Byte *_aad, U64 _aadSize, const Byte *_ptxt, U64 _ptxtSize) override
+  {
+    return encryptBegin(_iv, _ivSize, _aad, _aadSize) &&
+      encryptUpdate(_ctxt, _ptxt, _ptxtSize) && encryptEnd(_tag, _tagSize);
+  }
+
+  bool encryptBegin(const Byte *_iv, U32 _ivSize, const Byte *_aad, U64 _aadSize) override
+  {
+    return ivIs(enc_, encIVSize_, _iv, _ivSize, true) &&
+      update(enc_, nullptr, _aad, _aadSize, true);
+  }
+
+  bool encryptAad(const Byte *_aad, U64 _aadSize) override
+  {
+    return update(enc_, nullptr, _aad, _aadSize, true);
+  }
+
+  bool encryptUpdate(Byte *_ctxt, const Byte *_ptxt, U64 _size) override
+  {
+    return update(enc_, _ctxt, _ptxt, _size, true);
+  }
+
+  bool encryptEnd(Byte *_tag, U32 _tagSize) override
+  {
+    Byte tag[AES_GCM_BLOCKSIZE_BYTES];
+    int len = 0;
+    if ((EVP_EncryptFinal_ex(enc_, tag, &len) != 1) ||
+      (EVP_CIPHER_CTX_ctrl(enc_, EVP_CTRL_GCM_GET_TAG, sizeof(tag), tag) != 1)) {
+      return false;
+    }
+    memcpy(_tag, tag, _tagSize);
+    return true;
+  }
+
+  bool decrypt(Byte *_ptxt, const Byte *_tag, U32 _tagSize, const Byte *_iv, U32 _ivSize,
+    const Byte *_aad, U64 _aadSize, const Byte *_ctxt, U64 _ctxtSize) override
+  {
+    Byte tag[AES_GCM_BLOCKSIZE_BYTES];
+    memcpy(tag, _tag, _tagSize);
+    int len = 0;
+    return ivIs(dec_, decIVSize_, _iv, _ivSize, false) &&
+      update(dec_, nullptr, _aad, _aadSize, false) &&
+      update(dec_, _ptxt, _ctxt, _ctxtSize, false) &&
+      (EVP_CIPHER_CTX_ctrl(dec_, EVP_CTRL_GCM_SET_TAG, (int)_tagSize, tag) == 1) &&
+      (EVP_DecryptFinal_ex(dec_, tag, &len) == 1);
+  }
+
+  U32 contextBytes() const override
+  {
+    return (U32)sizeof(*this) + 2 * EVP_GCM_CTX_BYTES;
+  }
+
+ private:
+  static bool ivIs(EVP_CIPHER_CTX *_ctx, U32 &_current, const Byte *_iv, U32 _ivSize,
+    bool _encrypt)
+  {
+    if ((_ivSize != _current) &&
+      (EVP_CIPHER_CTX_ctrl(_ctx, EVP_CTRL_GCM_SET_IVLEN, (int)_ivSize, nullptr) != 1)) {
+      return false;
+    }
+    _current = _ivSize;
+    return (_encrypt) ? (EVP_EncryptInit_ex(_ctx, nullptr, nullptr, nullptr, _iv) == 1) :
+      (EVP_DecryptInit_ex(_ctx, nullptr, nullptr, nullptr, _iv) == 1);
+  }
+
+  // 'out' is nullptr for AAD
+  static bool update(EVP_CIPHER_CTX *_ctx, Byte *_out, const Byte *_in, U64 _size,
+    bool _encrypt)
+  {
+    for (U64 done = 0; done < _size; done += EVP_STEP_BYTES) {
+      int step = (int)std::min(EVP_STEP_BYTES, _size - done);
+      int len = 0;
+      Byte *out = (_out != nullptr) ? _out + done : nullptr;
+      int ok = (_encrypt) ? EVP_EncryptUpdate(_ctx, out, &len, _in + done, step) :
+        EVP_DecryptUpdate(_ctx, out, &len, _in + done, step);
+      if (ok != 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  EVP_CIPHER_CTX *enc_;
+  EVP_CIPHER_CTX *dec_;
+  U32 encIVSize_;
+  U32 decIVSize_;
+};
+
+// EVP_DigestSign with an HMAC key: the keyed context is set up once and
+// copied for each MAC, so the key's padded blocks are hashed once
+class OpenSSL_HMAC : public HMAC_SHA256
+{
+ public:
+  OpenSSL_HMAC()
+    : keyed_(EVP_MD_CTX_new()), mac_(EVP_MD_CTX_new()), key_(nullptr), started_(false)
+  {
+    // empty
+  }
+
+  OpenSSL_HMAC(const OpenSSL_HMAC &) = delete;
+  OpenSSL_HMAC &operator=(const OpenSSL_HMAC &) = delete;
+
+  ~OpenSSL_HMAC()
+  {
+    EVP_MD_CTX_free(keyed_);
+    EVP_MD_CTX_free(mac_);
+    EVP_PKEY_free(key_);
+  }
+
+  bool keyIs(const Byte *_key, U64 _keySize) override
+  {
+    EVP_PKEY_free(key_);
+    started_ = false;
+    key_ = EVP_PKEY_new_raw_private_key(EVP_PKEY_HMAC, nullptr, _key, _keySize);
+    return (key_ != nullptr) && (keyed_ != nullptr) && (mac_ != nullptr) &&
+      (EVP_MD_CTX_reset(keyed_) == 1) &&
+      (EVP_DigestSignInit(keyed_, nullptr, EVP_sha256(), nullptr, key_) == 1);
+  }
+
+  bool update(const Byte *_data, U64 _size) override
+  {
+    return start() && (EVP_DigestSignUpdate(mac_, _data, _size) == 1);
+  }
+
+  bool digest(Byte *_mac) override
+  {
+    size_t size = HMAC_SHA256_BYTES;
+    bool ok = start() && (EVP_DigestSignFinal(mac_, _mac, &size) == 1);
+    started_ = false;
+    return ok;
+  }
+
+ private:
+  bool start()
+  {
+    if (!started_) {
+      started_ = (key_ != nullptr) && (EVP_MD_CTX_copy_ex(mac_, keyed_) == 1);
+    }
+    return started_;
+  }
+
+  EVP_MD_CTX *keyed_;
+  EVP_MD_CTX *mac_;
+  EVP_PKEY *key_;
+  bool started_;
+};
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+
+// EVP_MAC's CMAC (OpenSSL 3 deprecates CMAC keys for EVP_DigestSign). Keyed
+// once; initializing again without a key restarts it under the same key.
+class OpenSSL_CMAC : public AES_CMAC
+{
+ public:
+  OpenSSL_CMAC()
+    : mac_(EVP_MAC_fetch(nullptr, "CMAC", nullptr)),
+    ctx_((mac_ != nullptr) ? EVP_MAC_CTX_new(mac_) : nullptr), keyed_(false), started_(false)
+  {
+    // empty
+  }
+
+  OpenSSL_CMAC(const OpenSSL_CMAC &) = delete;
+  OpenSSL_CMAC &operator=(const OpenSSL_CMAC &) = delete;
+
+  ~OpenSSL_CMAC()
+  {
+    EVP_MAC_CTX_free(ctx_);
+    EVP_MAC_free(mac_);
+  }
+
+  bool keyIs(const Byte *_key, U32 _keySize) override
+  {
+    keyed_ = false;
+    started_ = false;
+    const EVP_CIPHER *cipher = cbcCipher(_keySize);
+    if ((cipher == nullptr) || (ctx_ == nullptr)) {
+      return false;
+    }
+    OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_CIPHER,
+        const_cast<char *>(EVP_CIPHER_get0_name(cipher)), 0),
+      OSSL_PARAM_construct_end()
+    };
+    keyed_ = (EVP_MAC_init(ctx_, _key, _keySize, params) == 1);
+    started_ = keyed_;
+    return keyed_;
+  }
+
+  bool update(const Byte *_data, U64 _size) override
+  {
+    return start() && (EVP_MAC_update(ctx_, _data, _size) == 1);
+  }
+
+  bool digest(Byte *_mac) override
+  {
+    size_t size = 0;
+    bool ok = start() && (EVP_MAC_final(ctx_, _mac, &size, AES_CMAC_BYTES) == 1);
+    started_ = false;
+    return ok;
+  }
+
+ private:
+  bool start()
+  {
+    if (!started_) {
+      started_ = keyed_ && (EVP_MAC_init(ctx_, nullptr, 0, nullptr) == 1);
+    }
+    return started_;
+  }
+
+  EVP_MAC *mac_;
+  EVP_MAC_CTX *ctx_;
+  bool keyed_;
+  bool started_;
+};
+
+#else
+
+// EVP_DigestSign with a CMAC key, set up once and copied for each MAC like
+// OpenSSL_HMAC
+class OpenSSL_CMAC : public AES_CMAC
+{
+ public:
+  OpenSSL_CMAC()
+    : keyed_(EVP_MD_CTX_new()), mac_(EVP_MD_CTX_new()), key_(nullptr), started_(false)
+  {
+    // empty
+  }
+
+  OpenSSL_CMAC(const OpenSSL_CMAC &) = delete;
+  OpenSSL_CMAC &operator=(const OpenSSL_CMAC &) = delete;
+
+  ~OpenSSL_CMAC()
+  {
+    EVP_MD_CTX_free(keyed_);
+    EVP_MD_CTX_free(mac_);
+    EVP_PKEY_free(key_);
+  }
+
+  bool keyIs(const Byte *_key, U32 _keySize) override
+  {
+    EVP_PKEY_free(key_);
+    key_ = nullptr;
+    started_ = false;
+    const EVP_CIPHER *cipher = cbcCipher(_keySize);
+    if (cipher != nullptr) {
+      key_ = EVP_PKEY_new_CMAC_key(nullptr, _key, _keySize, cipher);
+    }
+    return (key_ != nullptr) && (keyed_ != nullptr) && (mac_ != nullptr) &&
+      (EVP_MD_CTX_reset(keyed_) == 1) &&
+      (EVP_DigestSignInit(keyed_, nullptr, nullptr, nullptr, key_) == 1);
+  }
+
+  bool update(const Byte *_data, U64 _size) override
+  {
+    return start() && (EVP_DigestSignUpdate(mac_, _data, _size) == 1);
+  }
+
+  bool digest(Byte *_mac) override
+  {
+    size_t size = AES_CMAC_BYTES;
+    bool ok = start() && (EVP_DigestSignFinal(mac_, _mac, &size) == 1);
+    started_ = false;
+    return ok;
+  }
+
+ private:
+  bool start()
+  {
+    if (!started_) {
+      started_ = (key_ != nullptr) && (EVP_MD_CTX_copy_ex(mac_, keyed_) == 1);
+    }
+    return started_;
+  }
+
+  EVP_MD_CTX *keyed_;
+  EVP_MD_CTX *mac_;
+  EVP_PKEY *key_;
+  bool started_;
+};
+
+#endif
+
+// Keyed once; each call only resets the counter
+class OpenSSL_CTR : public AES_CTR
+{
+ public:
+  OpenSSL_CTR()
+    : ctx_(EVP_CIPHER_CTX_new()), keyed_(false)
+  {
+    // empty
+  }
+
+  OpenSSL_CTR(const OpenSSL_CTR &) = delete;
+  OpenSSL_CTR &operator=(const OpenSSL_CTR &) = delete;
+
+  ~OpenSSL_CTR()
+  {
+    EVP_CIPHER_CTX_free(ctx_);
+  }
+
+  bool keyIs(const Byte *_key, U32 _keySize) override
+  {
+    const EVP_CIPHER *cipher = ctrCipher(_keySize);
+    keyed_ = (cipher != nullptr) && (ctx_ != nullptr) &&
+      (EVP_EncryptInit_ex(ctx_, cipher, nullptr, _key, nullptr) == 1);
+    return keyed_;
+  }
+
+  bool crypt(Byte *_out, const Byte *_in, U64 _size, const Byte *_counter) override
+  {
+    if (!keyed_ || (EVP_EncryptInit_ex(ctx_, nullptr, nullptr, nullptr, _counter) != 1)) {
+      return false;
+    }
+    for (U64 done = 0; done < _size; done += EVP_STEP_BYTES) {
+      int len = 0;
+      int step = (int)std::min(EVP_STEP_BYTES, _size - done);
+      if (EVP_EncryptUpdate(ctx_, _out + done, &len, _in + done, step) != 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  EVP_CIPHER_CTX *ctx_;
+  bool keyed_;
+};
+
+class OpenSSL_Backend : public Backend
+{
+ public:
+  BACKEND type() const override
+  {
+    return BACKEND::OPENSSL;
+  }
+
+  const char *name() const override
+  {
+    return "openssl";
+  }
+
+  unique_ptr<AES_GCM_Cipher> gcm(AES_GCM_TABLES) const override
+  {
+    // OpenSSL picks its GHASH implementation (PCLMULQDQ, NEON, or 4-bit
+    // tables) from the CPU; there is no table option
+    return make_unique<OpenSSL_Cipher>();
+  }
+
+  unique_ptr<HMAC_SHA256> hmacSha256() const override
+  {
+    return make_unique<OpenSSL_HMAC>();
+  }
+
+  unique_ptr<AES_CMAC> aesCmac() const override
+  {
+    return make_unique<OpenSSL_CMAC>();
+  }
+
+  unique_ptr<AES_CTR> aesCtr() const override
+  {
+    return make_unique<OpenSSL_CTR>();
+  }
+
+  U32 tableBytes(AES_GCM_TABLES) const override
+  {
+    return GCM_HTABLE_BYTES;
+  }
+
+  bool pbkdf2Sha256(Byte *_key, U64 _keySize, const Byte *_password, U64 _passwordSize,
+    const Byte *_salt, U64 _saltSize, U64 _iterations) const override
+  {
+    // libcrypto takes int sizes and counts
+    if ((_keySize > INT_MAX) || (_passwordSize > INT_MAX) || (_saltSize > INT_MAX) ||
+      (_iterations > INT_MAX)) {
+      return false;
+    }
+    return PKCS5_PBKDF2_HMAC(reinterpret_cast<const char *>(_password), (int)_passwordSize,
+      _salt, (int)_saltSize, (int)_iterations, EVP_sha256(), (int)_keySize, _key) == 1;
+  }
+
+  void random(Byte *_data, U64 _size) const override
+  {
+    // Like Crypto++'s generators, fail loudly rather than leave the buffer
+    // predictable
+    for (U64 done = 0; done < _size; done += EVP_STEP_BYTES) {
+      if (RAND_bytes(_data + done, (int)std::min(EVP_STEP_BYTES, _size - done)) != 1) {
+        throw std::runtime_error("RAND_bytes failed");
+      }
+    }
+  }
+};
+
+} // namespace
+
+const Backend *Crypto::OpenSSLBackend()
+{
+  static const OpenSSL_Backend backend;
+  return &backend;
+}
+
+#else
+
+const Crypto::Backend *Crypto::OpenSSLBackend()
+{
+  return nullptr;
+}
+
+#endif // BAE_WITH_OPENSSL
@@ -0,0 +1,137 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm.h"
+#include "crypto/aes_gcm_key.h"
+#include "crypto/backend.h"
+#include "crypto/pbkdf2_sha256.h"
+#include "crypto/random.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+static std::vector<BACKEND> available()
+{
+  std::vector<BACKEND> out;
+  for (BACKEND type : {BACKEND::CRYPTOPP, BACKEND::OPENSSL}) {
+    if (backendAvailable(type)) {
+      out.push_back(type);
+    }
+  }
+  return out;
+}
+
+TEST(BackendTest, Selection) {
+  EXPECT_TRUE(backendAvailable(BACKEND::CRYPTOPP));
+  BACKEND initial = backend().type();
+  for (BACKEND type : available()) {
+    EXPECT_TRUE(backendIs(type));
+    EXPECT_EQ(backend().type(), type);
+    EXPECT_EQ(backend(type), &backend());
+  }
+  if (!backendAvailable(BACKEND::OPENSSL)) {
+    EXPECT_FALSE(backendIs(BACKEND::OPENSSL));
+  }
+  backendIs(initial);
+}
+
+TEST(BackendTest, Interoperable) {
+  // Messages and derived keys are the same whichever backend made them
+  AES_GCM_Config cfg = {AES_GCM_KEYSIZE::K256, AES_GCM_TAGSIZE::T96,
+    AES_GCM_IV_MODE::RANDOM, AES_GCM_IV_OUTPUT::CTXT_PREPEND_AAD};
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_256);
+  unique_ptr<Blob> pt = random(1000);
+  BACKEND initial = backend().type();
+  std::vector<BACKEND> types = available();
+  for (BACKEND from : types) {
+    backendIs(from);
+    AES_GCM_Enc enc(cfg);
+    EXPECT_EQ(enc.keyIs(*key), AES_GCM_STATUS::VALID);
+    enc.plaintextIs(*pt);
+    unique_ptr<AES_GCM_Result> ct = enc.ciphertext();
+    EXPECT_EQ(ct->second, AES_GCM_STATUS::VALID);
+    U64 ctxtOffset = AES_GCM_BLOCKSIZE_BYTES;
+    U64 ctxtSize = ct->first.size() - ctxtOffset - 12;
+    unique_ptr<Blob> derived = PBKDF2_SHA256(32, Blob("password"), Blob("salt"), 1000);
+    for (BACKEND to : types) {
+      backendIs(to);
+      AES_GCM_Dec dec;
+      dec.keyIs(*key);
+      dec.ivIs(Blob(ct->first, AES_GCM_BLOCKSIZE_BYTES, 0));
+      dec.ciphertextIs(Blob(ct->first, ctxtSize, ctxtOffset));
+      dec.tagIs(Blob(ct->first, 12, ctxtOffset + ctxtSize));
+      EXPECT_EQ(dec.plaintext().second, AES_GCM_STATUS::VALID);
+      EXPECT_EQ(dec.plaintext().first, *pt);
+      EXPECT_EQ(*PBKDF2_SHA256(32, Blob("password"), Blob("salt"), 1000), *derived);
+    }
+  }
+  backendIs(initial);
+}
+
+TEST(BackendTest, Key) {
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_128);
+  unique_ptr<Blob> pt = random(4096);
+  Byte iv[AES_GCM_BLOCKSIZE_BYTES] = {1};
+  Byte aad[5] = {2};
+  BACKEND initial = backend().type();
+  std::vector<MutableBlob> outputs;
+  for (BACKEND type : available()) {
+    backendIs(type);
+    AES_GCM_Key ctx;
+    EXPECT_EQ(ctx.keyIs(*key), AES_GCM_STATUS::VALID);
+    EXPECT_GT(ctx.contextBytes(), 0U);
+    MutableBlob out(pt->size() + 16);
+    EXPECT_EQ(ctx.encrypt(out.data(), out.data() + pt->size(), 16, iv, sizeof(iv), aad,
+      sizeof(aad), pt->data(), pt->size()), AES_GCM_STATUS::VALID);
+    outputs.push_back(out);
+
+    // Short IVs and tags
+    MutableBlob buf(*pt);
+    Byte tag[8];
+    EXPECT_EQ(ctx.encrypt(buf.data(), tag, sizeof(tag), iv, 12, nullptr, 0, buf.data(),
+      buf.size()), AES_GCM_STATUS::VALID);
+    EXPECT_EQ(ctx.decrypt(buf.data(), tag, sizeof(tag), iv, 12, nullptr, 0, buf.data(),
+      buf.size()), AES_GCM_STATUS::VALID);
+    EXPECT_EQ(Blob(buf), *pt);
+    tag[0] ^= 1;
+    EXPECT_EQ(ctx.decrypt(buf.data(), tag, sizeof(tag), iv, 12, nullptr, 0, buf.data(),
+      buf.size()), AES_GCM_STATUS::DEC_ERROR);
+  }
+  for (const MutableBlob &out : outputs) {
+    EXPECT_EQ(Blob(out), Blob(outputs[0]));
+  }
+  backendIs(initial);
+}
+
+TEST(BackendTest, Incremental) {
+  // Encrypting in uneven pieces gives the one-shot message
+  unique_ptr<Blob> key = random(AES_GCM_KEYSIZE_256);
+  unique_ptr<Blob> pt = random(5000);
+  Byte iv[12] = {3};
+  Byte aad[7] = {4};
+  BACKEND initial = backend().type();
+  for (BACKEND type : available()) {
+    backendIs(type);
+    unique_ptr<AES_GCM_Cipher> cipher = backend().gcm(AES_GCM_TABLES_DEFAULT);
+    EXPECT_TRUE(cipher->keyIs(key->data(), (U32)key->size()));
+    MutableBlob whole(pt->size());
+    Byte wholeTag[16];
+    EXPECT_TRUE(cipher->encrypt(whole.data(), wholeTag, sizeof(wholeTag), iv, sizeof(iv), aad,
+      sizeof(aad), pt->data(), pt->size()));
+
+    MutableBlob pieces(pt->size());
+    Byte piecesTag[16];
+    EXPECT_TRUE(cipher->encryptBegin(iv, sizeof(iv), aad, sizeof(aad)));
+    for (U64 done = 0, step = 1; done < pt->size(); done += step, step = step * 3 + 1) {
+      step = std::min(step, pt->size() - done);
+      EXPECT_TRUE(cipher->encryptUpdate(pieces.data() + done, pt->data() + done, step));
+    }
+    EXPECT_TRUE(cipher->encryptEnd(piecesTag, sizeof(piecesTag)));
+    EXPECT_EQ(Blob(pieces), Blob(whole));
+    EXPECT_EQ(memcmp(piecesTag, wholeTag, sizeof(wholeTag)), 0);
+  }
+  backendIs(initial);
+}
@@ -0,0 +1,211 @@
+#include "crypto/base58.h"
+#include "util/make_unique.h"
+#include <cstring>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::string;
+using std::unique_ptr;
+using Util::make_unique;
+
+static const char ALPHABET[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+static const Byte INVALID = 0xff;
+
+// The number is held in limbs of 5 base58 digits while encoding (58^5 <
+// 2^30) and of 32 bits while decoding, so a limb times the largest step plus
+// a carry always fits in 64 bits
+static const U32 LIMB_DIGITS = 5;
+static const U32 LIMB_BASE = 58 * 58 * 58 * 58 * 58;
+static const U32 LIMB_BYTES = 4;
+
+// Limbs for the largest input encoded without allocating
+static const U64 STACK_LIMBS = (BASE58_STACK_BYTES * 138 / 100 + 1) / LIMB_DIGITS + 1;
+
+namespace {
+
+struct DecodeTable
+{
+  DecodeTable()
+  {
+    memset(values, INVALID, sizeof(values));
+    for (Byte i = 0; i < 58; i++) {
+      values[(Byte)ALPHABET[i]] = i;
+    }
+  }
+
+  Byte values[256];
+};
+
+} // namespace
+
+static const Byte *decodeTable()
+{
+  static const DecodeTable table;
+  return table.values;
+}
+
+U64 Crypto::base58MaxSize(U64 _size)
+{
+  // log(256) / log(58) < 1.38
+  return _size * 138 / 100 + 1;
+}
+
+U64 Crypto::base58MaxDecodedSize(U64 _size)
+{
+  // A leading '1' is a whole byte; other characters are less
+  return _size;
+}
+
+U64 Crypto::encodeBase58(char *_text, const Byte *_data, U64 _size)
+{
+  U64 zeros = 0;
+  while ((zeros < _size) && (_data[zeros] == 0)) {
+    zeros++;
+  }
+  memset(_text, ALPHABET[0], zeros);
+  const Byte *in = _data + zeros;
+  U64 size = _size - zeros;
+  if (size == 0) {
+    return zeros;
+  }
+
+  U32 stack[STACK_LIMBS];
+  std::vector<U32> heap;
+  U32 *limbs = stack;
+  U64 maxLimbs = base58MaxSize(size) / LIMB_DIGITS + 1;
+  if (maxLimbs > STACK_LIMBS) {
+    heap.resize(maxLimbs);
+    limbs = heap.data();
+  }
+
+  // Multiply in the input 32 bits at a time, the odd bytes first
+  U64 used = 0;
+  U64 step = ((size % LIMB_BYTES) != 0) ? (size % LIMB_BYTES) : LIMB_BYTES;
+  for (U64 i = 0; i < size; i += step, step = LIMB_BYTES) {
+    U64 carry = 0;
+    for (U64 j = 0; j < step; j++) {
+      carry = (carry << 8) | in[i + j];
+    }
+    U32 shift = 8 * (U32)step;
+    for (U64 k = 0; k < used; k++) {
+      U64 value = ((U64)limbs[k] << shift) + carry;
+      limbs[k] = (U32)(value % LIMB_BASE);
+      carry = value / LIMB_BASE;
+    }
+    while (carry != 0) {
+      limbs[used++] = (U32)(carry % LIMB_BASE);
+      carry /= LIMB_BASE;
+    }
+  }
+
+  // Digits from the most significant limb, which has no leading zeros
+  char *out = _text + zeros;
+  char top[LIMB_DIGITS];
+  U32 count = 0;
+  for (U32 value = limbs[used - 1]; value != 0; value /= 58) {
+    top[count++] = ALPHABET[value % 58];
+  }
+  while (count > 0) {
+    *out++ = top[--count];
+  }
+  for (U64 k = used - 1; k-- > 0;) {
+    U32 value = limbs[k];
+    for (U32 d = LIMB_DIGITS; d-- > 0;) {
+      out[d] = ALPHABET[value % 58];
+      value /= 58;
+    }
+    out += LIMB_DIGITS;
+  }
+  return (U64)(out - _text);
+}
+
+bool Crypto::decodeBase58(Byte *_data, U64 &_dataSize, const char *_text, U64 _size)
+{
+  U64 ones = 0;
+  while ((ones < _size) && (_text[ones] == ALPHABET[0])) {
+    ones++;
+  }
+  memset(_data, 0, ones);
+  const char *in = _text + ones;
+  U64 size = _size - ones;
+
+  U32 stack[STACK_LIMBS];
+  std::vector<U32> heap;
+  U32 *limbs = stack;
+  U64 maxLimbs = (size * 733 / 1000 + 1) / LIMB_BYTES + 1;
+  if (maxLimbs > STACK_LIMBS) {
+    heap.resize(maxLimbs);
+    limbs = heap.data();
+  }
+
+  // Multiply in the digits 5 at a time, the odd ones first
+  const Byte *table = decodeTable();
+  U64 used = 0;
+  U64 step = ((size % LIMB_DIGITS) != 0) ? (size % LIMB_DIGITS) : LIMB_DIGITS;
+  for (U64 i = 0; i < size; i += step, step = LIMB_DIGITS) {
+    U64 carry = 0;
+    U64 scale = 1;
+    for (U64 j = 0; j < step; j++) {
+      Byte value = table[(Byte)in[i + j]];
+      if (value == INVALID) {
+        return false;
+      }
+      carry = carry * 58 + value;
+      scale *= 58;
+    }
+    for (U64 k = 0; k < used; k++) {
+      U64 value = (U64)limbs[k] * scale + carry;
+      limbs[k] = (U32)value;
+      carry = value >> 32;
+    }
+    while (carry != 0) {
+      limbs[used++] = (U32)carry;
+      carry >>= 32;
+    }
+  }
+
+  // Big-endian bytes, without the top limb's leading zeros
+  Byte *out = _data + ones;
+  bool leading = true;
+  for (U64 k = used; k-- > 0;) {
+    for (U32 b = LIMB_BYTES; b-- > 0;) {
+      Byte byte = (Byte)(limbs[k] >> (8 * b));
+      leading = leading && (byte == 0);
+      if (!leading) {
+        *out++ = byte;
+      }
+    }
+  }
+  _dataSize = (U64)(out - _data);
+  return true;
+}
+
+U64 Crypto::encodeBase58(char *_text, U64 *_ends, const Byte *_data, U64 _itemSize,
+  U64 _count)
+{
+  U64 total = 0;
+  for (U64 i = 0; i < _count; i++) {
+    total += encodeBase58(_text + total, _data + i * _itemSize, _itemSize);
+    _ends[i] = total;
+  }
+  return total;
+}
+
+string Crypto::encodeBase58(const Blob &_data)
+{
+  string text(base58MaxSize(_data.size()), '\0');
+  text.resize(encodeBase58(&text[0], _data.data(), _data.size()));
+  return text;
+}
+
+unique_ptr<Blob> Crypto::decodeBase58(const string &_text)
+{
+  MutableBlob data(base58MaxDecodedSize(_text.size()));
+  U64 size = 0;
+  if (!decodeBase58(data.data(), size, _text.data(), _text.size())) {
+    return unique_ptr<Blob>();
+  }
+  return make_unique<Blob>(data, size, 0);
+}
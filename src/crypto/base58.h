@@ -0,0 +1,47 @@
+#ifndef CRYPTO_BASE58_H
+#define CRYPTO_BASE58_H
+
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <memory>
+#include <string>
+
+namespace Crypto {
+
+// Base58 with the Bitcoin alphabet, for keys, IVs and tokens people copy by
+// hand: no '0', 'O', 'I' or 'l', and no punctuation. Each leading zero byte
+// is a leading '1'. The conversion uses 64-bit arithmetic on limbs of 5
+// digits (or 4 bytes) rather than arbitrary-precision numbers, so it needs no
+// GMP and no allocation for inputs up to BASE58_STACK_BYTES. The work grows
+// with the square of the size; it is meant for short inputs.
+static const U64 BASE58_STACK_BYTES = 256;
+
+// Most characters 'size' bytes can encode to
+U64 base58MaxSize(U64 size);
+
+// Most bytes 'size' characters can decode to
+U64 base58MaxDecodedSize(U64 size);
+
+// Writes the encoding of 'size' bytes of 'data' to 'text' (which holds
+// base58MaxSize() characters, no terminator) and returns its length
+U64 encodeBase58(char *text, const Byte *data, U64 size);
+
+// Writes the bytes 'text' encodes to 'data' (which holds
+// base58MaxDecodedSize() bytes) and sets 'dataSize'. Returns false if 'text'
+// has a character outside the alphabet.
+bool decodeBase58(Byte *data, U64 &dataSize, const char *text, U64 size);
+
+// Batch encoding of 'count' items of 'itemSize' bytes stored back to back in
+// 'data'. Item i's text is written to 'text' (which holds count *
+// base58MaxSize(itemSize) characters) from ends[i - 1] (0 for the first) to
+// ends[i]. Returns the total length.
+U64 encodeBase58(char *text, U64 *ends, const Byte *data, U64 itemSize, U64 count);
+
+// The same with strings and blobs; decodeBase58() returns nullptr if 'text'
+// is malformed
+std::string encodeBase58(const Util::Blob &data);
+std::unique_ptr<Util::Blob> decodeBase58(const std::string &text);
+
+} // namespace Crypto
+
+#endif // CRYPTO_BASE58_H
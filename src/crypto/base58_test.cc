@@ -0,0 +1,114 @@
+#include "gtest/gtest.h"
+#include "crypto/base58.h"
+#include "crypto/random.h"
+#include <string>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::string;
+using std::unique_ptr;
+
+static Blob fromHex(const string &hex)
+{
+  MutableBlob out(hex.size() / 2);
+  for (U64 i = 0; i < out.size(); i++) {
+    out.data()[i] = (Byte)std::stoi(hex.substr(2 * i, 2), nullptr, 16);
+  }
+  return out;
+}
+
+// Digit-at-a-time reference (the textbook algorithm)
+static string reference(const Blob &data)
+{
+  static const char *alphabet = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+  std::vector<U32> digits;
+  U64 zeros = 0;
+  while ((zeros < data.size()) && (data.data()[zeros] == 0)) {
+    zeros++;
+  }
+  for (U64 i = zeros; i < data.size(); i++) {
+    U32 carry = data.data()[i];
+    for (U32 &d : digits) {
+      carry += d * 256;
+      d = carry % 58;
+      carry /= 58;
+    }
+    while (carry != 0) {
+      digits.push_back(carry % 58);
+      carry /= 58;
+    }
+  }
+  string s(zeros, '1');
+  for (U64 i = digits.size(); i-- > 0;) {
+    s += alphabet[digits[i]];
+  }
+  return s;
+}
+
+TEST(Base58Test, Vectors) {
+  // Bitcoin Core's base58_encode_decode.json
+  const char *vectors[][2] = {
+    {"", ""},
+    {"61", "2g"},
+    {"626262", "a3gV"},
+    {"636363", "aPEr"},
+    {"73696d706c792061206c6f6e6720737472696e67", "2cFupjhnEsSn59qHXstmK2ffpLv2"},
+    {"00eb15231dfceb60925886b67d065299925915aeb172c06647", "1NS17iag9jJgTHD1VXjvLCEnZuQ3rJDE9L"},
+    {"516b6fcd0f", "ABnLTmg"},
+    {"bf4f89001e670274dd", "3SEo3LWLoPntC"},
+    {"572e4794", "3EFU7m"},
+    {"ecac89cad93923c02321", "EJDM8drfXA6uyA"},
+    {"10c8511e", "Rt5zm"},
+    {"00000000000000000000", "1111111111"},
+  };
+  for (const auto &v : vectors) {
+    Blob data = fromHex(v[0]);
+    EXPECT_EQ(encodeBase58(data), v[1]);
+    unique_ptr<Blob> back = decodeBase58(v[1]);
+    ASSERT_TRUE(back);
+    EXPECT_EQ(*back, data);
+  }
+}
+
+TEST(Base58Test, RoundTrip) {
+  // Every length past the stack limit, with and without leading zeros
+  unique_ptr<Blob> noise = random(BASE58_STACK_BYTES + 40);
+  for (U64 size = 0; size <= noise->size(); size++) {
+    MutableBlob data(Blob(*noise, size, 0));
+    if ((size % 3) == 0) {
+      for (U64 i = 0; i < std::min<U64>(size, 3); i++) {
+        data.data()[i] = 0;
+      }
+    }
+    string text = encodeBase58(data);
+    ASSERT_EQ(text, reference(data)) << size;
+    EXPECT_LE(text.size(), base58MaxSize(size));
+    unique_ptr<Blob> back = decodeBase58(text);
+    ASSERT_TRUE(back);
+    EXPECT_EQ(*back, Blob(data));
+  }
+}
+
+TEST(Base58Test, Batch) {
+  const U64 itemSize = 32;
+  const U64 count = 100;
+  unique_ptr<Blob> items = random(itemSize * count);
+  std::vector<char> text(count * base58MaxSize(itemSize));
+  std::vector<U64> ends(count);
+  U64 total = encodeBase58(text.data(), ends.data(), items->data(), itemSize, count);
+  EXPECT_EQ(total, ends.back());
+  for (U64 i = 0; i < count; i++) {
+    U64 begin = (i == 0) ? 0 : ends[i - 1];
+    EXPECT_EQ(string(text.data() + begin, ends[i] - begin),
+      encodeBase58(Blob(*items, itemSize, i * itemSize)));
+  }
+}
+
+TEST(Base58Test, Malformed) {
+  for (const char *bad : {"0", "O", "I", "l", "+", "abc/", " 2g", "2g\n"}) {
+    EXPECT_FALSE(decodeBase58(bad)) << bad;
+  }
+  EXPECT_EQ(*decodeBase58("111"), fromHex("000000"));
+}
@@ -0,0 +1,37 @@
+#ifndef CRYPTO_BYTE_ORDER_H
+#define CRYPTO_BYTE_ORDER_H
+
+#include "util/fixed_types.h"
+
+namespace Crypto {
+
+// Big-endian (network order) helpers for the fixed-size header fields used by
+// the message formats in this library.
+
+inline void storeBE32(Byte *dst, U32 val)
+{
+  dst[0] = (Byte)(val >> 24);
+  dst[1] = (Byte)(val >> 16);
+  dst[2] = (Byte)(val >> 8);
+  dst[3] = (Byte)(val);
+}
+
+inline U32 loadBE32(const Byte *src)
+{
+  return ((U32)src[0] << 24) | ((U32)src[1] << 16) | ((U32)src[2] << 8) | (U32)src[3];
+}
+
+inline void storeBE64(Byte *dst, U64 val)
+{
+  storeBE32(dst, (U32)(val >> 32));
+  storeBE32(dst + 4, (U32)val);
+}
+
+inline U64 loadBE64(const Byte *src)
+{
+  return ((U64)loadBE32(src) << 32) | (U64)loadBE32(src + 4);
+}
+
+} // namespace Crypto
+
+#endif // CRYPTO_BYTE_ORDER_H
@@ -0,0 +1,121 @@
+#include "crypto/compression.h"
+#include "crypto/byte_order.h"
+#include "util/make_unique.h"
+#include "cryptopp/zdeflate.h"
+#include "cryptopp/zinflate.h"
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+using Util::make_unique;
+
+// Codec identifiers in the frame header
+static const Byte CODEC_STORED = 0;
+static const Byte CODEC_DEFLATE = 1;
+
+// Favor speed: the goal is to cut AES and I/O bytes, not to maximize ratio
+static const int DEFLATE_LEVEL = 1;
+
+// Deflates 'data' into at most 'capacity' bytes of 'out'. Returns the
+// compressed size, or 0 if the output did not fit.
+static U64 deflate(const Byte *_data, U64 _size, Byte *_out, U64 _capacity)
+{
+  try {
+    CryptoPP::ArraySink *sink = new CryptoPP::ArraySink(_out, _capacity);
+    CryptoPP::Deflator deflator(sink, DEFLATE_LEVEL);
+    deflator.Put(_data, _size);
+    deflator.MessageEnd();
+    U64 total = sink->TotalPutLength();
+    return (total <= _capacity) ? total : 0;
+  }
+  catch (std::exception const &e) {
+    return 0;
+  }
+}
+
+AES_GCM_CompressionStats::AES_GCM_CompressionStats()
+  : messages(0), compressed(0), bytesIn(0), bytesOut(0)
+{
+  // empty
+}
+
+unique_ptr<Blob> Crypto::compress(const Byte *_data, U64 _size, AES_GCM_COMPRESSION _codec,
+  AES_GCM_CompressionStats &_stats)
+{
+  _stats.messages++;
+  _stats.bytesIn += _size;
+
+  // Worth trying only if a sample shrinks by at least 1/8
+  bool attempt = (_codec == AES_GCM_COMPRESSION::DEFLATE) && (_size > COMPRESSION_HEADER_BYTES);
+  if (attempt && (_size > COMPRESSION_SAMPLE_BYTES)) {
+    MutableBlob sample(COMPRESSION_SAMPLE_BYTES);
+    attempt = (deflate(_data, COMPRESSION_SAMPLE_BYTES, sample.data(),
+      COMPRESSION_SAMPLE_BYTES - COMPRESSION_SAMPLE_BYTES / 8) != 0);
+  }
+
+  // Compress directly into the frame, giving up once it stops paying off
+  if (attempt) {
+    U64 budget = _size - _size / 16 - COMPRESSION_HEADER_BYTES;
+    MutableBlob frame(COMPRESSION_HEADER_BYTES + budget);
+    U64 csize = deflate(_data, _size, frame.data() + COMPRESSION_HEADER_BYTES, budget);
+    if (csize != 0) {
+      frame.data()[0] = CODEC_DEFLATE;
+      storeBE64(frame.data() + 1, _size);
+      _stats.compressed++;
+      _stats.bytesOut += COMPRESSION_HEADER_BYTES + csize;
+      return make_unique<Blob>(Blob(frame, COMPRESSION_HEADER_BYTES + csize, 0));
+    }
+  }
+
+  MutableBlob frame(1 + _size);
+  frame.data()[0] = CODEC_STORED;
+  memcpy(frame.data() + 1, _data, _size);
+  _stats.bytesOut += frame.size();
+  return make_unique<Blob>(frame);
+}
+
+MutableBlob Crypto::framedAAD(const Byte *_aad, U64 _size)
+{
+  MutableBlob aad(_size + COMPRESSION_AAD_SUFFIX_BYTES);
+  memcpy(aad.data(), _aad, _size);
+  memcpy(aad.data() + _size, COMPRESSION_AAD_SUFFIX, COMPRESSION_AAD_SUFFIX_BYTES);
+  return aad;
+}
+
+bool Crypto::decompress(const Byte *_frame, U64 _size, Blob &_data, U64 _maxSize)
+{
+  if (_size == 0) {
+    return false;
+  }
+  if (_frame[0] == CODEC_STORED) {
+    MutableBlob data(_size - 1, Blob::ScrubType::ZEROS);
+    memcpy(data.data(), _frame + 1, data.size());
+    _data = data;
+    return true;
+  }
+  if ((_frame[0] != CODEC_DEFLATE) || (_size < COMPRESSION_HEADER_BYTES)) {
+    return false;
+  }
+  U64 osize = loadBE64(_frame + 1);
+  if ((osize > _maxSize) ||
+    (osize / COMPRESSION_MAX_RATIO > _size - COMPRESSION_HEADER_BYTES)) {
+    return false;
+  }
+  try {
+    MutableBlob data(osize, Blob::ScrubType::ZEROS);
+    CryptoPP::ArraySink *sink = new CryptoPP::ArraySink(data.data(), data.size());
+    CryptoPP::Inflator inflator(sink);
+    inflator.Put(_frame + COMPRESSION_HEADER_BYTES, _size - COMPRESSION_HEADER_BYTES);
+    inflator.MessageEnd();
+    if (sink->TotalPutLength() != osize) {
+      return false;
+    }
+    _data = data;
+    return true;
+  }
+  catch (std::exception const &e) {
+    return false;
+  }
+}
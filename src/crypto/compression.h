@@ -0,0 +1,71 @@
+#ifndef CRYPTO_COMPRESSION_H
+#define CRYPTO_COMPRESSION_H
+
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <memory>
+
+namespace Crypto {
+
+// Optional compression applied to the plaintext before encryption. It is off
+// by default because the compressed length can reveal information about the
+// plaintext (e.g. CRIME/BREACH-style attacks when secrets and attacker-chosen
+// data share a message).
+enum class AES_GCM_COMPRESSION
+{
+  NONE, DEFLATE
+};
+
+static const AES_GCM_COMPRESSION AES_GCM_COMPRESSION_DEFAULT = AES_GCM_COMPRESSION::NONE;
+
+// When compression is enabled the encrypted plaintext is framed as
+//
+//   | codec (1) | original size (8, big-endian; only if compressed) | data |
+//
+// Inputs that do not shrink by at least 1/16 are stored uncompressed (codec
+// NONE). Large inputs are probed with a sample first so that incompressible
+// data costs little more than a copy.
+static const U32 COMPRESSION_HEADER_BYTES = 9;
+static const U32 COMPRESSION_SAMPLE_BYTES = 65536;
+
+// Framed messages are authenticated with this suffix after their additional
+// data (it is not sent). A decryptor whose compression setting differs from
+// the encryptor's therefore fails with DEC_ERROR instead of returning a frame
+// as plaintext, or stripping bytes off an unframed message.
+static const U32 COMPRESSION_AAD_SUFFIX_BYTES = 8;
+static const Byte COMPRESSION_AAD_SUFFIX[COMPRESSION_AAD_SUFFIX_BYTES] = {
+  'B', 'A', 'E', 'F', 'R', 'A', 'M', 'E'
+};
+
+// Bounds on the original size a frame may claim, checked before anything is
+// allocated: at most the decryptor's limit (by default
+// COMPRESSION_MAX_BYTES_DEFAULT), and at most DEFLATE's greatest ratio
+// (1032:1) times the compressed size
+static const U64 COMPRESSION_MAX_BYTES_DEFAULT = 1ULL << 30;
+static const U64 COMPRESSION_MAX_RATIO = 1032;
+
+struct AES_GCM_CompressionStats
+{
+  AES_GCM_CompressionStats();
+
+  U64 messages;     // Messages framed
+  U64 compressed;   // Messages stored compressed
+  U64 bytesIn;      // Plaintext bytes
+  U64 bytesOut;     // Framed bytes handed to AES/GCM
+};
+
+// Frames 'size' bytes of 'data', compressing with 'codec' if worthwhile
+std::unique_ptr<Util::Blob> compress(const Byte *data, U64 size, AES_GCM_COMPRESSION codec,
+  AES_GCM_CompressionStats &stats);
+
+// 'size' bytes of additional data followed by COMPRESSION_AAD_SUFFIX
+Util::MutableBlob framedAAD(const Byte *aad, U64 size);
+
+// Recovers the original data from a frame. Returns false if it is malformed
+// or a compressed frame claims more than 'maxSize' bytes.
+bool decompress(const Byte *frame, U64 size, Util::Blob &data,
+  U64 maxSize = COMPRESSION_MAX_BYTES_DEFAULT);
+
+} // namespace Crypto
+
+#endif // CRYPTO_COMPRESSION_H
@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+#include "crypto/compression.h"
+#include "crypto/aes_gcm_pbkd.h"
+#include "crypto/byte_order.h"
+#include "crypto/random.h"
+#include <string>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+
+static Blob repetitive(U64 size)
+{
+  std::string s;
+  while (s.size() < size) {
+    s += "{\"level\":\"info\",\"msg\":\"request served\",\"status\":200}\n";
+  }
+  return Blob(s.substr(0, size));
+}
+
+TEST(CompressionTest, Frames) {
+  AES_GCM_CompressionStats stats;
+
+  // Compressible data shrinks and round-trips
+  Blob text = repetitive(200000);
+  unique_ptr<Blob> frame = compress(text.data(), text.size(), AES_GCM_COMPRESSION::DEFLATE, stats);
+  EXPECT_LT(frame->size(), text.size() / 5);
+  Blob out;
+  EXPECT_TRUE(decompress(frame->data(), frame->size(), out));
+  EXPECT_EQ(out, text);
+
+  // Incompressible data is stored (after a cheap sample probe)
+  unique_ptr<Blob> noise = random(200000);
+  frame = compress(noise->data(), noise->size(), AES_GCM_COMPRESSION::DEFLATE, stats);
+  EXPECT_EQ(frame->size(), noise->size() + 1);
+  EXPECT_TRUE(decompress(frame->data(), frame->size(), out));
+  EXPECT_EQ(out, *noise);
+
+  // Tiny and empty inputs are stored
+  frame = compress(text.data(), 4, AES_GCM_COMPRESSION::DEFLATE, stats);
+  EXPECT_EQ(frame->size(), 5U);
+  frame = compress(text.data(), 0, AES_GCM_COMPRESSION::DEFLATE, stats);
+  EXPECT_TRUE(decompress(frame->data(), frame->size(), out));
+  EXPECT_EQ(out.size(), 0U);
+
+  EXPECT_EQ(stats.messages, 4U);
+  EXPECT_EQ(stats.compressed, 1U);
+  EXPECT_EQ(stats.bytesIn, 400004U);
+
+  // Malformed frames are rejected
+  EXPECT_FALSE(decompress(text.data(), 0, out));
+  MutableBlob bad(Blob("\x01\x00\x00\x00\x00\x00\x00\x00\x10garbage", 16));
+  EXPECT_FALSE(decompress(bad.data(), bad.size(), out));
+  bad.data()[0] = 7;
+  EXPECT_FALSE(decompress(bad.data(), bad.size(), out));
+
+  // Claimed sizes past the limit, or past DEFLATE's ratio, are rejected
+  // before allocating
+  frame = compress(text.data(), text.size(), AES_GCM_COMPRESSION::DEFLATE, stats);
+  EXPECT_FALSE(decompress(frame->data(), frame->size(), out, text.size() - 1));
+  EXPECT_TRUE(decompress(frame->data(), frame->size(), out, text.size()));
+  MutableBlob bomb(*frame);
+  storeBE64(bomb.data() + 1, ~0ULL);
+  EXPECT_FALSE(decompress(bomb.data(), bomb.size(), out, ~0ULL));
+  storeBE64(bomb.data() + 1, (frame->size() - COMPRESSION_HEADER_BYTES + 1) *
+    COMPRESSION_MAX_RATIO);
+  EXPECT_FALSE(decompress(bomb.data(), bomb.size(), out, ~0ULL));
+}
+
+TEST(CompressionTest, Encryption) {
+  AES_GCM_PBKD_Config cfg;
+  cfg.PBKDIters = 1000;
+  cfg.compression = AES_GCM_COMPRESSION::DEFLATE;
+  Blob text = repetitive(100000);
+  Blob pw("password", 8);
+
+  AES_GCM_PBKD_Enc e(cfg);
+  e.passwordIs(pw);
+  e.plaintextIs(text);
+  unique_ptr<AES_GCM_Result> eres = e.ciphertext();
+  EXPECT_EQ(eres->second, AES_GCM_STATUS::VALID);
+  EXPECT_LT(eres->first.size(), text.size() / 5);
+
+  AES_GCM_PBKD_Dec d(cfg);
+  d.passwordIs(pw);
+  d.ciphertextIs(eres->first);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, text);
+
+  // A decryptor set differently fails, whichever way round
+  cfg.compression = AES_GCM_COMPRESSION::NONE;
+  AES_GCM_PBKD_Dec raw(cfg);
+  raw.passwordIs(pw);
+  raw.ciphertextIs(eres->first);
+  EXPECT_EQ(raw.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  AES_GCM_PBKD_Enc plain(cfg);
+  plain.passwordIs(pw);
+  plain.plaintextIs(text);
+  eres = plain.ciphertext();
+  EXPECT_EQ(eres->second, AES_GCM_STATUS::VALID);
+  cfg.compression = AES_GCM_COMPRESSION::DEFLATE;
+  AES_GCM_PBKD_Dec framed(cfg);
+  framed.passwordIs(pw);
+  framed.ciphertextIs(eres->first);
+  EXPECT_EQ(framed.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+  raw.ciphertextIs(eres->first);
+  EXPECT_EQ(raw.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(raw.plaintext().first, text);
+  eres = e.ciphertext();
+
+  // A decryptor's size limit applies to the decompressed plaintext
+  cfg.decompressedMax = text.size() - 1;
+  AES_GCM_PBKD_Dec small(cfg);
+  small.passwordIs(pw);
+  small.ciphertextIs(eres->first);
+  EXPECT_EQ(small.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+}
@@ -0,0 +1,91 @@
+#include "crypto/hkdf_sha256.h"
+#include "util/make_unique.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::unique_ptr;
+using Util::make_unique;
+
+unique_ptr<Blob> Crypto::HKDF_SHA256_Extract(const Blob &_secret, const Blob &_salt)
+{
+  static const Byte zeros[HMAC_SHA256_BYTES] = {0};
+  unique_ptr<HMAC_SHA256> mac = backend().hmacSha256();
+  MutableBlob prk(HMAC_SHA256_BYTES, Blob::ScrubType::ZEROS, Blob::CompareType::CONST);
+  bool keyed = (_salt.size() == 0) ? mac->keyIs(zeros, sizeof(zeros)) :
+    mac->keyIs(_salt.data(), _salt.size());
+  if (!keyed || !mac->update(_secret.data(), _secret.size()) || !mac->digest(prk.data())) {
+    return unique_ptr<Blob>();
+  }
+  return make_unique<Blob>(prk);
+}
+
+unique_ptr<Blob> Crypto::HKDF_SHA256_Expand(U64 _keySize, const Blob &_prk, const Blob &_info)
+{
+  HKDF_SHA256_Expander expander;
+  expander.prkIs(_prk);
+  return expander.subkey(_keySize, _info);
+}
+
+unique_ptr<Blob> Crypto::HKDF_SHA256(U64 _keySize, const Blob &_secret, const Blob &_salt,
+  const Blob &_info)
+{
+  HKDF_SHA256_Expander expander;
+  expander.secretIs(_secret, _salt);
+  return expander.subkey(_keySize, _info);
+}
+
+HKDF_SHA256_Expander::HKDF_SHA256_Expander()
+  : prk_(backend().hmacSha256()), keyed_(false)
+{
+  // empty
+}
+
+void HKDF_SHA256_Expander::secretIs(const Blob &_secret, const Blob &_salt)
+{
+  unique_ptr<Blob> prk = HKDF_SHA256_Extract(_secret, _salt);
+  keyed_ = prk && prk_->keyIs(prk->data(), prk->size());
+}
+
+void HKDF_SHA256_Expander::prkIs(const Blob &_prk)
+{
+  keyed_ = prk_->keyIs(_prk.data(), _prk.size());
+}
+
+bool HKDF_SHA256_Expander::expand(Byte *_key, U64 _keySize, const Byte *_info,
+  U64 _infoSize)
+{
+  if (!keyed_ || (_keySize > HKDF_SHA256_MAX_BYTES)) {
+    return false;
+  }
+
+  // T(i) = HMAC(PRK, T(i - 1) | info | i), written straight to the key
+  // except for a partial last block
+  Byte block[HMAC_SHA256_BYTES];
+  const Byte *previous = nullptr;
+  for (U64 done = 0, i = 1; done < _keySize; done += HMAC_SHA256_BYTES, i++) {
+    Byte counter = (Byte)i;
+    bool whole = (_keySize - done >= HMAC_SHA256_BYTES);
+    Byte *out = (whole) ? _key + done : block;
+    if (((previous != nullptr) && !prk_->update(previous, HMAC_SHA256_BYTES)) ||
+      !prk_->update(_info, _infoSize) || !prk_->update(&counter, 1) || !prk_->digest(out)) {
+      return false;
+    }
+    if (!whole) {
+      memcpy(_key + done, block, _keySize - done);
+    }
+    previous = out;
+  }
+  return true;
+}
+
+unique_ptr<Blob> HKDF_SHA256_Expander::subkey(U64 _keySize, const Blob &_info)
+{
+  MutableBlob key(_keySize, Blob::ScrubType::ZEROS, Blob::CompareType::CONST);
+  if (!expand(key.data(), _keySize, _info.data(), _info.size())) {
+    return unique_ptr<Blob>();
+  }
+  return make_unique<Blob>(key);
+}
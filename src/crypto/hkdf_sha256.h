@@ -0,0 +1,59 @@
+#ifndef CRYPTO_HKDF_SHA256_H
+#define CRYPTO_HKDF_SHA256_H
+
+#include "crypto/backend.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <memory>
+
+namespace Crypto {
+
+// HKDF with HMAC-SHA256 (RFC 5869), for secrets that are already random: a
+// master key, a shared secret, a key read from a KMS. It costs a few hashes,
+// against PBKDF2's deliberate hundreds of thousands, and so does nothing to
+// slow down guessing: passwords still need PBKDF2_SHA256.
+//
+// Extract concentrates the secret into a pseudorandom key (PRK); expand
+// derives any number of independent subkeys from the PRK, one per 'info'
+// (a tenant, a purpose, a key version). Subkeys are at most
+// HKDF_SHA256_MAX_BYTES long.
+static const U64 HKDF_SHA256_MAX_BYTES = 255 * HMAC_SHA256_BYTES;
+
+// PRK = HMAC(salt, secret); an empty salt is HMAC_SHA256_BYTES zeros
+std::unique_ptr<Util::Blob> HKDF_SHA256_Extract(const Util::Blob &secret,
+  const Util::Blob &salt);
+
+// nullptr if keySize is more than HKDF_SHA256_MAX_BYTES
+std::unique_ptr<Util::Blob> HKDF_SHA256_Expand(U64 keySize, const Util::Blob &prk,
+  const Util::Blob &info);
+
+// Extract then expand
+std::unique_ptr<Util::Blob> HKDF_SHA256(U64 keySize, const Util::Blob &secret,
+  const Util::Blob &salt, const Util::Blob &info);
+
+// Extracts once and keeps the PRK's HMAC context, so each subkey costs only
+// its own hashes. Not thread-safe.
+class HKDF_SHA256_Expander
+{
+ public:
+  HKDF_SHA256_Expander();
+  HKDF_SHA256_Expander(const HKDF_SHA256_Expander &) = delete;
+  HKDF_SHA256_Expander &operator=(const HKDF_SHA256_Expander &) = delete;
+  void secretIs(const Util::Blob &secret, const Util::Blob &salt);
+  void prkIs(const Util::Blob &prk);
+
+  // Writes 'keySize' bytes to 'key'. False (writing nothing) if keySize is
+  // more than HKDF_SHA256_MAX_BYTES or there is no secret or PRK yet.
+  bool expand(Byte *key, U64 keySize, const Byte *info, U64 infoSize);
+
+  // nullptr where expand() fails
+  std::unique_ptr<Util::Blob> subkey(U64 keySize, const Util::Blob &info);
+
+ private:
+  std::unique_ptr<HMAC_SHA256> prk_;
+  bool keyed_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_HKDF_SHA256_H
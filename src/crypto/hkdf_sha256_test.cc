@@ -0,0 +1,138 @@
+#include "gtest/gtest.h"
+#include "crypto/hkdf_sha256.h"
+#include "crypto/aes_gcm_pbkd.h"
+#include <cstring>
+#include <string>
+
+using namespace Crypto;
+using Util::Blob;
+using Util::MutableBlob;
+using std::string;
+using std::unique_ptr;
+
+static Blob fromHex(const string &hex)
+{
+  MutableBlob out(hex.size() / 2);
+  for (U64 i = 0; i < out.size(); i++) {
+    out.data()[i] = (Byte)std::stoi(hex.substr(2 * i, 2), nullptr, 16);
+  }
+  return out;
+}
+
+// first, first + 1, ...
+static Blob counting(Byte first, U64 size)
+{
+  MutableBlob out(size);
+  for (U64 i = 0; i < size; i++) {
+    out.data()[i] = (Byte)(first + i);
+  }
+  return out;
+}
+
+static Blob ikm22(string(22, '\x0b').data(), 22);
+
+TEST(HKDF_SHA256_Test, Vectors) {
+  // RFC 5869 appendix A, test cases 1-3
+  struct Vector
+  {
+    Blob secret, salt, info;
+    const char *prk, *okm;
+  };
+  const Vector vectors[] = {
+    {ikm22, counting(0x00, 13), counting(0xf0, 10),
+      "077709362c2e32df0ddc3f0dc47bba6390b6c73bb50f9c3122ec844ad7c2b3e5",
+      "3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf"
+      "34007208d5b887185865"},
+    {counting(0x00, 80), counting(0x60, 80), counting(0xb0, 80),
+      "06a6b88c5853361a06104c9ceb35b45cef760014904671014a193f40c15fc244",
+      "b11e398dc80327a1c8e7f78c596a49344f012eda2d4efad8a050cc4c19afa97c"
+      "59045a99cac7827271cb41c65e590e09da3275600c2f09b8367793a9aca3db71"
+      "cc30c58179ec3e87c14c01d5c1f3434f1d87"},
+    {ikm22, Blob(), Blob(),
+      "19ef24a32c717b167f33a91d6f648bdf96596776afdb6377ac434c1c293ccb04",
+      "8da4e775a563c18f715f802a063c5a31b8a11f5c5ee1879ec3454e5f3c738d2d"
+      "9d201395faa4b61a96c8"},
+  };
+  for (const Vector &v : vectors) {
+    Blob okm = fromHex(v.okm);
+    unique_ptr<Blob> prk = HKDF_SHA256_Extract(v.secret, v.salt);
+    ASSERT_TRUE(prk);
+    EXPECT_EQ(*prk, fromHex(v.prk));
+    unique_ptr<Blob> expanded = HKDF_SHA256_Expand(okm.size(), *prk, v.info);
+    ASSERT_TRUE(expanded);
+    EXPECT_EQ(*expanded, okm);
+    unique_ptr<Blob> key = HKDF_SHA256(okm.size(), v.secret, v.salt, v.info);
+    ASSERT_TRUE(key);
+    EXPECT_EQ(*key, okm);
+  }
+}
+
+TEST(HKDF_SHA256_Test, Expander) {
+  // One extract serves any number of subkeys, each equal to a one-shot HKDF
+  HKDF_SHA256_Expander expander;
+  EXPECT_FALSE(expander.subkey(32, Blob("a", 1)));
+  expander.secretIs(ikm22, counting(0x00, 13));
+  for (U64 size : {1, 16, 31, 32, 33, 64, 100}) {
+    for (const char *info : {"", "tenant-1", "tenant-2"}) {
+      Blob binfo(info, strlen(info));
+      unique_ptr<Blob> subkey = expander.subkey(size, binfo);
+      ASSERT_TRUE(subkey);
+      EXPECT_EQ(*subkey, *HKDF_SHA256(size, ikm22, counting(0x00, 13), binfo));
+    }
+  }
+  EXPECT_NE(*expander.subkey(32, Blob("tenant-1", 8)), *expander.subkey(32, Blob("tenant-2", 8)));
+
+  // Output is limited to 255 blocks
+  EXPECT_TRUE(expander.subkey(HKDF_SHA256_MAX_BYTES, Blob()));
+  EXPECT_FALSE(expander.subkey(HKDF_SHA256_MAX_BYTES + 1, Blob()));
+  EXPECT_FALSE(HKDF_SHA256(HKDF_SHA256_MAX_BYTES + 1, ikm22, Blob(), Blob()));
+}
+
+TEST(HKDF_SHA256_Test, Backends) {
+  // RFC 4231 test case 2, then a key and message longer than a block, on
+  // every backend built in
+  Blob key("Jefe", 4);
+  Blob data("what do ya want for nothing?", 28);
+  Blob mac = fromHex("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+  for (BACKEND type : {BACKEND::CRYPTOPP, BACKEND::OPENSSL}) {
+    if (!backendAvailable(type)) {
+      continue;
+    }
+    unique_ptr<HMAC_SHA256> hmac = backend(type)->hmacSha256();
+    ASSERT_TRUE(hmac->keyIs(key.data(), key.size()));
+    MutableBlob out(HMAC_SHA256_BYTES);
+    for (int i = 0; i < 2; i++) {
+      ASSERT_TRUE(hmac->update(data.data(), 10));
+      ASSERT_TRUE(hmac->update(data.data() + 10, data.size() - 10));
+      ASSERT_TRUE(hmac->digest(out.data()));
+      EXPECT_EQ(Blob(out), mac) << backend(type)->name();
+    }
+  }
+}
+
+TEST(HKDF_SHA256_Test, PBKD) {
+  // The wrappers round-trip with HKDF, and an HKDF key is not a PBKDF2 one
+  AES_GCM_PBKD_Config cfg;
+  cfg.kdf = PBKD_KDF::HKDF;
+  Blob secret = counting(0x40, 32);
+  Blob pt("Plaintext", 9);
+  AES_GCM_PBKD_Enc e(cfg);
+  e.passwordIs(secret);
+  e.plaintextIs(pt);
+  unique_ptr<AES_GCM_Result> eres = e.ciphertext();
+  ASSERT_EQ(eres->second, AES_GCM_STATUS::VALID);
+
+  AES_GCM_PBKD_Dec d(cfg);
+  d.passwordIs(secret);
+  d.ciphertextIs(eres->first);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, pt);
+  EXPECT_EQ(d.keyDerivations(), 1u);
+
+  AES_GCM_PBKD_Config pcfg;
+  pcfg.PBKDIters = 1000;
+  AES_GCM_PBKD_Dec p(pcfg);
+  p.passwordIs(secret);
+  p.ciphertextIs(eres->first);
+  EXPECT_EQ(p.plaintext().second, AES_GCM_STATUS::DEC_ERROR);
+}
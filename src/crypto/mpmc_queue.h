@@ -0,0 +1,109 @@
+#ifndef CRYPTO_MPMC_QUEUE_H
+#define CRYPTO_MPMC_QUEUE_H
+
+#include "util/fixed_types.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace Crypto {
+
+// A bounded lock-free multi-producer/multi-consumer FIFO (Vyukov's array
+// queue). Each cell carries a sequence number telling producers and consumers
+// whose turn it is, so push() and pop() are one CAS on the shared position
+// plus one release store on the cell. Capacity is rounded up to a power of 2.
+template <typename T>
+class MPMCQueue
+{
+ public:
+  explicit MPMCQueue(size_t capacity)
+    : cells_(roundUp(capacity)), mask_(cells_.size() - 1), head_(0), pad_(), tail_(0)
+  {
+    for (size_t i = 0; i < cells_.size(); i++) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MPMCQueue(const MPMCQueue &) = delete;
+  MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+  size_t capacity() const
+  {
+    return cells_.size();
+  }
+
+  // Returns false if the queue is full
+  bool push(T &&value)
+  {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0) {
+        return false;
+      }
+      else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Returns false if the queue is empty
+  bool pop(T &value)
+  {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & mask_];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          value = std::move(cell.value);
+          cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0) {
+        return false;
+      }
+      else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  struct Cell
+  {
+    Cell() noexcept(noexcept(T())) : seq(0), value() {}
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  static size_t roundUp(size_t _n)
+  {
+    size_t n = 2;
+    while (n < _n) {
+      n <<= 1;
+    }
+    return n;
+  }
+
+  std::vector<Cell> cells_;
+  const size_t mask_;
+  std::atomic<size_t> head_;
+  char pad_[64];  // Keep producers and consumers off each other's cache line
+  std::atomic<size_t> tail_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_MPMC_QUEUE_H
@@ -0,0 +1,170 @@
+#include "crypto/pbkdf2_scheduler.h"
+#include <algorithm>
+#include <thread>
+
+using namespace Crypto;
+using Util::Blob;
+using std::unique_ptr;
+typedef std::chrono::steady_clock Clock;
+
+// Weight of the newest sample in the per-iteration cost estimate
+static const double COST_WEIGHT = 0.2;
+
+PBKD_SchedulerConfig::PBKD_SchedulerConfig()
+  : maxRunning(std::max(1U, std::thread::hardware_concurrency() / 2)), maxQueued(64),
+  maxQueuedPerTenant(8)
+{
+  // empty
+}
+
+static PBKD_SchedulerConfig clamped(PBKD_SchedulerConfig _config)
+{
+  _config.maxRunning = std::max(_config.maxRunning, 1U);
+  return _config;
+}
+
+PBKD_Scheduler::PBKD_Scheduler(const PBKD_SchedulerConfig &_config)
+  : cfg_(clamped(_config)), mux_(), queues_(), turns_(), running_(0), queued_(0),
+  queuedIters_(0), nsPerIter_(0.0), rejected_(0)
+{
+  // empty
+}
+
+const PBKD_SchedulerConfig &PBKD_Scheduler::config() const
+{
+  return cfg_;
+}
+
+unique_ptr<Blob> PBKD_Scheduler::derive(PBKD_Tenant _tenant, U64 _keySize,
+  const Blob &_password, const Blob &_salt, U64 _iterations, PBKD_Deadline _deadline,
+  AES_GCM_STATUS &_status)
+{
+  {
+    std::unique_lock<std::mutex> lock(mux_);
+    if (!admit(lock, _tenant, _iterations, _deadline)) {
+      rejected_++;
+      _status = AES_GCM_STATUS::BUSY;
+      return unique_ptr<Blob>();
+    }
+  }
+  Clock::time_point start = Clock::now();
+  unique_ptr<Blob> key;
+  try {
+    key = PBKDF2_SHA256(_keySize, _password, _salt, _iterations);
+  }
+  catch (...) {
+    // Free the slot (without a cost sample) before passing the error on
+    release(0, std::chrono::nanoseconds(0));
+    throw;
+  }
+  release(_iterations, Clock::now() - start);
+  _status = key ? AES_GCM_STATUS::VALID : AES_GCM_STATUS::INVALID_KEY;
+  return key;
+}
+
+U32 PBKD_Scheduler::running() const
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  return running_;
+}
+
+U32 PBKD_Scheduler::queued() const
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  return queued_;
+}
+
+U64 PBKD_Scheduler::rejected() const
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  return rejected_;
+}
+
+bool PBKD_Scheduler::admit(std::unique_lock<std::mutex> &_lock, PBKD_Tenant _tenant,
+  U64 _iterations, PBKD_Deadline _deadline)
+{
+  // Run now only if nobody is waiting, so waiters keep their turn
+  if ((running_ < cfg_.maxRunning) && turns_.empty()) {
+    running_++;
+    return true;
+  }
+  std::map<PBKD_Tenant, std::deque<Waiter *>>::iterator queue = queues_.find(_tenant);
+  size_t mine = (queue == queues_.end()) ? 0 : queue->second.size();
+  if ((queued_ >= cfg_.maxQueued) || (mine >= cfg_.maxQueuedPerTenant)) {
+    return false;
+  }
+
+  // Predicted finish: the queued work spread over the running slots, then
+  // this derivation. Nothing is predicted before the first measurement.
+  if ((_deadline != PBKD_DEADLINE_NONE) && (nsPerIter_ > 0.0)) {
+    double ns = nsPerIter_ * ((double)queuedIters_ / cfg_.maxRunning + (double)_iterations);
+    if (Clock::now() + std::chrono::nanoseconds((S64)ns) > _deadline) {
+      return false;
+    }
+  }
+
+  Waiter waiter;
+  waiter.iterations = _iterations;
+  waiter.admitted = false;
+  queues_[_tenant].push_back(&waiter);
+  if (mine == 0) {
+    turns_.push_back(_tenant);
+  }
+  queued_++;
+  queuedIters_ += _iterations;
+  if (_deadline == PBKD_DEADLINE_NONE) {
+    waiter.ready.wait(_lock, [&]() { return waiter.admitted; });
+  }
+  else if (!waiter.ready.wait_until(_lock, _deadline, [&]() { return waiter.admitted; })) {
+    dequeue(_tenant, &waiter);
+    return false;
+  }
+  return true;
+}
+
+void PBKD_Scheduler::release(U64 _iterations, std::chrono::nanoseconds _elapsed)
+{
+  std::lock_guard<std::mutex> lock(mux_);
+  running_--;
+  if (_iterations != 0) {
+    double sample = (double)_elapsed.count() / (double)_iterations;
+    nsPerIter_ = (nsPerIter_ == 0.0) ? sample :
+      (1.0 - COST_WEIGHT) * nsPerIter_ + COST_WEIGHT * sample;
+  }
+  grant();
+}
+
+void PBKD_Scheduler::dequeue(PBKD_Tenant _tenant, Waiter *_waiter)
+{
+  std::deque<Waiter *> &queue = queues_[_tenant];
+  queue.erase(std::find(queue.begin(), queue.end(), _waiter));
+  queued_--;
+  queuedIters_ -= _waiter->iterations;
+  if (queue.empty()) {
+    queues_.erase(_tenant);
+    turns_.erase(std::find(turns_.begin(), turns_.end(), _tenant));
+  }
+}
+
+void PBKD_Scheduler::grant()
+{
+  // One waiter per tenant per turn
+  while ((running_ < cfg_.maxRunning) && !turns_.empty()) {
+    PBKD_Tenant tenant = turns_.front();
+    turns_.pop_front();
+    std::deque<Waiter *> &queue = queues_[tenant];
+    Waiter *waiter = queue.front();
+    queue.pop_front();
+    if (queue.empty()) {
+      queues_.erase(tenant);
+    }
+    else {
+      turns_.push_back(tenant);
+    }
+    queued_--;
+    queuedIters_ -= waiter->iterations;
+    running_++;
+    waiter->admitted = true;
+    waiter->ready.notify_one();
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef CRYPTO_PBKDF2_SCHEDULER_H
+#define CRYPTO_PBKDF2_SCHEDULER_H
+
+#include "crypto/aes_gcm.h"
+#include "crypto/pbkdf2_sha256.h"
+#include "util/blob.h"
+#include "util/fixed_types.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace Crypto {
+
+// Whoever a derivation is done for (an account, a client, an endpoint)
+typedef U32 PBKD_Tenant;
+
+typedef std::chrono::steady_clock::time_point PBKD_Deadline;
+static const PBKD_Deadline PBKD_DEADLINE_NONE = PBKD_Deadline::max();
+
+struct PBKD_SchedulerConfig
+{
+  PBKD_SchedulerConfig();
+
+  U32 maxRunning;          // Derivations at once (default: half the cores)
+  U32 maxQueued;           // Derivations waiting, over all tenants
+  U32 maxQueuedPerTenant;  // Derivations waiting for one tenant
+};
+
+// Admission control for PBKDF2, which is deliberately expensive. At most
+// maxRunning derivations run at once, each on its caller's thread, so the
+// rest of the machine keeps its cores. Callers beyond that wait in per-tenant
+// queues served round-robin: one tenant's burst only delays that tenant.
+//
+// derive() fails fast with BUSY, without deriving anything, when the queue
+// or the tenant's share of it is full, when the measured cost of the work
+// already admitted means the deadline cannot be met, or when the deadline
+// passes while waiting. A rejection costs a lock and a few comparisons.
+// Thread-safe.
+class PBKD_Scheduler
+{
+ public:
+  PBKD_Scheduler(const PBKD_SchedulerConfig &config = PBKD_SchedulerConfig());
+  PBKD_Scheduler(const PBKD_Scheduler &) = delete;
+  PBKD_Scheduler &operator=(const PBKD_Scheduler &) = delete;
+  const PBKD_SchedulerConfig &config() const;
+
+  // PBKDF2_SHA256() once admitted; nullptr unless 'status' is VALID. If the
+  // derivation throws, its slot is released and the exception propagates.
+  std::unique_ptr<Util::Blob> derive(PBKD_Tenant tenant, U64 keySize,
+    const Util::Blob &password, const Util::Blob &salt, U64 iterations,
+    PBKD_Deadline deadline, AES_GCM_STATUS &status);
+
+  U32 running() const;
+  U32 queued() const;
+  U64 rejected() const;
+
+ private:
+  struct Waiter
+  {
+    std::condition_variable ready;
+    U64                     iterations;
+    bool                    admitted;
+  };
+  bool admit(std::unique_lock<std::mutex> &lock, PBKD_Tenant tenant, U64 iterations,
+    PBKD_Deadline deadline);
+  void release(U64 iterations, std::chrono::nanoseconds elapsed);
+  void dequeue(PBKD_Tenant tenant, Waiter *waiter);
+  void grant();
+  const PBKD_SchedulerConfig cfg_;
+  mutable std::mutex mux_;
+  std::map<PBKD_Tenant, std::deque<Waiter *>> queues_;
+  std::deque<PBKD_Tenant> turns_;
+  U32 running_;
+  U32 queued_;
+  U64 queuedIters_;
+  double nsPerIter_;
+  U64 rejected_;
+};
+
+} // namespace Crypto
+
+#endif // CRYPTO_PBKDF2_SCHEDULER_H
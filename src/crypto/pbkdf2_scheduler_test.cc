@@ -0,0 +1,189 @@
+#include "gtest/gtest.h"
+#include "crypto/aes_gcm_pbkd.h"
+#include "crypto/pbkdf2_scheduler.h"
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace Crypto;
+using Util::Blob;
+using std::unique_ptr;
+
+static const U64 SLOW_ITERS = 300000;
+
+static void waitForQueued(const PBKD_Scheduler &_s, U32 _queued)
+{
+  while (_s.queued() != _queued) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+static void waitForRunning(const PBKD_Scheduler &_s, U32 _running)
+{
+  while (_s.running() != _running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// Occupies the scheduler's only slot on another thread
+static std::future<AES_GCM_STATUS> occupy(PBKD_Scheduler &_s, PBKD_Tenant _tenant)
+{
+  std::future<AES_GCM_STATUS> f = std::async(std::launch::async, [&_s, _tenant]() {
+    AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+    _s.derive(_tenant, 32, Blob("pw"), Blob("salt"), SLOW_ITERS, PBKD_DEADLINE_NONE, status);
+    return status;
+  });
+  waitForRunning(_s, 1);
+  return f;
+}
+
+TEST(PBKD_SchedulerTest, Sanity) {
+  PBKD_Scheduler s;
+  EXPECT_GE(s.config().maxRunning, 1U);
+  AES_GCM_STATUS status = AES_GCM_STATUS::BUSY;
+  unique_ptr<Blob> key = s.derive(1, 32, Blob("password"), Blob("salt"), 1000,
+    PBKD_DEADLINE_NONE, status);
+  EXPECT_EQ(status, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(*key, *PBKDF2_SHA256(32, Blob("password"), Blob("salt"), 1000));
+  EXPECT_EQ(s.running(), 0U);
+
+  // A derivation that throws (here, failing to allocate the key) still frees
+  // its slot
+  EXPECT_ANY_THROW(s.derive(1, ~0ULL, Blob("password"), Blob("salt"), 1000,
+    PBKD_DEADLINE_NONE, status));
+  EXPECT_EQ(s.running(), 0U);
+}
+
+TEST(PBKD_SchedulerTest, Admission) {
+  PBKD_SchedulerConfig cfg;
+  cfg.maxRunning = 1;
+  cfg.maxQueued = 2;
+  cfg.maxQueuedPerTenant = 1;
+  PBKD_Scheduler s(cfg);
+  std::future<AES_GCM_STATUS> running = occupy(s, 0);
+
+  auto queue = [&s](PBKD_Tenant _tenant) {
+    return std::async(std::launch::async, [&s, _tenant]() {
+      AES_GCM_STATUS status = AES_GCM_STATUS::BUSY;
+      s.derive(_tenant, 32, Blob("pw"), Blob("salt"), 1, PBKD_DEADLINE_NONE, status);
+      return status;
+    });
+  };
+  std::future<AES_GCM_STATUS> first = queue(1);
+  waitForQueued(s, 1);
+
+  // Tenant 1 has used its share; tenant 2 may still queue, then the queue is full
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  EXPECT_FALSE(s.derive(1, 32, Blob("pw"), Blob("salt"), 1, PBKD_DEADLINE_NONE, status));
+  EXPECT_EQ(status, AES_GCM_STATUS::BUSY);
+  std::future<AES_GCM_STATUS> second = queue(2);
+  waitForQueued(s, 2);
+  EXPECT_FALSE(s.derive(3, 32, Blob("pw"), Blob("salt"), 1, PBKD_DEADLINE_NONE, status));
+  EXPECT_EQ(status, AES_GCM_STATUS::BUSY);
+  EXPECT_EQ(s.rejected(), 2U);
+
+  EXPECT_EQ(running.get(), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(first.get(), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(second.get(), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(s.queued(), 0U);
+}
+
+TEST(PBKD_SchedulerTest, Fairness) {
+  // Tenant 1 queues three derivations before tenant 2 queues one; tenant 2
+  // is served second, not last. Each runs long enough for its completion to
+  // be recorded before the next one finishes.
+  PBKD_SchedulerConfig cfg;
+  cfg.maxRunning = 1;
+  PBKD_Scheduler s(cfg);
+  std::future<AES_GCM_STATUS> running = occupy(s, 0);
+
+  std::mutex mux;
+  std::vector<PBKD_Tenant> order;
+  std::vector<std::future<void>> waiters;
+  PBKD_Tenant tenants[] = {1, 1, 1, 2};
+  for (U32 i = 0; i < 4; i++) {
+    PBKD_Tenant tenant = tenants[i];
+    waiters.push_back(std::async(std::launch::async, [&, tenant]() {
+      AES_GCM_STATUS status = AES_GCM_STATUS::BUSY;
+      s.derive(tenant, 32, Blob("pw"), Blob("salt"), SLOW_ITERS / 4, PBKD_DEADLINE_NONE,
+        status);
+      std::lock_guard<std::mutex> lock(mux);
+      order.push_back(tenant);
+    }));
+    waitForQueued(s, i + 1);
+  }
+  running.get();
+  for (std::future<void> &w : waiters) {
+    w.get();
+  }
+  ASSERT_EQ(order.size(), 4U);
+  EXPECT_EQ(order[0], 1U);
+  EXPECT_EQ(order[1], 2U);
+}
+
+TEST(PBKD_SchedulerTest, Deadline) {
+  PBKD_SchedulerConfig cfg;
+  cfg.maxRunning = 1;
+  PBKD_Scheduler s(cfg);
+
+  // Nothing measured yet: waits, then gives up at the deadline
+  std::future<AES_GCM_STATUS> running = occupy(s, 0);
+  AES_GCM_STATUS status = AES_GCM_STATUS::VALID;
+  PBKD_Deadline deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(5);
+  EXPECT_FALSE(s.derive(1, 32, Blob("pw"), Blob("salt"), 1, deadline, status));
+  EXPECT_EQ(status, AES_GCM_STATUS::BUSY);
+  EXPECT_GE(std::chrono::steady_clock::now(), deadline);
+  EXPECT_EQ(s.queued(), 0U);
+  running.get();
+
+  // Once the cost is known, a derivation that cannot finish in time is
+  // turned away without waiting
+  running = occupy(s, 0);
+  std::future<AES_GCM_STATUS> queued = std::async(std::launch::async, [&s]() {
+    AES_GCM_STATUS st = AES_GCM_STATUS::BUSY;
+    s.derive(2, 32, Blob("pw"), Blob("salt"), SLOW_ITERS, PBKD_DEADLINE_NONE, st);
+    return st;
+  });
+  waitForQueued(s, 1);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  deadline = start + std::chrono::seconds(60);
+  EXPECT_FALSE(s.derive(1, 32, Blob("pw"), Blob("salt"), SLOW_ITERS * 10000, deadline,
+    status));
+  EXPECT_EQ(status, AES_GCM_STATUS::BUSY);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+  EXPECT_EQ(running.get(), AES_GCM_STATUS::VALID);
+  EXPECT_EQ(queued.get(), AES_GCM_STATUS::VALID);
+}
+
+TEST(PBKD_SchedulerTest, PBKD_Dec) {
+  AES_GCM_PBKD_Config cfg;
+  cfg.PBKDIters = 1000;
+  AES_GCM_PBKD_Enc e(cfg);
+  e.passwordIs(Blob("password"));
+  e.plaintextIs(Blob("message"));
+  unique_ptr<AES_GCM_Result> ct = e.ciphertext();
+  EXPECT_EQ(ct->second, AES_GCM_STATUS::VALID);
+
+  PBKD_SchedulerConfig scfg;
+  scfg.maxRunning = 1;
+  std::shared_ptr<PBKD_Scheduler> s = std::make_shared<PBKD_Scheduler>(scfg);
+  AES_GCM_PBKD_Dec d(cfg);
+  d.schedulerIs(s, 7, std::chrono::milliseconds(5));
+  d.passwordIs(Blob("password"));
+
+  // Garbage is rejected before any derivation
+  d.ciphertextIs(Blob("short"));
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::INVALID_SIZE);
+  EXPECT_EQ(d.keyDerivations(), 0U);
+
+  // Out of capacity, then retried once the slot is free
+  d.ciphertextIs(ct->first);
+  std::future<AES_GCM_STATUS> running = occupy(*s, 0);
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::BUSY);
+  EXPECT_EQ(d.keyDerivations(), 0U);
+  running.get();
+  EXPECT_EQ(d.plaintext().second, AES_GCM_STATUS::VALID);
+  EXPECT_EQ(d.plaintext().first, Blob("message"));
+  EXPECT_EQ(d.keyDerivations(), 1U);
+}
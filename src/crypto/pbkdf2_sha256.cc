@@ -1,7 +1,8 @@
 #include "crypto/pbkdf2_sha256.h"
+#include "crypto/backend.h"
 #include "util/make_unique.h"
-#include "cryptopp/sha.h"
-#include "cryptopp/pwdbased.h"
+#include <algorithm>
+#include <mutex>
 
 using namespace Crypto;
 using Util::Blob;
@@ -13,9 +14,89 @@ unique_ptr<Blob> Crypto::PBKDF2_SHA256(U64 _keySize, const Blob &_password,
   const Blob &_salt, U64 _iterations)
 {
   MutableBlob mkey(_keySize, Blob::ScrubType::ZEROS, Blob::CompareType::CONST);
-  CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> pbkdf;
-  pbkdf.DeriveKey(mkey.data(), mkey.size(), 0, _password.data(), _password.size(),
-    _salt.data(), _salt.size(), _iterations);
+  if (!backend().pbkdf2Sha256(mkey.data(), mkey.size(), _password.data(), _password.size(),
+    _salt.data(), _salt.size(), _iterations)) {
+    return unique_ptr<Blob>();
+  }
   return make_unique<Blob>(mkey); // XXX make sure size is not zero
 }
 
+
+// Measurement: derivations of growing size until one takes long enough to
+// time reliably, best of a few. A backend that fails, or that is still too
+// fast to time at PROBE_ITERS_MAX, has no rate.
+static const U64 PROBE_ITERS = 1000;
+static const U64 PROBE_ITERS_MAX = 1ULL << 30;
+static const double PROBE_SECONDS = 0.02;
+static const U32 PROBE_RUNS = 3;
+static const U32 BACKEND_COUNT = 2;
+
+static std::mutex rateMux;
+static double rates[BACKEND_COUNT] = {0.0, 0.0};
+
+static double measureRate(const Backend &_backend)
+{
+  typedef std::chrono::steady_clock Clock;
+  static const Byte password[] = "calibration";
+  Byte salt[16] = {0};
+  Byte key[32];
+  double best = 0.0;
+  U64 iters = PROBE_ITERS;
+  for (U32 run = 0; run < PROBE_RUNS;) {
+    Clock::time_point start = Clock::now();
+    if (!_backend.pbkdf2Sha256(key, sizeof(key), password, sizeof(password) - 1, salt,
+      sizeof(salt), iters)) {
+      return 0.0;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (seconds < PROBE_SECONDS) {
+      if (iters >= PROBE_ITERS_MAX) {
+        return 0.0;
+      }
+      iters *= 2;
+      continue;
+    }
+    best = std::max(best, (double)iters / seconds);
+    run++;
+  }
+  return best;
+}
+
+double Crypto::PBKDF2_SHA256_Rate(BACKEND _type)
+{
+  const Backend *b = backend(_type);
+  if (b == nullptr) {
+    return 0.0;
+  }
+  std::lock_guard<std::mutex> lock(rateMux);
+  double &rate = rates[(U32)_type];
+  if (rate <= 0.0) {
+    rate = measureRate(*b);
+  }
+  return rate;
+}
+
+void Crypto::PBKDF2_SHA256_RateIs(BACKEND _type, double _rate)
+{
+  if ((_rate > 0.0) && backendAvailable(_type)) {
+    std::lock_guard<std::mutex> lock(rateMux);
+    rates[(U32)_type] = _rate;
+  }
+}
+
+BACKEND Crypto::PBKDF2_SHA256_Fastest()
+{
+  return (PBKDF2_SHA256_Rate(BACKEND::OPENSSL) > PBKDF2_SHA256_Rate(BACKEND::CRYPTOPP)) ?
+    BACKEND::OPENSSL : BACKEND::CRYPTOPP;
+}
+
+PBKD_Iters Crypto::PBKDF2_SHA256_Calibrate(std::chrono::milliseconds _target)
+{
+  double rate = PBKDF2_SHA256_Rate(PBKDF2_SHA256_Fastest());
+  if (rate <= 0.0) {
+    return PBKD_ITERS_DEFAULT;
+  }
+  double iters = rate * (double)_target.count() / 1e3;
+  iters = std::min(std::max(iters, (double)PBKD_ITERS_MIN), (double)PBKD_ITERS_MAX);
+  return (PBKD_Iters)(iters / 1000) * 1000;
+}
@@ -1,7 +1,9 @@
 #ifndef CRYPTO_PBKDF2_SHA256_H
 #define CRYPTO_PBKDF2_SHA256_H
 
+#include "crypto/backend.h"
 #include "util/blob.h"
+#include <chrono>
 #include <string>
 #include <memory>
 
@@ -10,9 +12,38 @@ namespace Crypto {
 typedef U32 PBKD_Iters;
 static const PBKD_Iters PBKD_ITERS_DEFAULT = 100000;
 
+// Bounds of calibrated iteration counts, and the most a decryptor accepts
+// from a message header by default
+static const PBKD_Iters PBKD_ITERS_MIN = 10000;
+static const PBKD_Iters PBKD_ITERS_MAX = 10000000;
+
+// A key of 'keySize' bytes, or nullptr if the backend cannot derive it (e.g.
+// a count or size beyond what its library accepts)
 std::unique_ptr<Util::Blob> PBKDF2_SHA256(U64 keySize, const Util::Blob &password,
   const Util::Blob &salt, U64 iterations);
 
+// PBKDF2-SHA256 iterations per second of the given backend on this host,
+// for 32-byte keys. Measured (in about 100 ms) on the first call for each
+// backend and cached for the life of the process; 0 if the backend was not
+// built in or could not be measured (its derivations failed, or finished too
+// fast to time).
+double PBKDF2_SHA256_Rate(BACKEND type);
+
+// Seeds the cache with a rate kept from an earlier run (see
+// PBKDF2_SHA256_Rate()), so that this process does not measure again.
+// Ignored unless 'rate' is positive.
+void PBKDF2_SHA256_RateIs(BACKEND type, double rate);
+
+// The iteration count that takes about 'target' on the fastest backend built
+// in, rounded down to a thousand and clamped to [PBKD_ITERS_MIN,
+// PBKD_ITERS_MAX]. Derivations run on backend(), so select that backend
+// (backendIs()) for the count to meet the target. PBKD_ITERS_DEFAULT if no
+// backend could be measured.
+PBKD_Iters PBKDF2_SHA256_Calibrate(std::chrono::milliseconds target);
+
+// The backend PBKDF2_SHA256_Calibrate() measures as fastest
+BACKEND PBKDF2_SHA256_Fastest();
+
 // TODO: Futures
 
 } // namespace Crypto
@@ -97,3 +97,34 @@ TEST(Pbkdf2Sha256Test, TestVectors) {
   EXPECT_EQ(*(f18.get()), k_s2_p3_100k);
 }
 
+TEST(Pbkdf2Sha256Test, Calibrate) {
+  // Measured rates are cached; seeded rates replace them
+  double rate = PBKDF2_SHA256_Rate(BACKEND::CRYPTOPP);
+  EXPECT_GT(rate, 0.0);
+  EXPECT_EQ(PBKDF2_SHA256_Rate(BACKEND::CRYPTOPP), rate);
+  PBKD_Iters iters = PBKDF2_SHA256_Calibrate(std::chrono::milliseconds(50));
+  EXPECT_GE(iters, PBKD_ITERS_MIN);
+  EXPECT_LE(iters, PBKD_ITERS_MAX);
+  EXPECT_EQ(iters % 1000, 0U);
+
+  for (BACKEND type : {BACKEND::CRYPTOPP, BACKEND::OPENSSL}) {
+    PBKDF2_SHA256_RateIs(type, 1e6);
+  }
+  PBKDF2_SHA256_RateIs(BACKEND::CRYPTOPP, 2e6);
+  PBKDF2_SHA256_RateIs(BACKEND::CRYPTOPP, -1.0);
+  EXPECT_EQ(PBKDF2_SHA256_Fastest(), BACKEND::CRYPTOPP);
+  EXPECT_EQ(PBKDF2_SHA256_Calibrate(std::chrono::milliseconds(50)), 100000U);
+  EXPECT_EQ(PBKDF2_SHA256_Calibrate(std::chrono::milliseconds(1)), PBKD_ITERS_MIN);
+  EXPECT_EQ(PBKDF2_SHA256_Calibrate(std::chrono::milliseconds(60000)), PBKD_ITERS_MAX);
+}
+
+TEST(Pbkdf2Sha256Test, Unsupported) {
+  // Counts a backend cannot take yield no key rather than a truncated count
+  BACKEND initial = backend().type();
+  if (backendIs(BACKEND::OPENSSL)) {
+    EXPECT_FALSE(PBKDF2_SHA256(32, p1, s1, 1ULL << 31));
+  }
+  ASSERT_TRUE(backendIs(BACKEND::CRYPTOPP));
+  EXPECT_FALSE(PBKDF2_SHA256(32, p1, s1, 1ULL << 32));
+  backendIs(initial);
+}
@@ -13,6 +13,9 @@ std::unique_ptr<Util::Blob> random(U64 size);
 // Fill an existing MutableBlob with crypto-strenght random data
 void randomize(Util::MutableBlob &blob);
 
+// Fill 'size' bytes at 'data' with crypto-strength random data
+void randomize(Byte *data, U64 size);
+
 } // namespace Crypto
 
 #endif // CRYPTO_RANDOM_H
@@ -1,3 +1,4 @@
+#include "bench/bench.h"
 #include "crypto/aes_gcm_pbkd.h"
 #include "crypto/random.h"
 #include "util/byte_encoders.h"
@@ -12,7 +13,6 @@ using std::unique_ptr;
 using Util::Blob;
 using Util::MutableBlob;
 using Util::encode_hex;
-using Util::encode_base58;
 using Util::encode_base64;
 using Util::encode_string;
 
@@ -21,6 +21,7 @@ static void usage()
   const char *msg =
     "\nUsage: <program> [options]\n"
     "    -d <demo>  Choose demo 1 (default) or 2\n"
+    "    -b <name>  Run benchmarks whose name contains <name> ('all' for all)\n"
     "    -h         Print this help message\n"
     "\n";
     cerr << msg;
@@ -114,6 +115,10 @@ static Blob ex2_encrypt(const string &_msg, const string &_pw)
   cout << "Password:\n    " << _pw << endl;
   unique_ptr<Blob> key = Crypto::PBKDF2_SHA256(Crypto::AES_GCM_KEYSIZE_256,
     _pw, ivc, 100000);
+  if (!key) {
+    cout << "Error deriving key" << endl;
+    exit(1);
+  }
   cout << "Key:" << endl;
   blockPrint(*(key->data(encode_hex)), 4, 80);
 
@@ -161,6 +166,10 @@ static void ex2_decrypt(const Blob &_ctxt, const string &_pw)
   // Recover the key
   unique_ptr<Blob> key = Crypto::PBKDF2_SHA256(Crypto::AES_GCM_KEYSIZE_256,
     _pw, ivc, 100000);
+  if (!key) {
+    cout << "Error deriving key" << endl;
+    exit(1);
+  }
 
   // Decrypt
   Crypto::AES_GCM_Dec dec;
@@ -184,14 +193,18 @@ static void ex2_decrypt(const Blob &_ctxt, const string &_pw)
 int main(int argc, char *argv[])
 {
   int demo = 1;
+  string bench;
 
   // Parse command line options
   int ch;
-  while ((ch = getopt(argc, argv, "d:h")) != -1) {
+  while ((ch = getopt(argc, argv, "d:b:h")) != -1) {
     switch (ch) {
       case 'd':
         demo = std::stoi(optarg);
         break;
+      case 'b':
+        bench = optarg;
+        break;
       case 'h':
       default:
         usage();
@@ -201,6 +214,11 @@ int main(int argc, char *argv[])
   argc -= optind;
   argv += optind;
 
+  if (!bench.empty()) {
+    Bench::run(cout, bench);
+    return 0;
+  }
+
   string msg = "This is a plaintext message";
   string pw = "7j(xf";
 